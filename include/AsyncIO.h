@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @file AsyncIO.h
+ *
+ * Asynchronous positional file writer used by the chunked exporters
+ * (raster tiles, glTF buffer views, shards).  Writes are copied into a
+ * fixed pool of page-aligned buffers and handed to the kernel without
+ * blocking the caller.  On Linux the buffers are registered with an
+ * io_uring instance and submitted as fixed-buffer writes; when io_uring is
+ * unavailable (old kernel, seccomp, RLIMIT_MEMLOCK) a small thread pool
+ * issuing pwrite(2) takes its place behind the same interface.  Setting
+ * CITYGEN_NO_IO_URING=1 in the environment forces the fallback.
+ */
+
+class AsyncFileWriter {
+public:
+    /// A registered buffer on loan from the writer's pool.
+    struct Buffer {
+        std::uint8_t *data = nullptr;
+        std::size_t capacity = 0;
+        int index = -1;
+    };
+
+    /**
+     * @brief Create/truncate the file at path and set up the buffer pool.
+     *
+     * @param bufferSize Size of each pooled buffer in bytes.
+     * @param bufferCount Number of pooled buffers, i.e. the maximum number
+     *        of writes in flight.
+     */
+    explicit AsyncFileWriter(const std::string &path,
+                             std::size_t bufferSize = std::size_t(1) << 20,
+                             unsigned bufferCount = 8);
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter &) = delete;
+    AsyncFileWriter &operator=(const AsyncFileWriter &) = delete;
+
+    /// True if the file was opened successfully.
+    bool isOpen() const;
+
+    /// True if writes go through io_uring rather than the pwrite pool.
+    bool usingIoUring() const;
+
+    /// Borrow a free buffer, blocking while all buffers are in flight.
+    Buffer acquire();
+
+    /**
+     * @brief Queue the first len bytes of buf for writing at offset.
+     *
+     * Ownership of the buffer returns to the pool once the write has
+     * completed; the caller must not touch it afterwards.
+     */
+    void submit(const Buffer &buf, std::size_t len, std::uint64_t offset);
+
+    /// Copy data through pooled buffers and queue it at offset.  Safe to
+    /// call from several threads at once.
+    void write(const void *data, std::size_t len, std::uint64_t offset);
+
+    /// Wait for every queued write; returns false if any write failed.
+    bool finish();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "City.h"
+#include "Config.h"
+
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+/**
+ * @file Checkpoint.h
+ *
+ * Stage checkpoints for long generations.  After each major stage of
+ * CityGenerator::generate the city (zones, buildings, facilities, roads,
+ * blocks) and the RNG state are serialised into a binary snapshot, which
+ * a background thread writes to `<file>.tmp` and renames over the
+ * checkpoint file, so generation continues while the snapshot is on its
+ * way to disk and a crash never leaves a torn checkpoint.  The exporters
+ * then record each finished output in the checkpoint header.  A resumed
+ * run restores the last snapshot, skips the stages and outputs already
+ * completed and produces the same files as an uninterrupted run.
+ *
+ * File layout (native byte order):
+ *
+ *     "CGCK" u32 version, u64 optionsHash, u32 stage, u32 exported,
+ *     u32 sizeof(Building), i32 gridSize, u64 payloadBytes, 24 reserved bytes
+ *     u32 rngLength, RNG state text
+ *     city payload (see CityFile.h)
+ */
+
+/// Generation stages after which a checkpoint is taken, in order.
+enum class CheckpointStage : std::uint32_t {
+    None = 0,
+    Zoning = 1,
+    GreenSpace = 2,
+    Parcels = 3,   ///< Includes the street layout (roads and blocks)
+    Facilities = 4 ///< Generation complete
+};
+
+/// Human-readable stage name for log messages.
+const char *checkpointStageName(CheckpointStage stage);
+
+/// Outputs recorded by Checkpointer::markExported().
+enum ExportStep : std::uint32_t {
+    ExportModel = 1,   ///< Model file or shard set
+    ExportSummary = 2,
+    ExportTiles = 4,
+    ExportRaster = 8
+};
+
+/// Thrown by restore() when the checkpoint is unreadable or was written
+/// for different options.
+class CheckpointMismatch : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class Checkpointer {
+public:
+    /**
+     * @param path Checkpoint file.
+     * @param cfg Options the checkpoint is tied to: every generation
+     *        option plus the output format and extra outputs.
+     * @param resume Whether restore() picks up an existing checkpoint;
+     *        otherwise the run starts fresh and overwrites it.
+     */
+    Checkpointer(std::string path, const Config &cfg, bool resume);
+    /// Waits for a pending snapshot write.
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer &) = delete;
+    Checkpointer &operator=(const Checkpointer &) = delete;
+
+    /**
+     * @brief Load the last snapshot into city and rng.
+     * @return The restored stage, or None when not resuming or no
+     *         checkpoint exists.
+     */
+    CheckpointStage restore(City &city, std::mt19937 &rng);
+
+    /// Snapshot the state after stage; the file is written asynchronously
+    /// (a snapshot still in flight is waited for first).
+    void save(CheckpointStage stage, const City &city, const std::mt19937 &rng);
+
+    /// Stage restored by restore() (None for a fresh run).
+    CheckpointStage resumedStage() const { return resumed_; }
+
+    /// True if the restored checkpoint records the output as written.
+    bool exported(ExportStep step) const { return (exported_ & step) != 0; }
+
+    /// Record a finished output (synchronously, in the file header).
+    void markExported(ExportStep step);
+
+    /// Wait for the pending snapshot; false if any snapshot write failed.
+    bool wait();
+
+    /// Remove the checkpoint once the run has completed.
+    void discard();
+
+private:
+    std::string path_;
+    std::uint64_t optionsHash_;
+    bool resume_;
+    CheckpointStage resumed_ = CheckpointStage::None;
+    CheckpointStage saved_ = CheckpointStage::None;
+    std::uint32_t exported_ = 0;
+    std::thread writer_;
+    std::atomic<bool> failed_{false};
+};
@@ -3,6 +3,13 @@
 #include <vector>
 #include <string>
 #include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "Memory.h"
+#include "TiledGrid.h"
+
+class ExecutionContext;
 
 /**
  * @file City.h
@@ -24,6 +31,20 @@ enum class ZoneType {
     Green        ///< Parks, green spaces
 };
 
+/// Lower-case zone name used in tiles and diffs.
+inline const char *zoneName(ZoneType z) {
+    switch (z) {
+        case ZoneType::Residential: return "residential";
+        case ZoneType::Commercial: return "commercial";
+        case ZoneType::Industrial: return "industrial";
+        case ZoneType::Green: return "green";
+        default: return "none";
+    }
+}
+
+/// Zoning grid: row-major or tiled storage (see TiledGrid.h).
+using ZoneGrid = TiledGrid<ZoneType>;
+
 /// Simple 2D point convenience type.
 struct Vec2 {
     double x = 0.0;
@@ -94,6 +115,15 @@ inline double roadWidth(RoadType type) {
     }
 }
 
+/// Lower-case road class name used in tiles and diffs.
+inline const char *roadClassName(RoadType t) {
+    switch (t) {
+        case RoadType::Arterial: return "arterial";
+        case RoadType::Secondary: return "secondary";
+        default: return "local";
+    }
+}
+
 /**
  * @brief Representation of an entire city.
  *
@@ -107,18 +137,22 @@ inline double roadWidth(RoadType type) {
 class City {
 public:
     /// Construct an empty city of the given grid size.  Zoning is
-    /// initialised to undeveloped cells.
-    explicit City(int size = 0);
+    /// initialised to undeveloped cells, stored in zoneLayout order.
+    explicit City(int size = 0, GridLayout zoneLayout = GridLayout::Rows);
 
     /// Grid dimension (city is size × size cells).
     int size = 0;
 
     /// Zoning grid expressed per underlying cell.  This is retained for
-    /// statistics and to compute parcel zoning.
-    std::vector<ZoneType> zones;
+    /// statistics and to compute parcel zoning.  Reach cells through
+    /// zoneAt() or zones.forEachRowSpan(); the storage order depends on
+    /// the layout.
+    /// Spills to a scratch file under a memory limit (see Memory.h).
+    ZoneGrid zones;
 
     /// Collection of parcel-based buildings (one per parcel).
-    std::vector<Building> buildings;
+    /// Spills to a scratch file under a memory limit (see Memory.h).
+    SpillVector<Building> buildings;
 
     /// List of facilities (hospitals, schools) placed within the city.
     std::vector<Facility> facilities;
@@ -129,15 +163,25 @@ public:
     /// Blocks carved out by the road network.
     std::vector<Block> blocks;
 
+    /// Generation-order index of each building once the buildings have
+    /// been reordered (SpatialOrder.h); empty while they are in generation
+    /// order.
+    std::vector<std::uint32_t> buildingIds;
+
+    /// Stable ID of building i: its index in generation order.
+    std::uint32_t buildingId(std::size_t i) const {
+        return buildingIds.empty() ? static_cast<std::uint32_t>(i) : buildingIds[i];
+    }
+
     /// Access zoning at coordinates (x, y).  No bounds checking is
     /// performed; callers should ensure indices are valid (0 ≤ x,y < size).
     ZoneType &zoneAt(int x, int y) {
-        return zones[y * size + x];
+        return zones.at(x, y);
     }
 
     /// Const overload of zoneAt().
     const ZoneType &zoneAt(int x, int y) const {
-        return zones[y * size + x];
+        return zones.at(x, y);
     }
 
     /**
@@ -151,9 +195,15 @@ public:
      * ignored.  Note that building height is scaled by 1.0 unit per floor,
      * but this can be adjusted by postprocessing.
      *
-     * @param filename Path to the OBJ file to create.
+     * @param filename Path to the OBJ file to create, or an output target
+     *        (`-` for stdout, `fd:N` for an inherited descriptor; see
+     *        Output.h).  Streamed OBJ output omits the MTL companion.
+     * @param ctx Optional execution context for progress and cancellation
+     *        (see Execution.h); aborting throws GenerationCancelled and may
+     *        leave a partial file behind.
+     * @return False if the file could not be created or a write failed.
      */
-    void saveOBJ(const std::string &filename) const;
+    bool saveOBJ(const std::string &filename, ExecutionContext *ctx = nullptr) const;
 
     /**
      * @brief Write the city as a glTF 2.0 scene.
@@ -163,10 +213,15 @@ public:
      * produced by passing binary=true; otherwise a JSON .gltf plus external
      * .bin is written.
      *
-     * @param filename Path to the output glTF (.gltf or .glb) file.
+     * @param filename Path to the output glTF (.gltf or .glb) file, or a
+     *        stream target (`-` / `fd:N`).  Streamed JSON glTF embeds its
+     *        buffer as a base64 data URI instead of a companion .bin.
      * @param binary If true, emit GLB; otherwise emit JSON + BIN pair.
+     * @param ctx Optional execution context (see saveOBJ()).
+     * @return False if the file could not be created or a write failed.
      */
-    void saveGLTF(const std::string &filename, bool binary = false) const;
+    bool saveGLTF(const std::string &filename, bool binary = false,
+                  ExecutionContext *ctx = nullptr) const;
 
     /**
      * @brief Write a JSON file summarising high‑level statistics of the city.
@@ -176,7 +231,107 @@ public:
      * tests to verify correctness and scaling.  The JSON is emitted using
      * manual string concatenation to avoid external dependencies.
      *
-     * @param filename Path to the JSON file to create.
+     * @param filename Path to the JSON file to create, or a stream target
+     *        (`-` / `fd:N`).
+     * @param ctx Optional execution context (see saveOBJ()).
+     * @return False if the file could not be created or a write failed.
+     */
+    bool saveSummary(const std::string &filename, ExecutionContext *ctx = nullptr) const;
+
+    /**
+     * @brief Write a Mapbox Vector Tile pyramid covering the city.
+     *
+     * Tiles use a local square scheme over the grid (zoom z splits the grid
+     * into 2^z × 2^z tiles) and are written as `<directory>/z/x/y.mvt`.
+     * Each tile carries `zones`, `buildings`, `roads` and `facilities`
+     * layers, clipped to the tile plus a small buffer and quantised to a
+     * 4096 extent.  The finest zoom is assigned from source geometry and
+     * every coarser level is derived from the level below; sub-pixel
+     * footprints are dropped on coarse levels.  Only tiles over zoning or
+     * features are visited, found from the non-empty tiles of the level
+     * above, and tiles within a level are encoded in parallel.  maxZoom is
+     * clamped to maxTileZoom(size).
+     *
+     * @param directory Root directory of the pyramid (created as needed).
+     * @param minZoom Coarsest zoom level to emit.
+     * @param maxZoom Finest zoom level to emit.
+     * @param ctx Optional execution context (see saveOBJ()).
+     * @return Number of tiles written, or 0 if a tile could not be written.
+     */
+    std::size_t saveVectorTiles(const std::string &directory, int minZoom, int maxZoom,
+                                ExecutionContext *ctx = nullptr) const;
+
+    /**
+     * @brief Write the zone grid and derived per-cell layers as a tiled raster.
+     *
+     * Bands: `zone` (ZoneType codes), `distance_school`,
+     * `distance_hospital` and `distance_road` (exact Euclidean distance in
+     * cells, -1 when no such feature exists) and `population_density`
+     * (inhabitants per cell, spread over residential floor space).  Bands
+     * are cut into 256×256 tiles compressed in parallel; see Raster.h for
+     * the file layout and RasterReader for windowed reads.
+     *
+     * @param filename Path to the raster file to create.
+     * @param population Total population distributed by the density band.
+     * @param ctx Optional execution context (see saveOBJ()).
+     * @return False if the file could not be created or a write failed.
+     */
+    bool saveRaster(const std::string &filename, int population,
+                    ExecutionContext *ctx = nullptr) const;
+
+    /// Strategy used by saveShards() to assign features to shards.
+    enum class ShardMode {
+        Spatial,   ///< Recursive bisection on building centroids
+        RoundRobin ///< Runs of consecutive buildings dealt out in turn
+    };
+
+    /**
+     * @brief Split the model into count standalone files plus a manifest.
+     *
+     * Each shard is written as `<directory>/city_shard_NNN.<extension>`
+     * using the regular OBJ/glTF/GLB exporter, so every file can be loaded
+     * on its own.  Spatial mode partitions by recursive bisection of the
+     * building centroids along the longer axis, giving compact shards of
+     * near-equal building count; roads and facilities follow the shard
+     * whose region contains their midpoint/location.  Shards are built and
+     * written concurrently.  `<directory>/city_shards.json` lists each
+     * shard's file, feature counts and bounds.
+     *
+     * @param directory Existing directory receiving the shards.
+     * @param extension One of `obj`, `gltf` or `glb`.
+     * @param count Number of shards (at least 1).
+     * @param mode Partitioning strategy.
+     * @param ctx Optional execution context (see saveOBJ()).
+     * @return Number of shard files written, or 0 if a shard or the
+     *         manifest could not be written.
+     */
+    std::size_t saveShards(const std::string &directory, const std::string &extension,
+                           int count, ShardMode mode, ExecutionContext *ctx = nullptr) const;
+
+    /**
+     * @brief Write a lossless binary dump of the city (`.city`).
+     *
+     * The file can be reloaded with loadCity() and compared with another
+     * city by `citygen diff` (see CityFile.h and CityDiff.h).
+     *
+     * @param filename Output path or stream target (see Output.h).
+     * @param ctx Optional execution context (see saveOBJ()).
+     * @return False if the file could not be created or a write failed.
+     */
+    bool saveCity(const std::string &filename, ExecutionContext *ctx = nullptr) const;
+
+    /**
+     * @brief Publish the city in a POSIX shared-memory segment.
+     *
+     * The segment (see SharedMemory.h) holds the zoning grid, columnar
+     * building, facility, road and block arrays, the summary JSON and the
+     * glTF mesh buffers (`mesh/<material>/positions|normals|indices`), so
+     * a local consumer can map it read-only and render or analyse the city
+     * without copying or parsing anything.
+     *
+     * @param name Segment name (a leading '/' is optional).
+     * @param ctx Optional execution context (see saveOBJ()).
+     * @return Segment size in bytes, or 0 if it could not be created.
      */
-    void saveSummary(const std::string &filename) const;
+    std::uint64_t saveSharedMemory(const std::string &name, ExecutionContext *ctx = nullptr) const;
 };
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "City.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @file CityDiff.h
+ *
+ * Structural comparison of two generated cities, e.g. before and after a
+ * generator change.  Zone grids are compared a 64-bit word at a time (XOR,
+ * then a popcount of the cells with any differing bit); only words that
+ * differ are decoded into from/to transitions.  Buildings, roads and
+ * facilities are matched with a spatial hash join on their centroids:
+ * features at the same index that are identical pair up directly, the
+ * rest are bucketed into tolerance-sized cells and each feature of the
+ * first city takes the nearest unmatched feature of the second within the
+ * tolerance.  Matched features that differ count as modified; the others
+ * are removed (first city only) or added (second city only).
+ */
+
+/// Per-feature-kind counts of a CityDiff.
+struct FeatureDiff {
+    std::uint64_t countA = 0;
+    std::uint64_t countB = 0;
+    std::uint64_t unchanged = 0;
+    std::uint64_t modified = 0;
+    std::uint64_t added = 0;
+    std::uint64_t removed = 0;
+
+    /// Indices into the first city of removed features.
+    std::vector<std::size_t> removedIndices;
+    /// Indices into the second city of added features.
+    std::vector<std::size_t> addedIndices;
+    /// (first, second) index pairs of modified features.
+    std::vector<std::pair<std::size_t, std::size_t>> modifiedPairs;
+};
+
+struct CityDiff {
+    /// False when the grids differ in size; zone counts are then zero.
+    bool zonesComparable = true;
+    std::uint64_t zoneCells = 0;
+    std::uint64_t zoneCellsChanged = 0;
+    /// Changed cells by [from][to] ZoneType.
+    std::array<std::array<std::uint64_t, 5>, 5> zoneTransitions{};
+
+    FeatureDiff buildings;
+    /// Breakdown of modified buildings (one building may count in several).
+    std::uint64_t buildingsMoved = 0; ///< Footprint or centroid changed
+    std::uint64_t buildingsHeightChanged = 0;
+    std::uint64_t buildingsZoneChanged = 0;
+    std::uint64_t buildingsFacilityChanged = 0;
+
+    FeatureDiff roads;
+    FeatureDiff facilities;
+
+    bool identical() const;
+};
+
+/**
+ * @brief Compare two cities.
+ *
+ * @param tolerance Largest centroid distance (grid units) at which two
+ *        features are still considered the same feature.
+ */
+CityDiff diffCities(const City &a, const City &b, double tolerance = 0.5);
+
+/// Counts of a diff as a JSON document.
+std::string cityDiffToJson(const CityDiff &diff);
+
+/**
+ * @brief Write the changed features as a GeoJSON FeatureCollection.
+ *
+ * Coordinates are grid units.  Every feature has a `change` property
+ * (`added`, `removed` or `modified`) and a `kind` (`building`, `road`,
+ * `facility`); removed features use the first city's geometry, the others
+ * the second city's.
+ *
+ * @return false if the file could not be written.
+ */
+bool saveDiffLayer(const CityDiff &diff, const City &a, const City &b, const std::string &filename);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "City.h"
+
+#include <cstdint>
+#include <istream>
+#include <string>
+
+/**
+ * @file CityFile.h
+ *
+ * Binary city files (`.city`) written by City::saveCity(): a lossless dump
+ * of a generated city for later comparison (see CityDiff.h) or reloading
+ * without regenerating.  Records are stored in their in-memory layout, so
+ * files are only portable between builds with the same Building layout
+ * (checked on load).
+ *
+ * File layout (native byte order):
+ *
+ *     "CGCY" u32 version, u32 sizeof(Building), i32 gridSize
+ *     city payload (below)
+ *
+ * The payload is shared with checkpoints (Checkpoint.h):
+ *
+ *     gridSize² × u8 zone
+ *     u64 count + raw records, for buildings, facilities, roads, blocks
+ */
+
+/// Size in bytes of the city payload.
+std::uint64_t cityPayloadBytes(const City &city);
+
+/// Write the payload for city to out (cityPayloadBytes(city) bytes).
+void writeCityPayload(const City &city, std::uint8_t *out);
+
+/**
+ * @brief Read a payload into city, whose size must already be set.
+ * @param bytes Payload size announced by the enclosing header.
+ * @return false if the payload is truncated or inconsistent.
+ */
+bool readCityPayload(std::istream &in, City &city, std::uint64_t bytes);
+
+/// Load a file written by City::saveCity(); throws std::runtime_error if
+/// it is missing, malformed or from an incompatible build.
+City loadCity(const std::string &filename);
@@ -2,6 +2,12 @@
 
 #include "Config.h"
 #include "City.h"
+#include "Execution.h"
+
+#include <random>
+#include <string>
+
+class Checkpointer;
 
 /**
  * @file CityGenerator.h
@@ -24,7 +30,29 @@ public:
      * (CityGenerator.cpp) for details of the algorithm.
      *
      * @param cfg Configuration controlling the generation process.
+     * @param ctx Optional execution context receiving per-stage progress
+     *        (zoning rows, blocks, facility candidates) and able to cancel
+     *        the run; a cancelled or expired context makes generate() throw
+     *        GenerationCancelled.
+     * @param checkpoints Optional checkpoint store (Checkpoint.h): the run
+     *        starts after the last stage it restores and snapshots the
+     *        city after each further stage.
      * @return Generated City object.
      */
-    static City generate(const Config &cfg);
+    static City generate(const Config &cfg, ExecutionContext *ctx = nullptr,
+                         Checkpointer *checkpoints = nullptr);
+
+    /**
+     * @brief Site cfg.hospitals and cfg.schools on existing buildings.
+     *
+     * The last stage of generate(), exposed for callers that assemble a
+     * city from parts (Region.h): residential and commercial parcels
+     * nearest the roads are preferred, ties broken by rng.
+     */
+    static void placeFacilities(City &city, const Config &cfg, std::mt19937 &rng,
+                                ExecutionContext *ctx = nullptr);
 };
+
+/// Canonical description of every Config field generate() reads.  Equal
+/// keys produce identical cities; the exporter options are not included.
+std::string generationKey(const Config &cfg);
@@ -3,8 +3,18 @@
 #include <cstdint>
 #include <string>
 #include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
 #include <stdexcept>
 
+/// Finest zoom `--tiles` accepts on any grid (see maxTileZoom()).
+constexpr int kMaxTileZoom = 20;
+
+/// Most shard files, and shard worker processes, `--shards` may ask for.
+constexpr int kMaxShards = 4096;
+
 /**
  * @brief High-level configuration for procedural city generation.
  *
@@ -49,6 +59,33 @@ struct Config {
     ExportFormat export_format = ExportFormat::OBJ;
     enum class LayoutType { Grid, Radial };
     LayoutType layout = LayoutType::Grid;
+    // Vector tile pyramid zoom range; tiles are skipped while max < 0
+    int tiles_min_zoom = 0;
+    int tiles_max_zoom = -1;
+    // Also write the tiled zone/distance/density raster
+    bool export_raster = false;
+    // Split the model into this many standalone shard files (0 = single file)
+    int shards = 0;
+    enum class ShardMode { Spatial, RoundRobin };
+    ShardMode shard_mode = ShardMode::Spatial;
+    // Write the shards from this many worker processes (0 = in this process)
+    int shard_workers = 0;
+    // Sort buildings and blocks along a space-filling curve (see SpatialOrder.h)
+    enum class SpatialOrder { None, Hilbert, Morton };
+    SpatialOrder spatial_order = SpatialOrder::None;
+    // Check footprints against roads, blocks and each other (see Validation.h)
+    bool validate = false;
+    // Also write a binary city dump (see CityFile.h); empty = skip
+    std::string city_file;
+
+    // ===== Resources =====
+    // Budget for tracked memory in bytes; 0 = unlimited (see Memory.h)
+    std::uint64_t memory_limit = 0;
+    // Directory for spill files; empty = next to the output, else $TMPDIR
+    std::string scratch_dir;
+    // Zone grid storage order (see TiledGrid.h); the output is the same
+    enum class ZoneLayout { Rows, Tiled };
+    ZoneLayout zone_layout = ZoneLayout::Rows;
 
     // ===== Sanity checks =====
     void normalize() {
@@ -59,6 +96,11 @@ struct Config {
         if (hospitals < 0) hospitals = 0;
         if (schools < 0) schools = 0;
         if (green_m2_per_capita < 0.0) green_m2_per_capita = 0.0;
+        if (tiles_max_zoom > kMaxTileZoom) tiles_max_zoom = kMaxTileZoom;
+        if (tiles_min_zoom < 0) tiles_min_zoom = 0;
+        if (tiles_min_zoom > tiles_max_zoom) tiles_min_zoom = std::max(tiles_max_zoom, 0);
+        if (shards < 0) shards = 0;
+        if (shard_workers < 0) shard_workers = 0;
     }
 };
 
@@ -88,3 +130,147 @@ inline Config::LayoutType layoutTypeFromString(std::string s) {
     if (s == "radial") return Config::LayoutType::Radial;
     throw std::invalid_argument("Unknown layout type: " + s);
 }
+
+inline Config::SpatialOrder spatialOrderFromString(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    if (s == "none") return Config::SpatialOrder::None;
+    if (s == "hilbert") return Config::SpatialOrder::Hilbert;
+    if (s == "morton" || s == "z-order") return Config::SpatialOrder::Morton;
+    throw std::invalid_argument("Unknown spatial order: " + s);
+}
+
+inline Config::ZoneLayout zoneLayoutFromString(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    if (s == "rows" || s == "row-major") return Config::ZoneLayout::Rows;
+    if (s == "tiled" || s == "tiles") return Config::ZoneLayout::Tiled;
+    throw std::invalid_argument("Unknown zone layout: " + s);
+}
+
+inline Config::ShardMode shardModeFromString(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    if (s == "spatial") return Config::ShardMode::Spatial;
+    if (s == "round-robin" || s == "roundrobin" || s == "rr") return Config::ShardMode::RoundRobin;
+    throw std::invalid_argument("Unknown shard mode: " + s);
+}
+
+// Byte count with an optional K/M/G/T suffix (powers of 1024), e.g. "512M".
+inline std::uint64_t byteSizeFromString(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    std::size_t end = 0;
+    double value = 0.0;
+    try {
+        value = std::stod(s, &end);
+    } catch (const std::exception &) {
+        throw std::invalid_argument("Invalid byte size: " + s);
+    }
+    std::string suffix = s.substr(end);
+    if (!suffix.empty() && suffix.back() == 'b') suffix.pop_back();
+    if (!suffix.empty() && suffix.back() == 'i') suffix.pop_back();
+    double scale = 1.0;
+    if (suffix == "k") scale = 1024.0;
+    else if (suffix == "m") scale = 1024.0 * 1024.0;
+    else if (suffix == "g") scale = 1024.0 * 1024.0 * 1024.0;
+    else if (suffix == "t") scale = 1024.0 * 1024.0 * 1024.0 * 1024.0;
+    else if (!suffix.empty()) throw std::invalid_argument("Invalid byte size: " + s);
+    if (value < 0.0) throw std::invalid_argument("Invalid byte size: " + s);
+    return static_cast<std::uint64_t>(value * scale);
+}
+
+// Whole-number option value within [lo, hi]; throws std::invalid_argument
+// for anything else, so `grid-size=oops` is an error rather than 0.
+inline long long integerOptionFromString(const std::string &key, const std::string &value, long long lo,
+                                         long long hi) {
+    char *end = nullptr;
+    errno = 0;
+    long long v = std::strtoll(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || errno == ERANGE || v < lo || v > hi) {
+        throw std::invalid_argument("Invalid " + key + ": " + value);
+    }
+    return v;
+}
+
+// Finest vector-tile zoom for a grid: its tiles are still at least one
+// grid cell wide, so no level holds more tiles than the grid has cells.
+inline int maxTileZoom(int gridSize) {
+    int zoom = 0;
+    while (zoom < kMaxTileZoom && (2LL << zoom) <= gridSize) ++zoom;
+    return zoom;
+}
+
+// `[<min>-]<max>` zoom range of --tiles; throws std::invalid_argument
+// unless 0 <= min <= max <= kMaxTileZoom.
+inline void tileZoomsFromString(const std::string &s, int &minZoom, int &maxZoom) {
+    std::size_t dash = s.find('-');
+    try {
+        long long lo = dash == std::string::npos ? 0 : integerOptionFromString("tiles", s.substr(0, dash), 0, kMaxTileZoom);
+        long long hi = integerOptionFromString("tiles", s.substr(dash == std::string::npos ? 0 : dash + 1), lo,
+                                               kMaxTileZoom);
+        minZoom = static_cast<int>(lo);
+        maxZoom = static_cast<int>(hi);
+    } catch (const std::invalid_argument &) {
+        throw std::invalid_argument("Invalid tiles: " + s + " (zooms 0-" + std::to_string(kMaxTileZoom) +
+                                    ", min <= max)");
+    }
+}
+
+// Finite decimal option value; throws std::invalid_argument otherwise.
+inline double numberOptionFromString(const std::string &key, const std::string &value) {
+    char *end = nullptr;
+    double v = std::strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0' || !std::isfinite(v)) {
+        throw std::invalid_argument("Invalid " + key + ": " + value);
+    }
+    return v;
+}
+
+// Longest accepted timeout: a year, far inside the range of the clocks'
+// durations, so deadlines computed from it cannot overflow.
+constexpr double kMaxTimeoutSeconds = 365.0 * 24.0 * 3600.0;
+
+// Timeout in seconds (0 for none); throws std::invalid_argument unless the
+// value is a number in [0, kMaxTimeoutSeconds].
+inline double timeoutFromString(const std::string &key, const std::string &value) {
+    double seconds = numberOptionFromString(key, value);
+    if (seconds < 0.0 || seconds > kMaxTimeoutSeconds) {
+        throw std::invalid_argument("Invalid " + key + ": " + value);
+    }
+    return seconds;
+}
+
+/**
+ * @brief Apply one generation option given as key/value text.
+ *
+ * Keys are the command-line spellings without the leading dashes
+ * (`population`, `seed`, `grid-size`, `radius-fraction`, `hospitals`,
+ * `schools`, `transport`, `format`, `layout`, `spatial-order`), so the CLI and the server
+ * accept the same vocabulary.  Returns false for an unknown key; throws
+ * std::invalid_argument for a malformed value.
+ */
+inline bool applyConfigOption(Config &cfg, const std::string &key, const std::string &value) {
+    constexpr long long kMaxU32 = std::numeric_limits<std::uint32_t>::max();
+    constexpr long long kMaxInt = std::numeric_limits<int>::max();
+    if (key == "population") {
+        cfg.population = static_cast<int>(integerOptionFromString(key, value, 0, kMaxInt));
+    } else if (key == "hospitals") {
+        cfg.hospitals = static_cast<int>(integerOptionFromString(key, value, 0, kMaxInt));
+    } else if (key == "schools") {
+        cfg.schools = static_cast<int>(integerOptionFromString(key, value, 0, kMaxInt));
+    } else if (key == "transport") {
+        cfg.transport_mode = transportModeFromString(value);
+    } else if (key == "seed") {
+        cfg.seed = static_cast<std::uint32_t>(integerOptionFromString(key, value, 0, kMaxU32));
+    } else if (key == "grid-size") {
+        cfg.grid_size = static_cast<int>(integerOptionFromString(key, value, 0, kMaxInt));
+    } else if (key == "radius-fraction") {
+        cfg.city_radius = numberOptionFromString(key, value);
+    } else if (key == "format") {
+        cfg.export_format = exportFormatFromString(value);
+    } else if (key == "layout") {
+        cfg.layout = layoutTypeFromString(value);
+    } else if (key == "spatial-order") {
+        cfg.spatial_order = spatialOrderFromString(value);
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+
+/**
+ * @file DetMath.h
+ *
+ * Deterministic transcendental functions for generation.  libm results
+ * for exp, log, sin and friends differ in the last bits between library
+ * versions and platforms, and the std:: random distributions use
+ * implementation-defined algorithms on top of them, so the same seed
+ * could give different cities on different machines.  The functions here
+ * use only IEEE-754 basic operations (+ - * /, sqrt, min/max and integer
+ * conversions), which are correctly rounded everywhere, so results are
+ * bit-identical on any conforming platform as long as the compiler does
+ * not contract a * b + c into fused multiply-adds (the Makefile passes
+ * -ffp-contract=off).
+ *
+ * Each function is a Cody–Waite argument reduction followed by a Taylor
+ * or atanh series long enough that truncation is far below an ulp.  The
+ * largest errors seen against long double libm over four million random
+ * arguments in the stated ranges:
+ *
+ *  - exp:    1.2 ulp on [-708, 709]
+ *  - log:    1.3 ulp on all positive arguments, subnormals included
+ *  - sincos: 1.6 ulp on |x| <= 1e6, away from the zeros of sin and cos
+ *            (absolute error below 1e-18 there)
+ *  - asin:   3.1 ulp, acos: 2.1 ulp, on [-1, 1]
+ *
+ * The scalar functions are inline, and exp, log and sincos are
+ * branch-free (edge cases are selects, rounding goes through int32
+ * conversion), so loops over them vectorise once -fno-trapping-math (also
+ * in the Makefile) lets the compiler if-convert the selects.  The *Array
+ * variants are such loops for batches.  NaN in gives NaN out; other
+ * arguments outside the ranges above are not supported.
+ *
+ * The samplers at the end replace std::uniform_real_distribution,
+ * std::lognormal_distribution and std::exponential_distribution with
+ * fixed algorithms on raw mt19937 output, and shuffle() replaces
+ * std::shuffle, whose algorithm also differs between standard libraries.
+ */
+namespace detmath {
+
+constexpr double kPi = 3.14159265358979311600e+00;
+constexpr double kHalfPi = 1.57079632679489655800e+00;
+
+namespace detail {
+
+// ln 2 and pi/2 split into heads with trailing zero bits, so k * head is
+// exact for the k that occur, and tails carrying the rest.
+constexpr double kLn2Hi = 6.93147180369123816490e-01;
+constexpr double kLn2Lo = 1.90821492927058770002e-10;
+constexpr double kInvLn2 = 1.44269504088896338700e+00;
+constexpr double kPio2_1 = 1.57079632673412561417e+00;
+constexpr double kPio2_2 = 6.07710050630396597660e-11;
+constexpr double kPio2_3 = 2.02226624871116645580e-21;
+constexpr double kHalfPiLo = 6.12323399573676603587e-17;
+constexpr double kTwoOverPi = 6.36619772367581382433e-01;
+constexpr double kSqrt2 = 1.41421356237309514547e+00;
+
+inline std::uint64_t bits(double x) {
+    std::uint64_t u;
+    std::memcpy(&u, &x, sizeof u);
+    return u;
+}
+
+inline double fromBits(std::uint64_t u) {
+    double x;
+    std::memcpy(&x, &u, sizeof x);
+    return x;
+}
+
+// Nearest integer, halves away from zero; |v| < 2^31.
+inline std::int32_t roundToInt(double v) { return static_cast<std::int32_t>(v + (v < 0.0 ? -0.5 : 0.5)); }
+
+// 2^k for -1022 <= k <= 1023.
+inline double pow2(std::int32_t k) { return fromBits(static_cast<std::uint64_t>(k + 1023) << 52); }
+
+// sin r and cos r for |r| <= pi/4: Taylor series to r^17 and r^18.
+inline void sincosKernel(double r, double &s, double &c) {
+    double r2 = r * r;
+    s = r * (1.0 + r2 * (-1.0 / 6.0 + r2 * (1.0 / 120.0 + r2 * (-1.0 / 5040.0 + r2 * (1.0 / 362880.0 +
+        r2 * (-1.0 / 39916800.0 + r2 * (1.0 / 6227020800.0 + r2 * (-1.0 / 1307674368000.0 +
+        r2 * (1.0 / 355687428096000.0)))))))));
+    c = 1.0 + r2 * (-0.5 + r2 * (1.0 / 24.0 + r2 * (-1.0 / 720.0 + r2 * (1.0 / 40320.0 +
+        r2 * (-1.0 / 3628800.0 + r2 * (1.0 / 479001600.0 + r2 * (-1.0 / 87178291200.0 +
+        r2 * (1.0 / 20922789888000.0 + r2 * (-1.0 / 6402373705728000.0)))))))));
+}
+
+// Taylor coefficients of asin: (2n)! / (4^n (n!)^2 (2n + 1)), built from
+// the ratio of successive central binomial terms.
+constexpr int kAsinTerms = 25;
+constexpr std::array<double, kAsinTerms> asinCoefficients() {
+    std::array<double, kAsinTerms> c{};
+    double a = 1.0;
+    for (int n = 0; n < kAsinTerms; ++n) {
+        if (n > 0) a = a * (2.0 * n - 1.0) / (2.0 * n);
+        c[n] = a / (2.0 * n + 1.0);
+    }
+    return c;
+}
+constexpr std::array<double, kAsinTerms> kAsin = asinCoefficients();
+
+// asin x for |x| <= 0.5: Taylor series to x^49.
+inline double asinKernel(double x) {
+    double x2 = x * x;
+    double p = kAsin[kAsinTerms - 1];
+    for (int n = kAsinTerms - 2; n >= 0; --n) p = kAsin[n] + x2 * p;
+    return x * p;
+}
+
+} // namespace detail
+
+/// e^x; 0 below -745.2 and +inf above 709.78.
+inline double exp(double x) {
+    // Clamped to where 2^k saturates to 0 and inf.  xk maps NaN to the
+    // low end so k is always defined; xr keeps NaN so it propagates.
+    double xk = std::min(std::max(-746.0, x), 710.0);
+    double xr = std::min(std::max(x, -746.0), 710.0);
+    std::int32_t k = detail::roundToInt(xk * detail::kInvLn2);
+    double kd = static_cast<double>(k);
+    double r = (xr - kd * detail::kLn2Hi) - kd * detail::kLn2Lo;
+    double p = 1.0 + r * (1.0 + r * (1.0 / 2.0 + r * (1.0 / 6.0 + r * (1.0 / 24.0 + r * (1.0 / 120.0 +
+               r * (1.0 / 720.0 + r * (1.0 / 5040.0 + r * (1.0 / 40320.0 + r * (1.0 / 362880.0 +
+               r * (1.0 / 3628800.0 + r * (1.0 / 39916800.0 + r * (1.0 / 479001600.0 +
+               r * (1.0 / 6227020800.0)))))))))))));
+    // Two power-of-two factors keep each within range near the limits.
+    std::int32_t k1 = k / 2;
+    return p * detail::pow2(k1) * detail::pow2(k - k1);
+}
+
+/// Natural logarithm; -inf at 0, NaN below.
+inline double log(double x) {
+    // Subnormals are scaled into the normal range first.
+    bool tiny = x < std::numeric_limits<double>::min();
+    double xs = tiny ? x * 18014398509481984.0 : x; // 2^54
+    std::uint64_t u = detail::bits(xs);
+    std::int32_t e = static_cast<std::int32_t>((u >> 52) & 0x7ff) - (tiny ? 1023 + 54 : 1023);
+    double m = detail::fromBits((u & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL);
+    bool high = m > detail::kSqrt2;
+    m = high ? m * 0.5 : m;
+    e = high ? e + 1 : e;
+    // log(1 + f) = 2 atanh(s) with s = f / (2 + f), |s| < 0.1716, written
+    // as f - s (f - R) so the leading term f is exact.
+    double f = m - 1.0;
+    double s = f / (2.0 + f);
+    double s2 = s * s;
+    double R = s2 * (2.0 / 3.0 + s2 * (2.0 / 5.0 + s2 * (2.0 / 7.0 + s2 * (2.0 / 9.0 + s2 * (2.0 / 11.0 +
+               s2 * (2.0 / 13.0 + s2 * (2.0 / 15.0 + s2 * (2.0 / 17.0 + s2 * (2.0 / 19.0 +
+               s2 * (2.0 / 21.0 + s2 * (2.0 / 23.0)))))))))));
+    double ed = static_cast<double>(e);
+    double v = ed * detail::kLn2Hi + ((f - s * (f - R)) + ed * detail::kLn2Lo);
+    v = x == std::numeric_limits<double>::infinity() ? x : v;
+    v = x == 0.0 ? -std::numeric_limits<double>::infinity() : v;
+    return x < 0.0 || x != x ? std::numeric_limits<double>::quiet_NaN() : v;
+}
+
+/// sin x and cos x together; |x| <= 1e6.
+inline void sincos(double x, double &s, double &c) {
+    std::int32_t k = detail::roundToInt(x * detail::kTwoOverPi);
+    double kd = static_cast<double>(k);
+    // r + rt = x - k pi/2: the first step is exact, the rest is carried
+    // in the tail rt and applied to first order.
+    double r0 = x - kd * detail::kPio2_1;
+    double w = kd * detail::kPio2_2;
+    double r = r0 - w;
+    double rt = ((r0 - r) - w) - kd * detail::kPio2_3;
+    double ks, kc;
+    detail::sincosKernel(r, ks, kc);
+    double ts = ks + rt * kc;
+    kc = kc - rt * ks;
+    ks = ts;
+    // Quadrant k mod 4: odd quadrants swap sin and cos, and the signs
+    // follow bit 1 of k (sin) and of k + 1 (cos).
+    bool swap = (k & 1) != 0;
+    double sv = swap ? kc : ks;
+    double cv = swap ? ks : kc;
+    s = (k & 2) ? -sv : sv;
+    c = ((k + 1) & 2) ? -cv : cv;
+}
+
+inline double sin(double x) {
+    double s, c;
+    sincos(x, s, c);
+    return s;
+}
+
+inline double cos(double x) {
+    double s, c;
+    sincos(x, s, c);
+    return c;
+}
+
+/// Arcsine in [-pi/2, pi/2]; NaN outside [-1, 1].
+inline double asin(double x) {
+    double ax = x < 0.0 ? -x : x;
+    if (!(ax > 0.5)) return detail::asinKernel(x);
+    // asin a = pi/2 - 2 asin(sqrt((1 - a) / 2)); 1 - a is exact here.
+    double t = std::sqrt((1.0 - ax) * 0.5);
+    double v = (kHalfPi - 2.0 * detail::asinKernel(t)) + detail::kHalfPiLo;
+    return x < 0.0 ? -v : v;
+}
+
+/// Arccosine in [0, pi]; NaN outside [-1, 1].
+inline double acos(double x) {
+    if (x > 0.5) return 2.0 * detail::asinKernel(std::sqrt((1.0 - x) * 0.5));
+    if (x < -0.5) return (kPi - 2.0 * detail::asinKernel(std::sqrt((1.0 + x) * 0.5))) + 2.0 * detail::kHalfPiLo;
+    return (kHalfPi - detail::asinKernel(x)) + detail::kHalfPiLo;
+}
+
+/// Batch variants: out[i] = f(in[i]) for i < n.
+void expArray(const double *in, double *out, std::size_t n);
+void logArray(const double *in, double *out, std::size_t n);
+void sincosArray(const double *in, double *sinOut, double *cosOut, std::size_t n);
+
+/// Uniform in [0, 1) with 53 random bits from two draws.
+inline double uniform01(std::mt19937 &rng) {
+    double a = static_cast<double>(rng() >> 5);
+    double b = static_cast<double>(rng() >> 6);
+    return (a * 67108864.0 + b) * (1.0 / 9007199254740992.0);
+}
+
+/// Uniform in [lo, hi).
+inline double uniform(std::mt19937 &rng, double lo, double hi) { return lo + (hi - lo) * uniform01(rng); }
+
+/// Standard normal by Box–Muller (cosine branch; two draws of uniform01).
+inline double normal(std::mt19937 &rng) {
+    double u1 = 1.0 - uniform01(rng); // (0, 1], so the log is finite
+    double u2 = uniform01(rng);
+    return std::sqrt(-2.0 * log(u1)) * cos(2.0 * kPi * u2);
+}
+
+/// Lognormal: exp(mu + sigma * normal).
+inline double lognormal(std::mt19937 &rng, double mu, double sigma) {
+    return exp(mu + sigma * normal(rng));
+}
+
+/// Exponential with rate lambda.
+inline double exponential(std::mt19937 &rng, double lambda) { return -log(1.0 - uniform01(rng)) / lambda; }
+
+/// Fisher–Yates shuffle, one draw per position from the back.
+template <typename RandomIt>
+void shuffle(RandomIt first, RandomIt last, std::mt19937 &rng) {
+    for (std::size_t i = static_cast<std::size_t>(last - first); i > 1; --i) {
+        std::swap(first[i - 1], first[rng() % i]);
+    }
+}
+
+} // namespace detmath
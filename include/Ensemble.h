@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Config.h"
+#include "Execution.h"
+#include "Sketch.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @file Ensemble.h
+ *
+ * Multi-seed ensembles for robustness studies.  Every seed of a range is
+ * generated with otherwise identical options and reduced to its summary
+ * (Summary.h); only the scalar metrics of those summaries are kept, folded
+ * into one running distribution per metric.  No per-city output is
+ * written and at most one city per worker is alive at a time, so a
+ * 10,000-seed ensemble needs the memory of a handful of cities.
+ *
+ * Seeds are generated in parallel but reduced strictly in seed order, so
+ * the report is identical however many workers run.
+ */
+
+/// Seed range of an ensemble, both ends inclusive.
+struct EnsembleSeeds {
+    std::uint32_t first = 0;
+    std::uint32_t last = 0;
+
+    std::uint64_t count() const { return static_cast<std::uint64_t>(last) - first + 1; }
+};
+
+/// Parse "seeds:A-B" (or "seeds:A" for a single seed); throws
+/// std::invalid_argument otherwise.
+EnsembleSeeds ensembleSeedsFromString(const std::string &spec);
+
+/// Distribution of one summary metric across the seeds of an ensemble.
+/// Mean and variance are exact (Welford); quantiles come from a KllSketch.
+struct EnsembleMetric {
+    std::string name;
+    std::uint64_t count = 0; ///< Seeds for which the metric was defined
+    double mean = 0.0;
+    double m2 = 0.0;         ///< Sum of squared deviations from the mean
+    KllSketch sketch;
+
+    explicit EnsembleMetric(std::string metricName) : name(std::move(metricName)) {}
+
+    void add(double v);
+    /// Sample variance (0 for fewer than two values).
+    double variance() const { return count > 1 ? m2 / static_cast<double>(count - 1) : 0.0; }
+};
+
+struct EnsembleReport {
+    EnsembleSeeds seeds;
+    Config config;          ///< Options shared by every member (seed ignored)
+    std::vector<EnsembleMetric> metrics;
+};
+
+/**
+ * @brief Generate and summarise every seed of the range.
+ *
+ * Advances an "ensemble" stage on ctx once per seed; cancellation and
+ * deadlines abort the whole ensemble.
+ */
+EnsembleReport runEnsemble(const Config &cfg, EnsembleSeeds seeds, ExecutionContext *ctx = nullptr);
+
+/// Serialise an ensemble report as JSON.
+std::string ensembleToJson(const EnsembleReport &report);
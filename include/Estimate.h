@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Config.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @file Estimate.h
+ *
+ * Pre-flight resource estimate for a Config, computed without generating
+ * the city.  Roads and blocks are derived exactly with the generator's
+ * own layout code (Layout.h); parcels are counted by running the parcel
+ * subdivision on the blocks (sampled when there are many); zoning and
+ * mesh sizes follow from closed-form models of the generator and the
+ * exporters.  Numbers are expectations, typically within a few percent.
+ */
+struct ResourceEstimate {
+    std::uint64_t cells = 0;          ///< grid_size²
+    std::uint64_t developedCells = 0; ///< Cells inside the city radius
+    std::uint64_t greenCells = 0;
+    std::uint64_t blocks = 0;
+    std::uint64_t roads = 0;
+    std::uint64_t parcels = 0;        ///< Developed parcels, parks included
+    std::uint64_t parks = 0;
+    std::uint64_t facilities = 0;
+    std::uint64_t triangles = 0;      ///< Mesh triangles of the model export
+
+    std::uint64_t objBytes = 0;       ///< city.obj plus city.mtl
+    std::uint64_t gltfBytes = 0;      ///< city.gltf plus city.bin
+    std::uint64_t glbBytes = 0;
+    std::uint64_t summaryBytes = 0;
+    std::uint64_t rasterBytes = 0;    ///< Uncompressed upper bound of --raster
+
+    std::uint64_t generationRssBytes = 0; ///< Peak RSS while generating
+    std::uint64_t peakRssBytes = 0;       ///< Peak RSS including export of cfg.export_format
+};
+
+/// Estimate the resources needed to generate and export cfg (normalised
+/// internally).
+ResourceEstimate estimateResources(const Config &cfg);
+
+/// Serialise an estimate as JSON for `citygen --estimate`.
+std::string estimateToJson(const ResourceEstimate &estimate);
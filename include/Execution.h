@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+/**
+ * @file Execution.h
+ *
+ * Execution context threaded through CityGenerator::generate and the City
+ * exporters: per-stage progress callbacks, a cooperative cancellation flag
+ * and an optional deadline.  Long loops advance a StageScope once per unit
+ * of work (grid row, block, building, tile); the context checks the flag
+ * on every advance and the clock only every few hundred advances, so the
+ * overhead is an atomic add on the hot path.  When the job is cancelled or
+ * the deadline passes, the next check throws GenerationCancelled and
+ * ordinary unwinding releases everything built so far.  Inside
+ * parallelFor the first worker to throw stops the others as well.
+ */
+
+/// Thrown from a checkpoint once the context is cancelled or expired.
+class GenerationCancelled : public std::runtime_error {
+public:
+    enum class Reason { Cancelled, DeadlineExceeded };
+
+    GenerationCancelled(Reason reason, const std::string &stage);
+
+    Reason reason() const { return reason_; }
+    /// Stage that was running when the abort was noticed.
+    const std::string &stage() const { return stage_; }
+
+private:
+    Reason reason_;
+    std::string stage_;
+};
+
+class ExecutionContext {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Snapshot handed to the progress callback.
+    struct Progress {
+        const char *stage = "";
+        std::uint64_t done = 0;
+        std::uint64_t total = 0;
+    };
+    using ProgressCallback = std::function<void(const Progress &)>;
+
+    ExecutionContext() = default;
+    /// Context for work nested under parent: its own stages and no
+    /// progress callback, but it stops whenever parent is cancelled or
+    /// expires (noticed on the clock-reading advances).
+    explicit ExecutionContext(ExecutionContext *parent) : parent_(parent) {}
+    ExecutionContext(const ExecutionContext &) = delete;
+    ExecutionContext &operator=(const ExecutionContext &) = delete;
+
+    /**
+     * @brief Install a progress callback.
+     *
+     * Called at the start and end of every stage and at most once per
+     * interval in between, from whichever thread advanced the stage;
+     * calls never overlap.  The callback must not throw.
+     */
+    void onProgress(ProgressCallback callback,
+                    std::chrono::milliseconds interval = std::chrono::milliseconds(100));
+
+    /// Abort at the first checkpoint after the given time.
+    void setDeadline(Clock::time_point deadline);
+    /// Abort at the first checkpoint once timeout has elapsed from now.
+    void setTimeout(Clock::duration timeout) { setDeadline(Clock::now() + timeout); }
+
+    /// Request cancellation.  Safe from any thread and from signal
+    /// handlers (a single lock-free store).
+    void cancel() noexcept { cancelled_.store(true, std::memory_order_relaxed); }
+    bool cancelRequested() const noexcept { return cancelled_.load(std::memory_order_relaxed); }
+
+    /// Throw GenerationCancelled if this context or its parent is
+    /// cancelled or past the deadline.
+    void check();
+
+    /// Start a stage of total work units; reports 0/total.
+    void beginStage(const char *name, std::uint64_t total);
+    /// Add n completed units to the current stage (any thread) and run a
+    /// checkpoint.
+    void advance(std::uint64_t n = 1) {
+        done_.fetch_add(n, std::memory_order_relaxed);
+        if (cancelled_.load(std::memory_order_relaxed)) check();
+        if ((ticks_.fetch_add(1, std::memory_order_relaxed) & kSlowPathMask) == 0) slowPath();
+    }
+    /// Mark the current stage complete; reports total/total.
+    void endStage();
+
+private:
+    // Every 256th advance reads the clock (deadline, progress interval).
+    static constexpr std::uint64_t kSlowPathMask = 255;
+
+    void slowPath();
+    void report(bool force);
+
+    ExecutionContext *parent_ = nullptr;
+    std::atomic<bool> cancelled_{false};
+    std::atomic<bool> hasDeadline_{false};
+    Clock::time_point deadline_{};
+    std::atomic<const char *> stage_{""};
+    std::atomic<std::uint64_t> done_{0};
+    std::atomic<std::uint64_t> total_{0};
+    std::atomic<std::uint64_t> ticks_{0};
+
+    std::mutex reportMutex_;
+    ProgressCallback callback_;
+    Clock::duration interval_{};
+    Clock::time_point lastReport_{};
+};
+
+/**
+ * @brief A stage on an optional context.
+ *
+ * Everything is a no-op without a context, so code paths can be
+ * instrumented unconditionally.  The stage completes at finish() or when
+ * the scope ends normally; an exception (including GenerationCancelled)
+ * leaves it unfinished.
+ */
+class StageScope {
+public:
+    StageScope(ExecutionContext *ctx, const char *name, std::uint64_t total)
+        : ctx_(ctx), exceptions_(std::uncaught_exceptions()) {
+        if (ctx_) ctx_->beginStage(name, total);
+    }
+    ~StageScope() {
+        if (std::uncaught_exceptions() == exceptions_) finish();
+    }
+    StageScope(const StageScope &) = delete;
+    StageScope &operator=(const StageScope &) = delete;
+
+    void advance(std::uint64_t n = 1) {
+        if (ctx_) ctx_->advance(n);
+    }
+
+    /// Complete the stage before the scope ends.
+    void finish() {
+        if (ctx_) ctx_->endStage();
+        ctx_ = nullptr;
+    }
+
+private:
+    ExecutionContext *ctx_;
+    int exceptions_;
+};
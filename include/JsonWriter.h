@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file JsonWriter.h
+ *
+ * Small streaming JSON emitter for reports and manifests.  Numbers are
+ * formatted with std::to_chars (shortest round-trip form) straight into a
+ * std::string, avoiding iostream formatting in hot loops.  Objects are
+ * pretty-printed one member per line; arrays, and anything nested inside an
+ * array, are written on a single line.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string &out) : out_(out) {}
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    /// Emit the key of the next object member.
+    void key(std::string_view name);
+
+    void value(double v);     ///< NaN and infinities are written as null
+    void value(std::int64_t v);
+    void value(std::uint64_t v);
+    void value(int v) { value(static_cast<std::int64_t>(v)); }
+    void value(unsigned v) { value(static_cast<std::uint64_t>(v)); }
+    void value(bool v);
+    void value(std::string_view v);
+    void value(const char *v) { value(std::string_view(v)); }
+    void null();
+
+    /// Shorthand for key(name) followed by value(v).
+    template <typename T>
+    void field(std::string_view name, const T &v) {
+        key(name);
+        value(v);
+    }
+
+private:
+    struct Level {
+        bool array;
+        bool compact;
+        std::size_t count;
+    };
+
+    void separate();
+    void newline();
+    void writeString(std::string_view s);
+    void raw(std::string_view s) { out_.append(s.data(), s.size()); }
+
+    std::string &out_;
+    std::vector<Level> stack_;
+    bool afterKey_ = false;
+};
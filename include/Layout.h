@@ -0,0 +1,61 @@
+#pragma once
+
+#include "City.h"
+#include "Config.h"
+
+#include <array>
+#include <random>
+#include <vector>
+
+/**
+ * @file Layout.h
+ *
+ * Street layout and parcel subdivision shared by CityGenerator and the
+ * pre-flight estimator.  Road lines and blocks depend only on the Config
+ * (never on the seed or the zoning), so they can be derived cheaply
+ * without running the full generator.  Parcel subdivision consumes the
+ * generator's RNG and is exposed so the estimator can sample it.
+ */
+
+/// Angular sector of a ring band forming one radial-layout block.
+struct Wedge {
+    double r0 = 0.0;
+    double r1 = 0.0;
+    double theta0 = 0.0;
+    double theta1 = 0.0;
+};
+
+/// Roads and blocks of a layout, in the order the generator emits them.
+struct StreetLayout {
+    double centreX = 0.0;
+    double centreY = 0.0;
+    double radius = 0.0;  ///< Radius of the developed area in grid units
+    std::vector<RoadSegment> roads;
+    std::vector<Block> blocks;
+    /// Radial layout only: polar parameters of blocks[i].
+    std::vector<Wedge> wedges;
+};
+
+/// Derive roads and blocks for cfg.layout.
+StreetLayout deriveStreetLayout(const Config &cfg);
+
+/// Carve a courtyard out of a grid block and subdivide the remaining
+/// strips into parcels.
+std::vector<Rect> parcelizeBlock(const Block &block, std::mt19937 &rng);
+
+/// Subdivide a wedge block in (arc, radius) space and map the jittered
+/// parcels back to world-space quads.
+std::vector<std::array<Vec2, 4>> parcelizeWedge(double cx, double cy, const Wedge &wedge,
+                                                std::mt19937 &rng);
+
+/// Shrink a parcel and jitter it so buildings do not fill their lots.
+Rect jitterFootprint(const Rect &parcel, std::mt19937 &rng);
+
+/// Corners of an axis-aligned rectangle in counter-clockwise order.
+std::array<Vec2, 4> rectToQuad(const Rect &r);
+
+/// Axis-aligned bounds of a quad.
+Rect boundsFromQuad(const std::array<Vec2, 4> &q);
+
+/// Vertex average of a quad.
+Vec2 centroidOfQuad(const std::array<Vec2, 4> &q);
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @file Memory.h
+ *
+ * Process-wide memory budget and the spill-capable container behind the
+ * city's large arrays (zone grid, buildings, exporter mesh buffers,
+ * generator candidate lists).  Every SpillVector charges its heap
+ * capacity to the budget; when a growth step would push the total over
+ * the limit the vector moves its contents into an unlinked scratch file
+ * mapped with MAP_SHARED and keeps growing there.  Spilled pages are
+ * file-backed, so the kernel can write them back and reclaim them instead
+ * of counting them as anonymous memory, and the vector additionally drops
+ * its resident pages behind the append position as it fills.  Readers see
+ * an ordinary contiguous array either way; exporters stream straight out
+ * of the mapping.
+ *
+ * Without a limit (the default) nothing is ever spilled and the accounting
+ * is a pair of relaxed atomic adds per growth step.
+ */
+
+/// Thrown when a container exceeds the budget and cannot spill to disk.
+class MemoryLimitExceeded : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/// Set the budget for tracked heap memory in bytes (0 = unlimited).
+void setMemoryLimit(std::uint64_t bytes);
+
+/// Current budget in bytes (0 = unlimited).
+std::uint64_t memoryLimit();
+
+/// Bytes of tracked heap memory currently charged to the budget.
+std::uint64_t memoryCharged();
+
+/// Total bytes moved to scratch files so far (capacity at spill time).
+std::uint64_t memorySpilled();
+
+/// Directory for scratch files; empty selects $TMPDIR, then /tmp.
+void setScratchDirectory(const std::string &directory);
+
+/// Charge bytes to the budget; returns false (charging nothing) if that
+/// would exceed the limit.
+bool tryChargeMemory(std::uint64_t bytes);
+
+/// Return bytes previously charged with tryChargeMemory().
+void releaseMemory(std::uint64_t bytes);
+
+/**
+ * @brief Raw byte storage that lives on the heap or in a scratch mapping.
+ *
+ * Building block of SpillVector; knows nothing about element types.
+ */
+class SpillBuffer {
+public:
+    SpillBuffer() = default;
+    ~SpillBuffer();
+
+    SpillBuffer(const SpillBuffer &) = delete;
+    SpillBuffer &operator=(const SpillBuffer &) = delete;
+    SpillBuffer(SpillBuffer &&other) noexcept { swap(other); }
+    SpillBuffer &operator=(SpillBuffer &&other) noexcept {
+        SpillBuffer(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    std::uint8_t *data() const { return data_; }
+    std::size_t capacity() const { return capacity_; }
+    bool spilled() const { return fd_ >= 0; }
+
+    /// Grow to at least bytes of capacity, preserving the first used bytes.
+    void reserve(std::size_t bytes, std::size_t used);
+
+    /// Called as a spilled buffer fills: release resident pages that lie
+    /// well behind the write position `used`.
+    void trim(std::size_t used) {
+        if (fd_ >= 0 && used >= dropped_ + 2 * kResidentWindow) dropResident(used);
+    }
+
+    void swap(SpillBuffer &other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(dropped_, other.dropped_);
+        std::swap(fd_, other.fd_);
+    }
+
+    /// Bytes kept resident behind the write position of a spilled buffer.
+    static constexpr std::size_t kResidentWindow = std::size_t(8) << 20;
+
+private:
+    void dropResident(std::size_t used);
+    void spill(std::size_t bytes, std::size_t used);
+
+    std::uint8_t *data_ = nullptr;
+    std::size_t capacity_ = 0;
+    std::size_t dropped_ = 0; ///< Spilled: pages below this were released
+    int fd_ = -1;             ///< Scratch file descriptor once spilled
+};
+
+/**
+ * @brief Contiguous array of trivially copyable T that may spill to disk.
+ *
+ * Offers the subset of the std::vector interface the generator and
+ * exporters use; iterators are plain pointers, so it works with the
+ * standard algorithms.  Element storage is not zeroed by reserve().
+ */
+template <typename T>
+class SpillVector {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SpillVector elements are moved with memcpy");
+
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    SpillVector() = default;
+    explicit SpillVector(std::size_t n, const T &value = T()) { resize(n, value); }
+
+    SpillVector(const SpillVector &other) {
+        reserve(other.size_);
+        if (other.size_) std::memcpy(buf_.data(), other.buf_.data(), other.size_ * sizeof(T));
+        size_ = other.size_;
+        buf_.trim(size_ * sizeof(T));
+    }
+    SpillVector &operator=(const SpillVector &other) {
+        if (this != &other) SpillVector(other).swap(*this);
+        return *this;
+    }
+    SpillVector(SpillVector &&other) noexcept { swap(other); }
+    SpillVector &operator=(SpillVector &&other) noexcept {
+        SpillVector(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    std::size_t capacity() const { return buf_.capacity() / sizeof(T); }
+    bool spilled() const { return buf_.spilled(); }
+
+    T *data() { return reinterpret_cast<T *>(buf_.data()); }
+    const T *data() const { return reinterpret_cast<const T *>(buf_.data()); }
+    T *begin() { return data(); }
+    T *end() { return data() + size_; }
+    const T *begin() const { return data(); }
+    const T *end() const { return data() + size_; }
+    T &operator[](std::size_t i) { return data()[i]; }
+    const T &operator[](std::size_t i) const { return data()[i]; }
+    T &front() { return data()[0]; }
+    const T &front() const { return data()[0]; }
+    T &back() { return data()[size_ - 1]; }
+    const T &back() const { return data()[size_ - 1]; }
+
+    void reserve(std::size_t n) {
+        if (n > capacity()) buf_.reserve(n * sizeof(T), size_ * sizeof(T));
+    }
+
+    void push_back(const T &value) {
+        if (size_ == capacity()) {
+            T copy = value; // value may live in the storage about to move
+            reserve(std::max<std::size_t>(16, size_ * 2));
+            new (data() + size_) T(copy);
+        } else {
+            new (data() + size_) T(value);
+        }
+        ++size_;
+        buf_.trim(size_ * sizeof(T));
+    }
+
+    /// Resize to n elements, filling new slots with value.
+    void resize(std::size_t n, const T &value = T()) {
+        reserve(n);
+        // Fill in window-sized slices so a spilled grid never becomes
+        // resident all at once.
+        const std::size_t slice = std::max<std::size_t>(1, SpillBuffer::kResidentWindow / sizeof(T));
+        while (size_ < n) {
+            std::size_t stop = std::min(n, size_ + slice);
+            std::fill(data() + size_, data() + stop, value);
+            size_ = stop;
+            buf_.trim(size_ * sizeof(T));
+        }
+        size_ = n;
+    }
+
+    void clear() { size_ = 0; }
+
+    void swap(SpillVector &other) noexcept {
+        buf_.swap(other.buf_);
+        std::swap(size_, other.size_);
+    }
+
+private:
+    SpillBuffer buf_;
+    std::size_t size_ = 0;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * @file Numa.h
+ *
+ * NUMA placement for the modes that run many cities at once: ensembles,
+ * `citygen optimize` and the server (`--numa`).  On a multi-socket host a
+ * city allocated by a thread on one socket and processed on the other pays
+ * remote-memory latency on every pass.  With placement enabled each worker
+ * thread is bound to the CPUs of one node and given a preferred-node
+ * memory policy, so the pages of every city it generates are faulted in
+ * on that node.  Threads a worker starts (nested parallel passes, the
+ * exporters and their async writers) inherit both its CPU mask and its
+ * memory policy, so they stay on the node with the city.
+ *
+ * Topology comes from /sys/devices/system/node restricted to the CPUs the
+ * process may run on; without it every CPU forms a single node.  Binding
+ * is best effort: a failed memory-policy call (e.g. under a seccomp
+ * filter) leaves first-touch placement from the CPU binding alone.
+ * Per-node job counts and busy time are kept so the gain can be checked.
+ */
+
+/// A node and the CPUs of it that the process may use.
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus;
+};
+
+/// Nodes with at least one usable CPU, by id; never empty.
+const std::vector<NumaNode> &numaNodes();
+
+/// Enable or disable placement process-wide (off by default).
+void setNumaPlacement(bool enabled);
+bool numaPlacement();
+
+/**
+ * @brief Bind the calling thread to numaNodes()[node].
+ *
+ * Sets the CPU mask and the preferred memory node, and caps workerCount()
+ * on this thread at the node's CPU count.  Returns false, changing
+ * nothing, if the CPU mask could not be set.
+ */
+bool bindThreadToNode(std::size_t node);
+
+/// Node index the calling thread is bound to, or -1.
+int boundNode();
+
+/// Throughput of one node since the process started.
+struct NumaNodeStats {
+    int node = 0;
+    std::size_t cpus = 0;
+    std::uint64_t jobs = 0;   ///< Jobs (cities) completed by workers on the node
+    double busySeconds = 0.0; ///< Summed time of those jobs
+};
+
+/// Credit a finished job to numaNodes()[node].  Thread-safe.
+void recordNumaJob(std::size_t node, std::chrono::steady_clock::duration busy);
+
+/// Counters of every node, in numaNodes() order.
+std::vector<NumaNodeStats> numaStats();
+
+/**
+ * @brief parallelFor over whole jobs, with placement when it is enabled.
+ *
+ * Without placement this is parallelFor.  With it, one worker per usable
+ * CPU is started and bound to that CPU's node (nodes take turns, so a
+ * short batch still spreads across sockets), items are handed out as in
+ * parallelFor, nested parallel passes run inline on their worker, and
+ * each item's time is credited to the node.  The calling thread only
+ * waits, so its own binding is untouched.  Exceptions behave as in
+ * parallelFor.
+ */
+void parallelForOnNodes(std::size_t begin, std::size_t end, const std::function<void(std::size_t)> &fn);
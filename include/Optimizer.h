@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Config.h"
+#include "Execution.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @file Optimizer.h
+ *
+ * Config search against planning targets (`citygen optimize`).  Candidate
+ * configs are drawn from a box of option ranges by Latin hypercube
+ * sampling and evaluated in parallel with summary-only generation: each
+ * run produces a CitySummary (Summary.h) and nothing is exported.
+ *
+ * Evaluation uses successive halving over replicate seeds.  The first
+ * rung runs every candidate on one seed; each later rung multiplies the
+ * seeds per candidate by eta, up to --replicates, and keeps only the best
+ * 1/eta of the survivors.  Candidates that miss a target by more than the
+ * drop margin are discarded at the end of any rung, so clearly failing
+ * configs never pay for more than one city.  Survivors are ranked by
+ * total target violation, then Pareto rank over the objectives.  The
+ * result is the Pareto set of feasible candidates at the final rung.
+ *
+ * Metrics are averaged over the seeds a candidate has run.  Sampling,
+ * evaluation order and ranking are deterministic, so the same options
+ * always give the same report.
+ */
+
+/// One searched option, e.g. `radius-fraction:0.5-0.9`.
+struct SearchDimension {
+    std::string option;   ///< Key accepted by applyConfigOption()
+    double lo = 0.0;
+    double hi = 0.0;
+    bool integer = true;  ///< False if either bound has a decimal point
+};
+
+/// Constraint such as `distanceToSchool.max<=20`.
+struct MetricTarget {
+    std::size_t metric = 0; ///< Index for summaryMetric()
+    bool atMost = true;     ///< `<=` (else `>=`)
+    double bound = 0.0;
+};
+
+/// Objective such as `max:greenCells`.
+struct Objective {
+    std::size_t metric = 0;
+    bool maximize = true;
+};
+
+/// Parse `<option>:<lo>-<hi>`; throws std::invalid_argument.
+SearchDimension searchDimensionFromString(const std::string &spec);
+/// Parse `<metric><=<bound>` or `<metric>>=<bound>`; throws std::invalid_argument.
+MetricTarget metricTargetFromString(const std::string &spec);
+/// Parse `max:<metric>` or `min:<metric>`; throws std::invalid_argument.
+Objective objectiveFromString(const std::string &spec);
+
+/// Upper bounds of --candidates and of --replicates / --eta.
+constexpr long long kMaxCandidates = 1 << 20;
+constexpr long long kMaxReplicates = 1 << 16;
+
+struct OptimizerOptions {
+    std::vector<SearchDimension> dimensions;
+    std::vector<MetricTarget> targets;
+    std::vector<Objective> objectives;
+    unsigned candidates = 64;     ///< Configs sampled
+    unsigned replicates = 1;      ///< Seeds per config at the final rung
+    unsigned eta = 3;             ///< Halving factor between rungs
+    double dropMargin = 0.25;     ///< Relative target miss that discards a candidate
+    std::uint32_t searchSeed = 0; ///< Seed of the candidate sampler
+};
+
+struct OptimizerCandidate {
+    std::vector<double> values;   ///< One per dimension
+    Config config;                ///< Base config with the values applied
+    unsigned seeds = 0;           ///< Seeds evaluated
+    std::vector<double> metrics;  ///< Mean per summaryMetric() index; NaN if undefined
+    double violation = 0.0;       ///< Summed relative target misses
+    bool dropped = false;         ///< Discarded as clearly failing
+    bool pareto = false;
+};
+
+struct OptimizerResult {
+    std::vector<OptimizerCandidate> candidates;
+    unsigned rungs = 0;
+    std::vector<std::uint64_t> rungSizes; ///< Candidates evaluated at each rung
+    unsigned finalSeeds = 0;      ///< Seeds per candidate at the final rung
+    std::uint64_t cityRuns = 0;
+};
+
+/**
+ * @brief Search the options box for configs meeting the targets.
+ *
+ * Advances an "optimize" stage on ctx once per city run; cancellation and
+ * deadlines abort the search.  Throws std::invalid_argument for an empty
+ * search or an unknown option.
+ */
+OptimizerResult optimizeConfig(const Config &base, const OptimizerOptions &options,
+                               ExecutionContext *ctx = nullptr);
+
+/// The Pareto set and search statistics as JSON.
+std::string optimizerToJson(const OptimizerResult &result, const OptimizerOptions &options);
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/**
+ * @file Output.h
+ *
+ * Output targets for the exporters.  A target string names either a
+ * regular file path, standard output (`-`) or an already open, inherited
+ * file descriptor (`fd:N`).  All targets share one large-buffer stream
+ * implementation that issues few, big write(2) calls, which keeps pipes
+ * into compressors or uploaders saturated.
+ */
+
+/// True if the target string names stdout or an inherited descriptor.
+bool isStreamTarget(const std::string &target);
+
+/**
+ * @brief std::streambuf writing to a POSIX file descriptor.
+ *
+ * Small writes are coalesced into a 1 MiB buffer; writes at least as
+ * large as the buffer bypass it and go straight to write(2).  When the
+ * descriptor is a pipe, its capacity is raised (F_SETPIPE_SZ, best effort)
+ * so each flush moves a whole buffer in one syscall.  vmsplice(2) is not
+ * used because the buffer is reused immediately after each flush, which
+ * would corrupt pages still referenced by the pipe.
+ */
+class FdStreamBuf : public std::streambuf {
+public:
+    FdStreamBuf(int fd, bool ownsFd);
+    ~FdStreamBuf() override;
+
+    FdStreamBuf(const FdStreamBuf &) = delete;
+    FdStreamBuf &operator=(const FdStreamBuf &) = delete;
+
+    /// Flush buffered bytes and, if owned, close the descriptor.
+    bool close();
+
+    /// False once any write(2) has failed.
+    bool ok() const { return ok_; }
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+    int sync() override;
+
+private:
+    bool flushBuffer();
+    bool writeAll(const char *data, std::size_t len);
+
+    int fd_;
+    bool ownsFd_;
+    bool ok_ = true;
+    std::vector<char> buffer_;
+};
+
+/**
+ * @brief Output stream bound to a target string.
+ *
+ * `-` writes to stdout, `fd:N` to descriptor N (left open on close), and
+ * anything else creates/truncates a regular file.  Check good() after
+ * construction; close() flushes and reports whether every write succeeded.
+ */
+class OutputSink : public std::ostream {
+public:
+    explicit OutputSink(const std::string &target);
+    ~OutputSink() override;
+
+    const std::string &target() const { return target_; }
+
+    /// True when writing to stdout or an inherited descriptor.
+    bool isStream() const { return stream_; }
+
+    /// Flush and release the target; returns false if any write failed.
+    bool close();
+
+private:
+    std::string target_;
+    bool stream_ = false;
+    std::unique_ptr<FdStreamBuf> buf_;
+};
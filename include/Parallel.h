@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @file Parallel.h
+ *
+ * Minimal fork/join helpers shared by the exporters and analysis passes.
+ * Work is distributed dynamically over a fixed set of std::threads; there
+ * is no global pool so each call owns its threads for its duration.
+ */
+
+namespace detail {
+/// Set on threads currently running parallelFor work items.
+inline thread_local bool inParallelFor = false;
+/// CPUs available to this thread when it is bound to a NUMA node (0 = all).
+inline thread_local unsigned workerLimit = 0;
+} // namespace detail
+
+/// Number of worker threads used by parallelFor (never less than one).
+inline unsigned workerCount() {
+    unsigned n = std::thread::hardware_concurrency();
+    if (detail::workerLimit != 0 && (n == 0 || detail::workerLimit < n)) n = detail::workerLimit;
+    return n == 0 ? 1u : n;
+}
+
+/**
+ * @brief Invoke fn(i) for every i in [begin, end) across worker threads.
+ *
+ * Indices are handed out through an atomic counter so uneven work items
+ * (e.g. dense vs empty tiles) balance naturally.  The call returns once
+ * all indices have been processed.  If any invocation throws, remaining
+ * indices are abandoned and the first exception is rethrown on the
+ * calling thread.  Callers that need deterministic results must write to
+ * per-index slots rather than rely on execution order.  Calls made from
+ * inside a work item run inline on that worker, so an outer loop over
+ * whole jobs (e.g. ensemble seeds) does not multiply the thread count.
+ */
+template <typename Fn>
+void parallelFor(std::size_t begin, std::size_t end, Fn &&fn) {
+    if (end <= begin) return;
+    std::size_t count = end - begin;
+    std::size_t threads = std::min<std::size_t>(workerCount(), count);
+    if (threads <= 1 || detail::inParallelFor) {
+        for (std::size_t i = begin; i < end; ++i) fn(i);
+        return;
+    }
+    std::atomic<std::size_t> next{begin};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto worker = [&]() {
+        bool outer = detail::inParallelFor;
+        detail::inParallelFor = true;
+        while (!failed.load(std::memory_order_relaxed)) {
+            std::size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= end) break;
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) error = std::current_exception();
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+        detail::inParallelFor = outer;
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (std::size_t t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+    if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @file Raster.h
+ *
+ * Reader for the tiled raster files written by City::saveRaster().  A
+ * raster holds several co-registered bands over the city grid (zones,
+ * distance fields, population density).  Each band is cut into fixed
+ * 256×256 tiles that are compressed independently, and a tile directory
+ * at the head of the file allows any window to be read without touching
+ * tiles outside it.
+ *
+ * File layout (all integers little-endian):
+ *
+ *     "CGRT" u32 version
+ *     u32 width, u32 height, u32 tileSize, u32 bandCount
+ *     bandCount × { u8 type, u8 nameLength, name bytes }
+ *     bandCount × tilesY × tilesX × { u64 offset, u32 compressedSize }
+ *     tile payloads
+ *
+ * Tiles at the right/bottom edge are clipped to the grid.  Payloads are
+ * PackBits run-length encoded.  Float32 tiles are first delta coded (as
+ * 32-bit integers) against the left neighbour within each tile row and
+ * then byte-plane shuffled, so slowly varying values still form runs.
+ */
+
+/// Element type of a raster band.
+enum class RasterType : std::uint8_t {
+    UInt8 = 1,  ///< One byte per cell (zone codes)
+    Float32 = 2 ///< IEEE-754 single precision per cell
+};
+
+/// Size in bytes of a single cell of the given band type.
+inline std::size_t rasterTypeSize(RasterType type) {
+    return type == RasterType::Float32 ? 4 : 1;
+}
+
+/**
+ * @brief Random-access reader for tiled raster files.
+ *
+ * The constructor reads only the header and tile directory.  Window reads
+ * then fetch and decompress just the tiles overlapping the window.
+ * Malformed files raise std::runtime_error.
+ */
+class RasterReader {
+public:
+    explicit RasterReader(const std::string &filename);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int tileSize() const { return tileSize_; }
+    std::size_t bandCount() const { return bands_.size(); }
+    const std::string &bandName(std::size_t band) const { return bands_[band].name; }
+    RasterType bandType(std::size_t band) const { return bands_[band].type; }
+
+    /// Index of the band with the given name, or -1 if absent.
+    int findBand(const std::string &name) const;
+
+    /**
+     * @brief Read a window of raw cell bytes from one band.
+     *
+     * The window is clipped to the raster; cells are returned row-major
+     * with rasterTypeSize(bandType(band)) bytes per cell.
+     */
+    std::vector<std::uint8_t> readWindow(std::size_t band, int x0, int y0, int w, int h) const;
+
+    /// Convenience wrapper for UInt8 bands.
+    std::vector<std::uint8_t> readWindowU8(std::size_t band, int x0, int y0, int w, int h) const;
+
+    /// Convenience wrapper for Float32 bands.
+    std::vector<float> readWindowF32(std::size_t band, int x0, int y0, int w, int h) const;
+
+private:
+    struct BandInfo {
+        std::string name;
+        RasterType type;
+    };
+    struct TileEntry {
+        std::uint64_t offset;
+        std::uint32_t size;
+    };
+
+    std::string filename_;
+    int width_ = 0;
+    int height_ = 0;
+    int tileSize_ = 0;
+    int tilesX_ = 0;
+    int tilesY_ = 0;
+    std::vector<BandInfo> bands_;
+    std::vector<TileEntry> directory_;
+};
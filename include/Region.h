@@ -0,0 +1,80 @@
+#pragma once
+
+#include "City.h"
+#include "Config.h"
+#include "Execution.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @file Region.h
+ *
+ * Metropolitan regions: several cities generated on one shared grid and
+ * exported as a single City (`--region=<file>`).  A region file lists the
+ * options shared by every city, then one line per city:
+ *
+ *     # core city and two satellites on a 600 x 600 grid
+ *     grid-size=600 seed=7
+ *     city x=300 y=300 radius=140 population=900000 layout=radial
+ *     city x=110 y=120 radius=45 population=60000 schools=2
+ *     city x=470 y=450 radius=60 population=120000 seed=40
+ *
+ * Lines are whitespace-separated `key=value` options in the
+ * applyConfigOption() vocabulary.  `x`, `y` (the centre, in grid cells)
+ * and `radius` (grid units) are required per city, and the disc must lie
+ * on the grid and reach outside the territory of the other cities (see
+ * below); a city wholly swallowed by a larger neighbour is rejected.  A
+ * city without its own `seed` uses the region seed plus its index.  Blank
+ * lines and `#` comments are ignored.
+ *
+ * Every city is generated in parallel on a grid just large enough for its
+ * disc and then translated into place.  Where discs meet, territory is
+ * split by the power diagram of the discs, which weights each city by its
+ * radius and cuts the plane into convex cells.  Each city keeps the zones,
+ * blocks and buildings wholly inside its cell, plus its roads clipped to
+ * the cell less half their width, so features of neighbouring cities
+ * never overlap, and buildings in a dropped block go with it.  Cities are
+ * then joined by arterial connectors along a minimum spanning tree over
+ * the gaps between their discs, and parcels and blocks that a connector
+ * crosses are cleared.  Hospitals and schools are sited last, on each
+ * city's surviving buildings, so none are lost at a boundary.  The merge
+ * runs in city order, so the region is deterministic.
+ */
+
+/// One city of a region.
+struct RegionCity {
+    Config config;       ///< Generation options; grid_size and city_radius are derived
+    int x = 0;           ///< Centre on the region grid
+    int y = 0;
+    double radius = 0.0; ///< Radius of the developed disc in grid units
+};
+
+struct Region {
+    int gridSize = 0;
+    std::vector<RegionCity> cities;
+
+    /// Total population of the cities.
+    int population() const;
+};
+
+/**
+ * @brief Parse a region description (see the file comment).
+ *
+ * @param base Options every city starts from, e.g. the command line.
+ * Throws std::invalid_argument naming the offending line.
+ */
+Region regionFromString(const std::string &text, const Config &base);
+
+/// Read and parse a region file; throws std::invalid_argument.
+Region loadRegion(const std::string &path, const Config &base);
+
+/**
+ * @brief Generate every city of the region and merge them into one City.
+ *
+ * Advances a "region" stage on ctx once per city generated; each city
+ * generates under a child context, so cancelling ctx stops it too.
+ * Throws std::invalid_argument if a city keeps too few buildings to site
+ * its hospitals and schools.
+ */
+City generateRegion(const Region &region, ExecutionContext *ctx = nullptr);
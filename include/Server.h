@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @file Server.h
+ *
+ * Long-running generation service for tools that would otherwise spawn
+ * `citygen` per request.  A minimal HTTP/1.1 server listens on a Unix
+ * domain socket or a loopback TCP port; each connection carries one
+ * request whose query string uses the CLI option names:
+ *
+ *   GET /summary?seed=3&grid-size=200      city_summary.json document
+ *   GET /model?seed=3&format=glb           model bytes, with Content-Length
+ *   GET /stats                             queue and cache counters
+ *   GET /health                            "ok"
+ *
+ * `priority=low|normal|high` (or an integer in ±1000) orders the shared
+ * job queue and `timeout=<seconds>` sets a deadline measured from arrival;
+ * requests that miss it get 504, and malformed values get 400.  When the queue is full a request is turned away
+ * with 503 unless it outranks the lowest-priority waiting job, which is
+ * then turned away instead.  With a per-job memory budget, requests whose
+ * pre-flight estimate (Estimate.h) exceeds it get 413.
+ *
+ * Generated cities are kept in an LRU cache keyed by the generation
+ * parameters (not the output format), so repeated previews and different
+ * formats of the same city skip generation; concurrent identical requests
+ * share a single generation run.  A request waiting on another's run keeps
+ * its own deadline, and if that run is cancelled it generates the city
+ * itself.  Requests are read by a poll loop on the accepting thread, so a
+ * slow client delays nobody; one that takes longer than 5 s gets 408.
+ */
+/// Upper bounds of --serve-workers and --queue-limit.
+constexpr long long kMaxServeWorkers = 4096;
+constexpr long long kMaxQueueLimit = 1 << 20;
+
+struct ServerOptions {
+    /// `unix:<path>`, `<port>`, `127.0.0.1:<port>` or `localhost:<port>`;
+    /// port 0 picks a free port (the bound address is printed).
+    std::string endpoint;
+    unsigned workers = 0;                     ///< Concurrent jobs (0 = half the hardware threads)
+    std::size_t queueLimit = 64;              ///< Waiting jobs beyond this get 503
+    std::uint64_t cacheBytes = 256ull << 20;  ///< Budget of the generated-city cache
+    std::uint64_t jobMemoryBytes = 0;         ///< Reject larger estimates (0 = no check)
+};
+
+/**
+ * @brief Serve requests until SIGINT or SIGTERM.
+ *
+ * @param options Listening endpoint and scheduling limits.
+ * @param defaults Config that request parameters are applied on top of.
+ * @return Process exit code.
+ */
+int runServer(const ServerOptions &options, const Config &defaults);
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "City.h"
+#include "Execution.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @file Shards.h
+ *
+ * The pieces behind City::saveShards(), exposed so shards can also be
+ * written by separate worker processes (`--shard-workers=N`).
+ *
+ * The coordinator saves the city to a scratch `.city` file in the shard
+ * directory and starts N copies of its own executable as
+ *
+ *     citygen shard-worker <city-file> <directory> <format> <count> <mode>
+ *
+ * Each worker loads the city, plans the same partition, then reads shard
+ * indices from stdin, one per line, and answers each with a record line
+ * on stdout once that shard's file is complete:
+ *
+ *     <index> <file> <buildings> <roads> <facilities> <x0> <y0> <x1> <y1>
+ *
+ * with `-` for all four bounds of an empty shard.  A worker exits when
+ * stdin closes.  Indices are handed out one at a time, so workers stay
+ * busy until the queue is empty.  If a worker dies or exits with an
+ * error, its in-flight shard is queued again on a fresh worker, up to
+ * kShardRetries times per shard.  The coordinator then writes the
+ * manifest from the records, so the output is byte-identical to an
+ * in-process saveShards().  Workers have their own address spaces, so
+ * they share no allocator and a crash stays inside one process.  The
+ * worker command needs only the city file and a directory, so a cluster
+ * scheduler could run it just as well.
+ */
+
+/// Times a shard is retried on a fresh worker before the export fails.
+constexpr int kShardRetries = 2;
+
+/// Feature-to-shard assignment of a partition: the building, road and
+/// facility indices of each shard, in city order.
+struct ShardPlan {
+    int count = 1;
+    City::ShardMode mode = City::ShardMode::Spatial;
+    std::vector<std::vector<std::size_t>> buildings;
+    std::vector<std::vector<std::size_t>> roads;
+    std::vector<std::vector<std::size_t>> facilities;
+};
+
+/// One line of the manifest.
+struct ShardRecord {
+    int index = -1;
+    std::string file;
+    std::size_t buildings = 0;
+    std::size_t roads = 0;
+    std::size_t facilities = 0;
+    bool hasBounds = false;
+    double x0 = 0.0, y0 = 0.0, x1 = 0.0, y1 = 0.0;
+};
+
+/// Assign every building, road and facility to one of count shards.
+ShardPlan planShards(const City &city, int count, City::ShardMode mode);
+
+/// Write shard `index` of the plan as `<directory>/city_shard_NNN.<extension>`
+/// and fill in its record; false if the file could not be written.
+bool writeShard(const City &city, const ShardPlan &plan, int index, const std::string &directory,
+                const std::string &extension, ShardRecord &record);
+
+/// Write `<directory>/city_shards.json`; records must be in index order.
+bool writeShardManifest(const City &city, const ShardPlan &plan, const std::string &directory,
+                        const std::string &extension, const std::vector<ShardRecord> &records);
+
+/// Record line of the worker protocol, without the newline.
+std::string shardRecordToLine(const ShardRecord &record);
+
+/// Parse a record line; false if it is malformed.
+bool shardRecordFromLine(const std::string &line, ShardRecord &record);
+
+/**
+ * @brief City::saveShards() spread over worker processes.
+ *
+ * @param workers Number of processes (at least 1; capped at the shard count).
+ * @return Number of shard files written.
+ * Throws std::runtime_error if workers cannot be started or a shard still
+ * fails after its retries; GenerationCancelled stops the workers.
+ */
+std::size_t saveShardsWithWorkers(const City &city, const std::string &directory,
+                                  const std::string &extension, int count, City::ShardMode mode,
+                                  int workers, ExecutionContext *ctx = nullptr);
+
+/// Entry point of `citygen shard-worker`; returns the exit code.
+int runShardWorker(int argc, char **argv);
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class ExecutionContext;
+
+/**
+ * @file SharedMemory.h
+ *
+ * Zero-copy handoff of a generated city to a consumer on the same host.
+ * City::saveSharedMemory() lays the city arrays and the per-material mesh
+ * buffers out in a POSIX shared-memory segment and the producer passes on
+ * just the segment name; the consumer maps the segment read-only and uses
+ * the arrays in place, so nothing is serialised, written to disk or
+ * parsed on either side.
+ *
+ * Segment layout (native byte order, every section 64-byte aligned):
+ *
+ *     "CGSM" u32 version, u32 sectionCount, u32 complete,
+ *     u64 totalBytes, i32 gridSize, 36 reserved bytes
+ *     sectionCount × { char name[32], u32 type, u32 components,
+ *                      u64 offset, u64 count, u64 reserved }
+ *     section payloads
+ *
+ * A section holds count elements of components values each.  `complete`
+ * is set only after every payload is in place, so a segment left behind
+ * by a producer that died mid-write is rejected.  Segments outlive the
+ * producer; the consumer removes one with SharedCityView::unlink() once
+ * it has mapped it (the mapping stays valid).
+ */
+
+/// Element type of a shared-memory section.
+enum class SharedType : std::uint32_t {
+    UInt8 = 1,
+    Int32 = 2,
+    UInt32 = 3,
+    Float32 = 4,
+    Float64 = 5,
+    Text = 6 ///< UTF-8 bytes (count is the byte length)
+};
+
+/// Size in bytes of a single value of the given type.
+std::size_t sharedTypeSize(SharedType type);
+
+/// Canonical segment name: a leading '/' is added when missing.  Throws
+/// std::invalid_argument for empty names or names containing '/'.
+std::string sharedSegmentName(const std::string &name);
+
+/// One section to be written by writeSharedSegment().
+struct SharedSection {
+    std::string name;            ///< At most 31 bytes
+    SharedType type = SharedType::UInt8;
+    std::uint32_t components = 1;
+    std::uint64_t count = 0;
+    /// Fills count × components values at dst.
+    std::function<void(void *dst)> fill;
+};
+
+/**
+ * @brief Create (or replace) a segment holding the given sections.
+ *
+ * An existing segment of the same name is unlinked first, so consumers
+ * still mapping it keep their copy.
+ *
+ * @return Total segment size in bytes, or 0 if the segment could not be
+ *         created (the partial segment is removed).
+ */
+std::uint64_t writeSharedSegment(const std::string &name, int gridSize,
+                                 const std::vector<SharedSection> &sections,
+                                 ExecutionContext *ctx = nullptr);
+
+/**
+ * @brief Read-only mapping of a segment written by writeSharedSegment().
+ *
+ * Section data points straight into the mapping and stays valid for the
+ * lifetime of the view.  Missing, truncated or incomplete segments raise
+ * std::runtime_error.
+ */
+class SharedCityView {
+public:
+    struct Section {
+        std::string name;
+        SharedType type;
+        std::uint32_t components;
+        std::uint64_t count;
+        const void *data;
+    };
+
+    explicit SharedCityView(const std::string &name);
+    ~SharedCityView();
+    SharedCityView(const SharedCityView &) = delete;
+    SharedCityView &operator=(const SharedCityView &) = delete;
+
+    int gridSize() const { return gridSize_; }
+    std::uint64_t sizeBytes() const { return size_; }
+    const std::vector<Section> &sections() const { return sections_; }
+
+    /// Section with the given name, or nullptr if absent.
+    const Section *find(const std::string &name) const;
+
+    /// Remove the named segment; existing mappings are unaffected.
+    static bool unlink(const std::string &name);
+
+private:
+    void *base_ = nullptr;
+    std::uint64_t size_ = 0;
+    int gridSize_ = 0;
+    std::vector<Section> sections_;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @file Sketch.h
+ *
+ * Mergeable streaming quantile sketch (KLL, Karnin–Lang–Liberty).  Memory
+ * is bounded by roughly 3k values however many are inserted, and rank
+ * error is about 1.7/k of the stream length.  Compaction alternates which
+ * half of a level it keeps instead of drawing a random bit, so the sketch
+ * is fully deterministic: the same updates and merges, in the same order,
+ * always give the same answers.
+ */
+class KllSketch {
+public:
+    explicit KllSketch(unsigned k = 200);
+
+    /// Insert one value.
+    void update(double v);
+
+    /// Fold another sketch into this one.
+    void merge(const KllSketch &other);
+
+    /// Number of values inserted (exact).
+    std::uint64_t count() const { return n_; }
+    /// Sum of values inserted (exact up to rounding).
+    double sum() const { return sum_; }
+    /// Smallest and largest values inserted (exact); -1 when empty.
+    double min() const { return n_ ? min_ : -1.0; }
+    double max() const { return n_ ? max_ : -1.0; }
+
+    /// Approximate q-quantile (nearest rank, q in [0, 1]); -1 when empty.
+    double quantile(double q) const;
+
+    /// Number of values currently retained.
+    std::size_t retained() const;
+
+    unsigned k() const { return k_; }
+
+private:
+    std::size_t capacity(std::size_t level) const;
+    void compress();
+
+    unsigned k_;
+    std::uint64_t n_ = 0;
+    double sum_ = 0.0;
+    double min_ = 0.0;
+    double max_ = 0.0;
+    /// Items at level h stand for 2^h inserted values.
+    std::vector<std::vector<double>> levels_;
+    /// One alternation bit per level picks the half kept on compaction.
+    std::vector<std::uint8_t> parity_;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "City.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @file SpatialIndex.h
+ *
+ * Uniform-grid indices used by the analysis passes (summary statistics,
+ * validation) to answer nearest-feature queries without scanning every
+ * feature.  Indices are immutable after construction and safe to query
+ * from several threads at once.
+ */
+
+/**
+ * @brief Bucket grid over a static point set answering nearest-point queries.
+ *
+ * Points are sorted into roughly one point per cell (CSR layout).  A query
+ * visits rings of cells around the query position and stops once no
+ * unvisited cell can hold a closer point, so results are exact.
+ */
+class PointGrid {
+public:
+    explicit PointGrid(const std::vector<Vec2> &points);
+
+    bool empty() const { return points_.empty(); }
+
+    /// Squared distance from (x, y) to the nearest indexed point, or -1
+    /// when the index is empty.
+    double nearestSq(double x, double y) const;
+
+private:
+    double x0_ = 0.0;
+    double y0_ = 0.0;
+    double cell_ = 1.0;
+    int nx_ = 0;
+    int ny_ = 0;
+    std::vector<std::uint32_t> start_;
+    std::vector<Vec2> points_;
+};
+
+/**
+ * @brief Bucket grid over road centrelines answering nearest-road queries.
+ *
+ * Each segment is registered in exactly the cells it crosses, so long
+ * arterials do not flood the index.  Queries use the same ring search as
+ * PointGrid and return exact distances to the segment centrelines.
+ */
+class SegmentGrid {
+public:
+    explicit SegmentGrid(const std::vector<RoadSegment> &roads);
+
+    bool empty() const { return segments_.empty(); }
+
+    /// Squared distance from (x, y) to the nearest centreline, or -1 when
+    /// the index is empty.
+    double nearestSq(double x, double y) const;
+
+private:
+    double x0_ = 0.0;
+    double y0_ = 0.0;
+    double cell_ = 1.0;
+    int nx_ = 0;
+    int ny_ = 0;
+    std::vector<std::uint32_t> start_;
+    std::vector<std::uint32_t> ids_;
+    std::vector<RoadSegment> segments_;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "City.h"
+#include "Config.h"
+#include "Execution.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @file SpatialOrder.h
+ *
+ * Optional last generation stage (`--spatial-order=hilbert|morton`) that
+ * sorts buildings and blocks along a space-filling curve through their
+ * centroids.  Generation leaves buildings in block-iteration order, which
+ * in radial layouts jumps between distant sectors; after sorting,
+ * neighbouring array entries are neighbours on the ground, so exporters,
+ * tiling, sharding and the nearest-feature queries of the summary walk
+ * memory and pages in spatially coherent order.  The Hilbert curve keeps
+ * every run of the order inside a compact region.  The Morton (Z-order)
+ * curve is cheaper to compute but jumps at quadrant seams.
+ *
+ * Keys are 32-bit curve indices over a 2^16 × 2^16 grid spanning the
+ * city, and the sort is a stable parallel LSD radix sort, so ties keep
+ * generation order and the result does not depend on the thread count.
+ * City::buildingIds records each building's index in generation order;
+ * exports that name buildings (vector-tile feature ids, the shared-memory
+ * `building_id` column) use it, so IDs are the same with or without
+ * reordering.
+ */
+
+/// Index of (x, y) along the Hilbert curve over a 2^16 × 2^16 grid.
+std::uint32_t hilbertIndex(std::uint32_t x, std::uint32_t y);
+
+/// Index of (x, y) along the Morton (Z-order) curve: bits interleaved, x low.
+std::uint32_t mortonIndex(std::uint32_t x, std::uint32_t y);
+
+/// Permutation that sorts keys ascending, stable (order[k] = old index).
+std::vector<std::uint32_t> radixSortPermutation(const std::vector<std::uint32_t> &keys);
+
+/// Reorder city.buildings and city.blocks along the curve and record the
+/// generation-order IDs in city.buildingIds.  No-op for SpatialOrder::None.
+void applySpatialOrder(City &city, Config::SpatialOrder order, ExecutionContext *ctx = nullptr);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "City.h"
+#include "Execution.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @file Summary.h
+ *
+ * Statistics engine behind City::saveSummary().  All metrics are gathered
+ * in one fused pass: the zone grid and the building list are cut into
+ * fixed-size chunks, each chunk stages the fields it needs into local
+ * structure-of-arrays buffers and reduces them into a partial result, and
+ * the partials are combined in chunk order.  Because chunk boundaries do
+ * not depend on the number of threads, the output is bit-for-bit identical
+ * however many workers run.  Distance and height distributions are kept in
+ * mergeable quantile sketches (Sketch.h), so memory stays bounded however
+ * many buildings a city has.
+ */
+
+/// Distribution of a per-building quantity.  Count, mean and max are
+/// exact; quantiles come from a KllSketch and carry its rank error.
+struct DistributionStats {
+    std::uint64_t count = 0; ///< Buildings measured
+    double mean = -1.0;
+    double p50 = -1.0;
+    double p90 = -1.0;
+    double p95 = -1.0;
+    double p99 = -1.0;
+    double max = -1.0;       ///< -1 when nothing was measured
+};
+
+/// Height statistics of one zone's buildings.
+struct HeightStats {
+    std::uint64_t count = 0;
+    double mean = 0.0;
+    int max = 0;
+};
+
+/// Every metric written to city_summary.json.
+struct CitySummary {
+    /// Height histogram bins are one storey wide; the last bin collects
+    /// everything at or above its index.
+    static constexpr int kHeightBins = 64;
+    /// Parcel areas are binned by floor(log2(area)) starting at 2^kAreaLog2Min.
+    static constexpr int kAreaBins = 20;
+    static constexpr int kAreaLog2Min = -4;
+
+    int gridSize = 0;
+    std::uint64_t totalBuildings = 0;   ///< Excludes parks and undeveloped parcels
+    std::uint64_t parcels = 0;          ///< Every developed parcel, parks included
+    std::array<std::uint64_t, 5> zoneCells{}; ///< Indexed by ZoneType
+    std::uint64_t hospitals = 0;
+    std::uint64_t schools = 0;
+
+    HeightStats residential;
+    HeightStats commercial;
+    HeightStats industrial;
+    std::array<std::uint64_t, kHeightBins> heightHistogram{};
+
+    double meanParcelArea = 0.0;
+    std::array<std::uint64_t, kAreaBins> parcelAreaHistogram{};
+    double footprintArea = 0.0;         ///< Summed building footprints
+    double footprintCoverage = 0.0;     ///< footprintArea / developed cells
+
+    DistributionStats schoolDistance;   ///< Residential buildings to nearest school
+    DistributionStats hospitalDistance; ///< Residential buildings to nearest hospital
+    DistributionStats roadDistance;     ///< Buildings to nearest road centreline
+    DistributionStats heightDistribution; ///< Storeys of every non-park building
+    unsigned sketchK = 0;               ///< Accuracy parameter of the sketches
+};
+
+/// Compute all summary metrics of a city, advancing a "summary" stage on
+/// ctx once per chunk.
+CitySummary computeSummary(const City &city, ExecutionContext *ctx = nullptr);
+
+/// Number of scalar summary metrics (see summaryMetric()).
+std::size_t summaryMetricCount();
+
+/// Name of a scalar metric: its key in city_summary.json, with nested
+/// values spelled as paths (`distanceToSchool.p90`).
+const char *summaryMetricName(std::size_t index);
+
+/// Index of the named metric, or summaryMetricCount() if there is none.
+std::size_t findSummaryMetric(const std::string &name);
+
+/// Value of a scalar metric; NaN when the city does not define it (e.g.
+/// school distances without residential buildings).  Used by ensembles
+/// and the optimizer, which reduce many summaries without serialising them.
+double summaryMetric(const CitySummary &summary, std::size_t index);
+
+/// Serialise a summary as the JSON document written to city_summary.json.
+std::string summaryToJson(const CitySummary &summary);
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "Memory.h"
+
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * @file TiledGrid.h
+ *
+ * Square grid of cells stored either row-major or in 64×64 tiles
+ * (`--zone-layout=tiled` for City::zones).  In the tiled layout the
+ * tiles are laid out row-major and each tile is row-major inside, so a
+ * 2D neighbourhood of a cell lies in one tile, or in at most four near a
+ * tile corner, instead of being spread over rows a whole grid width
+ * apart.  Stencils and area samples over large grids then touch a few
+ * cache lines and pages rather than one per row.  Edge tiles are padded
+ * to the full 64×64.  The padding holds the fill value and is never
+ * visited through the accessors.
+ *
+ * Code that only visits cells goes through at() or forEachRowSpan(),
+ * which hands out each row as its contiguous runs: the whole row when
+ * row-major, one run per tile when tiled.  Scans then see the same cells
+ * in the same order under either layout, so the layout never changes
+ * the output.  Storage is a SpillVector, so the grid honours the memory
+ * limit.
+ */
+
+/// Storage order of a TiledGrid.
+enum class GridLayout { Rows, Tiled };
+
+template <typename T>
+class TiledGrid {
+public:
+    static constexpr int kTileShift = 6;
+    static constexpr int kTile = 1 << kTileShift;
+
+    TiledGrid() = default;
+    TiledGrid(int side, GridLayout layout, const T &value = T()) { reset(side, layout, value); }
+
+    /// Make the grid side × side cells in the given layout, all set to value.
+    void reset(int side, GridLayout layout, const T &value = T()) {
+        side_ = std::max(side, 0);
+        layout_ = layout;
+        tilesPerRow_ = (side_ + kTile - 1) >> kTileShift;
+        std::size_t cells = layout_ == GridLayout::Rows
+                                ? static_cast<std::size_t>(side_) * side_
+                                : static_cast<std::size_t>(tilesPerRow_) * tilesPerRow_ * kTile * kTile;
+        cells_.clear();
+        cells_.resize(cells, value);
+    }
+
+    /// Grid dimension (side × side cells).
+    int side() const { return side_; }
+    GridLayout layout() const { return layout_; }
+
+    /// Number of cells, not counting tile padding.
+    std::size_t size() const { return static_cast<std::size_t>(side_) * side_; }
+
+    /// Bytes held by the storage, tile padding included.
+    std::size_t storageBytes() const { return cells_.size() * sizeof(T); }
+
+    /// Storage index of cell (x, y).  No bounds checking.
+    std::size_t offset(int x, int y) const {
+        if (layout_ == GridLayout::Rows) return static_cast<std::size_t>(y) * side_ + x;
+        std::size_t tile = static_cast<std::size_t>(y >> kTileShift) * tilesPerRow_ + (x >> kTileShift);
+        return (tile << (2 * kTileShift)) | (static_cast<std::size_t>(y & (kTile - 1)) << kTileShift) |
+               static_cast<std::size_t>(x & (kTile - 1));
+    }
+
+    T &at(int x, int y) { return cells_[offset(x, y)]; }
+    const T &at(int x, int y) const { return cells_[offset(x, y)]; }
+
+    /// Call fn(x0, span, n) for the contiguous runs making up row y, left
+    /// to right; span[k] is cell (x0 + k, y).
+    template <typename Fn>
+    void forEachRowSpan(int y, Fn &&fn) {
+        rowSpans(*this, y, fn);
+    }
+    template <typename Fn>
+    void forEachRowSpan(int y, Fn &&fn) const {
+        rowSpans(*this, y, fn);
+    }
+
+    /// Store the same cells in another layout.
+    void setLayout(GridLayout layout) {
+        if (layout == layout_) return;
+        TiledGrid next(side_, layout);
+        for (int y = 0; y < side_; ++y) {
+            next.forEachRowSpan(y, [&](int x0, T *span, int n) {
+                for (int k = 0; k < n; ++k) span[k] = at(x0 + k, y);
+            });
+        }
+        *this = std::move(next);
+    }
+
+    /// Storage in layout order, padding included.  Two grids of the same
+    /// side and layout can be compared through it as plain arrays.
+    const T *data() const { return cells_.data(); }
+    std::size_t storageSize() const { return cells_.size(); }
+
+private:
+    template <typename Grid, typename Fn>
+    static void rowSpans(Grid &grid, int y, Fn &fn) {
+        if (grid.layout_ == GridLayout::Rows) {
+            if (grid.side_ > 0) fn(0, grid.cells_.data() + static_cast<std::size_t>(y) * grid.side_, grid.side_);
+            return;
+        }
+        for (int x0 = 0; x0 < grid.side_; x0 += kTile) {
+            fn(x0, grid.cells_.data() + grid.offset(x0, y), std::min(kTile, grid.side_ - x0));
+        }
+    }
+
+    int side_ = 0;
+    int tilesPerRow_ = 0;
+    GridLayout layout_ = GridLayout::Rows;
+    SpillVector<T> cells_;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "City.h"
+#include "Execution.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @file Validation.h
+ *
+ * Geometric validation of a generated city (`--validate`).  Three kinds of
+ * defect are reported, each with the indices of the features involved:
+ *
+ *  - two building footprints overlap;
+ *  - a footprint intrudes into a road, taken as its centreline inflated
+ *    by half the road width (an oriented rectangle);
+ *  - a footprint is not inside the block its centroid falls in (or its
+ *    centroid falls in no block).
+ *
+ * Candidate pairs come from a sweep-and-prune over the axis-aligned
+ * bounds of footprints and inflated roads: boxes are sorted by their left
+ * edge and each box is compared with the boxes that start before its
+ * right edge.  Candidates are confirmed with exact separating-axis tests
+ * on the quads.  The sweep and the block checks run in fixed chunks on
+ * parallelFor, and issues are concatenated in chunk order, so reports are
+ * deterministic.  Contacts shallower than the tolerance are not defects;
+ * neighbouring footprints and road kerbs may touch.
+ */
+
+struct ValidationIssue {
+    enum class Kind { BuildingOverlap, RoadIntrusion, OutsideBlock };
+    Kind kind = Kind::BuildingOverlap;
+    std::size_t building = 0;
+    /// Second building, road or block index; for OutsideBlock, SIZE_MAX
+    /// when the centroid is in no block.
+    std::size_t other = 0;
+    /// Penetration depth (overlaps, intrusions) or distance of the
+    /// farthest corner outside the block, in grid units.
+    double depth = 0.0;
+};
+
+struct ValidationReport {
+    std::uint64_t buildings = 0;
+    std::uint64_t roads = 0;
+    std::uint64_t blocks = 0;
+    std::uint64_t candidatePairs = 0; ///< Pairs passed to the exact tests
+    std::uint64_t buildingOverlaps = 0;
+    std::uint64_t roadIntrusions = 0;
+    std::uint64_t outsideBlock = 0;
+    std::vector<ValidationIssue> issues;
+
+    bool ok() const { return issues.empty(); }
+};
+
+/**
+ * @brief Check footprints against each other, the roads and the blocks.
+ *
+ * Buildings of zone None are skipped.  Advances a "validate" stage on ctx
+ * once per chunk.
+ *
+ * @param tolerance Depth (grid units) up to which contacts are accepted.
+ */
+ValidationReport validateCity(const City &city, ExecutionContext *ctx = nullptr,
+                              double tolerance = 1e-3);
+
+/// Counts and every issue as a JSON document.  Buildings are given by
+/// their stable City::buildingId(), roads and blocks by index.
+std::string validationToJson(const City &city, const ValidationReport &report);
@@ -0,0 +1,400 @@
+#include "AsyncIO.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define CITYGEN_HAVE_IO_URING 1
+#endif
+
+namespace {
+
+constexpr std::size_t kPageSize = 4096;
+// user_data of the NOP that tells the completion thread to exit.
+constexpr std::uint64_t kStopToken = ~std::uint64_t(0);
+
+#ifdef CITYGEN_HAVE_IO_URING
+
+template <typename T>
+T loadAcquire(const T *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+void storeRelease(T *p, T v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+// Raw io_uring instance driven through the syscalls directly, so no
+// liburing dependency is needed.
+struct Ring {
+    int fd = -1;
+    unsigned sqEntries = 0;
+    void *sqMap = MAP_FAILED;
+    void *cqMap = MAP_FAILED;
+    std::size_t sqMapSize = 0;
+    std::size_t cqMapSize = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    std::size_t sqesSize = 0;
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+
+    bool init(unsigned entries) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+        if (fd < 0) return false;
+        sqEntries = p.sq_entries;
+        sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+        sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED) return false;
+        cqMap = single ? sqMap
+                       : mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              fd, IORING_OFF_CQ_RING);
+        if (cqMap == MAP_FAILED) return false;
+        sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+        auto *sq = static_cast<char *>(sqMap);
+        auto *cq = static_cast<char *>(cqMap);
+        sqHead = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+        sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqMap != MAP_FAILED && cqMap != sqMap) munmap(cqMap, cqMapSize);
+        if (sqMap != MAP_FAILED) munmap(sqMap, sqMapSize);
+        if (fd >= 0) close(fd);
+    }
+
+    bool registerBuffers(const std::vector<iovec> &iov) {
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+                       iov.data(), static_cast<unsigned>(iov.size())) == 0;
+    }
+
+    // Single producer: callers serialise submissions.  In-flight work is
+    // bounded by the buffer pool, which is smaller than the ring.
+    bool push(const io_uring_sqe &entry) {
+        unsigned tail = *sqTail;
+        unsigned idx = tail & *sqMask;
+        sqes[idx] = entry;
+        sqArray[idx] = idx;
+        storeRelease(sqTail, tail + 1);
+        while (true) {
+            long r = syscall(__NR_io_uring_enter, fd, 1u, 0u, 0u, nullptr, 0);
+            if (r >= 0) return true;
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+        }
+    }
+
+    // Block until a completion is available and pop it.
+    bool pop(io_uring_cqe &out) {
+        while (true) {
+            unsigned head = *cqHead;
+            unsigned tail = loadAcquire(cqTail);
+            if (head != tail) {
+                out = cqes[head & *cqMask];
+                storeRelease(cqHead, head + 1);
+                return true;
+            }
+            long r = syscall(__NR_io_uring_enter, fd, 0u, 1u, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (r < 0 && errno != EINTR && errno != EAGAIN) return false;
+        }
+    }
+};
+
+#endif // CITYGEN_HAVE_IO_URING
+
+} // namespace
+
+struct AsyncFileWriter::Impl {
+    struct Pending {
+        std::size_t len = 0;
+        std::size_t done = 0;
+        std::uint64_t offset = 0;
+    };
+
+    int fd = -1;
+    std::size_t bufferSize = 0;
+    std::uint8_t *storage = nullptr;
+    std::size_t storageSize = 0;
+    std::vector<Pending> pending;
+
+    std::mutex mutex;
+    std::condition_variable freeCv;
+    std::condition_variable idleCv;
+    std::vector<int> freeList;
+    std::size_t inFlight = 0;
+    bool failed = false;
+
+#ifdef CITYGEN_HAVE_IO_URING
+    std::unique_ptr<Ring> ring;
+    std::mutex submitMutex;
+#endif
+    std::thread reaper;
+
+    // pwrite fallback
+    std::vector<std::thread> workers;
+    std::deque<int> jobs;
+    std::condition_variable jobCv;
+    bool stopping = false;
+
+    std::uint8_t *bufferAt(int index) const { return storage + static_cast<std::size_t>(index) * bufferSize; }
+
+    void complete(int index, bool ok) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok) failed = true;
+        freeList.push_back(index);
+        inFlight--;
+        freeCv.notify_one();
+        if (inFlight == 0) idleCv.notify_all();
+    }
+
+    bool pwriteAll(int index) {
+        Pending &p = pending[index];
+        while (p.done < p.len) {
+            ssize_t n = pwrite(fd, bufferAt(index) + p.done, p.len - p.done,
+                               static_cast<off_t>(p.offset + p.done));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            p.done += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    void startPool(unsigned threads) {
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([this]() {
+                while (true) {
+                    int index;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        jobCv.wait(lock, [&]() { return stopping || !jobs.empty(); });
+                        if (jobs.empty()) return;
+                        index = jobs.front();
+                        jobs.pop_front();
+                    }
+                    complete(index, pwriteAll(index));
+                }
+            });
+        }
+    }
+
+#ifdef CITYGEN_HAVE_IO_URING
+    bool startRing(unsigned bufferCount) {
+        const char *env = std::getenv("CITYGEN_NO_IO_URING");
+        if (env && *env && std::strcmp(env, "0") != 0) return false;
+        unsigned entries = 1;
+        while (entries < bufferCount * 2 + 2) entries <<= 1;
+        auto r = std::make_unique<Ring>();
+        if (!r->init(entries)) return false;
+        std::vector<iovec> iov(bufferCount);
+        for (unsigned i = 0; i < bufferCount; ++i) {
+            iov[i].iov_base = bufferAt(static_cast<int>(i));
+            iov[i].iov_len = bufferSize;
+        }
+        if (!r->registerBuffers(iov)) return false;
+        ring = std::move(r);
+        reaper = std::thread([this]() { reap(); });
+        return true;
+    }
+
+    bool submitFixed(int index) {
+        const Pending &p = pending[index];
+        io_uring_sqe sqe;
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITE_FIXED;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(bufferAt(index) + p.done);
+        sqe.len = static_cast<std::uint32_t>(p.len - p.done);
+        sqe.off = p.offset + p.done;
+        sqe.buf_index = static_cast<std::uint16_t>(index);
+        sqe.user_data = static_cast<std::uint64_t>(index);
+        std::lock_guard<std::mutex> lock(submitMutex);
+        return ring->push(sqe);
+    }
+
+    void reap() {
+        io_uring_cqe cqe;
+        while (ring->pop(cqe)) {
+            if (cqe.user_data == kStopToken) return;
+            int index = static_cast<int>(cqe.user_data);
+            Pending &p = pending[index];
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                if (!submitFixed(index)) complete(index, false);
+                continue;
+            }
+            if (cqe.res < 0) {
+                complete(index, false);
+                continue;
+            }
+            p.done += static_cast<std::size_t>(cqe.res);
+            if (p.done < p.len && cqe.res > 0) {
+                // Short write: queue the remainder from the same buffer.
+                if (!submitFixed(index)) complete(index, false);
+                continue;
+            }
+            complete(index, p.done == p.len);
+        }
+    }
+
+    void stopRing() {
+        io_uring_sqe sqe;
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = kStopToken;
+        bool pushed;
+        {
+            std::lock_guard<std::mutex> lock(submitMutex);
+            pushed = ring->push(sqe);
+        }
+        if (pushed && reaper.joinable()) reaper.join();
+        else if (reaper.joinable()) reaper.detach();
+    }
+#endif
+};
+
+AsyncFileWriter::AsyncFileWriter(const std::string &path, std::size_t bufferSize, unsigned bufferCount)
+    : impl_(std::make_unique<Impl>()) {
+    Impl &im = *impl_;
+    bufferCount = std::max(1u, bufferCount);
+    im.bufferSize = (std::max(bufferSize, kPageSize) + kPageSize - 1) / kPageSize * kPageSize;
+    im.fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (im.fd < 0) return;
+    im.storageSize = im.bufferSize * bufferCount;
+    void *mem = mmap(nullptr, im.storageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        ::close(im.fd);
+        im.fd = -1;
+        return;
+    }
+    im.storage = static_cast<std::uint8_t *>(mem);
+    im.pending.resize(bufferCount);
+    for (unsigned i = bufferCount; i > 0; --i) im.freeList.push_back(static_cast<int>(i - 1));
+#ifdef CITYGEN_HAVE_IO_URING
+    if (im.startRing(bufferCount)) return;
+#endif
+    im.startPool(std::min(bufferCount, 4u));
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    Impl &im = *impl_;
+    if (im.fd >= 0) finish();
+#ifdef CITYGEN_HAVE_IO_URING
+    if (im.ring) {
+        im.stopRing();
+        im.ring.reset();
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> lock(im.mutex);
+        im.stopping = true;
+    }
+    im.jobCv.notify_all();
+    for (auto &t : im.workers) t.join();
+    if (im.storage) munmap(im.storage, im.storageSize);
+    if (im.fd >= 0) ::close(im.fd);
+}
+
+bool AsyncFileWriter::isOpen() const {
+    return impl_->fd >= 0;
+}
+
+bool AsyncFileWriter::usingIoUring() const {
+#ifdef CITYGEN_HAVE_IO_URING
+    return impl_->ring != nullptr;
+#else
+    return false;
+#endif
+}
+
+AsyncFileWriter::Buffer AsyncFileWriter::acquire() {
+    Impl &im = *impl_;
+    std::unique_lock<std::mutex> lock(im.mutex);
+    im.freeCv.wait(lock, [&]() { return !im.freeList.empty(); });
+    int index = im.freeList.back();
+    im.freeList.pop_back();
+    return {im.bufferAt(index), im.bufferSize, index};
+}
+
+void AsyncFileWriter::submit(const Buffer &buf, std::size_t len, std::uint64_t offset) {
+    Impl &im = *impl_;
+    Impl::Pending &p = im.pending[buf.index];
+    p.len = std::min(len, im.bufferSize);
+    p.done = 0;
+    p.offset = offset;
+    {
+        std::lock_guard<std::mutex> lock(im.mutex);
+        im.inFlight++;
+    }
+    if (im.fd < 0 || p.len == 0) {
+        im.complete(buf.index, im.fd >= 0);
+        return;
+    }
+#ifdef CITYGEN_HAVE_IO_URING
+    if (im.ring) {
+        if (!im.submitFixed(buf.index)) im.complete(buf.index, false);
+        return;
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> lock(im.mutex);
+        im.jobs.push_back(buf.index);
+    }
+    im.jobCv.notify_one();
+}
+
+void AsyncFileWriter::write(const void *data, std::size_t len, std::uint64_t offset) {
+    const auto *bytes = static_cast<const std::uint8_t *>(data);
+    while (len > 0) {
+        Buffer buf = acquire();
+        std::size_t n = std::min(len, buf.capacity);
+        std::memcpy(buf.data, bytes, n);
+        submit(buf, n, offset);
+        bytes += n;
+        offset += n;
+        len -= n;
+    }
+}
+
+bool AsyncFileWriter::finish() {
+    Impl &im = *impl_;
+    std::unique_lock<std::mutex> lock(im.mutex);
+    im.idleCv.wait(lock, [&]() { return im.inFlight == 0; });
+    return im.fd >= 0 && !im.failed;
+}
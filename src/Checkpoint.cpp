@@ -0,0 +1,183 @@
+#include "Checkpoint.h"
+#include "CityFile.h"
+#include "CityGenerator.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[4] = {'C', 'G', 'C', 'K'};
+constexpr std::uint32_t kVersion = 1;
+
+struct FileHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t optionsHash;
+    std::uint32_t stage;
+    std::uint32_t exported;
+    std::uint32_t buildingSize;
+    std::int32_t gridSize;
+    std::uint64_t payloadBytes;
+    std::uint8_t reserved[24];
+};
+static_assert(sizeof(FileHeader) == 64, "checkpoint header layout");
+
+std::uint64_t fnv1a(const std::string &s) {
+    std::uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Generation options plus everything that decides which files the export
+// phase writes, so recorded outputs are only trusted for the same request.
+std::uint64_t optionsHash(const Config &cfg) {
+    std::ostringstream key;
+    key << generationKey(cfg) << '|' << static_cast<int>(cfg.export_format) << '|'
+        << cfg.tiles_min_zoom << '-' << cfg.tiles_max_zoom << '|' << cfg.export_raster << '|'
+        << cfg.shards << '/' << static_cast<int>(cfg.shard_mode);
+    return fnv1a(key.str());
+}
+
+bool writeAll(int fd, const std::uint8_t *data, std::size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+const char *checkpointStageName(CheckpointStage stage) {
+    switch (stage) {
+        case CheckpointStage::Zoning: return "zoning";
+        case CheckpointStage::GreenSpace: return "green space";
+        case CheckpointStage::Parcels: return "parcels";
+        case CheckpointStage::Facilities: return "facilities";
+        case CheckpointStage::None:
+        default: return "none";
+    }
+}
+
+Checkpointer::Checkpointer(std::string path, const Config &cfg, bool resume)
+    : path_(std::move(path)), optionsHash_(optionsHash(cfg)), resume_(resume) {}
+
+Checkpointer::~Checkpointer() { wait(); }
+
+CheckpointStage Checkpointer::restore(City &city, std::mt19937 &rng) {
+    if (!resume_) return CheckpointStage::None;
+    std::ifstream in(path_, std::ios::binary);
+    if (!in) return CheckpointStage::None;
+    auto corrupt = [&]() { return CheckpointMismatch("unreadable checkpoint " + path_); };
+    FileHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) {
+        throw corrupt();
+    }
+    if (header.optionsHash != optionsHash_ || header.gridSize != city.size) {
+        throw CheckpointMismatch("checkpoint " + path_ + " was written for different options");
+    }
+    if (header.buildingSize != sizeof(Building) || header.stage == 0 ||
+        header.stage > static_cast<std::uint32_t>(CheckpointStage::Facilities)) {
+        throw corrupt();
+    }
+    std::uint64_t remaining = header.payloadBytes;
+    std::uint32_t rngLength = 0;
+    if (!in.read(reinterpret_cast<char *>(&rngLength), sizeof(rngLength)) ||
+        sizeof(rngLength) + std::uint64_t(rngLength) > remaining) {
+        throw corrupt();
+    }
+    std::string rngText(rngLength, '\0');
+    if (!in.read(rngText.data(), rngLength)) throw corrupt();
+    std::istringstream(rngText) >> rng;
+    remaining -= sizeof(rngLength) + rngLength;
+
+    if (!readCityPayload(in, city, remaining)) throw corrupt();
+    resumed_ = saved_ = static_cast<CheckpointStage>(header.stage);
+    exported_ = header.exported;
+    return resumed_;
+}
+
+void Checkpointer::save(CheckpointStage stage, const City &city, const std::mt19937 &rng) {
+    wait();
+    std::ostringstream rngText;
+    rngText << rng;
+    std::string rngState = rngText.str();
+
+    std::uint32_t rngLength = static_cast<std::uint32_t>(rngState.size());
+    std::uint64_t payload = sizeof(rngLength) + rngLength + cityPayloadBytes(city);
+    // The snapshot is a SpillVector so it counts against --memory-limit.
+    SpillVector<std::uint8_t> snapshot(sizeof(FileHeader) + payload);
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.optionsHash = optionsHash_;
+    header.stage = static_cast<std::uint32_t>(stage);
+    header.exported = exported_;
+    header.buildingSize = sizeof(Building);
+    header.gridSize = city.size;
+    header.payloadBytes = payload;
+
+    std::uint8_t *out = snapshot.data();
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    std::memcpy(out, &rngLength, sizeof(rngLength));
+    out += sizeof(rngLength);
+    std::memcpy(out, rngState.data(), rngLength);
+    writeCityPayload(city, out + rngLength);
+    saved_ = stage;
+
+    writer_ = std::thread([this, snapshot = std::move(snapshot)]() {
+        std::string tmp = path_ + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool ok = fd >= 0 && writeAll(fd, snapshot.data(), snapshot.size()) && ::fsync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+        ok = ok && std::rename(tmp.c_str(), path_.c_str()) == 0;
+        if (!ok) {
+            ::unlink(tmp.c_str());
+            failed_.store(true, std::memory_order_relaxed);
+        }
+    });
+}
+
+void Checkpointer::markExported(ExportStep step) {
+    wait();
+    exported_ |= step;
+    if (saved_ == CheckpointStage::None) return;
+    int fd = ::open(path_.c_str(), O_WRONLY);
+    if (fd < 0) return;
+    // A four-byte update inside the first sector; no temporary file needed.
+    ssize_t n = ::pwrite(fd, &exported_, sizeof(exported_), offsetof(FileHeader, exported));
+    if (n != static_cast<ssize_t>(sizeof(exported_)) || ::fdatasync(fd) != 0) {
+        failed_.store(true, std::memory_order_relaxed);
+    }
+    ::close(fd);
+}
+
+bool Checkpointer::wait() {
+    if (writer_.joinable()) writer_.join();
+    return !failed_.load(std::memory_order_relaxed);
+}
+
+void Checkpointer::discard() {
+    wait();
+    std::remove(path_.c_str());
+    saved_ = CheckpointStage::None;
+}
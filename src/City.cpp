@@ -1,4 +1,9 @@
 #include "City.h"
+#include "AsyncIO.h"
+#include "Execution.h"
+#include "Output.h"
+#include "SharedMemory.h"
+#include "Summary.h"
 
 #include <fstream>
 #include <array>
@@ -10,6 +15,8 @@
 #include <unordered_map>
 #include <limits>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 
 namespace {
 
@@ -42,7 +49,7 @@ Quad buildingQuad(const Building &b) {
 
 // Write a prism defined by four base corners to an OBJ stream.
 // The corners should be specified in winding order around the base face.
-void writeQuadPrism(std::ofstream &ofs,
+void writeQuadPrism(std::ostream &ofs,
                     const Quad &base,
                     double baseZ,
                     double topZ,
@@ -72,7 +79,7 @@ void writeQuadPrism(std::ofstream &ofs,
 }
 
 // Convenience helper to extrude an axis-aligned rectangle into a prism.
-void writeRectPrism(std::ofstream &ofs, const Rect &r,
+void writeRectPrism(std::ostream &ofs, const Rect &r,
                     double baseZ, double topZ, std::size_t &vertexOffset) {
     writeQuadPrism(ofs, rectToQuad(r), baseZ, topZ, vertexOffset);
 }
@@ -144,7 +151,7 @@ const char *materialForZone(ZoneType zone) {
 }
 
 // Emit a single material block to an MTL stream.
-void writeMaterial(std::ofstream &mtl, const std::string &name,
+void writeMaterial(std::ostream &mtl, const std::string &name,
                    double r, double g, double b,
                    double ks, double shininess) {
     double ka = 0.25;
@@ -158,12 +165,38 @@ void writeMaterial(std::ofstream &mtl, const std::string &name,
 }
 
 bool writeMaterialsFile(const std::string &mtlPath) {
-    std::ofstream mtl(mtlPath);
+    OutputSink mtl(mtlPath);
     if (!mtl) return false;
     for (const auto &m : kMaterialPalette) {
         writeMaterial(mtl, m.name, m.r, m.g, m.b, m.ks, m.shininess);
     }
-    return true;
+    return mtl.close();
+}
+
+// Standard base64 encoding, used to embed the glTF buffer as a data URI
+// when the JSON is streamed and no companion .bin can be written.
+std::string base64Encode(const std::vector<std::uint8_t> &data) {
+    static const char kAlphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((data.size() + 2) / 3 * 4);
+    std::size_t i = 0;
+    for (; i + 2 < data.size(); i += 3) {
+        std::uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        out.push_back(kAlphabet[(v >> 18) & 63]);
+        out.push_back(kAlphabet[(v >> 12) & 63]);
+        out.push_back(kAlphabet[(v >> 6) & 63]);
+        out.push_back(kAlphabet[v & 63]);
+    }
+    if (i < data.size()) {
+        std::uint32_t v = data[i] << 16;
+        if (i + 1 < data.size()) v |= data[i + 1] << 8;
+        out.push_back(kAlphabet[(v >> 18) & 63]);
+        out.push_back(kAlphabet[(v >> 12) & 63]);
+        out.push_back(i + 1 < data.size() ? kAlphabet[(v >> 6) & 63] : '=');
+        out.push_back('=');
+    }
+    return out;
 }
 
 constexpr double kRoadThickness = 0.05;
@@ -180,15 +213,22 @@ Vec3 toGltfCoords(double x, double y, double z) {
     return {x, z, y};
 }
 
+// Per-material geometry; the arrays spill to scratch files under a memory
+// limit and the writers below stream from them either way.
 struct MeshBuffer {
-    std::vector<float> positions;
-    std::vector<float> normals;
-    std::vector<std::uint32_t> indices;
+    SpillVector<float> positions;
+    SpillVector<float> normals;
+    SpillVector<std::uint32_t> indices;
     bool hasBounds = false;
     std::array<double, 3> minPos{};
     std::array<double, 3> maxPos{};
 };
 
+struct MaterialMesh {
+    const MaterialDef *material;
+    MeshBuffer mesh;
+};
+
 void updateBounds(MeshBuffer &buf, const Vec3 &p) {
     if (!buf.hasBounds) {
         buf.minPos = {p.x, p.y, p.z};
@@ -266,27 +306,15 @@ void appendRectPrism(MeshBuffer &buf, const Rect &r,
     appendQuadPrism(buf, rectToQuad(r), baseZ, topZ);
 }
 
-} // namespace
-
-City::City(int s) : size(s) {
-    zones.resize(size * size, ZoneType::None);
-}
-
-void City::saveOBJ(const std::string &filename) const {
-    // Precompute and emit MTL palette
-    std::string mtlPath = replaceExtension(filename, ".mtl");
-    bool hasMtl = writeMaterialsFile(mtlPath);
-    std::string mtlName = filenameOnly(mtlPath);
-
-    std::ofstream ofs(filename);
-    if (!ofs) return;
-    if (hasMtl) {
-        ofs << "mtllib " << mtlName << "\n";
-    }
-    // Accumulate vertices and faces.  We write one object per parcel-based
-    // building for clarity, but the file can contain thousands of objects.
-    // A running vertex index is maintained to offset face indices.
-    std::size_t vertexOffset = 1;
+// Triangulate every parcel archetype and road into one buffer per material.
+// Shared by the glTF and shared-memory exporters; the result is in palette
+// order and skips materials without geometry, so indices are stable.
+std::vector<MaterialMesh> buildMaterialMeshes(const City &city, ExecutionContext *ctx) {
+    StageScope stage(ctx, "export", city.buildings.size() + city.roads.size());
+    std::unordered_map<std::string, MeshBuffer> meshByMaterial;
+    auto bufferFor = [&](const std::string &mat) -> MeshBuffer & {
+        return meshByMaterial[mat];
+    };
     auto boundsFromQuad = [](const Quad &q) {
         Rect r;
         r.x0 = r.x1 = q[0].first;
@@ -314,55 +342,53 @@ void City::saveOBJ(const std::string &filename) const {
     };
     auto emitStandard = [&](const Building &b) {
         double h = std::max(1.0, static_cast<double>(b.height));
-        writeQuadPrism(ofs, buildingQuad(b), 0.0, h, vertexOffset);
+        appendQuadPrism(bufferFor(materialForZone(b.zone)), buildingQuad(b), 0.0, h);
     };
     auto emitPark = [&](const Building &b) {
         Quad base = buildingQuad(b);
         Rect bounds = boundsFromQuad(base);
         double minDim = std::min(bounds.width(), bounds.height());
-        double marginFrac = 0.08;
-        double scale = std::max(0.2, 1.0 - 2.0 * marginFrac);
+        double scale = std::max(0.2, 1.0 - 0.16);
         Quad lawn = scaleQuad(base, scale);
         double padHeight = 0.08;
-        writeQuadPrism(ofs, lawn, 0.0, padHeight, vertexOffset);
+        appendQuadPrism(bufferFor("mat_green"), lawn, 0.0, padHeight);
         double baseScale = 0.3 + (0.2 / std::max(minDim, 1.0));
         double planterScale = std::clamp(baseScale, 0.25, 0.65);
         Quad planterA = scaleQuad(lawn, planterScale);
         Quad planterB = scaleQuad(lawn, 1.0 - planterScale * 0.5);
         double planterHeight = padHeight * 2.5;
-        writeQuadPrism(ofs, planterA, padHeight, padHeight + planterHeight, vertexOffset);
-        writeQuadPrism(ofs, planterB, padHeight, padHeight + planterHeight, vertexOffset);
+        appendQuadPrism(bufferFor("mat_green"), planterA, padHeight, padHeight + planterHeight);
+        appendQuadPrism(bufferFor("mat_green"), planterB, padHeight, padHeight + planterHeight);
     };
     auto emitSchool = [&](const Building &b) {
         Quad base = buildingQuad(b);
         Quad field = scaleQuad(base, 0.92);
         double fieldHeight = 0.05;
-        writeQuadPrism(ofs, field, 0.0, fieldHeight, vertexOffset);
-        Quad building = scaleQuad(base, 0.55);
+        appendQuadPrism(bufferFor(materialForZone(b.zone)), field, 0.0, fieldHeight);
+        Quad buildingRect = scaleQuad(base, 0.55);
         double schoolHeight = std::max(2.0, static_cast<double>(b.height));
-        writeQuadPrism(ofs, building, 0.0, schoolHeight, vertexOffset);
+        appendQuadPrism(bufferFor(materialForZone(b.zone)), buildingRect, 0.0, schoolHeight);
     };
     auto emitHospital = [&](const Building &b) {
         Quad base = buildingQuad(b);
         Quad podium = scaleQuad(base, 0.9);
         double podiumTop = std::max(1.2, static_cast<double>(b.height) * 0.25);
-        writeQuadPrism(ofs, podium, 0.0, podiumTop, vertexOffset);
+        appendQuadPrism(bufferFor(materialForZone(b.zone)), podium, 0.0, podiumTop);
         Quad main = scaleQuad(base, 0.65);
         double mainTop = std::max(podiumTop + 2.0, static_cast<double>(b.height));
-        writeQuadPrism(ofs, main, podiumTop, mainTop, vertexOffset);
+        appendQuadPrism(bufferFor(materialForZone(b.zone)), main, podiumTop, mainTop);
         Quad wing = scaleQuad(base, 0.45);
         double wingTop = std::max(podiumTop + 1.2, mainTop * 0.9);
-        writeQuadPrism(ofs, wing, podiumTop, wingTop, vertexOffset);
+        appendQuadPrism(bufferFor(materialForZone(b.zone)), wing, podiumTop, wingTop);
     };
-    for (const auto &b : buildings) {
+    for (const auto &b : city.buildings) {
+        stage.advance();
         if (b.zone == ZoneType::None) continue;
         if (b.zone == ZoneType::Green) {
-            ofs << "usemtl " << materialForZone(b.zone) << "\n";
             emitPark(b);
             continue;
         }
         if (b.facility) {
-            ofs << "usemtl " << materialForZone(b.zone) << "\n";
             if (b.facilityType == Facility::Type::Hospital) {
                 emitHospital(b);
             } else {
@@ -370,13 +396,10 @@ void City::saveOBJ(const std::string &filename) const {
             }
             continue;
         }
-        ofs << "usemtl " << materialForZone(b.zone) << "\n";
         emitStandard(b);
     }
-    // Roads: extrude each centreline into a thin rectangular prism so that
-    // the street hierarchy is visible in the 3D export.
-    for (const auto &road : roads) {
-        ofs << "usemtl mat_road\n";
+    for (const auto &road : city.roads) {
+        stage.advance();
         double dx = road.x2 - road.x1;
         double dy = road.y2 - road.y1;
         double len = std::sqrt(dx * dx + dy * dy);
@@ -387,22 +410,47 @@ void City::saveOBJ(const std::string &filename) const {
         double halfWidth = 0.5 * roadWidth(road.type);
         double hx = nx * halfWidth;
         double hy = ny * halfWidth;
-        std::array<std::pair<double, double>, 4> base = {{
-            {road.x1 + hx, road.y1 + hy},
-            {road.x1 - hx, road.y1 - hy},
-            {road.x2 - hx, road.y2 - hy},
-            {road.x2 + hx, road.y2 + hy}
-        }};
-        writeQuadPrism(ofs, base, 0.0, kRoadThickness, vertexOffset);
+        Rect base{road.x1 + hx, road.y1 + hy, road.x2 - hx, road.y2 - hy};
+        // Base rectangle might flip if hx/hy reorder bounds; normalise bounds.
+        if (base.x0 > base.x1) std::swap(base.x0, base.x1);
+        if (base.y0 > base.y1) std::swap(base.y0, base.y1);
+        appendRectPrism(bufferFor("mat_road"), base, 0.0, kRoadThickness);
+    }
+
+    std::vector<MaterialMesh> meshes;
+    for (const auto &def : kMaterialPalette) {
+        auto it = meshByMaterial.find(def.name);
+        if (it != meshByMaterial.end() && !it->second.indices.empty()) {
+            meshes.push_back({&def, std::move(it->second)});
+        }
     }
-    ofs.close();
+    return meshes;
 }
 
-void City::saveGLTF(const std::string &filename, bool binary) const {
-    std::unordered_map<std::string, MeshBuffer> meshByMaterial;
-    auto bufferFor = [&](const std::string &mat) -> MeshBuffer & {
-        return meshByMaterial[mat];
-    };
+} // namespace
+
+City::City(int s, GridLayout zoneLayout) : size(s) {
+    zones.reset(size, zoneLayout, ZoneType::None);
+}
+
+bool City::saveOBJ(const std::string &filename, ExecutionContext *ctx) const {
+    // Precompute and emit MTL palette.  Streamed output has nowhere to put
+    // a companion file, so it carries usemtl names without a library.
+    bool streamed = isStreamTarget(filename);
+    std::string mtlPath = replaceExtension(filename, ".mtl");
+    bool hasMtl = !streamed && writeMaterialsFile(mtlPath);
+    std::string mtlName = filenameOnly(mtlPath);
+
+    OutputSink ofs(filename);
+    if (!ofs) return false;
+    StageScope stage(ctx, "export", buildings.size() + roads.size());
+    if (hasMtl) {
+        ofs << "mtllib " << mtlName << "\n";
+    }
+    // Accumulate vertices and faces.  We write one object per parcel-based
+    // building for clarity, but the file can contain thousands of objects.
+    // A running vertex index is maintained to offset face indices.
+    std::size_t vertexOffset = 1;
     auto boundsFromQuad = [](const Quad &q) {
         Rect r;
         r.x0 = r.x1 = q[0].first;
@@ -430,52 +478,56 @@ void City::saveGLTF(const std::string &filename, bool binary) const {
     };
     auto emitStandard = [&](const Building &b) {
         double h = std::max(1.0, static_cast<double>(b.height));
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), buildingQuad(b), 0.0, h);
+        writeQuadPrism(ofs, buildingQuad(b), 0.0, h, vertexOffset);
     };
     auto emitPark = [&](const Building &b) {
         Quad base = buildingQuad(b);
         Rect bounds = boundsFromQuad(base);
         double minDim = std::min(bounds.width(), bounds.height());
-        double scale = std::max(0.2, 1.0 - 0.16);
+        double marginFrac = 0.08;
+        double scale = std::max(0.2, 1.0 - 2.0 * marginFrac);
         Quad lawn = scaleQuad(base, scale);
         double padHeight = 0.08;
-        appendQuadPrism(bufferFor("mat_green"), lawn, 0.0, padHeight);
+        writeQuadPrism(ofs, lawn, 0.0, padHeight, vertexOffset);
         double baseScale = 0.3 + (0.2 / std::max(minDim, 1.0));
         double planterScale = std::clamp(baseScale, 0.25, 0.65);
         Quad planterA = scaleQuad(lawn, planterScale);
         Quad planterB = scaleQuad(lawn, 1.0 - planterScale * 0.5);
         double planterHeight = padHeight * 2.5;
-        appendQuadPrism(bufferFor("mat_green"), planterA, padHeight, padHeight + planterHeight);
-        appendQuadPrism(bufferFor("mat_green"), planterB, padHeight, padHeight + planterHeight);
+        writeQuadPrism(ofs, planterA, padHeight, padHeight + planterHeight, vertexOffset);
+        writeQuadPrism(ofs, planterB, padHeight, padHeight + planterHeight, vertexOffset);
     };
     auto emitSchool = [&](const Building &b) {
         Quad base = buildingQuad(b);
         Quad field = scaleQuad(base, 0.92);
         double fieldHeight = 0.05;
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), field, 0.0, fieldHeight);
-        Quad buildingRect = scaleQuad(base, 0.55);
+        writeQuadPrism(ofs, field, 0.0, fieldHeight, vertexOffset);
+        Quad building = scaleQuad(base, 0.55);
         double schoolHeight = std::max(2.0, static_cast<double>(b.height));
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), buildingRect, 0.0, schoolHeight);
+        writeQuadPrism(ofs, building, 0.0, schoolHeight, vertexOffset);
     };
     auto emitHospital = [&](const Building &b) {
         Quad base = buildingQuad(b);
         Quad podium = scaleQuad(base, 0.9);
         double podiumTop = std::max(1.2, static_cast<double>(b.height) * 0.25);
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), podium, 0.0, podiumTop);
+        writeQuadPrism(ofs, podium, 0.0, podiumTop, vertexOffset);
         Quad main = scaleQuad(base, 0.65);
         double mainTop = std::max(podiumTop + 2.0, static_cast<double>(b.height));
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), main, podiumTop, mainTop);
+        writeQuadPrism(ofs, main, podiumTop, mainTop, vertexOffset);
         Quad wing = scaleQuad(base, 0.45);
         double wingTop = std::max(podiumTop + 1.2, mainTop * 0.9);
-        appendQuadPrism(bufferFor(materialForZone(b.zone)), wing, podiumTop, wingTop);
+        writeQuadPrism(ofs, wing, podiumTop, wingTop, vertexOffset);
     };
     for (const auto &b : buildings) {
+        stage.advance();
         if (b.zone == ZoneType::None) continue;
         if (b.zone == ZoneType::Green) {
+            ofs << "usemtl " << materialForZone(b.zone) << "\n";
             emitPark(b);
             continue;
         }
         if (b.facility) {
+            ofs << "usemtl " << materialForZone(b.zone) << "\n";
             if (b.facilityType == Facility::Type::Hospital) {
                 emitHospital(b);
             } else {
@@ -483,9 +535,14 @@ void City::saveGLTF(const std::string &filename, bool binary) const {
             }
             continue;
         }
+        ofs << "usemtl " << materialForZone(b.zone) << "\n";
         emitStandard(b);
     }
+    // Roads: extrude each centreline into a thin rectangular prism so that
+    // the street hierarchy is visible in the 3D export.
     for (const auto &road : roads) {
+        stage.advance();
+        ofs << "usemtl mat_road\n";
         double dx = road.x2 - road.x1;
         double dy = road.y2 - road.y1;
         double len = std::sqrt(dx * dx + dy * dy);
@@ -496,24 +553,19 @@ void City::saveGLTF(const std::string &filename, bool binary) const {
         double halfWidth = 0.5 * roadWidth(road.type);
         double hx = nx * halfWidth;
         double hy = ny * halfWidth;
-        Rect base{road.x1 + hx, road.y1 + hy, road.x2 - hx, road.y2 - hy};
-        // Base rectangle might flip if hx/hy reorder bounds; normalise bounds.
-        if (base.x0 > base.x1) std::swap(base.x0, base.x1);
-        if (base.y0 > base.y1) std::swap(base.y0, base.y1);
-        appendRectPrism(bufferFor("mat_road"), base, 0.0, kRoadThickness);
+        std::array<std::pair<double, double>, 4> base = {{
+            {road.x1 + hx, road.y1 + hy},
+            {road.x1 - hx, road.y1 - hy},
+            {road.x2 - hx, road.y2 - hy},
+            {road.x2 + hx, road.y2 + hy}
+        }};
+        writeQuadPrism(ofs, base, 0.0, kRoadThickness, vertexOffset);
     }
+    return ofs.close();
+}
 
-    // Collect used materials in palette order so indices are stable.
-    std::vector<const MaterialDef *> materials;
-    std::unordered_map<std::string, int> materialIndex;
-    for (const auto &def : kMaterialPalette) {
-        auto it = meshByMaterial.find(def.name);
-        if (it != meshByMaterial.end() && !it->second.indices.empty()) {
-            int idx = static_cast<int>(materials.size());
-            materials.push_back(&def);
-            materialIndex[def.name] = idx;
-        }
-    }
+bool City::saveGLTF(const std::string &filename, bool binary, ExecutionContext *ctx) const {
+    std::vector<MaterialMesh> meshes = buildMaterialMeshes(*this, ctx);
 
     struct ViewInfo { std::size_t offset; std::size_t length; int target; };
     struct AccessorInfo {
@@ -533,25 +585,25 @@ void City::saveGLTF(const std::string &filename, bool binary) const {
         std::string name;
     };
 
-    std::vector<std::uint8_t> binData;
-    auto align4 = [&](std::vector<std::uint8_t> &v) {
-        while (v.size() % 4 != 0) v.push_back(0);
-    };
+    // The binary buffer is described as a list of views into the mesh
+    // buffers rather than copied into one contiguous block; each writer
+    // below streams the chunks straight from their source vectors.
+    struct BinChunk { const std::uint8_t *data; std::size_t length; std::size_t offset; };
+    std::vector<BinChunk> binChunks;
+    std::size_t binSize = 0;
     auto appendBytes = [&](const void *ptr, std::size_t len) -> std::size_t {
-        align4(binData);
-        std::size_t offset = binData.size();
-        const auto *bytes = reinterpret_cast<const std::uint8_t *>(ptr);
-        binData.insert(binData.end(), bytes, bytes + len);
+        binSize = (binSize + 3) & ~std::size_t(3);
+        std::size_t offset = binSize;
+        binChunks.push_back({reinterpret_cast<const std::uint8_t *>(ptr), len, offset});
+        binSize += len;
         return offset;
     };
     std::vector<ViewInfo> views;
     std::vector<AccessorInfo> accessors;
     std::vector<MeshPrimitive> primitives;
 
-    for (const auto *mat : materials) {
-        auto it = meshByMaterial.find(mat->name);
-        if (it == meshByMaterial.end()) continue;
-        const MeshBuffer &buf = it->second;
+    for (std::size_t m = 0; m < meshes.size(); ++m) {
+        const MeshBuffer &buf = meshes[m].mesh;
         if (buf.indices.empty() || buf.positions.empty()) continue;
         // positions
         std::size_t posOffset = appendBytes(buf.positions.data(), buf.positions.size() * sizeof(float));
@@ -593,8 +645,8 @@ void City::saveGLTF(const std::string &filename, bool binary) const {
         prim.positionAccessor = static_cast<int>(posAccessor);
         prim.normalAccessor = static_cast<int>(normAccessor);
         prim.indexAccessor = static_cast<int>(idxAccessor);
-        prim.material = materialIndex[mat->name];
-        prim.name = mat->name;
+        prim.material = static_cast<int>(m);
+        prim.name = meshes[m].material->name;
         primitives.push_back(prim);
     }
 
@@ -619,9 +671,9 @@ void City::saveGLTF(const std::string &filename, bool binary) const {
     oss << "],";
     // materials
     oss << "\"materials\":[";
-    for (std::size_t i = 0; i < materials.size(); ++i) {
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
         if (i) oss << ",";
-        const auto *m = materials[i];
+        const auto *m = meshes[i].material;
         oss << "{\"name\":\"" << m->name << "\",";
         oss << "\"pbrMetallicRoughness\":{\"baseColorFactor\":["
             << m->r << "," << m->g << "," << m->b << ",1],";
@@ -672,136 +724,200 @@ void City::saveGLTF(const std::string &filename, bool binary) const {
     }
     oss << "],";
     // buffers
+    binSize = (binSize + 3) & ~std::size_t(3);
+    bool streamed = isStreamTarget(filename);
     std::string binFilename = replaceExtension(filename, ".bin");
     oss << "\"buffers\":[{";
-    oss << "\"byteLength\":" << binData.size();
-    if (!binary) {
+    oss << "\"byteLength\":" << binSize;
+    if (!binary && streamed) {
+        std::vector<std::uint8_t> binData(binSize, 0);
+        for (const auto &c : binChunks) std::memcpy(binData.data() + c.offset, c.data, c.length);
+        oss << ",\"uri\":\"data:application/octet-stream;base64," << base64Encode(binData) << "\"";
+    } else if (!binary) {
         oss << ",\"uri\":\"" << filenameOnly(binFilename) << "\"";
     }
     oss << "}]}";
     std::string json = oss.str();
 
+    // Regular files take the chunks through the asynchronous writer at
+    // their final offsets (gaps are alignment padding and read as zero).
+    auto writeChunksAsync = [&](AsyncFileWriter &out, std::uint64_t base) {
+        for (const auto &c : binChunks) out.write(c.data, c.length, base + c.offset);
+    };
+    // Streams have no random access, so padding is written explicitly.
+    auto writeChunksSequential = [&](std::ostream &out) {
+        static const char zeros[4] = {0, 0, 0, 0};
+        std::size_t pos = 0;
+        for (const auto &c : binChunks) {
+            out.write(zeros, static_cast<std::streamsize>(c.offset - pos));
+            out.write(reinterpret_cast<const char *>(c.data), static_cast<std::streamsize>(c.length));
+            pos = c.offset + c.length;
+        }
+        out.write(zeros, static_cast<std::streamsize>(binSize - pos));
+    };
+
     if (binary) {
         // Write GLB (JSON + BIN)
-        std::ofstream ofs(filename, std::ios::binary);
-        if (!ofs) return;
         // Pad JSON to 4-byte boundary with spaces
+        std::vector<std::uint8_t> head;
         std::vector<std::uint8_t> jsonBytes(json.begin(), json.end());
         while (jsonBytes.size() % 4 != 0) jsonBytes.push_back(0x20);
-        align4(binData);
         std::uint32_t totalLength = 12 // header
             + 8 + static_cast<std::uint32_t>(jsonBytes.size())
-            + 8 + static_cast<std::uint32_t>(binData.size());
-        ofs.write("glTF", 4);
-        std::uint32_t version = 2;
-        ofs.write(reinterpret_cast<const char *>(&version), sizeof(version));
-        ofs.write(reinterpret_cast<const char *>(&totalLength), sizeof(totalLength));
-        std::uint32_t jsonLength = static_cast<std::uint32_t>(jsonBytes.size());
-        std::uint32_t jsonType = 0x4E4F534Au; // JSON
-        ofs.write(reinterpret_cast<const char *>(&jsonLength), sizeof(jsonLength));
-        ofs.write(reinterpret_cast<const char *>(&jsonType), sizeof(jsonType));
-        ofs.write(reinterpret_cast<const char *>(jsonBytes.data()), jsonBytes.size());
-        std::uint32_t binLength = static_cast<std::uint32_t>(binData.size());
-        std::uint32_t binType = 0x004E4942u; // BIN
-        ofs.write(reinterpret_cast<const char *>(&binLength), sizeof(binLength));
-        ofs.write(reinterpret_cast<const char *>(&binType), sizeof(binType));
-        ofs.write(reinterpret_cast<const char *>(binData.data()), binData.size());
+            + 8 + static_cast<std::uint32_t>(binSize);
+        auto putU32 = [&](std::uint32_t v) {
+            const auto *p = reinterpret_cast<const std::uint8_t *>(&v);
+            head.insert(head.end(), p, p + sizeof(v));
+        };
+        head.insert(head.end(), {'g', 'l', 'T', 'F'});
+        putU32(2); // version
+        putU32(totalLength);
+        putU32(static_cast<std::uint32_t>(jsonBytes.size()));
+        putU32(0x4E4F534Au); // JSON
+        head.insert(head.end(), jsonBytes.begin(), jsonBytes.end());
+        putU32(static_cast<std::uint32_t>(binSize));
+        putU32(0x004E4942u); // BIN
+        if (streamed) {
+            OutputSink ofs(filename);
+            if (!ofs) return false;
+            ofs.write(reinterpret_cast<const char *>(head.data()), static_cast<std::streamsize>(head.size()));
+            writeChunksSequential(ofs);
+            return ofs.close();
+        } else {
+            AsyncFileWriter out(filename);
+            if (!out.isOpen()) return false;
+            out.write(head.data(), head.size(), 0);
+            writeChunksAsync(out, head.size());
+            // Materialise trailing padding so the file has its full length.
+            if (binSize > 0) {
+                std::uint8_t zero = 0;
+                std::size_t lastEnd = binChunks.empty() ? 0 : binChunks.back().offset + binChunks.back().length;
+                if (lastEnd < binSize) out.write(&zero, 1, head.size() + binSize - 1);
+            }
+            return out.finish();
+        }
+    } else if (streamed) {
+        OutputSink gltfOut(filename);
+        if (!gltfOut) return false;
+        gltfOut << json;
+        return gltfOut.close();
     } else {
-        align4(binData);
-        std::ofstream binOut(binFilename, std::ios::binary);
-        if (!binOut) return;
-        binOut.write(reinterpret_cast<const char *>(binData.data()),
-                     static_cast<std::streamsize>(binData.size()));
-        binOut.close();
-        std::ofstream gltfOut(filename);
-        if (!gltfOut) return;
+        {
+            AsyncFileWriter binOut(binFilename);
+            if (!binOut.isOpen()) return false;
+            writeChunksAsync(binOut, 0);
+            if (!binOut.finish()) return false;
+        }
+        OutputSink gltfOut(filename);
+        if (!gltfOut) return false;
         gltfOut << json;
+        return gltfOut.close();
     }
 }
 
-void City::saveSummary(const std::string &filename) const {
-    std::ofstream ofs(filename);
-    if (!ofs) return;
-    // Count metrics
-    std::size_t countResidential = 0;
-    std::size_t countCommercial = 0;
-    std::size_t countIndustrial = 0;
-    std::size_t countGreen = 0;
-    std::size_t countUndeveloped = 0;
-    std::size_t totalBuildings = 0;
-    int maxResidentialHeight = 0;
-    int maxCommercialHeight = 0;
-    int maxIndustrialHeight = 0;
-    for (const auto z : zones) {
-        if (z == ZoneType::None) { countUndeveloped++; continue; }
-        if (z == ZoneType::Residential) countResidential++;
-        else if (z == ZoneType::Commercial) countCommercial++;
-        else if (z == ZoneType::Industrial) countIndustrial++;
-        else if (z == ZoneType::Green) countGreen++;
-    }
-    std::vector<std::pair<double, double>> schoolPos;
-    std::vector<std::pair<double, double>> hospitalPos;
-    schoolPos.reserve(facilities.size());
-    hospitalPos.reserve(facilities.size());
-    for (const auto &f : facilities) {
-        if (f.type == Facility::Type::School) schoolPos.push_back({f.x, f.y});
-        else if (f.type == Facility::Type::Hospital) hospitalPos.push_back({f.x, f.y});
-    }
-    auto nearest = [](double x, double y, const std::vector<std::pair<double, double>> &pts) {
-        if (pts.empty()) return -1.0;
-        double best = std::numeric_limits<double>::max();
-        for (const auto &p : pts) {
-            double dx = x - p.first;
-            double dy = y - p.second;
-            double d = std::sqrt(dx * dx + dy * dy);
-            if (d < best) best = d;
-        }
-        return best;
+bool City::saveSummary(const std::string &filename, ExecutionContext *ctx) const {
+    CitySummary summary = computeSummary(*this, ctx);
+    OutputSink ofs(filename);
+    if (!ofs) return false;
+    ofs << summaryToJson(summary);
+    return ofs.close();
+}
+
+std::uint64_t City::saveSharedMemory(const std::string &name, ExecutionContext *ctx) const {
+    std::vector<MaterialMesh> meshes = buildMaterialMeshes(*this, ctx);
+    std::string summary = summaryToJson(computeSummary(*this, ctx));
+
+    // Structs are split into columns of plain numbers so consumers can view
+    // each one as a typed array without knowing the C++ layout.
+    std::vector<SharedSection> sections;
+    auto add = [&](const char *sectionName, SharedType type, std::uint32_t components,
+                   std::uint64_t count, std::function<void(void *)> fill) {
+        sections.push_back({sectionName, type, components, count, std::move(fill)});
     };
-    double maxDistSchool = -1.0;
-    double maxDistHospital = -1.0;
-    for (const auto &b : buildings) {
-        if (b.zone != ZoneType::None && b.zone != ZoneType::Green) {
-            totalBuildings++;
+    add("zones", SharedType::UInt8, 1, zones.size(), [&](void *dst) {
+        auto *out = static_cast<std::uint8_t *>(dst);
+        for (int y = 0; y < size; ++y) {
+            zones.forEachRowSpan(y, [&](int, const ZoneType *span, int n) {
+                for (int k = 0; k < n; ++k) *out++ = static_cast<std::uint8_t>(span[k]);
+            });
         }
-        if (b.zone == ZoneType::Residential) {
-            maxResidentialHeight = std::max(maxResidentialHeight, b.height);
-            if (!schoolPos.empty()) {
-                double d = nearest(b.footprint.centreX(), b.footprint.centreY(), schoolPos);
-                if (d > maxDistSchool) maxDistSchool = d;
-            }
-            if (!hospitalPos.empty()) {
-                double d = nearest(b.footprint.centreX(), b.footprint.centreY(), hospitalPos);
-                if (d > maxDistHospital) maxDistHospital = d;
-            }
-        } else if (b.zone == ZoneType::Commercial) {
-            maxCommercialHeight = std::max(maxCommercialHeight, b.height);
-        } else if (b.zone == ZoneType::Industrial) {
-            maxIndustrialHeight = std::max(maxIndustrialHeight, b.height);
+    });
+    // Generation-order IDs, stable under --spatial-order.
+    add("building_id", SharedType::UInt32, 1, buildings.size(), [&](void *dst) {
+        auto *out = static_cast<std::uint32_t *>(dst);
+        for (std::size_t i = 0; i < buildings.size(); ++i) *out++ = buildingId(i);
+    });
+    add("building_footprint", SharedType::Float64, 4, buildings.size(), [&](void *dst) {
+        auto *out = static_cast<double *>(dst);
+        for (const auto &b : buildings) {
+            *out++ = b.footprint.x0; *out++ = b.footprint.y0;
+            *out++ = b.footprint.x1; *out++ = b.footprint.y1;
         }
+    });
+    add("building_corners", SharedType::Float64, 8, buildings.size(), [&](void *dst) {
+        auto *out = static_cast<double *>(dst);
+        for (const auto &b : buildings) {
+            for (const auto &p : buildingQuad(b)) { *out++ = p.first; *out++ = p.second; }
+        }
+    });
+    add("building_height", SharedType::Int32, 1, buildings.size(), [&](void *dst) {
+        auto *out = static_cast<std::int32_t *>(dst);
+        for (const auto &b : buildings) *out++ = b.height;
+    });
+    add("building_zone", SharedType::UInt8, 1, buildings.size(), [&](void *dst) {
+        auto *out = static_cast<std::uint8_t *>(dst);
+        for (const auto &b : buildings) *out++ = static_cast<std::uint8_t>(b.zone);
+    });
+    // 0 = none, otherwise 1 + Facility::Type.
+    add("building_facility", SharedType::UInt8, 1, buildings.size(), [&](void *dst) {
+        auto *out = static_cast<std::uint8_t *>(dst);
+        for (const auto &b : buildings) {
+            *out++ = b.facility ? static_cast<std::uint8_t>(1 + static_cast<int>(b.facilityType)) : 0;
+        }
+    });
+    add("facility_position", SharedType::Float64, 2, facilities.size(), [&](void *dst) {
+        auto *out = static_cast<double *>(dst);
+        for (const auto &f : facilities) { *out++ = f.x; *out++ = f.y; }
+    });
+    add("facility_type", SharedType::UInt8, 1, facilities.size(), [&](void *dst) {
+        auto *out = static_cast<std::uint8_t *>(dst);
+        for (const auto &f : facilities) *out++ = static_cast<std::uint8_t>(f.type);
+    });
+    add("road_segment", SharedType::Float64, 4, roads.size(), [&](void *dst) {
+        auto *out = static_cast<double *>(dst);
+        for (const auto &r : roads) { *out++ = r.x1; *out++ = r.y1; *out++ = r.x2; *out++ = r.y2; }
+    });
+    add("road_type", SharedType::UInt8, 1, roads.size(), [&](void *dst) {
+        auto *out = static_cast<std::uint8_t *>(dst);
+        for (const auto &r : roads) *out++ = static_cast<std::uint8_t>(r.type);
+    });
+    add("block_bounds", SharedType::Float64, 4, blocks.size(), [&](void *dst) {
+        auto *out = static_cast<double *>(dst);
+        for (const auto &b : blocks) {
+            *out++ = b.bounds.x0; *out++ = b.bounds.y0; *out++ = b.bounds.x1; *out++ = b.bounds.y1;
+        }
+    });
+    add("summary", SharedType::Text, 1, summary.size(), [&](void *dst) {
+        std::memcpy(dst, summary.data(), summary.size());
+    });
+    // Mesh sections use the glTF conventions: Y-up float positions and
+    // normals, u32 triangle indices.
+    for (const auto &m : meshes) {
+        const MeshBuffer *buf = &m.mesh;
+        std::string prefix = std::string("mesh/") + m.material->name + "/";
+        sections.push_back({prefix + "positions", SharedType::Float32, 3, buf->positions.size() / 3,
+                            [buf](void *dst) {
+                                std::memcpy(dst, buf->positions.data(), buf->positions.size() * sizeof(float));
+                            }});
+        sections.push_back({prefix + "normals", SharedType::Float32, 3, buf->normals.size() / 3,
+                            [buf](void *dst) {
+                                std::memcpy(dst, buf->normals.data(), buf->normals.size() * sizeof(float));
+                            }});
+        sections.push_back({prefix + "indices", SharedType::UInt32, 1, buf->indices.size(),
+                            [buf](void *dst) {
+                                std::memcpy(dst, buf->indices.data(),
+                                            buf->indices.size() * sizeof(std::uint32_t));
+                            }});
     }
-    std::size_t countHospitals = 0;
-    std::size_t countSchools = 0;
-    for (const auto &f : facilities) {
-        if (f.type == Facility::Type::Hospital) countHospitals++;
-        else if (f.type == Facility::Type::School) countSchools++;
-    }
-    // Write JSON.  Note: this is simplistic and not pretty‑printed.
-    ofs << "{\n";
-    ofs << "  \"gridSize\": " << size << ",\n";
-    ofs << "  \"totalBuildings\": " << totalBuildings << ",\n";
-    ofs << "  \"residentialCells\": " << countResidential << ",\n";
-    ofs << "  \"commercialCells\": " << countCommercial << ",\n";
-    ofs << "  \"industrialCells\": " << countIndustrial << ",\n";
-    ofs << "  \"greenCells\": " << countGreen << ",\n";
-    ofs << "  \"undevelopedCells\": " << countUndeveloped << ",\n";
-    ofs << "  \"numHospitals\": " << countHospitals << ",\n";
-    ofs << "  \"numSchools\": " << countSchools << ",\n";
-    ofs << "  \"maxDistanceToSchool\": " << maxDistSchool << ",\n";
-    ofs << "  \"maxDistanceToHospital\": " << maxDistHospital << ",\n";
-    ofs << "  \"maxResidentialHeight\": " << maxResidentialHeight << ",\n";
-    ofs << "  \"maxCommercialHeight\": " << maxCommercialHeight << ",\n";
-    ofs << "  \"maxIndustrialHeight\": " << maxIndustrialHeight << "\n";
-    ofs << "}";
-    ofs.close();
+    return writeSharedSegment(name, size, sections, ctx);
 }
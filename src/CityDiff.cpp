@@ -0,0 +1,445 @@
+#include "CityDiff.h"
+#include "JsonWriter.h"
+#include "Output.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+constexpr std::size_t kNone = std::numeric_limits<std::size_t>::max();
+
+struct Point {
+    double x;
+    double y;
+};
+
+// Spatial hash join: match[i] is the index in b paired with a[i], or kNone.
+// same(i, j) tells whether a[i] and b[j] are identical features.
+template <typename Same>
+std::vector<std::size_t> matchFeatures(const std::vector<Point> &a, const std::vector<Point> &b,
+                                       double tolerance, Same same) {
+    std::vector<std::size_t> match(a.size(), kNone);
+    std::vector<bool> taken(b.size(), false);
+    // Regenerating with small changes mostly leaves features in place and
+    // in order, so identical features at the same index pair up first.
+    std::size_t common = std::min(a.size(), b.size());
+    for (std::size_t i = 0; i < common; ++i) {
+        if (same(i, i)) {
+            match[i] = i;
+            taken[i] = true;
+        }
+    }
+    auto cellOf = [&](double v) { return static_cast<std::int64_t>(std::floor(v / tolerance)); };
+    auto keyOf = [](std::int64_t cx, std::int64_t cy) {
+        const std::int64_t bias = std::int64_t(1) << 31;
+        return (static_cast<std::uint64_t>(cx + bias) << 32) |
+               static_cast<std::uint64_t>(static_cast<std::uint32_t>(cy + bias));
+    };
+    std::vector<std::pair<std::uint64_t, std::size_t>> buckets;
+    for (std::size_t j = 0; j < b.size(); ++j) {
+        if (!taken[j]) buckets.emplace_back(keyOf(cellOf(b[j].x), cellOf(b[j].y)), j);
+    }
+    std::sort(buckets.begin(), buckets.end());
+    const double maxDist2 = tolerance * tolerance;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (match[i] != kNone) continue;
+        std::int64_t cx = cellOf(a[i].x);
+        std::int64_t cy = cellOf(a[i].y);
+        std::size_t best = kNone;
+        double bestDist2 = maxDist2;
+        for (std::int64_t dy = -1; dy <= 1; ++dy) {
+            for (std::int64_t dx = -1; dx <= 1; ++dx) {
+                std::uint64_t key = keyOf(cx + dx, cy + dy);
+                auto it = std::lower_bound(buckets.begin(), buckets.end(),
+                                           std::make_pair(key, std::size_t(0)));
+                for (; it != buckets.end() && it->first == key; ++it) {
+                    std::size_t j = it->second;
+                    if (taken[j]) continue;
+                    double ex = a[i].x - b[j].x;
+                    double ey = a[i].y - b[j].y;
+                    double d2 = ex * ex + ey * ey;
+                    if (d2 < bestDist2 || (d2 == bestDist2 && (best == kNone || j < best))) {
+                        best = j;
+                        bestDist2 = d2;
+                    }
+                }
+            }
+        }
+        if (best != kNone) {
+            match[i] = best;
+            taken[best] = true;
+        }
+    }
+    return match;
+}
+
+// Fill counts and index lists from a match.
+template <typename Same>
+void classify(FeatureDiff &diff, std::size_t countA, std::size_t countB,
+              const std::vector<std::size_t> &match, Same same) {
+    diff.countA = countA;
+    diff.countB = countB;
+    std::vector<bool> matched(countB, false);
+    for (std::size_t i = 0; i < countA; ++i) {
+        std::size_t j = match[i];
+        if (j == kNone) {
+            diff.removedIndices.push_back(i);
+            continue;
+        }
+        matched[j] = true;
+        if (same(i, j)) {
+            diff.unchanged++;
+        } else {
+            diff.modifiedPairs.emplace_back(i, j);
+        }
+    }
+    for (std::size_t j = 0; j < countB; ++j) {
+        if (!matched[j]) diff.addedIndices.push_back(j);
+    }
+    diff.modified = diff.modifiedPairs.size();
+    diff.removed = diff.removedIndices.size();
+    diff.added = diff.addedIndices.size();
+}
+
+bool sameRect(const Rect &a, const Rect &b) {
+    return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+}
+
+bool sameShape(const Building &a, const Building &b) {
+    if (!sameRect(a.footprint, b.footprint) || a.hasCorners != b.hasCorners) return false;
+    if (!a.hasCorners) return true;
+    for (int k = 0; k < 4; ++k) {
+        if (a.corners[k].x != b.corners[k].x || a.corners[k].y != b.corners[k].y) return false;
+    }
+    return true;
+}
+
+bool sameFacility(const Building &a, const Building &b) {
+    return a.facility == b.facility && (!a.facility || a.facilityType == b.facilityType);
+}
+
+bool sameBuilding(const Building &a, const Building &b) {
+    return a.zone == b.zone && a.height == b.height && sameFacility(a, b) && sameShape(a, b);
+}
+
+bool sameRoad(const RoadSegment &a, const RoadSegment &b) {
+    if (a.type != b.type) return false;
+    bool forward = a.x1 == b.x1 && a.y1 == b.y1 && a.x2 == b.x2 && a.y2 == b.y2;
+    bool reverse = a.x1 == b.x2 && a.y1 == b.y2 && a.x2 == b.x1 && a.y2 == b.y1;
+    return forward || reverse;
+}
+
+// Zone grids: XOR a word at a time, then fold each cell's bits onto its
+// lowest bit and popcount those.  Only differing words are decoded.  Both
+// grids are walked in storage order, so b is first brought into a's layout;
+// tile padding is None in both and never counts as a change.
+void diffZones(const City &a, const City &b, CityDiff &diff) {
+    constexpr std::size_t kCell = sizeof(ZoneType);
+    static_assert(8 % kCell == 0, "zone cells must tile a 64-bit word");
+    constexpr std::size_t kPerWord = 8 / kCell;
+    std::uint64_t lowBits = 0;
+    for (std::size_t k = 0; k < kPerWord; ++k) lowBits |= std::uint64_t(1) << (k * kCell * 8);
+
+    ZoneGrid relaid;
+    const ZoneGrid *bz = &b.zones;
+    if (b.zones.layout() != a.zones.layout()) {
+        relaid = b.zones;
+        relaid.setLayout(a.zones.layout());
+        bz = &relaid;
+    }
+    const ZoneType *za = a.zones.data();
+    const ZoneType *zb = bz->data();
+    const std::size_t cells = a.zones.storageSize();
+    const auto *pa = reinterpret_cast<const unsigned char *>(za);
+    const auto *pb = reinterpret_cast<const unsigned char *>(zb);
+    auto transition = [&](std::size_t i) {
+        auto from = static_cast<std::size_t>(za[i]);
+        auto to = static_cast<std::size_t>(zb[i]);
+        if (from < 5 && to < 5) diff.zoneTransitions[from][to]++;
+    };
+    std::size_t words = cells / kPerWord;
+    std::uint64_t changed = 0;
+    for (std::size_t w = 0; w < words; ++w) {
+        std::uint64_t x, y;
+        std::memcpy(&x, pa + w * 8, 8);
+        std::memcpy(&y, pb + w * 8, 8);
+        x ^= y;
+        if (!x) continue;
+        for (std::size_t shift = 1; shift < kCell * 8; shift <<= 1) x |= x >> shift;
+        changed += static_cast<std::uint64_t>(__builtin_popcountll(x & lowBits));
+        for (std::size_t i = w * kPerWord; i < (w + 1) * kPerWord; ++i) {
+            if (za[i] != zb[i]) transition(i);
+        }
+    }
+    for (std::size_t i = words * kPerWord; i < cells; ++i) {
+        if (za[i] != zb[i]) {
+            changed++;
+            transition(i);
+        }
+    }
+    diff.zoneCells = a.zones.size();
+    diff.zoneCellsChanged = changed;
+}
+
+// Opens the object for a feature kind; the caller may add fields and closes it.
+void writeFeatureCounts(JsonWriter &json, const char *name, const FeatureDiff &d) {
+    json.key(name);
+    json.beginObject();
+    json.field("a", d.countA);
+    json.field("b", d.countB);
+    json.field("unchanged", d.unchanged);
+    json.field("modified", d.modified);
+    json.field("added", d.added);
+    json.field("removed", d.removed);
+}
+
+// GeoJSON helpers.
+void beginFeature(JsonWriter &json, const char *kind, const char *change) {
+    json.beginObject();
+    json.field("type", "Feature");
+    json.key("properties");
+    json.beginObject();
+    json.field("kind", kind);
+    json.field("change", change);
+}
+
+void buildingGeometry(JsonWriter &json, const Building &b) {
+    std::array<Vec2, 4> ring = b.corners;
+    if (!b.hasCorners) {
+        ring = {Vec2{b.footprint.x0, b.footprint.y0}, Vec2{b.footprint.x1, b.footprint.y0},
+                Vec2{b.footprint.x1, b.footprint.y1}, Vec2{b.footprint.x0, b.footprint.y1}};
+    }
+    json.key("geometry");
+    json.beginObject();
+    json.field("type", "Polygon");
+    json.key("coordinates");
+    json.beginArray();
+    json.beginArray();
+    for (int k = 0; k <= 4; ++k) {
+        json.beginArray();
+        json.value(ring[k % 4].x);
+        json.value(ring[k % 4].y);
+        json.endArray();
+    }
+    json.endArray();
+    json.endArray();
+    json.endObject();
+}
+
+void roadGeometry(JsonWriter &json, const RoadSegment &r) {
+    json.key("geometry");
+    json.beginObject();
+    json.field("type", "LineString");
+    json.key("coordinates");
+    json.beginArray();
+    json.beginArray();
+    json.value(r.x1);
+    json.value(r.y1);
+    json.endArray();
+    json.beginArray();
+    json.value(r.x2);
+    json.value(r.y2);
+    json.endArray();
+    json.endArray();
+    json.endObject();
+}
+
+void pointGeometry(JsonWriter &json, const Facility &f) {
+    json.key("geometry");
+    json.beginObject();
+    json.field("type", "Point");
+    json.key("coordinates");
+    json.beginArray();
+    json.value(f.x);
+    json.value(f.y);
+    json.endArray();
+    json.endObject();
+}
+
+} // namespace
+
+bool CityDiff::identical() const {
+    auto same = [](const FeatureDiff &d) { return d.modified == 0 && d.added == 0 && d.removed == 0; };
+    return zonesComparable && zoneCellsChanged == 0 && same(buildings) && same(roads) && same(facilities);
+}
+
+CityDiff diffCities(const City &a, const City &b, double tolerance) {
+    CityDiff diff;
+    tolerance = std::max(tolerance, 1e-9);
+    diff.zonesComparable = a.size == b.size;
+    if (diff.zonesComparable) diffZones(a, b, diff);
+
+    {
+        auto centres = [](const City &c) {
+            std::vector<Point> pts;
+            pts.reserve(c.buildings.size());
+            for (const auto &bd : c.buildings) pts.push_back({bd.footprint.centreX(), bd.footprint.centreY()});
+            return pts;
+        };
+        auto same = [&](std::size_t i, std::size_t j) { return sameBuilding(a.buildings[i], b.buildings[j]); };
+        auto match = matchFeatures(centres(a), centres(b), tolerance, same);
+        classify(diff.buildings, a.buildings.size(), b.buildings.size(), match, same);
+        for (const auto &[i, j] : diff.buildings.modifiedPairs) {
+            const Building &ba = a.buildings[i];
+            const Building &bb = b.buildings[j];
+            if (!sameShape(ba, bb)) diff.buildingsMoved++;
+            if (ba.height != bb.height) diff.buildingsHeightChanged++;
+            if (ba.zone != bb.zone) diff.buildingsZoneChanged++;
+            if (!sameFacility(ba, bb)) diff.buildingsFacilityChanged++;
+        }
+    }
+    {
+        auto midpoints = [](const City &c) {
+            std::vector<Point> pts;
+            pts.reserve(c.roads.size());
+            for (const auto &r : c.roads) pts.push_back({(r.x1 + r.x2) * 0.5, (r.y1 + r.y2) * 0.5});
+            return pts;
+        };
+        auto same = [&](std::size_t i, std::size_t j) { return sameRoad(a.roads[i], b.roads[j]); };
+        auto match = matchFeatures(midpoints(a), midpoints(b), tolerance, same);
+        classify(diff.roads, a.roads.size(), b.roads.size(), match, same);
+    }
+    {
+        auto positions = [](const City &c) {
+            std::vector<Point> pts;
+            pts.reserve(c.facilities.size());
+            for (const auto &f : c.facilities) pts.push_back({f.x, f.y});
+            return pts;
+        };
+        auto same = [&](std::size_t i, std::size_t j) {
+            const Facility &fa = a.facilities[i];
+            const Facility &fb = b.facilities[j];
+            return fa.x == fb.x && fa.y == fb.y && fa.type == fb.type;
+        };
+        auto match = matchFeatures(positions(a), positions(b), tolerance, same);
+        classify(diff.facilities, a.facilities.size(), b.facilities.size(), match, same);
+    }
+    return diff;
+}
+
+std::string cityDiffToJson(const CityDiff &diff) {
+    std::string out;
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("identical", diff.identical());
+    json.key("zones");
+    json.beginObject();
+    json.field("comparable", diff.zonesComparable);
+    json.field("cells", diff.zoneCells);
+    json.field("changed", diff.zoneCellsChanged);
+    json.key("transitions");
+    json.beginArray();
+    for (std::size_t from = 0; from < 5; ++from) {
+        for (std::size_t to = 0; to < 5; ++to) {
+            if (!diff.zoneTransitions[from][to]) continue;
+            json.beginObject();
+            json.field("from", zoneName(static_cast<ZoneType>(from)));
+            json.field("to", zoneName(static_cast<ZoneType>(to)));
+            json.field("cells", diff.zoneTransitions[from][to]);
+            json.endObject();
+        }
+    }
+    json.endArray();
+    json.endObject();
+    writeFeatureCounts(json, "buildings", diff.buildings);
+    json.field("moved", diff.buildingsMoved);
+    json.field("heightChanged", diff.buildingsHeightChanged);
+    json.field("zoneChanged", diff.buildingsZoneChanged);
+    json.field("facilityChanged", diff.buildingsFacilityChanged);
+    json.endObject();
+    writeFeatureCounts(json, "roads", diff.roads);
+    json.endObject();
+    writeFeatureCounts(json, "facilities", diff.facilities);
+    json.endObject();
+    json.endObject();
+    out += '\n';
+    return out;
+}
+
+bool saveDiffLayer(const CityDiff &diff, const City &a, const City &b, const std::string &filename) {
+    std::string out;
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("type", "FeatureCollection");
+    json.key("features");
+    json.beginArray();
+    for (std::size_t i : diff.buildings.removedIndices) {
+        beginFeature(json, "building", "removed");
+        json.endObject();
+        buildingGeometry(json, a.buildings[i]);
+        json.endObject();
+    }
+    for (std::size_t j : diff.buildings.addedIndices) {
+        beginFeature(json, "building", "added");
+        json.endObject();
+        buildingGeometry(json, b.buildings[j]);
+        json.endObject();
+    }
+    for (const auto &[i, j] : diff.buildings.modifiedPairs) {
+        beginFeature(json, "building", "modified");
+        json.field("heightA", a.buildings[i].height);
+        json.field("heightB", b.buildings[j].height);
+        json.field("zoneA", zoneName(a.buildings[i].zone));
+        json.field("zoneB", zoneName(b.buildings[j].zone));
+        json.endObject();
+        buildingGeometry(json, b.buildings[j]);
+        json.endObject();
+    }
+    for (std::size_t i : diff.roads.removedIndices) {
+        beginFeature(json, "road", "removed");
+        json.field("class", roadClassName(a.roads[i].type));
+        json.endObject();
+        roadGeometry(json, a.roads[i]);
+        json.endObject();
+    }
+    for (std::size_t j : diff.roads.addedIndices) {
+        beginFeature(json, "road", "added");
+        json.field("class", roadClassName(b.roads[j].type));
+        json.endObject();
+        roadGeometry(json, b.roads[j]);
+        json.endObject();
+    }
+    for (const auto &[i, j] : diff.roads.modifiedPairs) {
+        beginFeature(json, "road", "modified");
+        json.field("classA", roadClassName(a.roads[i].type));
+        json.field("classB", roadClassName(b.roads[j].type));
+        json.endObject();
+        roadGeometry(json, b.roads[j]);
+        json.endObject();
+    }
+    auto facilityName = [](const Facility &f) {
+        return f.type == Facility::Type::Hospital ? "hospital" : "school";
+    };
+    for (std::size_t i : diff.facilities.removedIndices) {
+        beginFeature(json, "facility", "removed");
+        json.field("type", facilityName(a.facilities[i]));
+        json.endObject();
+        pointGeometry(json, a.facilities[i]);
+        json.endObject();
+    }
+    for (std::size_t j : diff.facilities.addedIndices) {
+        beginFeature(json, "facility", "added");
+        json.field("type", facilityName(b.facilities[j]));
+        json.endObject();
+        pointGeometry(json, b.facilities[j]);
+        json.endObject();
+    }
+    for (const auto &[i, j] : diff.facilities.modifiedPairs) {
+        beginFeature(json, "facility", "modified");
+        json.field("typeA", facilityName(a.facilities[i]));
+        json.field("typeB", facilityName(b.facilities[j]));
+        json.endObject();
+        pointGeometry(json, b.facilities[j]);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    out += '\n';
+    OutputSink sink(filename);
+    if (!sink) return false;
+    sink << out;
+    return sink.close();
+}
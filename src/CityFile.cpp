@@ -0,0 +1,167 @@
+#include "CityFile.h"
+#include "Execution.h"
+#include "Output.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+constexpr char kMagic[4] = {'C', 'G', 'C', 'Y'};
+constexpr std::uint32_t kVersion = 1;
+
+struct FileHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t buildingSize;
+    std::int32_t gridSize;
+};
+static_assert(sizeof(FileHeader) == 16, "city file header layout");
+
+// Payload sinks: a presized memory buffer (checkpoint snapshots) or a
+// stream (city files).
+class BufferOut {
+public:
+    explicit BufferOut(std::uint8_t *out) : out_(out) {}
+    void bytes(const void *data, std::size_t len) {
+        if (len) std::memcpy(out_, data, len);
+        out_ += len;
+    }
+
+private:
+    std::uint8_t *out_;
+};
+
+class StreamOut {
+public:
+    explicit StreamOut(std::ostream &out) : out_(out) {}
+    void bytes(const void *data, std::size_t len) {
+        out_.write(static_cast<const char *>(data), static_cast<std::streamsize>(len));
+    }
+
+private:
+    std::ostream &out_;
+};
+
+template <typename Vec>
+std::uint64_t recordBytes(const Vec &v) {
+    return sizeof(std::uint64_t) + v.size() * sizeof(typename Vec::value_type);
+}
+
+template <typename Out, typename Vec>
+void writeRecords(Out &out, const Vec &v) {
+    static_assert(std::is_trivially_copyable<typename Vec::value_type>::value,
+                  "city file records must be trivially copyable");
+    std::uint64_t count = v.size();
+    out.bytes(&count, sizeof(count));
+    out.bytes(v.data(), v.size() * sizeof(typename Vec::value_type));
+}
+
+template <typename Out>
+void writePayload(const City &city, Out &out) {
+    // Zones are narrowed to one byte per cell and written row-major
+    // whatever the grid layout, a row at a time.
+    std::vector<std::uint8_t> row(static_cast<std::size_t>(std::max(city.size, 0)));
+    for (int y = 0; y < city.size; ++y) {
+        city.zones.forEachRowSpan(y, [&](int x0, const ZoneType *span, int n) {
+            for (int k = 0; k < n; ++k) row[x0 + k] = static_cast<std::uint8_t>(span[k]);
+        });
+        out.bytes(row.data(), row.size());
+    }
+    writeRecords(out, city.buildings);
+    writeRecords(out, city.facilities);
+    writeRecords(out, city.roads);
+    writeRecords(out, city.blocks);
+}
+
+template <typename Vec>
+bool readRecords(std::istream &in, Vec &v, std::uint64_t &remaining) {
+    std::uint64_t count = 0;
+    if (remaining < sizeof(count) || !in.read(reinterpret_cast<char *>(&count), sizeof(count))) {
+        return false;
+    }
+    remaining -= sizeof(count);
+    if (count > remaining / sizeof(typename Vec::value_type)) return false;
+    v.resize(static_cast<std::size_t>(count));
+    std::size_t len = v.size() * sizeof(typename Vec::value_type);
+    remaining -= len;
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(v.data()), static_cast<std::streamsize>(len)));
+}
+
+} // namespace
+
+std::uint64_t cityPayloadBytes(const City &city) {
+    return city.zones.size() + recordBytes(city.buildings) + recordBytes(city.facilities) +
+           recordBytes(city.roads) + recordBytes(city.blocks);
+}
+
+void writeCityPayload(const City &city, std::uint8_t *out) {
+    BufferOut sink(out);
+    writePayload(city, sink);
+}
+
+bool readCityPayload(std::istream &in, City &city, std::uint64_t bytes) {
+    if (bytes < city.zones.size()) return false;
+    std::vector<std::uint8_t> row(static_cast<std::size_t>(city.size));
+    for (int y = 0; y < city.size; ++y) {
+        if (!in.read(reinterpret_cast<char *>(row.data()), static_cast<std::streamsize>(row.size()))) {
+            return false;
+        }
+        if (std::any_of(row.begin(), row.end(), [](std::uint8_t z) {
+                return z > static_cast<std::uint8_t>(ZoneType::Green);
+            })) {
+            return false;
+        }
+        city.zones.forEachRowSpan(y, [&](int x0, ZoneType *span, int n) {
+            for (int k = 0; k < n; ++k) span[k] = static_cast<ZoneType>(row[x0 + k]);
+        });
+    }
+    std::uint64_t remaining = bytes - city.zones.size();
+    return readRecords(in, city.buildings, remaining) && readRecords(in, city.facilities, remaining) &&
+           readRecords(in, city.roads, remaining) && readRecords(in, city.blocks, remaining) &&
+           remaining == 0;
+}
+
+bool City::saveCity(const std::string &filename, ExecutionContext *ctx) const {
+    StageScope stage(ctx, "city file", 1);
+    OutputSink out(filename);
+    if (!out) return false;
+    FileHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.buildingSize = sizeof(Building);
+    header.gridSize = size;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    StreamOut sink(out);
+    writePayload(*this, sink);
+    return out.close();
+}
+
+City loadCity(const std::string &filename) {
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in) throw std::runtime_error("cannot open city file " + filename);
+    std::uint64_t fileSize = static_cast<std::uint64_t>(in.tellg());
+    in.seekg(0);
+    FileHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) {
+        throw std::runtime_error("not a city file: " + filename);
+    }
+    if (header.buildingSize != sizeof(Building)) {
+        throw std::runtime_error("city file from an incompatible build: " + filename);
+    }
+    if (header.gridSize < 0 ||
+        static_cast<std::uint64_t>(header.gridSize) * static_cast<std::uint64_t>(header.gridSize) >
+            fileSize) {
+        throw std::runtime_error("truncated city file " + filename);
+    }
+    City city(header.gridSize);
+    if (!readCityPayload(in, city, fileSize - sizeof(header))) {
+        throw std::runtime_error("truncated or corrupt city file " + filename);
+    }
+    return city;
+}
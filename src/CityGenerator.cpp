@@ -1,10 +1,16 @@
 #include "CityGenerator.h"
+#include "Checkpoint.h"
+#include "DetMath.h"
+#include "JsonWriter.h"
+#include "Layout.h"
+#include "SpatialOrder.h"
 
 #include <random>
 #include <cmath>
 #include <algorithm>
 #include <limits>
 #include <array>
+#include <initializer_list>
 
 namespace {
 
@@ -60,6 +66,7 @@ static ZoneType sampleZone(const City &city, const Rect &r) {
 
 // Sample a height for a parcel based on its zone and footprint size.  Larger
 // footprints tend to produce slightly taller buildings in commercial areas.
+// Draws go through DetMath.h so heights are the same on every platform.
 static int sampleHeight(ZoneType zone, const Rect &footprint, double distToCentre,
                         double cityRadius, std::mt19937 &rng) {
     double area = std::max(footprint.width() * footprint.height(), 1.0);
@@ -70,22 +77,19 @@ static int sampleHeight(ZoneType zone, const Rect &footprint, double distToCentr
     };
     switch (zone) {
         case ZoneType::Residential: {
-            std::lognormal_distribution<double> distH(std::log(3.0), 0.35);
-            double h = distH(rng);
+            double h = detmath::lognormal(rng, detmath::log(3.0), 0.35);
             h *= 0.6 + 0.7 * radial; // taller near centre, modest elsewhere
             h += std::min(std::sqrt(area) * 0.1, 1.5);
             return clampHeight(h, 2, 12);
         }
         case ZoneType::Commercial: {
-            std::lognormal_distribution<double> distH(std::log(8.0), 0.5);
-            double h = distH(rng);
+            double h = detmath::lognormal(rng, detmath::log(8.0), 0.5);
             h *= 0.8 + 1.2 * radial; // CBD bias
             h += std::min(std::sqrt(area) * 0.15, 3.0);
             return clampHeight(h, 4, 40);
         }
         case ZoneType::Industrial: {
-            std::exponential_distribution<double> distH(1.0 / 5.0);
-            double h = 2.0 + distH(rng);
+            double h = 2.0 + detmath::exponential(rng, 1.0 / 5.0);
             h *= 0.7 + 0.6 * radial;
             h += std::min(std::sqrt(area) * 0.05, 1.0);
             return clampHeight(h, 2, 14);
@@ -95,187 +99,6 @@ static int sampleHeight(ZoneType zone, const Rect &footprint, double distToCentr
     }
 }
 
-// Shrink a parcel footprint and apply small random jitter so buildings do not
-// perfectly fill or align within their parcels.
-static Rect jitterFootprint(const Rect &parcel, std::mt19937 &rng) {
-    double w = parcel.width();
-    double h = parcel.height();
-    if (w <= 0.0 || h <= 0.0) return parcel;
-    std::uniform_real_distribution<double> scaleDist(0.4, 0.9);
-    double areaScale = scaleDist(rng);
-    double linearScale = std::sqrt(areaScale);
-    double newW = w * linearScale;
-    double newH = h * linearScale;
-    double marginX = (w - newW) * 0.5;
-    double marginY = (h - newH) * 0.5;
-    double jitterFrac = 0.6;
-    std::uniform_real_distribution<double> jitterX(-marginX * jitterFrac, marginX * jitterFrac);
-    std::uniform_real_distribution<double> jitterY(-marginY * jitterFrac, marginY * jitterFrac);
-    double cx = parcel.centreX() + jitterX(rng);
-    double cy = parcel.centreY() + jitterY(rng);
-    Rect r;
-    r.x0 = cx - newW * 0.5;
-    r.x1 = cx + newW * 0.5;
-    r.y0 = cy - newH * 0.5;
-    r.y1 = cy + newH * 0.5;
-    // Clamp to stay within the parcel bounds
-    double shiftX0 = std::max(parcel.x0 - r.x0, 0.0);
-    double shiftY0 = std::max(parcel.y0 - r.y0, 0.0);
-    double shiftX1 = std::max(r.x1 - parcel.x1, 0.0);
-    double shiftY1 = std::max(r.y1 - parcel.y1, 0.0);
-    r.x0 += shiftX0 - shiftX1;
-    r.x1 += shiftX0 - shiftX1;
-    r.y0 += shiftY0 - shiftY1;
-    r.y1 += shiftY0 - shiftY1;
-    return r;
-}
-
-// Recursively subdivide a rectangle into smaller lots using a binary split
-// along the longest dimension until parcels fit within maxSize.
-static void subdivideRect(const Rect &r, double minSize, double maxSize,
-                          std::mt19937 &rng, std::vector<Rect> &out, int depth = 0) {
-    double w = r.width();
-    double h = r.height();
-    if ((w <= maxSize && h <= maxSize) || depth > 6) {
-        out.push_back(r);
-        return;
-    }
-    bool splitX = (w > h);
-    double minCut = splitX ? r.x0 + minSize : r.y0 + minSize;
-    double maxCut = splitX ? r.x1 - minSize : r.y1 - minSize;
-    if (maxCut <= minCut) {
-        out.push_back(r);
-        return;
-    }
-    std::uniform_real_distribution<double> dist(minCut, maxCut);
-    double cut = dist(rng);
-    Rect a = r;
-    Rect b = r;
-    if (splitX) {
-        a.x1 = cut;
-        b.x0 = cut;
-    } else {
-        a.y1 = cut;
-        b.y0 = cut;
-    }
-    subdivideRect(a, minSize, maxSize, rng, out, depth + 1);
-    subdivideRect(b, minSize, maxSize, rng, out, depth + 1);
-}
-
-// Carve out a central courtyard from a block and subdivide the remaining
-// strips into parcels.  If the block is too small for a courtyard, the whole
-// area is subdivided.
-static std::vector<Rect> parcelizeBlock(const Block &block, std::mt19937 &rng) {
-    const Rect &b = block.bounds;
-    double w = b.width();
-    double h = b.height();
-    const double minParcel = 3.0;
-    const double maxParcel = 12.0;
-    std::vector<Rect> parcels;
-    // Randomised courtyard fraction; ensures at least ~15% stays open.
-    std::uniform_real_distribution<double> fracDist(0.15, 0.30);
-    double margin = std::min(w, h) * fracDist(rng);
-    if (margin * 2.0 < w && margin * 2.0 < h) {
-        Rect inner{b.x0 + margin, b.y0 + margin, b.x1 - margin, b.y1 - margin};
-        Rect strips[4] = {
-            {b.x0, b.y0, b.x1, inner.y0},
-            {b.x0, inner.y1, b.x1, b.y1},
-            {b.x0, inner.y0, inner.x0, inner.y1},
-            {inner.x1, inner.y0, b.x1, inner.y1}
-        };
-        for (const auto &s : strips) {
-            if (s.width() >= minParcel && s.height() >= minParcel) {
-                subdivideRect(s, minParcel, maxParcel, rng, parcels);
-            }
-        }
-        // The inner courtyard is intentionally left empty.
-    } else {
-        subdivideRect(b, minParcel, maxParcel, rng, parcels);
-    }
-    return parcels;
-}
-
-static std::array<Vec2, 4> rectToQuad(const Rect &r) {
-    return {{
-        {r.x0, r.y0},
-        {r.x1, r.y0},
-        {r.x1, r.y1},
-        {r.x0, r.y1}
-    }};
-}
-
-static Rect boundsFromQuad(const std::array<Vec2, 4> &q) {
-    Rect r;
-    r.x0 = r.x1 = q[0].x;
-    r.y0 = r.y1 = q[0].y;
-    for (int i = 1; i < 4; ++i) {
-        r.x0 = std::min(r.x0, q[i].x);
-        r.x1 = std::max(r.x1, q[i].x);
-        r.y0 = std::min(r.y0, q[i].y);
-        r.y1 = std::max(r.y1, q[i].y);
-    }
-    return r;
-}
-
-static Vec2 centroidOfQuad(const std::array<Vec2, 4> &q) {
-    double cx = 0.0;
-    double cy = 0.0;
-    for (const auto &p : q) {
-        cx += p.x;
-        cy += p.y;
-    }
-    cx *= 0.25;
-    cy *= 0.25;
-    return {cx, cy};
-}
-
-static Vec2 polarToCartesian(double cx, double cy, double r, double theta) {
-    double x = cx + r * std::cos(theta);
-    double y = cy + r * std::sin(theta);
-    return {x, y};
-}
-
-// Convert a wedge block into quads by unwrapping to a rectangle in (arc, radius)
-// space, parcelising, and mapping back to polar coordinates.
-static std::vector<std::array<Vec2, 4>> parcelizeWedge(double cx, double cy,
-                                                       double r0, double r1,
-                                                       double theta0, double theta1,
-                                                       std::mt19937 &rng) {
-    double radialThickness = r1 - r0;
-    if (radialThickness <= 0.1) return {};
-    double midR = (r0 + r1) * 0.5;
-    double thetaSpan = theta1 - theta0;
-    if (thetaSpan <= 1e-4 || midR <= 1e-6) return {};
-    double arcLength = thetaSpan * midR;
-    Rect uvBlock{0.0, 0.0, arcLength, radialThickness};
-    std::vector<Rect> uvParcels;
-    const double minParcel = 3.0;
-    const double maxParcel = 12.0;
-    subdivideRect(uvBlock, minParcel, maxParcel, rng, uvParcels);
-    std::vector<std::array<Vec2, 4>> quads;
-    quads.reserve(uvParcels.size());
-    for (const auto &uv : uvParcels) {
-        Rect jittered = jitterFootprint(uv, rng);
-        double u0 = jittered.x0;
-        double u1 = jittered.x1;
-        double v0 = jittered.y0;
-        double v1 = jittered.y1;
-        auto uvToWorld = [&](double u, double v) {
-            double t = theta0 + (u / arcLength) * thetaSpan;
-            double rr = r0 + v;
-            return polarToCartesian(cx, cy, rr, t);
-        };
-        std::array<Vec2, 4> quad = {{
-            uvToWorld(u0, v0),
-            uvToWorld(u1, v0),
-            uvToWorld(u1, v1),
-            uvToWorld(u0, v1)
-        }};
-        quads.push_back(quad);
-    }
-    return quads;
-}
-
 // Compute the shortest distance from a parcel to the road network.  Roads are
 // treated as thickened line segments (using their hierarchy width) so parcels
 // adjacent to roads yield zero distance.
@@ -299,138 +122,90 @@ static double distanceToRoads(const Rect &parcel, const std::vector<RoadSegment>
     return best;
 }
 
-} // anonymous namespace
-
-City CityGenerator::generate(const Config &cfg) {
-    City city(cfg.grid_size);
+// 1. Zone assignment across the base grid
+void assignZones(City &city, const Config &cfg, ExecutionContext *ctx) {
     int size = cfg.grid_size;
     double centre = static_cast<double>(size) / 2.0;
     double radius = (static_cast<double>(size) * cfg.city_radius) / 2.0;
-    // RNG for various choices
-    std::mt19937 rng(cfg.seed);
-    // 1. Zone assignment across the base grid
+    auto zoneFor = [&](int x, int y) {
+        double dx = static_cast<double>(x) + 0.5 - centre;
+        double dy = static_cast<double>(y) + 0.5 - centre;
+        double dist = std::sqrt(dx * dx + dy * dy);
+        if (dist > radius) return ZoneType::None;
+        double value = fractalNoise(x, y, cfg.seed);
+        if (value < 0.55) return ZoneType::Residential;
+        if (value < 0.75) return ZoneType::Commercial;
+        if (value < 0.90) return ZoneType::Industrial;
+        return ZoneType::Green;
+    };
+    StageScope zoning(ctx, "zoning", static_cast<std::uint64_t>(size));
     for (int y = 0; y < size; ++y) {
-        for (int x = 0; x < size; ++x) {
-            double dx = static_cast<double>(x) + 0.5 - centre;
-            double dy = static_cast<double>(y) + 0.5 - centre;
-            double dist = std::sqrt(dx * dx + dy * dy);
-            if (dist > radius) {
-                city.zoneAt(x, y) = ZoneType::None;
-                continue;
-            }
-            double value = fractalNoise(x, y, cfg.seed);
-            if (value < 0.55) {
-                city.zoneAt(x, y) = ZoneType::Residential;
-            } else if (value < 0.75) {
-                city.zoneAt(x, y) = ZoneType::Commercial;
-            } else if (value < 0.90) {
-                city.zoneAt(x, y) = ZoneType::Industrial;
-            } else {
-                city.zoneAt(x, y) = ZoneType::Green;
-            }
-        }
+        zoning.advance();
+        city.zones.forEachRowSpan(y, [&](int x0, ZoneType *span, int n) {
+            for (int k = 0; k < n; ++k) span[k] = zoneFor(x0 + k, y);
+        });
     }
-    // 2. Ensure a minimum amount of green space based on population
-    // The recommended minimum is about 8 m^2 per inhabitant.  Each grid
-    // cell represents an arbitrary area; we assume each cell could be ~100 m ×
-    // 100 m (10,000 m²).  So one cell contributes 10,000 m² of green space.
-    // Compute the target number of green cells and convert some cells if
-    // necessary.  Choose candidates from residential and industrial zones.
+}
+
+// 2. Ensure a minimum amount of green space based on population
+// The recommended minimum is about 8 m^2 per inhabitant.  Each grid
+// cell represents an arbitrary area; we assume each cell could be ~100 m ×
+// 100 m (10,000 m²).  So one cell contributes 10,000 m² of green space.
+// Compute the target number of green cells and convert some cells if
+// necessary.  Choose candidates from residential and industrial zones.
+void enforceGreenSpace(City &city, const Config &cfg, std::mt19937 &rng, ExecutionContext *ctx) {
+    int size = cfg.grid_size;
     double greenAreaPerPerson = 8.0; // m^2 per person
     double cellArea = 100.0 * 100.0; // m^2 per cell
     std::uint64_t targetGreenCells = static_cast<std::uint64_t>(
         std::ceil((cfg.population * greenAreaPerPerson) / cellArea));
     // Count current green cells
     std::uint64_t currentGreen = 0;
-    for (const auto z : city.zones) {
-        if (z == ZoneType::Green) currentGreen++;
+    for (int y = 0; y < size; ++y) {
+        city.zones.forEachRowSpan(y, [&](int, const ZoneType *span, int n) {
+            currentGreen += static_cast<std::uint64_t>(std::count(span, span + n, ZoneType::Green));
+        });
     }
-    if (currentGreen < targetGreenCells) {
-        // Determine how many additional cells we need to convert
-        std::uint64_t diff = targetGreenCells - currentGreen;
-        // Collect candidate indices
-        std::vector<std::size_t> candidates;
-        candidates.reserve(city.zones.size());
-        for (std::size_t idx = 0; idx < city.zones.size(); ++idx) {
-            ZoneType z = city.zones[idx];
-            if (z == ZoneType::Residential || z == ZoneType::Industrial) {
-                candidates.push_back(idx);
+    if (currentGreen >= targetGreenCells) return;
+    StageScope green(ctx, "green space", static_cast<std::uint64_t>(size));
+    // Determine how many additional cells we need to convert
+    std::uint64_t diff = targetGreenCells - currentGreen;
+    // Collect candidate indices (row-major, whatever the grid layout)
+    SpillVector<std::size_t> candidates;
+    candidates.reserve(city.zones.size());
+    for (int y = 0; y < size; ++y) {
+        green.advance();
+        city.zones.forEachRowSpan(y, [&](int x0, const ZoneType *span, int n) {
+            for (int k = 0; k < n; ++k) {
+                if (span[k] == ZoneType::Residential || span[k] == ZoneType::Industrial) {
+                    candidates.push_back(static_cast<std::size_t>(y) * size + x0 + k);
+                }
             }
-        }
-        // Shuffle candidates deterministically using rng
-        std::shuffle(candidates.begin(), candidates.end(), rng);
-        std::size_t converted = 0;
-        for (std::size_t i = 0; i < candidates.size() && converted < diff; ++i) {
-            std::size_t idx = candidates[i];
-            city.zones[idx] = ZoneType::Green;
-            converted++;
-        }
+        });
+    }
+    // Shuffle candidates deterministically using rng
+    detmath::shuffle(candidates.begin(), candidates.end(), rng);
+    std::size_t converted = 0;
+    for (std::size_t i = 0; i < candidates.size() && converted < diff; ++i) {
+        std::size_t idx = candidates[i];
+        city.zoneAt(static_cast<int>(idx % size), static_cast<int>(idx / size)) = ZoneType::Green;
+        converted++;
     }
-    // 3. Generate primary road network and parcels according to layout
-    double cx = centre;
-    double cy = centre;
+}
+
+// 3. Primary road network and blocks according to layout (Layout.h)
+// 4. Subdivide blocks into parcels and spawn buildings per parcel
+void placeParcels(City &city, const Config &cfg, std::mt19937 &rng, ExecutionContext *ctx) {
+    double radius = (static_cast<double>(cfg.grid_size) * cfg.city_radius) / 2.0;
+    StreetLayout layout = deriveStreetLayout(cfg);
+    double cx = layout.centreX;
+    double cy = layout.centreY;
+    city.roads = std::move(layout.roads);
+    city.blocks = std::move(layout.blocks);
+    StageScope parcelling(ctx, "parcels", city.blocks.size());
     if (cfg.layout == Config::LayoutType::Grid) {
-        // Road alignments along fixed grid lines; these are reused when carving
-        // blocks so that road geometry and parcels stay consistent.
-        std::vector<double> xLines = {cx - radius, cx - radius * 0.9, cx - radius * 0.5,
-                                      cx, cx + radius * 0.5, cx + radius * 0.9, cx + radius};
-        std::vector<double> yLines = {cy - radius, cy - radius * 0.9, cy - radius * 0.5,
-                                      cy, cy + radius * 0.5, cy + radius * 0.9, cy + radius};
-        auto uniqSort = [](std::vector<double> &vals) {
-            std::sort(vals.begin(), vals.end());
-            vals.erase(std::unique(vals.begin(), vals.end()), vals.end());
-        };
-        uniqSort(xLines);
-        uniqSort(yLines);
-        auto classifyRoad = [&](double coord, bool isX) {
-            double anchor = isX ? cx : cy;
-            double denom = (radius > 1e-6) ? radius : 1.0;
-            double norm = std::abs(coord - anchor) / denom;
-            if (norm < 0.15) return RoadType::Arterial;
-            if (norm < 0.6) return RoadType::Secondary;
-            return RoadType::Local;
-        };
-        auto addRoad = [&](double x0, double y0, double x1, double y1, RoadType t) {
-            city.roads.push_back({x0, y0, x1, y1, t});
-        };
-        // Vertical and horizontal lines spanning the developed area.  Widths are
-        // derived from hierarchy.
-        for (double x : xLines) {
-            RoadType type = classifyRoad(x, true);
-            addRoad(x, cy - radius, x, cy + radius, type);
-        }
-        for (double y : yLines) {
-            RoadType type = classifyRoad(y, false);
-            addRoad(cx - radius, y, cx + radius, y, type);
-        }
-        // 4. Derive blocks from road lines (axis-aligned grid between road traces)
-        auto insetFor = [&](double coord, bool isX) {
-            return 0.5 * roadWidth(classifyRoad(coord, isX));
-        };
-        for (std::size_t xi = 0; xi + 1 < xLines.size(); ++xi) {
-            for (std::size_t yi = 0; yi + 1 < yLines.size(); ++yi) {
-                double x0 = xLines[xi] + insetFor(xLines[xi], true);
-                double x1 = xLines[xi + 1] - insetFor(xLines[xi + 1], true);
-                double y0 = yLines[yi] + insetFor(yLines[yi], false);
-                double y1 = yLines[yi + 1] - insetFor(yLines[yi + 1], false);
-                if (x1 <= x0 || y1 <= y0) continue;
-                Rect bounds{x0, y0, x1, y1};
-                double blockCx = bounds.centreX();
-                double blockCy = bounds.centreY();
-                double dx = blockCx - cx;
-                double dy = blockCy - cy;
-                double dist = std::sqrt(dx * dx + dy * dy);
-                if (dist > radius * 1.05) continue; // outside developed area
-                if (bounds.width() < 1.0 || bounds.height() < 1.0) continue;
-                Block blk;
-                blk.bounds = bounds;
-                blk.hasCorners = true;
-                blk.corners = rectToQuad(bounds);
-                city.blocks.push_back(blk);
-            }
-        }
-        // 5. Subdivide blocks into parcels and spawn buildings per parcel
         for (const auto &block : city.blocks) {
+            parcelling.advance();
             std::vector<Rect> parcels = parcelizeBlock(block, rng);
             for (const auto &footprint : parcels) {
                 Rect adjusted = jitterFootprint(footprint, rng);
@@ -457,107 +232,45 @@ City CityGenerator::generate(const Config &cfg) {
             }
         }
     } else { // Radial layout
-        int ringCount = std::clamp(static_cast<int>(std::round(3.0 + cfg.population / 200000.0)), 3, 8);
-        int radialRoads = std::clamp(static_cast<int>(std::round(10.0 + cfg.city_radius * 8.0)), 8, 20);
-        double maxR = radius;
-        std::vector<double> ringEdges;
-        ringEdges.reserve(ringCount + 2);
-        ringEdges.push_back(0.0);
-        for (int i = 1; i <= ringCount; ++i) {
-            double frac = static_cast<double>(i) / static_cast<double>(ringCount + 1);
-            ringEdges.push_back(maxR * frac);
-        }
-        ringEdges.push_back(maxR);
-        std::sort(ringEdges.begin(), ringEdges.end());
-        ringEdges.erase(std::unique(ringEdges.begin(), ringEdges.end()), ringEdges.end());
-        std::vector<double> angles(radialRoads + 1);
-        const double twoPi = 6.28318530717958647692;
-        double delta = twoPi / static_cast<double>(radialRoads);
-        for (int i = 0; i <= radialRoads; ++i) {
-            angles[i] = delta * static_cast<double>(i);
-        }
-        auto ringType = [&](double r) {
-            double norm = (maxR > 1e-6) ? (r / maxR) : 0.0;
-            if (norm < 0.3) return RoadType::Arterial;
-            if (norm < 0.75) return RoadType::Secondary;
-            return RoadType::Local;
-        };
-        // Ring roads (approximated by segmented polylines)
-        for (std::size_t ri = 1; ri + 1 < ringEdges.size(); ++ri) {
-            double r = ringEdges[ri];
-            int segs = std::max(32, radialRoads * 2);
-            for (int s = 0; s < segs; ++s) {
-                double t0 = twoPi * static_cast<double>(s) / static_cast<double>(segs);
-                double t1 = twoPi * static_cast<double>(s + 1) / static_cast<double>(segs);
-                Vec2 p0 = polarToCartesian(cx, cy, r, t0);
-                Vec2 p1 = polarToCartesian(cx, cy, r, t1);
-                city.roads.push_back({p0.x, p0.y, p1.x, p1.y, ringType(r)});
-            }
-        }
-        // Radial arterials
-        for (int i = 0; i < radialRoads; ++i) {
-            double t = angles[i];
-            Vec2 p0 = polarToCartesian(cx, cy, 0.0, t);
-            Vec2 p1 = polarToCartesian(cx, cy, maxR, t);
-            city.roads.push_back({p0.x, p0.y, p1.x, p1.y, RoadType::Arterial});
-        }
-        // Blocks: wedges defined by consecutive ring bands and angular sectors
-        for (std::size_t ri = 0; ri + 1 < ringEdges.size(); ++ri) {
-            double r0 = ringEdges[ri];
-            double r1 = ringEdges[ri + 1];
-            for (int si = 0; si < radialRoads; ++si) {
-                double a0 = angles[si];
-                double a1 = angles[si + 1];
-                std::array<Vec2, 4> corners = {{
-                    polarToCartesian(cx, cy, r0, a0),
-                    polarToCartesian(cx, cy, r1, a0),
-                    polarToCartesian(cx, cy, r1, a1),
-                    polarToCartesian(cx, cy, r0, a1)
-                }};
-                Rect bounds = boundsFromQuad(corners);
-                Vec2 blockC = centroidOfQuad(corners);
-                double dx = blockC.x - cx;
-                double dy = blockC.y - cy;
-                double dist = std::sqrt(dx * dx + dy * dy);
-                if (dist > radius * 1.1) continue;
-                Block blk;
-                blk.bounds = bounds;
-                blk.hasCorners = true;
-                blk.corners = corners;
-                city.blocks.push_back(blk);
-                auto parcels = parcelizeWedge(cx, cy, r0, r1, a0, a1, rng);
-                for (const auto &quad : parcels) {
-                    Rect parcelBounds = boundsFromQuad(quad);
-                    Vec2 centreP = centroidOfQuad(quad);
-                    double pdx = centreP.x - cx;
-                    double pdy = centreP.y - cy;
-                    double pdist = std::sqrt(pdx * pdx + pdy * pdy);
-                    if (pdist > radius * 1.05) continue;
-                    ZoneType z = sampleZone(city, parcelBounds);
-                    if (z == ZoneType::None) continue;
-                    Building b;
-                    b.footprint = parcelBounds;
-                    b.corners = quad;
-                    b.hasCorners = true;
-                    b.zone = z;
-                    b.height = sampleHeight(z, parcelBounds, pdist, radius, rng);
-                    b.facility = false;
-                    if (z == ZoneType::Green) {
-                        b.height = 0;
-                    }
-                    city.buildings.push_back(b);
+        for (const auto &wedge : layout.wedges) {
+            parcelling.advance();
+            auto parcels = parcelizeWedge(cx, cy, wedge, rng);
+            for (const auto &quad : parcels) {
+                Rect parcelBounds = boundsFromQuad(quad);
+                Vec2 centreP = centroidOfQuad(quad);
+                double pdx = centreP.x - cx;
+                double pdy = centreP.y - cy;
+                double pdist = std::sqrt(pdx * pdx + pdy * pdy);
+                if (pdist > radius * 1.05) continue;
+                ZoneType z = sampleZone(city, parcelBounds);
+                if (z == ZoneType::None) continue;
+                Building b;
+                b.footprint = parcelBounds;
+                b.corners = quad;
+                b.hasCorners = true;
+                b.zone = z;
+                b.height = sampleHeight(z, parcelBounds, pdist, radius, rng);
+                b.facility = false;
+                if (z == ZoneType::Green) {
+                    b.height = 0;
                 }
+                city.buildings.push_back(b);
             }
         }
     }
-    // 6. Place facilities (hospitals and schools) on suitable parcels
+}
+
+// 5. Place facilities (hospitals and schools) on suitable parcels
+void placeFacilities(City &city, const Config &cfg, std::mt19937 &rng, ExecutionContext *ctx) {
     struct ParcelCandidate {
         std::size_t idx;
         double roadDistance;
     };
-    std::vector<ParcelCandidate> candidates;
+    StageScope siting(ctx, "facilities", city.buildings.size());
+    SpillVector<ParcelCandidate> candidates;
     candidates.reserve(city.buildings.size());
     for (std::size_t i = 0; i < city.buildings.size(); ++i) {
+        siting.advance();
         const auto &b = city.buildings[i];
         if (b.zone == ZoneType::Residential || b.zone == ZoneType::Commercial) {
             double dist = distanceToRoads(b.footprint, city.roads);
@@ -566,30 +279,36 @@ City CityGenerator::generate(const Config &cfg) {
     }
     if (candidates.empty()) {
         for (std::size_t i = 0; i < city.buildings.size(); ++i) {
+            if (ctx) ctx->check();
             double dist = distanceToRoads(city.buildings[i].footprint, city.roads);
             candidates.push_back({i, dist});
         }
     }
-    std::vector<ParcelCandidate> nearRoads;
-    std::vector<ParcelCandidate> interior;
+    SpillVector<ParcelCandidate> nearRoads;
+    SpillVector<ParcelCandidate> interior;
     const double accessibleRadius = 1.6; // one arterial lane away from the carriageway
     for (const auto &c : candidates) {
         if (c.roadDistance <= accessibleRadius) nearRoads.push_back(c);
         else interior.push_back(c);
     }
-    auto sortByAccess = [&](std::vector<ParcelCandidate> &vec) {
-        std::shuffle(vec.begin(), vec.end(), rng);
-        std::sort(vec.begin(), vec.end(),
+    auto sortByAccess = [&](SpillVector<ParcelCandidate> &vec) {
+        // Stable, so ties keep the shuffled order on every standard library.
+        detmath::shuffle(vec.begin(), vec.end(), rng);
+        std::stable_sort(vec.begin(), vec.end(),
                   [](const ParcelCandidate &a, const ParcelCandidate &b) {
                       return a.roadDistance < b.roadDistance;
                   });
     };
     sortByAccess(nearRoads);
     sortByAccess(interior);
-    std::vector<std::size_t> orderedParcels;
-    orderedParcels.reserve(candidates.size());
-    for (const auto &c : nearRoads) orderedParcels.push_back(c.idx);
-    for (const auto &c : interior) orderedParcels.push_back(c.idx);
+    // Residents are who the facilities serve; with none, every parcel counts.
+    std::vector<Vec2> homes;
+    for (const auto &b : city.buildings) {
+        if (b.zone == ZoneType::Residential) homes.push_back({b.footprint.centreX(), b.footprint.centreY()});
+    }
+    if (homes.empty()) {
+        for (const auto &b : city.buildings) homes.push_back({b.footprint.centreX(), b.footprint.centreY()});
+    }
 
     auto imprintFacility = [&](Building &b, Facility::Type type) {
         b.facility = true;
@@ -605,23 +324,121 @@ City CityGenerator::generate(const Config &cfg) {
         }
     };
 
-    auto placeFacilities = [&](Facility::Type type, std::uint32_t count) {
-        std::uint32_t placed = 0;
-        for (std::size_t idx : orderedParcels) {
-            if (placed >= count) break;
-            Building &b = city.buildings[idx];
-            if (!b.facility) {
-                imprintFacility(b, type);
-                Facility f;
-                f.x = b.footprint.centreX();
-                f.y = b.footprint.centreY();
-                f.type = type;
-                city.facilities.push_back(f);
-                placed++;
+    // Greedy k-centre over the residents: the first facility of a type goes
+    // next to the residents' centroid, each further one next to the
+    // resident farthest from those placed so far.  Road-side parcels are
+    // used while any is free; among them the one nearest the target wins,
+    // ties going to the access order.  Facilities thus spread out instead
+    // of bunching wherever the shuffle put them.
+    auto place = [&](Facility::Type type, std::uint32_t count) {
+        std::vector<double> served(homes.size(), std::numeric_limits<double>::max());
+        Vec2 target;
+        for (const auto &h : homes) {
+            target.x += h.x;
+            target.y += h.y;
+        }
+        if (!homes.empty()) {
+            target.x /= static_cast<double>(homes.size());
+            target.y /= static_cast<double>(homes.size());
+        }
+        for (std::uint32_t placed = 0; placed < count; ++placed) {
+            if (ctx) ctx->check();
+            std::size_t best = city.buildings.size();
+            for (const SpillVector<ParcelCandidate> *tier : {&nearRoads, &interior}) {
+                double bestDist = std::numeric_limits<double>::max();
+                for (const auto &c : *tier) {
+                    const Building &b = city.buildings[c.idx];
+                    if (b.facility) continue;
+                    double dx = b.footprint.centreX() - target.x;
+                    double dy = b.footprint.centreY() - target.y;
+                    double d = dx * dx + dy * dy;
+                    if (d < bestDist) {
+                        bestDist = d;
+                        best = c.idx;
+                    }
+                }
+                if (best < city.buildings.size()) break;
+            }
+            if (best >= city.buildings.size()) break;
+            Building &b = city.buildings[best];
+            imprintFacility(b, type);
+            Facility f;
+            f.x = b.footprint.centreX();
+            f.y = b.footprint.centreY();
+            f.type = type;
+            city.facilities.push_back(f);
+            double farthest = -1.0;
+            for (std::size_t j = 0; j < homes.size(); ++j) {
+                double dx = homes[j].x - f.x;
+                double dy = homes[j].y - f.y;
+                served[j] = std::min(served[j], dx * dx + dy * dy);
+                if (served[j] > farthest) {
+                    farthest = served[j];
+                    target = homes[j];
+                }
             }
         }
     };
-    placeFacilities(Facility::Type::Hospital, cfg.hospitals);
-    placeFacilities(Facility::Type::School, cfg.schools);
+    place(Facility::Type::Hospital, cfg.hospitals);
+    place(Facility::Type::School, cfg.schools);
+}
+
+} // anonymous namespace
+
+std::string generationKey(const Config &cfg) {
+    std::string key;
+    JsonWriter json(key);
+    json.beginObject();
+    json.field("seed", static_cast<std::uint64_t>(cfg.seed));
+    json.field("population", cfg.population);
+    json.field("grid", cfg.grid_size);
+    json.field("radius", cfg.city_radius);
+    json.field("hospitals", cfg.hospitals);
+    json.field("schools", cfg.schools);
+    json.field("green", cfg.green_m2_per_capita);
+    json.field("transport", static_cast<int>(cfg.transport_mode));
+    json.field("layout", static_cast<int>(cfg.layout));
+    // Only when set, so keys (and checkpoints) from before the option match.
+    if (cfg.spatial_order != Config::SpatialOrder::None) {
+        json.field("spatialOrder", static_cast<int>(cfg.spatial_order));
+    }
+    json.endObject();
+    return key;
+}
+
+void CityGenerator::placeFacilities(City &city, const Config &cfg, std::mt19937 &rng,
+                                    ExecutionContext *ctx) {
+    ::placeFacilities(city, cfg, rng, ctx);
+}
+
+City CityGenerator::generate(const Config &cfg, ExecutionContext *ctx, Checkpointer *checkpoints) {
+    City city(cfg.grid_size,
+              cfg.zone_layout == Config::ZoneLayout::Tiled ? GridLayout::Tiled : GridLayout::Rows);
+    // RNG for various choices
+    std::mt19937 rng(cfg.seed);
+    // Stages up to and including `resumed` come from the checkpoint, RNG
+    // state included, so a resumed run continues exactly where it stopped.
+    CheckpointStage resumed = checkpoints ? checkpoints->restore(city, rng) : CheckpointStage::None;
+    auto reached = [&](CheckpointStage stage) {
+        if (checkpoints) checkpoints->save(stage, city, rng);
+    };
+    if (resumed < CheckpointStage::Zoning) {
+        assignZones(city, cfg, ctx);
+        reached(CheckpointStage::Zoning);
+    }
+    if (resumed < CheckpointStage::GreenSpace) {
+        enforceGreenSpace(city, cfg, rng, ctx);
+        reached(CheckpointStage::GreenSpace);
+    }
+    if (resumed < CheckpointStage::Parcels) {
+        placeParcels(city, cfg, rng, ctx);
+        reached(CheckpointStage::Parcels);
+    }
+    if (resumed < CheckpointStage::Facilities) {
+        placeFacilities(city, cfg, rng, ctx);
+        reached(CheckpointStage::Facilities);
+    }
+    // Cheap and deterministic, so it is redone rather than checkpointed.
+    applySpatialOrder(city, cfg.spatial_order, ctx);
     return city;
 }
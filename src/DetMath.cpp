@@ -0,0 +1,17 @@
+#include "DetMath.h"
+
+namespace detmath {
+
+void expArray(const double *in, double *out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) out[i] = exp(in[i]);
+}
+
+void logArray(const double *in, double *out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) out[i] = log(in[i]);
+}
+
+void sincosArray(const double *in, double *sinOut, double *cosOut, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) sincos(in[i], sinOut[i], cosOut[i]);
+}
+
+} // namespace detmath
@@ -0,0 +1,143 @@
+#include "Ensemble.h"
+#include "CityGenerator.h"
+#include "JsonWriter.h"
+#include "Numa.h"
+#include "Parallel.h"
+#include "Summary.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Seeds generated per round.  Values are staged per seed and folded in
+// seed order after each round, so the staging buffer stays small and the
+// result does not depend on which worker finished first.
+constexpr std::size_t kSeedsPerWorker = 16;
+
+std::uint32_t parseSeed(const std::string &text, const std::string &spec) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::invalid_argument("Invalid ensemble: " + spec + " (expected seeds:<first>-<last>)");
+    }
+    unsigned long long v = std::strtoull(text.c_str(), nullptr, 10);
+    if (v > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::invalid_argument("Ensemble seed out of range: " + text);
+    }
+    return static_cast<std::uint32_t>(v);
+}
+
+} // namespace
+
+EnsembleSeeds ensembleSeedsFromString(const std::string &spec) {
+    const std::string prefix = "seeds:";
+    if (spec.rfind(prefix, 0) != 0) {
+        throw std::invalid_argument("Invalid ensemble: " + spec + " (expected seeds:<first>-<last>)");
+    }
+    std::string range = spec.substr(prefix.size());
+    std::size_t dash = range.find('-');
+    EnsembleSeeds seeds;
+    seeds.first = parseSeed(range.substr(0, dash), spec);
+    seeds.last = dash == std::string::npos ? seeds.first : parseSeed(range.substr(dash + 1), spec);
+    if (seeds.last < seeds.first) {
+        throw std::invalid_argument("Invalid ensemble: " + spec + " (last seed before first)");
+    }
+    return seeds;
+}
+
+void EnsembleMetric::add(double v) {
+    ++count;
+    double delta = v - mean;
+    mean += delta / static_cast<double>(count);
+    m2 += delta * (v - mean);
+    sketch.update(v);
+}
+
+EnsembleReport runEnsemble(const Config &cfg, EnsembleSeeds seeds, ExecutionContext *ctx) {
+    EnsembleReport report;
+    report.seeds = seeds;
+    report.config = cfg;
+    const std::size_t metricCount = summaryMetricCount();
+    report.metrics.reserve(metricCount);
+    for (std::size_t m = 0; m < metricCount; ++m) report.metrics.emplace_back(summaryMetricName(m));
+
+    StageScope stage(ctx, "ensemble", seeds.count());
+    std::uint64_t round = std::max<std::uint64_t>(1, workerCount()) * kSeedsPerWorker;
+    std::vector<double> staged;
+    for (std::uint64_t begin = 0; begin < seeds.count(); begin += round) {
+        std::size_t n = static_cast<std::size_t>(std::min(round, seeds.count() - begin));
+        staged.assign(n * metricCount, 0.0);
+        // Each worker holds one city at a time; nested parallel passes
+        // (the summary) run inline on that worker.
+        parallelForOnNodes(0, n, [&](std::size_t i) {
+            Config member = cfg;
+            member.seed = static_cast<std::uint32_t>(seeds.first + begin + i);
+            CitySummary summary = computeSummary(CityGenerator::generate(member));
+            double *row = staged.data() + i * metricCount;
+            for (std::size_t m = 0; m < metricCount; ++m) row[m] = summaryMetric(summary, m);
+            stage.advance();
+        });
+        for (std::size_t i = 0; i < n; ++i) {
+            const double *row = staged.data() + i * metricCount;
+            for (std::size_t m = 0; m < metricCount; ++m) {
+                if (!std::isnan(row[m])) report.metrics[m].add(row[m]);
+            }
+        }
+    }
+    stage.finish();
+    return report;
+}
+
+std::string ensembleToJson(const EnsembleReport &report) {
+    std::string out;
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("seeds");
+    json.beginObject();
+    json.field("first", report.seeds.first);
+    json.field("last", report.seeds.last);
+    json.field("count", report.seeds.count());
+    json.endObject();
+    // Options shared by every member; the seed varies and is left out.
+    const Config &cfg = report.config;
+    json.key("config");
+    json.beginObject();
+    json.field("population", cfg.population);
+    json.field("gridSize", cfg.grid_size);
+    json.field("radiusFraction", cfg.city_radius);
+    json.field("hospitals", cfg.hospitals);
+    json.field("schools", cfg.schools);
+    json.field("greenPerCapita", cfg.green_m2_per_capita);
+    const char *transport[] = {"car", "transit", "walk"};
+    json.field("transport", transport[static_cast<int>(cfg.transport_mode)]);
+    json.field("layout", cfg.layout == Config::LayoutType::Radial ? "radial" : "grid");
+    json.endObject();
+    json.key("metrics");
+    json.beginObject();
+    for (const EnsembleMetric &m : report.metrics) {
+        json.key(m.name);
+        json.beginObject();
+        json.field("count", m.count);
+        if (m.count == 0) {
+            json.endObject();
+            continue;
+        }
+        json.field("mean", m.mean);
+        json.field("variance", m.variance());
+        json.field("stddev", std::sqrt(m.variance()));
+        json.field("min", m.sketch.min());
+        json.field("p05", m.sketch.quantile(0.05));
+        json.field("p25", m.sketch.quantile(0.25));
+        json.field("p50", m.sketch.quantile(0.50));
+        json.field("p75", m.sketch.quantile(0.75));
+        json.field("p95", m.sketch.quantile(0.95));
+        json.field("max", m.sketch.max());
+        json.endObject();
+    }
+    json.endObject();
+    json.field("sketchK", report.metrics.empty() ? 0u : report.metrics.front().sketch.k());
+    json.endObject();
+    return out;
+}
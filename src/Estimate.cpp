@@ -0,0 +1,191 @@
+#include "Estimate.h"
+#include "City.h"
+#include "JsonWriter.h"
+#include "Layout.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+// Blocks parcelised when counting parcels; larger layouts are sampled.
+constexpr std::size_t kMaxSampledBlocks = 512;
+
+// Share of developed cells the zoning noise turns green before the
+// per-capita top-up (measured across seeds).
+constexpr double kNoiseGreenFraction = 0.003;
+
+// Exporter models: one prism is 12 triangles; glTF stores three unshared
+// vertices (position + normal) and three uint32 indices per triangle.
+constexpr std::uint64_t kTrianglesPerPrism = 12;
+constexpr std::uint64_t kGltfBytesPerTriangle = 3 * (12 + 12) + 3 * 4;
+constexpr std::uint64_t kGltfJsonBytes = 4096;
+constexpr double kObjVertexLineBytes = 20.0;
+constexpr double kObjUsemtlBytes = 22.5;
+constexpr double kObjRoadUsemtlBytes = 16.0;
+constexpr std::uint64_t kMtlBytes = 600;
+constexpr std::uint64_t kSummaryBytes = 2560;
+
+// Memory model, calibrated against measured max RSS.  The base covers the
+// runtime, worker threads and stream buffers.  The glTF mesh buffers grow
+// by doubling, so they hold about 1.5× their final payload, and the async
+// writer touches at most its whole buffer pool on top.
+constexpr std::uint64_t kBaseRssBytes = 10ull << 20;
+constexpr std::uint64_t kZoneBytes = sizeof(ZoneType);
+constexpr double kMeshGrowthFactor = 1.5;
+constexpr std::uint64_t kWriterPoolBytes = 8ull << 20;
+
+// Average number of decimal digits of the integers 1..n.
+double averageDigits(std::uint64_t n) {
+    if (n == 0) return 1.0;
+    double total = 0.0;
+    std::uint64_t lo = 1;
+    for (int digits = 1; lo <= n; ++digits, lo *= 10) {
+        std::uint64_t hi = std::min(n, lo * 10 - 1);
+        total += static_cast<double>(hi - lo + 1) * digits;
+    }
+    return total / static_cast<double>(n);
+}
+
+// Zone of the cell sampleZone() would read for a footprint centred at
+// (x, y) is None exactly when that cell's centre lies outside the radius.
+bool undevelopedAt(double x, double y, int size, double centre, double radius) {
+    double cx = std::clamp(x, 0.0, static_cast<double>(size - 1));
+    double cy = std::clamp(y, 0.0, static_cast<double>(size - 1));
+    double dx = std::floor(cx) + 0.5 - centre;
+    double dy = std::floor(cy) + 0.5 - centre;
+    return std::sqrt(dx * dx + dy * dy) > radius;
+}
+
+} // namespace
+
+ResourceEstimate estimateResources(const Config &input) {
+    Config cfg = input;
+    cfg.normalize();
+    ResourceEstimate e;
+    const int size = cfg.grid_size;
+    e.cells = static_cast<std::uint64_t>(size) * size;
+
+    StreetLayout layout = deriveStreetLayout(cfg);
+    const double centre = layout.centreX;
+    const double radius = layout.radius;
+    e.blocks = layout.blocks.size();
+    e.roads = layout.roads.size();
+
+    // Developed cells: per row, the cells whose centre lies in the disc.
+    for (int y = 0; y < size; ++y) {
+        double dy = y + 0.5 - centre;
+        double span2 = radius * radius - dy * dy;
+        if (span2 < 0.0) continue;
+        double half = std::sqrt(span2);
+        int x0 = std::max(0, static_cast<int>(std::ceil(centre - half - 0.5)));
+        int x1 = std::min(size - 1, static_cast<int>(std::floor(centre + half - 0.5)));
+        if (x1 >= x0) e.developedCells += static_cast<std::uint64_t>(x1 - x0 + 1);
+    }
+    auto target = static_cast<std::uint64_t>(std::ceil((cfg.population * 8.0) / 10000.0));
+    auto noiseGreen = static_cast<std::uint64_t>(e.developedCells * kNoiseGreenFraction);
+    e.greenCells = std::min(e.developedCells, std::max(target, noiseGreen));
+
+    // Parcels: run the generator's subdivision on (a sample of) the blocks
+    // and apply the same radius and zoning filters.  Small layouts are
+    // parcelised several times over, up to the sample budget, so the
+    // count is an average rather than one random draw.
+    std::mt19937 rng(cfg.seed);
+    std::size_t step = std::max<std::size_t>(1, (layout.blocks.size() + kMaxSampledBlocks - 1) / kMaxSampledBlocks);
+    std::size_t passes = layout.blocks.empty() ? 1 : std::max<std::size_t>(1, kMaxSampledBlocks / layout.blocks.size());
+    std::uint64_t sampledBlocks = 0;
+    std::uint64_t sampledParcels = 0;
+    for (std::size_t pass = 0; pass < passes; ++pass) {
+        for (std::size_t i = 0; i < layout.blocks.size(); i += step) {
+            sampledBlocks++;
+            if (cfg.layout == Config::LayoutType::Grid) {
+                for (const auto &parcel : parcelizeBlock(layout.blocks[i], rng)) {
+                    Rect r = jitterFootprint(parcel, rng);
+                    double dx = r.centreX() - centre, dy = r.centreY() - centre;
+                    if (std::sqrt(dx * dx + dy * dy) > radius * 1.02) continue;
+                    if (undevelopedAt(r.centreX(), r.centreY(), size, centre, radius)) continue;
+                    sampledParcels++;
+                }
+            } else {
+                for (const auto &quad : parcelizeWedge(centre, centre, layout.wedges[i], rng)) {
+                    Vec2 c = centroidOfQuad(quad);
+                    Rect r = boundsFromQuad(quad);
+                    double dx = c.x - centre, dy = c.y - centre;
+                    if (std::sqrt(dx * dx + dy * dy) > radius * 1.05) continue;
+                    if (undevelopedAt(r.centreX(), r.centreY(), size, centre, radius)) continue;
+                    sampledParcels++;
+                }
+            }
+        }
+    }
+    if (sampledBlocks > 0) {
+        e.parcels = static_cast<std::uint64_t>(std::llround(
+            static_cast<double>(sampledParcels) * e.blocks / static_cast<double>(sampledBlocks)));
+    }
+    double greenShare = e.developedCells ? static_cast<double>(e.greenCells) / e.developedCells : 0.0;
+    e.parks = static_cast<std::uint64_t>(std::llround(e.parcels * greenShare));
+    std::uint64_t buildings = e.parcels - e.parks;
+    std::uint64_t hospitals = std::min<std::uint64_t>(cfg.hospitals, buildings);
+    std::uint64_t schools = std::min<std::uint64_t>(cfg.schools, buildings - hospitals);
+    e.facilities = hospitals + schools;
+
+    // Archetypes: plain buildings and roads are one prism, parks and
+    // hospitals three, schools two.
+    std::uint64_t prisms = (buildings - e.facilities) + 3 * e.parks + 3 * hospitals + 2 * schools + e.roads;
+    e.triangles = prisms * kTrianglesPerPrism;
+    std::uint64_t binBytes = e.triangles * kGltfBytesPerTriangle;
+    e.gltfBytes = binBytes + kGltfJsonBytes;
+    e.glbBytes = binBytes + kGltfJsonBytes + 28;
+    double faceLine = 5.0 + 3.0 * averageDigits(prisms * 8);
+    e.objBytes = static_cast<std::uint64_t>(prisms * (8 * kObjVertexLineBytes + 12 * faceLine) +
+                                            e.parcels * kObjUsemtlBytes + e.roads * kObjRoadUsemtlBytes) +
+                 kMtlBytes;
+    e.summaryBytes = kSummaryBytes;
+    e.rasterBytes = e.cells * (1 + 4 * sizeof(float)) + 4096;
+
+    // Peak memory: the zone grid lives throughout; the green top-up briefly
+    // holds a candidate index per residential/industrial cell; facility
+    // placement keeps two candidate lists per parcel.
+    std::uint64_t zoneBytes = e.cells * kZoneBytes;
+    std::uint64_t topUp = target > noiseGreen ? e.developedCells * 7 / 10 * sizeof(std::size_t) : 0;
+    std::uint64_t cityBytes = e.parcels * sizeof(Building) + e.roads * sizeof(RoadSegment) +
+                              e.blocks * sizeof(Block);
+    std::uint64_t placement = e.parcels * 4 * (sizeof(std::size_t) + sizeof(double));
+    e.generationRssBytes = kBaseRssBytes + zoneBytes + std::max(topUp, cityBytes + placement);
+    std::uint64_t exportBytes = 0;
+    if (cfg.export_format != Config::ExportFormat::OBJ) {
+        exportBytes = static_cast<std::uint64_t>(binBytes * kMeshGrowthFactor) +
+                      std::min(binBytes, kWriterPoolBytes);
+    }
+    e.peakRssBytes = std::max(e.generationRssBytes, kBaseRssBytes + zoneBytes + cityBytes + exportBytes);
+    return e;
+}
+
+std::string estimateToJson(const ResourceEstimate &e) {
+    std::string out;
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("cells", e.cells);
+    json.field("developedCells", e.developedCells);
+    json.field("greenCells", e.greenCells);
+    json.field("blocks", e.blocks);
+    json.field("roads", e.roads);
+    json.field("parcels", e.parcels);
+    json.field("parks", e.parks);
+    json.field("facilities", e.facilities);
+    json.field("triangles", e.triangles);
+    json.key("outputBytes");
+    json.beginObject();
+    json.field("obj", e.objBytes);
+    json.field("gltf", e.gltfBytes);
+    json.field("glb", e.glbBytes);
+    json.field("summary", e.summaryBytes);
+    json.field("rasterMax", e.rasterBytes);
+    json.endObject();
+    json.field("generationRssBytes", e.generationRssBytes);
+    json.field("peakRssBytes", e.peakRssBytes);
+    json.endObject();
+    out.push_back('\n');
+    return out;
+}
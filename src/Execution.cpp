@@ -0,0 +1,74 @@
+#include "Execution.h"
+
+#include <algorithm>
+
+namespace {
+
+std::string cancelMessage(GenerationCancelled::Reason reason, const std::string &stage) {
+    std::string what = reason == GenerationCancelled::Reason::Cancelled ? "generation cancelled"
+                                                                         : "deadline exceeded";
+    if (!stage.empty()) what += " during " + stage;
+    return what;
+}
+
+} // namespace
+
+GenerationCancelled::GenerationCancelled(Reason reason, const std::string &stage)
+    : std::runtime_error(cancelMessage(reason, stage)), reason_(reason), stage_(stage) {}
+
+void ExecutionContext::onProgress(ProgressCallback callback, std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(reportMutex_);
+    callback_ = std::move(callback);
+    interval_ = interval;
+}
+
+void ExecutionContext::setDeadline(Clock::time_point deadline) {
+    deadline_ = deadline;
+    hasDeadline_.store(true, std::memory_order_release);
+}
+
+void ExecutionContext::check() {
+    if (cancelled_.load(std::memory_order_relaxed)) {
+        throw GenerationCancelled(GenerationCancelled::Reason::Cancelled,
+                                  stage_.load(std::memory_order_relaxed));
+    }
+    if (hasDeadline_.load(std::memory_order_acquire) && Clock::now() >= deadline_) {
+        throw GenerationCancelled(GenerationCancelled::Reason::DeadlineExceeded,
+                                  stage_.load(std::memory_order_relaxed));
+    }
+    if (parent_) parent_->check();
+}
+
+void ExecutionContext::beginStage(const char *name, std::uint64_t total) {
+    stage_.store(name, std::memory_order_relaxed);
+    total_.store(total, std::memory_order_relaxed);
+    done_.store(0, std::memory_order_relaxed);
+    check();
+    report(true);
+}
+
+void ExecutionContext::endStage() {
+    done_.store(total_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    report(true);
+}
+
+void ExecutionContext::slowPath() {
+    check();
+    report(false);
+}
+
+void ExecutionContext::report(bool force) {
+    // Workers that find another thread reporting simply move on.
+    std::unique_lock<std::mutex> lock(reportMutex_, std::defer_lock);
+    if (force) lock.lock();
+    else if (!lock.try_lock()) return;
+    if (!callback_) return;
+    Clock::time_point now = Clock::now();
+    if (!force && now - lastReport_ < interval_) return;
+    lastReport_ = now;
+    Progress p;
+    p.stage = stage_.load(std::memory_order_relaxed);
+    p.total = total_.load(std::memory_order_relaxed);
+    p.done = std::min(done_.load(std::memory_order_relaxed), p.total);
+    callback_(p);
+}
@@ -0,0 +1,120 @@
+#include "JsonWriter.h"
+
+#include <charconv>
+#include <cmath>
+
+void JsonWriter::newline() {
+    out_.push_back('\n');
+    out_.append(stack_.size() * 2, ' ');
+}
+
+// Emit the separator that precedes a new element of the current container.
+void JsonWriter::separate() {
+    if (afterKey_) {
+        afterKey_ = false;
+        return;
+    }
+    if (stack_.empty()) return;
+    Level &top = stack_.back();
+    if (top.count++ > 0) out_.push_back(',');
+    if (top.compact) {
+        if (top.count > 1) out_.push_back(' ');
+    } else {
+        newline();
+    }
+}
+
+void JsonWriter::beginObject() {
+    separate();
+    bool compact = !stack_.empty() && (stack_.back().array || stack_.back().compact);
+    out_.push_back('{');
+    stack_.push_back({false, compact, 0});
+}
+
+void JsonWriter::endObject() {
+    Level top = stack_.back();
+    stack_.pop_back();
+    if (!top.compact && top.count > 0) newline();
+    out_.push_back('}');
+}
+
+void JsonWriter::beginArray() {
+    separate();
+    out_.push_back('[');
+    stack_.push_back({true, true, 0});
+}
+
+void JsonWriter::endArray() {
+    stack_.pop_back();
+    out_.push_back(']');
+}
+
+void JsonWriter::key(std::string_view name) {
+    separate();
+    writeString(name);
+    raw(": ");
+    afterKey_ = true;
+}
+
+void JsonWriter::value(double v) {
+    if (!std::isfinite(v)) {
+        null();
+        return;
+    }
+    separate();
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out_.append(buf, res.ptr);
+}
+
+void JsonWriter::value(std::int64_t v) {
+    separate();
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out_.append(buf, res.ptr);
+}
+
+void JsonWriter::value(std::uint64_t v) {
+    separate();
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out_.append(buf, res.ptr);
+}
+
+void JsonWriter::value(bool v) {
+    separate();
+    raw(v ? "true" : "false");
+}
+
+void JsonWriter::value(std::string_view v) {
+    separate();
+    writeString(v);
+}
+
+void JsonWriter::writeString(std::string_view v) {
+    out_.push_back('"');
+    for (char c : v) {
+        switch (c) {
+            case '"': raw("\\\""); break;
+            case '\\': raw("\\\\"); break;
+            case '\n': raw("\\n"); break;
+            case '\r': raw("\\r"); break;
+            case '\t': raw("\\t"); break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    static const char hex[] = "0123456789abcdef";
+                    raw("\\u00");
+                    out_.push_back(hex[(c >> 4) & 0xF]);
+                    out_.push_back(hex[c & 0xF]);
+                } else {
+                    out_.push_back(c);
+                }
+        }
+    }
+    out_.push_back('"');
+}
+
+void JsonWriter::null() {
+    separate();
+    raw("null");
+}
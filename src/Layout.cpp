@@ -0,0 +1,447 @@
+#include "Layout.h"
+#include "DetMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Largest gap (grid units) allowed between a ring road and the chords
+// that approximate it.  An eighth of the half width of the narrowest
+// (local) road, so the chords stay well inside the carriageway of the
+// true ring; blocks are inset by it as well, so the sag never brings a
+// chord closer to them.  Chords per ring grow as sqrt(r / tolerance).
+constexpr double kRingChordTolerance = 0.05;
+
+// Radial layouts: deepest ring band and longest outer block arc (grid
+// units) before rings are added or sectors doubled.  Small cities stay
+// within both with the population-based ring and street counts.
+constexpr double kMaxBandDepth = 16.0;
+constexpr double kMaxBlockArc = 24.0;
+constexpr int kMaxSectorLevel = 16;
+
+// Unit vector at angle theta.
+Vec2 direction(double theta) {
+    Vec2 d;
+    detmath::sincos(theta, d.y, d.x);
+    return d;
+}
+
+// Direction d rotated by the angle whose (cos, sin) is by.
+Vec2 rotate(const Vec2 &d, const Vec2 &by) { return {d.x * by.x - d.y * by.y, d.x * by.y + d.y * by.x}; }
+
+// Point at distance r from (cx, cy) along unit direction d.
+Vec2 along(double cx, double cy, double r, const Vec2 &d) { return {cx + r * d.x, cy + r * d.y}; }
+
+// Chords per radial sector of a ring of radius r such that no chord strays
+// more than kRingChordTolerance from the circle (sagitta r(1 - cos(a/2))).
+int ringChordsPerSector(double r, double sectorAngle) {
+    double maxChordAngle = 2.0 * detmath::acos(1.0 - std::min(kRingChordTolerance / std::max(r, 1e-9), 1.0));
+    return std::max(1, static_cast<int>(std::ceil(sectorAngle / maxChordAngle - 1e-9)));
+}
+
+// Recursively subdivide a rectangle into smaller lots using a binary split
+// along the longest dimension until parcels fit within maxSize.
+void subdivideRect(const Rect &r, double minSize, double maxSize,
+                   std::mt19937 &rng, std::vector<Rect> &out, int depth = 0) {
+    double w = r.width();
+    double h = r.height();
+    if ((w <= maxSize && h <= maxSize) || depth > 6) {
+        out.push_back(r);
+        return;
+    }
+    bool splitX = (w > h);
+    double minCut = splitX ? r.x0 + minSize : r.y0 + minSize;
+    double maxCut = splitX ? r.x1 - minSize : r.y1 - minSize;
+    if (maxCut <= minCut) {
+        out.push_back(r);
+        return;
+    }
+    double cut = detmath::uniform(rng, minCut, maxCut);
+    Rect a = r;
+    Rect b = r;
+    if (splitX) {
+        a.x1 = cut;
+        b.x0 = cut;
+    } else {
+        a.y1 = cut;
+        b.y0 = cut;
+    }
+    subdivideRect(a, minSize, maxSize, rng, out, depth + 1);
+    subdivideRect(b, minSize, maxSize, rng, out, depth + 1);
+}
+
+} // namespace
+
+// Shrink a parcel footprint and apply small random jitter so buildings do not
+// perfectly fill or align within their parcels.
+Rect jitterFootprint(const Rect &parcel, std::mt19937 &rng) {
+    double w = parcel.width();
+    double h = parcel.height();
+    if (w <= 0.0 || h <= 0.0) return parcel;
+    double areaScale = detmath::uniform(rng, 0.4, 0.9);
+    double linearScale = std::sqrt(areaScale);
+    double newW = w * linearScale;
+    double newH = h * linearScale;
+    double marginX = (w - newW) * 0.5;
+    double marginY = (h - newH) * 0.5;
+    double jitterFrac = 0.6;
+    double cx = parcel.centreX() + detmath::uniform(rng, -marginX * jitterFrac, marginX * jitterFrac);
+    double cy = parcel.centreY() + detmath::uniform(rng, -marginY * jitterFrac, marginY * jitterFrac);
+    Rect r;
+    r.x0 = cx - newW * 0.5;
+    r.x1 = cx + newW * 0.5;
+    r.y0 = cy - newH * 0.5;
+    r.y1 = cy + newH * 0.5;
+    // Clamp to stay within the parcel bounds
+    double shiftX0 = std::max(parcel.x0 - r.x0, 0.0);
+    double shiftY0 = std::max(parcel.y0 - r.y0, 0.0);
+    double shiftX1 = std::max(r.x1 - parcel.x1, 0.0);
+    double shiftY1 = std::max(r.y1 - parcel.y1, 0.0);
+    r.x0 += shiftX0 - shiftX1;
+    r.x1 += shiftX0 - shiftX1;
+    r.y0 += shiftY0 - shiftY1;
+    r.y1 += shiftY0 - shiftY1;
+    return r;
+}
+
+// Carve out a central courtyard from a block and subdivide the remaining
+// strips into parcels.  If the block is too small for a courtyard, the whole
+// area is subdivided.
+std::vector<Rect> parcelizeBlock(const Block &block, std::mt19937 &rng) {
+    const Rect &b = block.bounds;
+    double w = b.width();
+    double h = b.height();
+    const double minParcel = 3.0;
+    const double maxParcel = 12.0;
+    std::vector<Rect> parcels;
+    // Randomised courtyard fraction; ensures at least ~15% stays open.
+    double margin = std::min(w, h) * detmath::uniform(rng, 0.15, 0.30);
+    if (margin * 2.0 < w && margin * 2.0 < h) {
+        Rect inner{b.x0 + margin, b.y0 + margin, b.x1 - margin, b.y1 - margin};
+        Rect strips[4] = {
+            {b.x0, b.y0, b.x1, inner.y0},
+            {b.x0, inner.y1, b.x1, b.y1},
+            {b.x0, inner.y0, inner.x0, inner.y1},
+            {inner.x1, inner.y0, b.x1, inner.y1}
+        };
+        for (const auto &s : strips) {
+            if (s.width() >= minParcel && s.height() >= minParcel) {
+                subdivideRect(s, minParcel, maxParcel, rng, parcels);
+            }
+        }
+        // The inner courtyard is intentionally left empty.
+    } else {
+        subdivideRect(b, minParcel, maxParcel, rng, parcels);
+    }
+    return parcels;
+}
+
+std::array<Vec2, 4> rectToQuad(const Rect &r) {
+    return {{
+        {r.x0, r.y0},
+        {r.x1, r.y0},
+        {r.x1, r.y1},
+        {r.x0, r.y1}
+    }};
+}
+
+Rect boundsFromQuad(const std::array<Vec2, 4> &q) {
+    Rect r;
+    r.x0 = r.x1 = q[0].x;
+    r.y0 = r.y1 = q[0].y;
+    for (int i = 1; i < 4; ++i) {
+        r.x0 = std::min(r.x0, q[i].x);
+        r.x1 = std::max(r.x1, q[i].x);
+        r.y0 = std::min(r.y0, q[i].y);
+        r.y1 = std::max(r.y1, q[i].y);
+    }
+    return r;
+}
+
+Vec2 centroidOfQuad(const std::array<Vec2, 4> &q) {
+    double cx = 0.0;
+    double cy = 0.0;
+    for (const auto &p : q) {
+        cx += p.x;
+        cy += p.y;
+    }
+    cx *= 0.25;
+    cy *= 0.25;
+    return {cx, cy};
+}
+
+// Convert a wedge block into quads by unwrapping to a rectangle in (arc, radius)
+// space, parcelising, and mapping back to polar coordinates.
+std::vector<std::array<Vec2, 4>> parcelizeWedge(double cx, double cy, const Wedge &wedge,
+                                                std::mt19937 &rng) {
+    const double r1 = wedge.r1;
+    const double theta0 = wedge.theta0;
+    const double theta1 = wedge.theta1;
+    const double minParcel = 3.0;
+    const double maxParcel = 12.0;
+    if (wedge.r0 <= 1e-6) return {};
+    // Parcel edges are straight, so an inner edge sags towards the centre
+    // by up to the sagitta of the widest parcel; start parcels that far out.
+    double r0 = std::min(wedge.r0 + maxParcel * maxParcel / (8.0 * wedge.r0),
+                         (wedge.r0 + r1) * 0.5);
+    double radialThickness = r1 - r0;
+    if (radialThickness <= 0.1) return {};
+    double midR = (r0 + r1) * 0.5;
+    double thetaSpan = theta1 - theta0;
+    if (thetaSpan <= 1e-4 || midR <= 1e-6) return {};
+    double arcLength = thetaSpan * midR;
+    Rect uvBlock{0.0, 0.0, arcLength, radialThickness};
+    std::vector<Rect> uvParcels;
+    subdivideRect(uvBlock, minParcel, maxParcel, rng, uvParcels);
+    // Corners are placed along the direction of their arc position u,
+    // taken as an offset phi from the wedge's centre line; both corners at
+    // one u share a direction.  Radii are scaled so the outer arc maps onto
+    // the chord between the block's outer corners (at r1 cos(half) / cos(phi)),
+    // keeping parcels inside the block quad.
+    const double half = thetaSpan * 0.5;
+    const double chordR = r1 * detmath::cos(half);
+    Vec2 centreLine = direction(theta0 + half);
+    struct Ray {
+        Vec2 dir;
+        double scale; ///< World radius per unit of v
+    };
+    auto rayAt = [&](double u) {
+        double phi = (u / arcLength) * thetaSpan - half;
+        Vec2 offset = direction(phi);
+        double outer = chordR / offset.x;
+        return Ray{rotate(centreLine, offset), std::max(outer - r0, 0.0) / radialThickness};
+    };
+    std::vector<std::array<Vec2, 4>> quads;
+    quads.reserve(uvParcels.size());
+    for (const auto &uv : uvParcels) {
+        Rect jittered = jitterFootprint(uv, rng);
+        Ray a = rayAt(jittered.x0);
+        Ray b = rayAt(jittered.x1);
+        double v0 = jittered.y0;
+        double v1 = jittered.y1;
+        std::array<Vec2, 4> quad = {{
+            along(cx, cy, r0 + v0 * a.scale, a.dir),
+            along(cx, cy, r0 + v0 * b.scale, b.dir),
+            along(cx, cy, r0 + v1 * b.scale, b.dir),
+            along(cx, cy, r0 + v1 * a.scale, a.dir)
+        }};
+        quads.push_back(quad);
+    }
+    return quads;
+}
+
+
+namespace {
+
+void deriveGridLayout(StreetLayout &layout) {
+    const double cx = layout.centreX;
+    const double cy = layout.centreY;
+    const double radius = layout.radius;
+    // Road alignments along fixed grid lines; these are reused when carving
+    // blocks so that road geometry and parcels stay consistent.
+    std::vector<double> xLines = {cx - radius, cx - radius * 0.9, cx - radius * 0.5,
+                                  cx, cx + radius * 0.5, cx + radius * 0.9, cx + radius};
+    std::vector<double> yLines = {cy - radius, cy - radius * 0.9, cy - radius * 0.5,
+                                  cy, cy + radius * 0.5, cy + radius * 0.9, cy + radius};
+    auto uniqSort = [](std::vector<double> &vals) {
+        std::sort(vals.begin(), vals.end());
+        vals.erase(std::unique(vals.begin(), vals.end()), vals.end());
+    };
+    uniqSort(xLines);
+    uniqSort(yLines);
+    auto classifyRoad = [&](double coord, bool isX) {
+        double anchor = isX ? cx : cy;
+        double denom = (radius > 1e-6) ? radius : 1.0;
+        double norm = std::abs(coord - anchor) / denom;
+        if (norm < 0.15) return RoadType::Arterial;
+        if (norm < 0.6) return RoadType::Secondary;
+        return RoadType::Local;
+    };
+    // Vertical and horizontal lines spanning the developed area.  Widths are
+    // derived from hierarchy.
+    for (double x : xLines) {
+        layout.roads.push_back({x, cy - radius, x, cy + radius, classifyRoad(x, true)});
+    }
+    for (double y : yLines) {
+        layout.roads.push_back({cx - radius, y, cx + radius, y, classifyRoad(y, false)});
+    }
+    // Derive blocks from road lines (axis-aligned grid between road traces)
+    auto insetFor = [&](double coord, bool isX) {
+        return 0.5 * roadWidth(classifyRoad(coord, isX));
+    };
+    for (std::size_t xi = 0; xi + 1 < xLines.size(); ++xi) {
+        for (std::size_t yi = 0; yi + 1 < yLines.size(); ++yi) {
+            double x0 = xLines[xi] + insetFor(xLines[xi], true);
+            double x1 = xLines[xi + 1] - insetFor(xLines[xi + 1], true);
+            double y0 = yLines[yi] + insetFor(yLines[yi], false);
+            double y1 = yLines[yi + 1] - insetFor(yLines[yi + 1], false);
+            if (x1 <= x0 || y1 <= y0) continue;
+            Rect bounds{x0, y0, x1, y1};
+            double dx = bounds.centreX() - cx;
+            double dy = bounds.centreY() - cy;
+            double dist = std::sqrt(dx * dx + dy * dy);
+            if (dist > radius * 1.05) continue; // outside developed area
+            if (bounds.width() < 1.0 || bounds.height() < 1.0) continue;
+            Block blk;
+            blk.bounds = bounds;
+            blk.hasCorners = true;
+            blk.corners = rectToQuad(bounds);
+            layout.blocks.push_back(blk);
+        }
+    }
+}
+
+void deriveRadialLayout(const Config &cfg, StreetLayout &layout) {
+    const double cx = layout.centreX;
+    const double cy = layout.centreY;
+    const double radius = layout.radius;
+    double maxR = radius;
+    int ringCount = std::clamp(static_cast<int>(std::round(3.0 + cfg.population / 200000.0)), 3, 8);
+    // Large cities get more rings so no band is deeper than kMaxBandDepth.
+    ringCount = std::max(ringCount, static_cast<int>(std::ceil(maxR / kMaxBandDepth)) - 1);
+    int radialRoads = std::clamp(static_cast<int>(std::round(10.0 + cfg.city_radius * 8.0)), 8, 20);
+    std::vector<double> ringEdges;
+    ringEdges.reserve(ringCount + 2);
+    ringEdges.push_back(0.0);
+    for (int i = 1; i <= ringCount; ++i) {
+        double frac = static_cast<double>(i) / static_cast<double>(ringCount + 1);
+        ringEdges.push_back(maxR * frac);
+    }
+    ringEdges.push_back(maxR);
+    std::sort(ringEdges.begin(), ringEdges.end());
+    ringEdges.erase(std::unique(ringEdges.begin(), ringEdges.end()), ringEdges.end());
+    const std::size_t bands = ringEdges.size() - 1;
+    const double twoPi = 6.28318530717958647692;
+
+    // Sector doubling: band b is cut into radialRoads << level[b] sectors,
+    // the level rising outwards until the band's outer arc is at most
+    // kMaxBlockArc.  Each extra level adds secondary radial streets from
+    // that band's inner ring outwards, so block arc lengths stay within a
+    // factor of two of each other at any city size.
+    std::vector<int> level(bands, 0);
+    for (std::size_t b = 0; b < bands; ++b) {
+        int l = b > 0 ? level[b - 1] : 0;
+        while (l < kMaxSectorLevel && twoPi * ringEdges[b + 1] / (radialRoads << l) > kMaxBlockArc) ++l;
+        level[b] = l;
+    }
+    const int maxLevel = bands > 0 ? level.back() : 0;
+    const int finest = radialRoads << maxLevel;
+    const double delta = twoPi / static_cast<double>(finest);
+    // Unit directions of every radial street at the finest level, shared by
+    // rings, radials and block corners so their endpoints coincide exactly.
+    std::vector<double> spokeAngles(finest + 1), spokeSin(finest + 1), spokeCos(finest + 1);
+    for (int i = 0; i <= finest; ++i) spokeAngles[i] = delta * static_cast<double>(i);
+    detmath::sincosArray(spokeAngles.data(), spokeSin.data(), spokeCos.data(), spokeAngles.size());
+    std::vector<Vec2> spokes(finest + 1);
+    for (int i = 0; i <= finest; ++i) spokes[i] = {spokeCos[i], spokeSin[i]};
+    auto stride = [&](int l) { return 1 << (maxLevel - l); };
+    auto ringType = [&](double r) {
+        double norm = (maxR > 1e-6) ? (r / maxR) : 0.0;
+        if (norm < 0.3) return RoadType::Arterial;
+        if (norm < 0.75) return RoadType::Secondary;
+        return RoadType::Local;
+    };
+    auto spokeType = [&](int i) {
+        return i % stride(0) == 0 ? RoadType::Arterial : RoadType::Secondary;
+    };
+
+    // Ring roads, approximated by chords within kRingChordTolerance of the
+    // circle: more chords on outer rings, fewer on inner ones.  A ring is
+    // split at every street of the band outside it; chord ends advance from
+    // each street by a fixed rotation, so a ring costs one cos/sin pair
+    // however finely it is cut.
+    for (std::size_t ri = 1; ri < bands; ++ri) {
+        double r = ringEdges[ri];
+        int step = stride(level[ri]);
+        double sector = delta * step;
+        int chords = ringChordsPerSector(r, sector);
+        Vec2 turn = direction(sector / static_cast<double>(chords));
+        for (int si = 0; si < finest; si += step) {
+            Vec2 d = spokes[si];
+            for (int c = 0; c < chords; ++c) {
+                Vec2 next = c + 1 == chords ? spokes[si + step] : rotate(d, turn);
+                Vec2 p0 = along(cx, cy, r, d);
+                Vec2 p1 = along(cx, cy, r, next);
+                layout.roads.push_back({p0.x, p0.y, p1.x, p1.y, ringType(r)});
+                d = next;
+            }
+        }
+    }
+    // Radial arterials, then the secondary radials of each finer level from
+    // the ring where that level starts.
+    for (int i = 0; i < finest; i += stride(0)) {
+        Vec2 p0 = along(cx, cy, 0.0, spokes[i]);
+        Vec2 p1 = along(cx, cy, maxR, spokes[i]);
+        layout.roads.push_back({p0.x, p0.y, p1.x, p1.y, RoadType::Arterial});
+    }
+    for (int l = 1; l <= maxLevel; ++l) {
+        std::size_t first = static_cast<std::size_t>(std::find(level.begin(), level.end(), l) - level.begin());
+        double r0 = ringEdges[first];
+        for (int i = stride(l); i < finest; i += 2 * stride(l)) {
+            Vec2 p0 = along(cx, cy, r0, spokes[i]);
+            Vec2 p1 = along(cx, cy, maxR, spokes[i]);
+            layout.roads.push_back({p0.x, p0.y, p1.x, p1.y, RoadType::Secondary});
+        }
+    }
+
+    // Blocks: one per band and sector, kept clear of the roads around it.
+    // Rings are cleared radially by half their width plus the chord
+    // tolerance their tessellation may sag by; radial streets by a
+    // constant angle wide enough at the block's inner radius, which leaves
+    // at least half a street width everywhere further out.  The innermost
+    // band has no ring inside it, so its blocks start where the two
+    // streets bounding them are far enough apart.
+    auto ringHalfWidth = [&](std::size_t ri) {
+        if (ri == 0 || ri == bands) return 0.0;
+        return 0.5 * roadWidth(ringType(ringEdges[ri])) + kRingChordTolerance;
+    };
+    for (std::size_t b = 0; b < bands; ++b) {
+        int step = stride(level[b]);
+        double sector = delta * step;
+        double rOut = ringEdges[b + 1] - ringHalfWidth(b + 1);
+        for (int si = 0; si < finest; si += step) {
+            double hw0 = 0.5 * roadWidth(spokeType(si));
+            double hw1 = 0.5 * roadWidth(spokeType((si + step) % finest));
+            double rIn = std::max(ringEdges[b] + ringHalfWidth(b), 2.0 * (hw0 + hw1) / sector);
+            if (rOut <= rIn) continue;
+            double t0 = delta * si + detmath::asin(std::min(hw0 / rIn, 1.0));
+            double t1 = delta * (si + step) - detmath::asin(std::min(hw1 / rIn, 1.0));
+            Vec2 d0 = direction(t0);
+            Vec2 d1 = direction(t1);
+            std::array<Vec2, 4> corners = {{
+                along(cx, cy, rIn, d0),
+                along(cx, cy, rOut, d0),
+                along(cx, cy, rOut, d1),
+                along(cx, cy, rIn, d1)
+            }};
+            Vec2 blockC = centroidOfQuad(corners);
+            double dx = blockC.x - cx;
+            double dy = blockC.y - cy;
+            double dist = std::sqrt(dx * dx + dy * dy);
+            if (dist > radius * 1.1) continue;
+            Block blk;
+            blk.bounds = boundsFromQuad(corners);
+            blk.hasCorners = true;
+            blk.corners = corners;
+            layout.blocks.push_back(blk);
+            layout.wedges.push_back({rIn, rOut, t0, t1});
+        }
+    }
+}
+
+} // namespace
+
+StreetLayout deriveStreetLayout(const Config &cfg) {
+    StreetLayout layout;
+    double centre = static_cast<double>(cfg.grid_size) / 2.0;
+    layout.centreX = centre;
+    layout.centreY = centre;
+    layout.radius = (static_cast<double>(cfg.grid_size) * cfg.city_radius) / 2.0;
+    if (cfg.layout == Config::LayoutType::Grid) {
+        deriveGridLayout(layout);
+    } else {
+        deriveRadialLayout(cfg, layout);
+    }
+    return layout;
+}
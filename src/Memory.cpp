@@ -0,0 +1,179 @@
+#include "Memory.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<std::uint64_t> gLimit{0};
+std::atomic<std::uint64_t> gCharged{0};
+std::atomic<std::uint64_t> gSpilled{0};
+
+std::mutex gScratchMutex;
+std::string gScratchDirectory;
+
+std::size_t pageSize() {
+    static const std::size_t size = [] {
+        long p = ::sysconf(_SC_PAGESIZE);
+        return p > 0 ? static_cast<std::size_t>(p) : std::size_t(4096);
+    }();
+    return size;
+}
+
+std::size_t roundUpToPage(std::size_t bytes) {
+    std::size_t page = pageSize();
+    return (bytes + page - 1) / page * page;
+}
+
+std::string scratchDirectory() {
+    {
+        std::lock_guard<std::mutex> lock(gScratchMutex);
+        if (!gScratchDirectory.empty()) return gScratchDirectory;
+    }
+    const char *tmp = std::getenv("TMPDIR");
+    return tmp && *tmp ? std::string(tmp) : std::string("/tmp");
+}
+
+// Create an anonymous scratch file: it is unlinked immediately, so the
+// space is returned as soon as the descriptor closes, even after a crash.
+int openScratchFile(std::string &directory) {
+    directory = scratchDirectory();
+    std::string path = directory + "/citygen-spill-XXXXXX";
+    int fd = ::mkstemp(path.data());
+    if (fd < 0) return -1;
+    ::unlink(path.c_str());
+    return fd;
+}
+
+} // namespace
+
+void setMemoryLimit(std::uint64_t bytes) { gLimit.store(bytes, std::memory_order_relaxed); }
+
+std::uint64_t memoryLimit() { return gLimit.load(std::memory_order_relaxed); }
+
+std::uint64_t memoryCharged() { return gCharged.load(std::memory_order_relaxed); }
+
+std::uint64_t memorySpilled() { return gSpilled.load(std::memory_order_relaxed); }
+
+void setScratchDirectory(const std::string &directory) {
+    std::lock_guard<std::mutex> lock(gScratchMutex);
+    gScratchDirectory = directory;
+}
+
+bool tryChargeMemory(std::uint64_t bytes) {
+    std::uint64_t limit = gLimit.load(std::memory_order_relaxed);
+    if (limit == 0) {
+        gCharged.fetch_add(bytes, std::memory_order_relaxed);
+        return true;
+    }
+    std::uint64_t current = gCharged.load(std::memory_order_relaxed);
+    do {
+        if (current + bytes > limit) return false;
+    } while (!gCharged.compare_exchange_weak(current, current + bytes, std::memory_order_relaxed));
+    return true;
+}
+
+void releaseMemory(std::uint64_t bytes) { gCharged.fetch_sub(bytes, std::memory_order_relaxed); }
+
+SpillBuffer::~SpillBuffer() {
+    if (fd_ >= 0) {
+        if (data_) ::munmap(data_, capacity_);
+        ::close(fd_);
+    } else if (data_) {
+        std::free(data_);
+        releaseMemory(capacity_);
+    }
+}
+
+void SpillBuffer::reserve(std::size_t bytes, std::size_t used) {
+    if (bytes <= capacity_) return;
+    if (fd_ >= 0) {
+        // Already on disk: extend the file and map the larger range.  The
+        // contents live in the file, so the old mapping can simply go.
+        std::size_t grown = roundUpToPage(bytes);
+        if (::ftruncate(fd_, static_cast<off_t>(grown)) != 0) {
+            throw MemoryLimitExceeded("cannot extend scratch file: " + std::string(std::strerror(errno)));
+        }
+        ::munmap(data_, capacity_);
+        void *p = ::mmap(nullptr, grown, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            data_ = nullptr;
+            capacity_ = 0;
+            throw MemoryLimitExceeded("cannot map scratch file: " + std::string(std::strerror(errno)));
+        }
+        data_ = static_cast<std::uint8_t *>(p);
+        gSpilled.fetch_add(grown - capacity_, std::memory_order_relaxed);
+        capacity_ = grown;
+        return;
+    }
+    if (!tryChargeMemory(bytes)) {
+        spill(bytes, used);
+        return;
+    }
+    auto *p = static_cast<std::uint8_t *>(std::malloc(bytes));
+    if (!p) {
+        releaseMemory(bytes);
+        throw std::bad_alloc();
+    }
+    if (used) std::memcpy(p, data_, used);
+    std::free(data_);
+    releaseMemory(capacity_);
+    data_ = p;
+    capacity_ = bytes;
+}
+
+void SpillBuffer::spill(std::size_t bytes, std::size_t used) {
+    std::string directory;
+    int fd = openScratchFile(directory);
+    std::size_t size = roundUpToPage(bytes);
+    if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        std::string reason = std::strerror(errno);
+        if (fd >= 0) ::close(fd);
+        throw MemoryLimitExceeded("memory limit of " + std::to_string(memoryLimit()) +
+                                  " bytes reached and no scratch file could be created in " +
+                                  directory + ": " + reason);
+    }
+    void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        std::string reason = std::strerror(errno);
+        ::close(fd);
+        throw MemoryLimitExceeded("cannot map scratch file: " + reason);
+    }
+    auto *mapped = static_cast<std::uint8_t *>(p);
+    // Copy across in window-sized slices, dropping each one behind us so
+    // the copy itself never holds the whole array twice.
+    std::size_t copied = 0;
+    std::size_t dropped = 0;
+    while (copied < used) {
+        std::size_t n = std::min(used - copied, kResidentWindow);
+        std::memcpy(mapped + copied, data_ + copied, n);
+        copied += n;
+        std::size_t drop = copied / pageSize() * pageSize();
+        if (drop > dropped) {
+            ::madvise(mapped + dropped, drop - dropped, MADV_DONTNEED);
+            dropped = drop;
+        }
+    }
+    std::free(data_);
+    releaseMemory(capacity_);
+    data_ = mapped;
+    capacity_ = size;
+    dropped_ = dropped;
+    fd_ = fd;
+    gSpilled.fetch_add(size, std::memory_order_relaxed);
+}
+
+void SpillBuffer::dropResident(std::size_t used) {
+    // Dirty pages of a shared file mapping stay in the page cache (and
+    // reach the file on writeback), so releasing them loses nothing.
+    std::size_t limit = (used - kResidentWindow) / pageSize() * pageSize();
+    if (limit <= dropped_) return;
+    ::madvise(data_ + dropped_, limit - dropped_, MADV_DONTNEED);
+    dropped_ = limit;
+}
@@ -0,0 +1,197 @@
+#include "Numa.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// set_mempolicy(2) mode; spelled out so libnuma's headers are not needed.
+constexpr int kMpolPreferred = 1;
+
+std::atomic<bool> gPlacement{false};
+
+thread_local int tBoundNode = -1;
+
+std::mutex gStatsMutex;
+std::vector<NumaNodeStats> gStats;
+
+// Parse a sysfs CPU list such as "0-3,8-11".
+std::vector<int> parseCpuList(const std::string &text) {
+    std::vector<int> cpus;
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        std::size_t comma = text.find(',', pos);
+        if (comma == std::string::npos) comma = text.size();
+        std::string range = text.substr(pos, comma - pos);
+        std::size_t dash = range.find('-');
+        char *end = nullptr;
+        long lo = std::strtol(range.c_str(), &end, 10);
+        long hi = dash == std::string::npos ? lo : std::strtol(range.c_str() + dash + 1, &end, 10);
+        if (end != range.c_str() && lo >= 0) {
+            for (long c = lo; c <= hi && c < CPU_SETSIZE; ++c) cpus.push_back(static_cast<int>(c));
+        }
+        pos = comma + 1;
+    }
+    return cpus;
+}
+
+std::vector<NumaNode> discoverNodes() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveMask = ::sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    auto usable = [&](int cpu) { return !haveMask || CPU_ISSET(cpu, &allowed); };
+
+    std::vector<NumaNode> nodes;
+    if (DIR *dir = ::opendir("/sys/devices/system/node")) {
+        while (dirent *entry = ::readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.rfind("node", 0) != 0 || name.size() == 4 ||
+                name.find_first_not_of("0123456789", 4) != std::string::npos) {
+                continue;
+            }
+            std::ifstream in("/sys/devices/system/node/" + name + "/cpulist");
+            std::string list;
+            if (!std::getline(in, list)) continue;
+            NumaNode node;
+            node.id = std::atoi(name.c_str() + 4);
+            for (int cpu : parseCpuList(list)) {
+                if (usable(cpu)) node.cpus.push_back(cpu);
+            }
+            if (!node.cpus.empty()) nodes.push_back(std::move(node));
+        }
+        ::closedir(dir);
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+    if (nodes.empty()) {
+        NumaNode all;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (haveMask ? CPU_ISSET(cpu, &allowed) : cpu < static_cast<int>(workerCount())) {
+                all.cpus.push_back(cpu);
+            }
+        }
+        if (all.cpus.empty()) all.cpus.push_back(0);
+        nodes.push_back(std::move(all));
+    }
+    return nodes;
+}
+
+void preferNode(int id) {
+#ifdef SYS_set_mempolicy
+    constexpr std::size_t kBits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(static_cast<std::size_t>(id) / kBits + 1, 0);
+    mask[static_cast<std::size_t>(id) / kBits] |= 1ul << (static_cast<std::size_t>(id) % kBits);
+    // The kernel reads one bit fewer than maxnode, hence the + 1.
+    ::syscall(SYS_set_mempolicy, kMpolPreferred, mask.data(), mask.size() * kBits + 1);
+#else
+    (void)id;
+#endif
+}
+
+} // namespace
+
+const std::vector<NumaNode> &numaNodes() {
+    static const std::vector<NumaNode> nodes = discoverNodes();
+    return nodes;
+}
+
+void setNumaPlacement(bool enabled) { gPlacement.store(enabled, std::memory_order_relaxed); }
+
+bool numaPlacement() { return gPlacement.load(std::memory_order_relaxed); }
+
+bool bindThreadToNode(std::size_t node) {
+    const NumaNode &n = numaNodes().at(node);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : n.cpus) CPU_SET(cpu, &set);
+    if (::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) != 0) return false;
+    preferNode(n.id);
+    tBoundNode = static_cast<int>(node);
+    detail::workerLimit = static_cast<unsigned>(n.cpus.size());
+    return true;
+}
+
+int boundNode() { return tBoundNode; }
+
+void recordNumaJob(std::size_t node, std::chrono::steady_clock::duration busy) {
+    std::lock_guard<std::mutex> lock(gStatsMutex);
+    if (gStats.empty()) gStats.resize(numaNodes().size());
+    gStats.at(node).jobs++;
+    gStats[node].busySeconds += std::chrono::duration<double>(busy).count();
+}
+
+std::vector<NumaNodeStats> numaStats() {
+    const auto &nodes = numaNodes();
+    std::vector<NumaNodeStats> stats(nodes.size());
+    {
+        std::lock_guard<std::mutex> lock(gStatsMutex);
+        if (!gStats.empty()) stats = gStats;
+    }
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        stats[i].node = nodes[i].id;
+        stats[i].cpus = nodes[i].cpus.size();
+    }
+    return stats;
+}
+
+void parallelForOnNodes(std::size_t begin, std::size_t end, const std::function<void(std::size_t)> &fn) {
+    if (!numaPlacement() || detail::inParallelFor) {
+        parallelFor(begin, end, fn);
+        return;
+    }
+    if (end <= begin) return;
+    // Worker slots, dealt round-robin from each node's CPUs.
+    const auto &nodes = numaNodes();
+    std::vector<std::size_t> slots;
+    for (std::size_t k = 0;; ++k) {
+        std::size_t added = 0;
+        for (std::size_t n = 0; n < nodes.size(); ++n) {
+            if (k < nodes[n].cpus.size()) {
+                slots.push_back(n);
+                ++added;
+            }
+        }
+        if (added == 0) break;
+    }
+    slots.resize(std::min(slots.size(), end - begin));
+
+    std::atomic<std::size_t> next{begin};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto worker = [&](std::size_t node) {
+        bindThreadToNode(node);
+        detail::inParallelFor = true;
+        while (!failed.load(std::memory_order_relaxed)) {
+            std::size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= end) break;
+            auto start = std::chrono::steady_clock::now();
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) error = std::current_exception();
+                failed.store(true, std::memory_order_relaxed);
+                break;
+            }
+            recordNumaJob(node, std::chrono::steady_clock::now() - start);
+        }
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(slots.size());
+    for (std::size_t node : slots) pool.emplace_back(worker, node);
+    for (auto &t : pool) t.join();
+    if (error) std::rethrow_exception(error);
+}
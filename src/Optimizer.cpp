@@ -0,0 +1,338 @@
+#include "Optimizer.h"
+#include "CityGenerator.h"
+#include "DetMath.h"
+#include "JsonWriter.h"
+#include "Numa.h"
+#include "Summary.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+double parseNumber(const std::string &text, const std::string &spec) {
+    char *end = nullptr;
+    double v = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || !std::isfinite(v)) {
+        throw std::invalid_argument("Invalid number in " + spec + ": " + text);
+    }
+    return v;
+}
+
+std::size_t parseMetric(const std::string &name, const std::string &spec) {
+    std::size_t metric = findSummaryMetric(name);
+    if (metric == summaryMetricCount()) {
+        throw std::invalid_argument("Unknown summary metric in " + spec + ": " + name);
+    }
+    return metric;
+}
+
+std::string formatValue(double v, bool integer) {
+    if (integer) return std::to_string(static_cast<long long>(v));
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    return std::string(buf, res.ptr);
+}
+
+// Latin hypercube sample of the options box: each dimension is cut into
+// `count` strata and every stratum is used exactly once.  Uses the raw
+// mt19937 output (not std:: distributions, whose algorithms vary between
+// standard libraries) so candidates are the same on every platform.
+std::vector<std::vector<double>> sampleCandidates(const std::vector<SearchDimension> &dims,
+                                                  unsigned count, std::uint32_t seed) {
+    std::mt19937 rng(seed);
+    auto unit = [&] { return static_cast<double>(rng()) / 4294967296.0; };
+    std::vector<std::vector<double>> values(count, std::vector<double>(dims.size()));
+    std::vector<unsigned> strata(count);
+    for (std::size_t d = 0; d < dims.size(); ++d) {
+        std::iota(strata.begin(), strata.end(), 0u);
+        detmath::shuffle(strata.begin(), strata.end(), rng);
+        const SearchDimension &dim = dims[d];
+        for (unsigned i = 0; i < count; ++i) {
+            double t = (strata[i] + unit()) / count;
+            double v = dim.integer ? std::floor(dim.lo + t * (dim.hi - dim.lo + 1.0))
+                                   : dim.lo + t * (dim.hi - dim.lo);
+            values[i][d] = std::min(v, dim.hi);
+        }
+    }
+    return values;
+}
+
+// Orient an objective so that larger is better; undefined is worst.
+double score(const OptimizerCandidate &c, const Objective &o) {
+    double v = c.metrics[o.metric];
+    if (std::isnan(v)) return -std::numeric_limits<double>::infinity();
+    return o.maximize ? v : -v;
+}
+
+bool dominates(const OptimizerCandidate &a, const OptimizerCandidate &b,
+               const std::vector<Objective> &objectives) {
+    bool better = false;
+    for (const Objective &o : objectives) {
+        double sa = score(a, o), sb = score(b, o);
+        if (sa < sb) return false;
+        if (sa > sb) better = true;
+    }
+    return better;
+}
+
+// Non-dominated sorting: rank 0 is the Pareto front of `members`, rank 1
+// the front once rank 0 is removed, and so on.
+std::vector<unsigned> paretoRanks(const std::vector<OptimizerCandidate> &candidates,
+                                  const std::vector<std::size_t> &members,
+                                  const std::vector<Objective> &objectives) {
+    std::vector<unsigned> rank(members.size(), 0);
+    std::vector<bool> placed(members.size(), false);
+    std::size_t remaining = members.size();
+    for (unsigned front = 0; remaining > 0; ++front) {
+        std::vector<std::size_t> current;
+        for (std::size_t i = 0; i < members.size(); ++i) {
+            if (placed[i]) continue;
+            bool dominated = false;
+            for (std::size_t j = 0; j < members.size() && !dominated; ++j) {
+                dominated = j != i && !placed[j] &&
+                            dominates(candidates[members[j]], candidates[members[i]], objectives);
+            }
+            if (!dominated) current.push_back(i);
+        }
+        for (std::size_t i : current) {
+            rank[i] = front;
+            placed[i] = true;
+        }
+        remaining -= current.size();
+    }
+    return rank;
+}
+
+} // namespace
+
+SearchDimension searchDimensionFromString(const std::string &spec) {
+    std::size_t colon = spec.find(':');
+    std::size_t dash = colon == std::string::npos ? std::string::npos : spec.find('-', colon + 2);
+    if (colon == std::string::npos || colon == 0 || dash == std::string::npos) {
+        throw std::invalid_argument("Invalid search range: " + spec + " (expected <option>:<lo>-<hi>)");
+    }
+    SearchDimension dim;
+    dim.option = spec.substr(0, colon);
+    std::string lo = spec.substr(colon + 1, dash - colon - 1);
+    std::string hi = spec.substr(dash + 1);
+    dim.lo = parseNumber(lo, spec);
+    dim.hi = parseNumber(hi, spec);
+    dim.integer = lo.find('.') == std::string::npos && hi.find('.') == std::string::npos;
+    if (dim.hi < dim.lo) throw std::invalid_argument("Invalid search range: " + spec + " (hi < lo)");
+    Config probe;
+    if (!applyConfigOption(probe, dim.option, formatValue(dim.lo, dim.integer))) {
+        throw std::invalid_argument("Unknown option in search range: " + dim.option);
+    }
+    return dim;
+}
+
+MetricTarget metricTargetFromString(const std::string &spec) {
+    MetricTarget target;
+    std::size_t op = spec.find("<=");
+    if (op == std::string::npos) {
+        op = spec.find(">=");
+        target.atMost = false;
+    }
+    if (op == std::string::npos || op == 0) {
+        throw std::invalid_argument("Invalid target: " + spec + " (expected <metric><=<x> or <metric>>=<x>)");
+    }
+    target.metric = parseMetric(spec.substr(0, op), spec);
+    target.bound = parseNumber(spec.substr(op + 2), spec);
+    return target;
+}
+
+Objective objectiveFromString(const std::string &spec) {
+    Objective objective;
+    if (spec.rfind("max:", 0) == 0) {
+        objective.maximize = true;
+    } else if (spec.rfind("min:", 0) == 0) {
+        objective.maximize = false;
+    } else {
+        throw std::invalid_argument("Invalid objective: " + spec + " (expected max:<metric> or min:<metric>)");
+    }
+    objective.metric = parseMetric(spec.substr(4), spec);
+    return objective;
+}
+
+OptimizerResult optimizeConfig(const Config &base, const OptimizerOptions &options,
+                               ExecutionContext *ctx) {
+    if (options.dimensions.empty() || options.candidates == 0) {
+        throw std::invalid_argument("Nothing to optimize: give at least one --vary range");
+    }
+    const std::size_t metricCount = summaryMetricCount();
+    const unsigned eta = std::max(options.eta, 2u);
+    const unsigned replicates = std::max(options.replicates, 1u);
+
+    OptimizerResult result;
+    for (std::vector<double> &values : sampleCandidates(options.dimensions, options.candidates,
+                                                         options.searchSeed)) {
+        OptimizerCandidate c;
+        c.config = base;
+        for (std::size_t d = 0; d < values.size(); ++d) {
+            const SearchDimension &dim = options.dimensions[d];
+            applyConfigOption(c.config, dim.option, formatValue(values[d], dim.integer));
+        }
+        c.config.normalize();
+        c.values = std::move(values);
+        c.metrics.assign(metricCount, std::numeric_limits<double>::quiet_NaN());
+        result.candidates.push_back(std::move(c));
+    }
+    auto &candidates = result.candidates;
+    // Per-candidate metric sums and the number of seeds defining each.
+    std::vector<double> sums(candidates.size() * metricCount, 0.0);
+    std::vector<unsigned> defined(candidates.size() * metricCount, 0);
+
+    std::vector<std::size_t> alive(candidates.size());
+    std::iota(alive.begin(), alive.end(), 0);
+    unsigned rungSeeds = 1;
+    std::vector<std::pair<std::size_t, unsigned>> runs;
+    std::vector<double> staged;
+    for (;;) {
+        ++result.rungs;
+        result.rungSizes.push_back(alive.size());
+        runs.clear();
+        for (std::size_t c : alive) {
+            for (unsigned k = candidates[c].seeds; k < rungSeeds; ++k) runs.emplace_back(c, k);
+        }
+        staged.assign(runs.size() * metricCount, 0.0);
+        StageScope stage(ctx, "optimize", runs.size());
+        parallelForOnNodes(0, runs.size(), [&](std::size_t r) {
+            Config member = candidates[runs[r].first].config;
+            member.seed += runs[r].second;
+            CitySummary summary = computeSummary(CityGenerator::generate(member));
+            double *row = staged.data() + r * metricCount;
+            for (std::size_t m = 0; m < metricCount; ++m) row[m] = summaryMetric(summary, m);
+            stage.advance();
+        });
+        stage.finish();
+        result.cityRuns += runs.size();
+
+        // Fold in run order, then refresh means and target misses.
+        for (std::size_t r = 0; r < runs.size(); ++r) {
+            std::size_t c = runs[r].first;
+            for (std::size_t m = 0; m < metricCount; ++m) {
+                double v = staged[r * metricCount + m];
+                if (std::isnan(v)) continue;
+                sums[c * metricCount + m] += v;
+                ++defined[c * metricCount + m];
+            }
+        }
+        std::vector<std::size_t> survivors;
+        for (std::size_t c : alive) {
+            OptimizerCandidate &cand = candidates[c];
+            cand.seeds = rungSeeds;
+            for (std::size_t m = 0; m < metricCount; ++m) {
+                unsigned n = defined[c * metricCount + m];
+                cand.metrics[m] = n ? sums[c * metricCount + m] / n : std::numeric_limits<double>::quiet_NaN();
+            }
+            cand.violation = 0.0;
+            for (const MetricTarget &t : options.targets) {
+                double v = cand.metrics[t.metric];
+                double miss = std::isnan(v) ? std::numeric_limits<double>::infinity()
+                                            : std::max(0.0, t.atMost ? v - t.bound : t.bound - v) /
+                                                  std::max(std::fabs(t.bound), 1.0);
+                cand.violation += miss;
+                if (miss > options.dropMargin) cand.dropped = true;
+            }
+            if (!cand.dropped) survivors.push_back(c);
+        }
+        if (rungSeeds >= replicates || survivors.empty()) {
+            result.finalSeeds = rungSeeds;
+            alive = std::move(survivors);
+            break;
+        }
+        // Keep the best 1/eta: least violation, then Pareto rank.
+        std::vector<unsigned> rank = paretoRanks(candidates, survivors, options.objectives);
+        std::vector<std::size_t> order(survivors.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+            const OptimizerCandidate &ca = candidates[survivors[a]], &cb = candidates[survivors[b]];
+            if (ca.violation != cb.violation) return ca.violation < cb.violation;
+            if (rank[a] != rank[b]) return rank[a] < rank[b];
+            return survivors[a] < survivors[b];
+        });
+        std::size_t keep = (survivors.size() + eta - 1) / eta;
+        alive.clear();
+        for (std::size_t i = 0; i < keep; ++i) alive.push_back(survivors[order[i]]);
+        std::sort(alive.begin(), alive.end());
+        rungSeeds = std::min(replicates, rungSeeds * eta);
+    }
+
+    std::vector<std::size_t> feasible;
+    for (std::size_t c : alive) {
+        if (candidates[c].violation == 0.0) feasible.push_back(c);
+    }
+    std::vector<unsigned> rank = paretoRanks(candidates, feasible, options.objectives);
+    for (std::size_t i = 0; i < feasible.size(); ++i) {
+        if (rank[i] == 0) candidates[feasible[i]].pareto = true;
+    }
+    return result;
+}
+
+std::string optimizerToJson(const OptimizerResult &result, const OptimizerOptions &options) {
+    const auto &candidates = result.candidates;
+    std::vector<std::size_t> pareto;
+    std::uint64_t dropped = 0;
+    for (std::size_t c = 0; c < candidates.size(); ++c) {
+        if (candidates[c].pareto) pareto.push_back(c);
+        if (candidates[c].dropped) ++dropped;
+    }
+    // Best first by the first objective.
+    if (!options.objectives.empty()) {
+        const Objective &first = options.objectives.front();
+        std::stable_sort(pareto.begin(), pareto.end(), [&](std::size_t a, std::size_t b) {
+            return score(candidates[a], first) > score(candidates[b], first);
+        });
+    }
+    // Report the metrics the search was asked about.
+    std::vector<std::size_t> reported;
+    for (const MetricTarget &t : options.targets) reported.push_back(t.metric);
+    for (const Objective &o : options.objectives) reported.push_back(o.metric);
+    std::sort(reported.begin(), reported.end());
+    reported.erase(std::unique(reported.begin(), reported.end()), reported.end());
+
+    std::string out;
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("candidates", static_cast<std::uint64_t>(candidates.size()));
+    json.field("rungs", result.rungs);
+    json.key("rungSizes");
+    json.beginArray();
+    for (std::uint64_t n : result.rungSizes) json.value(n);
+    json.endArray();
+    json.field("seedsPerCandidate", result.finalSeeds);
+    json.field("cityRuns", result.cityRuns);
+    json.field("dropped", dropped);
+    json.key("pareto");
+    json.beginArray();
+    for (std::size_t c : pareto) {
+        const OptimizerCandidate &cand = candidates[c];
+        json.beginObject();
+        json.key("options");
+        json.beginObject();
+        for (std::size_t d = 0; d < options.dimensions.size(); ++d) {
+            const SearchDimension &dim = options.dimensions[d];
+            if (dim.integer) json.field(dim.option, static_cast<std::int64_t>(cand.values[d]));
+            else json.field(dim.option, cand.values[d]);
+        }
+        json.endObject();
+        json.field("seed", static_cast<std::uint64_t>(cand.config.seed));
+        json.field("seeds", cand.seeds);
+        json.key("metrics");
+        json.beginObject();
+        for (std::size_t m : reported) json.field(summaryMetricName(m), cand.metrics[m]);
+        json.endObject();
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return out;
+}
@@ -0,0 +1,142 @@
+#include "Output.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t kBufferSize = 1 << 20;
+
+// Parse "fd:N"; returns -1 if the target is not a descriptor reference.
+int parseFdTarget(const std::string &target) {
+    if (target.rfind("fd:", 0) != 0 || target.size() == 3) return -1;
+    char *end = nullptr;
+    long fd = std::strtol(target.c_str() + 3, &end, 10);
+    if (*end != '\0' || fd < 0) return -1;
+    return static_cast<int>(fd);
+}
+
+void growPipe(int fd) {
+#ifdef F_SETPIPE_SZ
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        // Unprivileged processes may be capped below this; ignore failure.
+        fcntl(fd, F_SETPIPE_SZ, static_cast<int>(kBufferSize));
+    }
+#else
+    (void)fd;
+#endif
+}
+
+} // namespace
+
+bool isStreamTarget(const std::string &target) {
+    return target == "-" || parseFdTarget(target) >= 0;
+}
+
+FdStreamBuf::FdStreamBuf(int fd, bool ownsFd) : fd_(fd), ownsFd_(ownsFd), buffer_(kBufferSize) {
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+    if (fd_ >= 0) growPipe(fd_);
+}
+
+FdStreamBuf::~FdStreamBuf() {
+    close();
+}
+
+bool FdStreamBuf::writeAll(const char *data, std::size_t len) {
+    while (len > 0 && ok_) {
+        ssize_t n = ::write(fd_, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok_ = false;
+            break;
+        }
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+    return ok_;
+}
+
+bool FdStreamBuf::flushBuffer() {
+    std::size_t pending = static_cast<std::size_t>(pptr() - pbase());
+    bool good = pending == 0 || writeAll(pbase(), pending);
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+    return good;
+}
+
+FdStreamBuf::int_type FdStreamBuf::overflow(int_type ch) {
+    if (fd_ < 0 || !flushBuffer()) return traits_type::eof();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize FdStreamBuf::xsputn(const char *s, std::streamsize n) {
+    if (fd_ < 0) return 0;
+    std::size_t len = static_cast<std::size_t>(n);
+    std::size_t room = static_cast<std::size_t>(epptr() - pptr());
+    if (len <= room) {
+        std::memcpy(pptr(), s, len);
+        pbump(static_cast<int>(len));
+        return n;
+    }
+    if (!flushBuffer()) return 0;
+    if (len >= buffer_.size()) {
+        return writeAll(s, len) ? n : 0;
+    }
+    std::memcpy(pptr(), s, len);
+    pbump(static_cast<int>(len));
+    return n;
+}
+
+int FdStreamBuf::sync() {
+    if (fd_ < 0) return -1;
+    return flushBuffer() ? 0 : -1;
+}
+
+bool FdStreamBuf::close() {
+    if (fd_ < 0) return ok_;
+    flushBuffer();
+    if (ownsFd_ && ::close(fd_) != 0) ok_ = false;
+    fd_ = -1;
+    return ok_;
+}
+
+OutputSink::OutputSink(const std::string &target) : std::ostream(nullptr), target_(target) {
+    int fd = -1;
+    bool owns = false;
+    if (target == "-") {
+        fd = STDOUT_FILENO;
+        stream_ = true;
+    } else if (int inherited = parseFdTarget(target); inherited >= 0) {
+        fd = fcntl(inherited, F_GETFD) == -1 ? -1 : inherited;
+        stream_ = true;
+    } else {
+        fd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        owns = true;
+    }
+    if (fd < 0) {
+        setstate(std::ios::badbit);
+        return;
+    }
+    buf_ = std::make_unique<FdStreamBuf>(fd, owns);
+    rdbuf(buf_.get());
+}
+
+OutputSink::~OutputSink() {
+    close();
+}
+
+bool OutputSink::close() {
+    if (!buf_) return false;
+    bool good = buf_->close() && !bad();
+    if (!good) setstate(std::ios::badbit);
+    return good;
+}
@@ -0,0 +1,472 @@
+#include "Raster.h"
+#include "AsyncIO.h"
+#include "City.h"
+#include "Execution.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr char kMagic[4] = {'C', 'G', 'R', 'T'};
+constexpr std::uint32_t kVersion = 1;
+constexpr int kTileSize = 256;
+// Stand-in for "no seed reachable" inside the distance transform; large
+// but finite so the parabola intersections never produce inf - inf.
+constexpr double kFar = 1e20;
+
+void putU32(std::vector<std::uint8_t> &out, std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+}
+
+void putU64(std::vector<std::uint8_t> &out, std::uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+}
+
+std::uint32_t getU32(const std::uint8_t *p) {
+    return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+           (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+std::uint64_t getU64(const std::uint8_t *p) {
+    return static_cast<std::uint64_t>(getU32(p)) | (static_cast<std::uint64_t>(getU32(p + 4)) << 32);
+}
+
+// PackBits: a header byte h in [0,127] is followed by h+1 literal bytes; h in
+// [129,255] means the next byte repeats 257-h times (2..128).
+void packBits(const std::uint8_t *in, std::size_t n, std::vector<std::uint8_t> &out) {
+    std::size_t i = 0;
+    while (i < n) {
+        std::size_t run = 1;
+        while (i + run < n && run < 128 && in[i + run] == in[i]) ++run;
+        if (run >= 2) {
+            out.push_back(static_cast<std::uint8_t>(257 - run));
+            out.push_back(in[i]);
+            i += run;
+            continue;
+        }
+        // Literal span: extend until a repeat of at least two bytes starts.
+        std::size_t start = i;
+        std::size_t len = 0;
+        while (i < n && len < 128) {
+            if (i + 1 < n && in[i + 1] == in[i]) break;
+            ++i;
+            ++len;
+        }
+        out.push_back(static_cast<std::uint8_t>(len - 1));
+        out.insert(out.end(), in + start, in + start + len);
+    }
+}
+
+bool unpackBits(const std::uint8_t *in, std::size_t n, std::uint8_t *out, std::size_t expected) {
+    std::size_t i = 0;
+    std::size_t o = 0;
+    while (i < n) {
+        std::uint8_t h = in[i++];
+        if (h < 128) {
+            std::size_t len = static_cast<std::size_t>(h) + 1;
+            if (i + len > n || o + len > expected) return false;
+            std::memcpy(out + o, in + i, len);
+            i += len;
+            o += len;
+        } else if (h > 128) {
+            std::size_t len = 257 - static_cast<std::size_t>(h);
+            if (i >= n || o + len > expected) return false;
+            std::memset(out + o, in[i++], len);
+            o += len;
+        }
+    }
+    return o == expected;
+}
+
+// Replace each 32-bit cell by the integer difference from its left
+// neighbour within a tile row.  For non-negative floats the bit patterns
+// are ordered, so smooth fields leave small deltas whose high bytes are
+// 0x00/0xFF and shuffle into long runs.
+void deltaEncodeRows(std::uint8_t *cells, int w, int h) {
+    for (int y = 0; y < h; ++y) {
+        std::uint8_t *row = cells + static_cast<std::size_t>(y) * w * 4;
+        std::uint32_t prev = 0;
+        for (int x = 0; x < w; ++x) {
+            std::uint32_t cur;
+            std::memcpy(&cur, row + x * 4, 4);
+            std::uint32_t delta = cur - prev;
+            std::memcpy(row + x * 4, &delta, 4);
+            prev = cur;
+        }
+    }
+}
+
+void deltaDecodeRows(std::uint8_t *cells, int w, int h) {
+    for (int y = 0; y < h; ++y) {
+        std::uint8_t *row = cells + static_cast<std::size_t>(y) * w * 4;
+        std::uint32_t prev = 0;
+        for (int x = 0; x < w; ++x) {
+            std::uint32_t delta;
+            std::memcpy(&delta, row + x * 4, 4);
+            prev += delta;
+            std::memcpy(row + x * 4, &prev, 4);
+        }
+    }
+}
+
+// Group byte k of every element together so that e.g. the exponent bytes
+// of a smooth float field form long runs.
+void shuffleBytes(const std::uint8_t *in, std::size_t count, std::size_t width, std::uint8_t *out) {
+    for (std::size_t k = 0; k < width; ++k) {
+        for (std::size_t i = 0; i < count; ++i) out[k * count + i] = in[i * width + k];
+    }
+}
+
+void unshuffleBytes(const std::uint8_t *in, std::size_t count, std::size_t width, std::uint8_t *out) {
+    for (std::size_t k = 0; k < width; ++k) {
+        for (std::size_t i = 0; i < count; ++i) out[i * width + k] = in[k * count + i];
+    }
+}
+
+// One-dimensional squared Euclidean distance transform of a sampled
+// function (Felzenszwalb & Huttenlocher, lower envelope of parabolas).
+void distanceTransform1D(const double *f, int n, double *d, int *v, double *z) {
+    int k = 0;
+    v[0] = 0;
+    z[0] = -std::numeric_limits<double>::infinity();
+    z[1] = std::numeric_limits<double>::infinity();
+    auto intersect = [&](int q, int p) {
+        return ((f[q] + static_cast<double>(q) * q) - (f[p] + static_cast<double>(p) * p)) /
+               (2.0 * q - 2.0 * p);
+    };
+    for (int q = 1; q < n; ++q) {
+        // z[0] is -inf, so the envelope never pops below its first parabola.
+        double s = intersect(q, v[k]);
+        while (s <= z[k]) {
+            --k;
+            s = intersect(q, v[k]);
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = std::numeric_limits<double>::infinity();
+    }
+    k = 0;
+    for (int q = 0; q < n; ++q) {
+        while (z[k + 1] < q) ++k;
+        double dq = static_cast<double>(q - v[k]);
+        d[q] = dq * dq + f[v[k]];
+    }
+}
+
+// Exact Euclidean distance (in cells) from every cell to the nearest seed
+// cell.  Columns and then rows are transformed in parallel.  Cells with no
+// reachable seed (no seeds at all) are set to -1.
+std::vector<float> distanceField(const std::vector<std::uint8_t> &seeds, int size) {
+    std::vector<float> out(seeds.size(), -1.0f);
+    if (std::find(seeds.begin(), seeds.end(), 1) == seeds.end()) return out;
+    std::vector<double> grid(seeds.size());
+    for (std::size_t i = 0; i < seeds.size(); ++i) grid[i] = seeds[i] ? 0.0 : kFar;
+    parallelFor(0, static_cast<std::size_t>(size), [&](std::size_t x) {
+        std::vector<double> f(size), d(size), z(size + 1);
+        std::vector<int> v(size);
+        for (int y = 0; y < size; ++y) f[y] = grid[static_cast<std::size_t>(y) * size + x];
+        distanceTransform1D(f.data(), size, d.data(), v.data(), z.data());
+        for (int y = 0; y < size; ++y) grid[static_cast<std::size_t>(y) * size + x] = d[y];
+    });
+    parallelFor(0, static_cast<std::size_t>(size), [&](std::size_t y) {
+        std::vector<double> d(size), z(size + 1);
+        std::vector<int> v(size);
+        double *row = grid.data() + y * size;
+        distanceTransform1D(row, size, d.data(), v.data(), z.data());
+        for (int x = 0; x < size; ++x) {
+            out[y * size + x] = static_cast<float>(std::sqrt(d[x]));
+        }
+    });
+    return out;
+}
+
+std::vector<std::uint8_t> facilitySeeds(const City &city, Facility::Type type) {
+    std::vector<std::uint8_t> seeds(city.zones.size(), 0);
+    for (const auto &f : city.facilities) {
+        if (f.type != type) continue;
+        int x = std::clamp(static_cast<int>(std::floor(f.x)), 0, city.size - 1);
+        int y = std::clamp(static_cast<int>(std::floor(f.y)), 0, city.size - 1);
+        seeds[static_cast<std::size_t>(y) * city.size + x] = 1;
+    }
+    return seeds;
+}
+
+// Mark every cell whose centre lies on a road carriageway.  Half a cell is
+// added to the road half-width so narrow roads still form connected seeds.
+std::vector<std::uint8_t> roadSeeds(const City &city) {
+    std::vector<std::uint8_t> seeds(city.zones.size(), 0);
+    const int n = city.size;
+    for (const auto &r : city.roads) {
+        double reach = 0.5 * roadWidth(r.type) + 0.5;
+        int x0 = std::max(0, static_cast<int>(std::floor(std::min(r.x1, r.x2) - reach)));
+        int x1 = std::min(n - 1, static_cast<int>(std::ceil(std::max(r.x1, r.x2) + reach)));
+        int y0 = std::max(0, static_cast<int>(std::floor(std::min(r.y1, r.y2) - reach)));
+        int y1 = std::min(n - 1, static_cast<int>(std::ceil(std::max(r.y1, r.y2) + reach)));
+        double dx = r.x2 - r.x1;
+        double dy = r.y2 - r.y1;
+        double len2 = dx * dx + dy * dy;
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                double px = x + 0.5 - r.x1;
+                double py = y + 0.5 - r.y1;
+                double t = len2 > 0.0 ? std::clamp((px * dx + py * dy) / len2, 0.0, 1.0) : 0.0;
+                double ex = px - t * dx;
+                double ey = py - t * dy;
+                if (ex * ex + ey * ey <= reach * reach) {
+                    seeds[static_cast<std::size_t>(y) * n + x] = 1;
+                }
+            }
+        }
+    }
+    return seeds;
+}
+
+// Spread the population over residential floor space (footprint area ×
+// storeys), accumulated at each building's centre cell.
+std::vector<float> populationDensity(const City &city, int population) {
+    std::vector<double> floor(city.zones.size(), 0.0);
+    double total = 0.0;
+    for (const auto &b : city.buildings) {
+        if (b.zone != ZoneType::Residential || b.facility) continue;
+        double area = b.footprint.width() * b.footprint.height() * std::max(b.height, 1);
+        int x = std::clamp(static_cast<int>(std::floor(b.footprint.centreX())), 0, city.size - 1);
+        int y = std::clamp(static_cast<int>(std::floor(b.footprint.centreY())), 0, city.size - 1);
+        floor[static_cast<std::size_t>(y) * city.size + x] += area;
+        total += area;
+    }
+    std::vector<float> out(floor.size(), 0.0f);
+    if (total <= 0.0) return out;
+    double perUnit = static_cast<double>(std::max(population, 0)) / total;
+    for (std::size_t i = 0; i < floor.size(); ++i) out[i] = static_cast<float>(floor[i] * perUnit);
+    return out;
+}
+
+struct BandSource {
+    const char *name;
+    RasterType type;
+    const std::uint8_t *data; // row-major, rasterTypeSize(type) bytes per cell
+};
+
+} // namespace
+
+bool City::saveRaster(const std::string &filename, int population, ExecutionContext *ctx) const {
+    if (size <= 0) return true;
+    if (ctx) ctx->check();
+    std::vector<std::uint8_t> zoneBytes(zones.size());
+    for (int y = 0; y < size; ++y) {
+        zones.forEachRowSpan(y, [&](int x0, const ZoneType *span, int n) {
+            std::uint8_t *out = zoneBytes.data() + static_cast<std::size_t>(y) * size + x0;
+            for (int k = 0; k < n; ++k) out[k] = static_cast<std::uint8_t>(span[k]);
+        });
+    }
+    std::vector<float> distSchool = distanceField(facilitySeeds(*this, Facility::Type::School), size);
+    std::vector<float> distHospital = distanceField(facilitySeeds(*this, Facility::Type::Hospital), size);
+    std::vector<float> distRoad = distanceField(roadSeeds(*this), size);
+    std::vector<float> density = populationDensity(*this, population);
+    if (ctx) ctx->check();
+    auto bytesOf = [](const std::vector<float> &v) {
+        return reinterpret_cast<const std::uint8_t *>(v.data());
+    };
+    const BandSource bands[] = {
+        {"zone", RasterType::UInt8, zoneBytes.data()},
+        {"distance_school", RasterType::Float32, bytesOf(distSchool)},
+        {"distance_hospital", RasterType::Float32, bytesOf(distHospital)},
+        {"distance_road", RasterType::Float32, bytesOf(distRoad)},
+        {"population_density", RasterType::Float32, bytesOf(density)},
+    };
+    const std::size_t bandCount = sizeof(bands) / sizeof(bands[0]);
+    const int tilesX = (size + kTileSize - 1) / kTileSize;
+    const int tilesY = tilesX;
+    const std::size_t tilesPerBand = static_cast<std::size_t>(tilesX) * tilesY;
+
+    // Compress every (band, tile) independently in parallel.
+    std::vector<std::vector<std::uint8_t>> payloads(bandCount * tilesPerBand);
+    StageScope stage(ctx, "raster", payloads.size());
+    parallelFor(0, payloads.size(), [&](std::size_t job) {
+        stage.advance();
+        const BandSource &band = bands[job / tilesPerBand];
+        std::size_t tile = job % tilesPerBand;
+        int tx = static_cast<int>(tile % tilesX);
+        int ty = static_cast<int>(tile / tilesX);
+        int x0 = tx * kTileSize;
+        int y0 = ty * kTileSize;
+        int w = std::min(kTileSize, size - x0);
+        int h = std::min(kTileSize, size - y0);
+        std::size_t cell = rasterTypeSize(band.type);
+        std::vector<std::uint8_t> raw(static_cast<std::size_t>(w) * h * cell);
+        for (int y = 0; y < h; ++y) {
+            const std::uint8_t *src = band.data + (static_cast<std::size_t>(y0 + y) * size + x0) * cell;
+            std::memcpy(raw.data() + static_cast<std::size_t>(y) * w * cell, src, w * cell);
+        }
+        std::vector<std::uint8_t> &out = payloads[job];
+        if (cell > 1) {
+            deltaEncodeRows(raw.data(), w, h);
+            std::vector<std::uint8_t> shuffled(raw.size());
+            shuffleBytes(raw.data(), raw.size() / cell, cell, shuffled.data());
+            packBits(shuffled.data(), shuffled.size(), out);
+        } else {
+            packBits(raw.data(), raw.size(), out);
+        }
+    });
+
+    std::vector<std::uint8_t> header;
+    header.insert(header.end(), kMagic, kMagic + 4);
+    putU32(header, kVersion);
+    putU32(header, static_cast<std::uint32_t>(size));
+    putU32(header, static_cast<std::uint32_t>(size));
+    putU32(header, kTileSize);
+    putU32(header, static_cast<std::uint32_t>(bandCount));
+    for (const auto &band : bands) {
+        std::size_t len = std::strlen(band.name);
+        header.push_back(static_cast<std::uint8_t>(band.type));
+        header.push_back(static_cast<std::uint8_t>(len));
+        header.insert(header.end(), band.name, band.name + len);
+    }
+    std::uint64_t offset = header.size() + payloads.size() * 12;
+    for (const auto &p : payloads) {
+        putU64(header, offset);
+        putU32(header, static_cast<std::uint32_t>(p.size()));
+        offset += p.size();
+    }
+
+    // Offsets are fixed by now, so tiles are queued from all workers at
+    // once and the writer overlaps the I/O.
+    AsyncFileWriter writer(filename);
+    if (!writer.isOpen()) return false;
+    writer.write(header.data(), header.size(), 0);
+    std::vector<std::uint64_t> offsets(payloads.size());
+    std::uint64_t cursor = header.size();
+    for (std::size_t i = 0; i < payloads.size(); ++i) {
+        offsets[i] = cursor;
+        cursor += payloads[i].size();
+    }
+    parallelFor(0, payloads.size(), [&](std::size_t i) {
+        writer.write(payloads[i].data(), payloads[i].size(), offsets[i]);
+    });
+    return writer.finish();
+}
+
+RasterReader::RasterReader(const std::string &filename) : filename_(filename) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) throw std::runtime_error("Cannot open raster: " + filename);
+    std::uint8_t fixed[24];
+    if (!ifs.read(reinterpret_cast<char *>(fixed), sizeof(fixed)) ||
+        std::memcmp(fixed, kMagic, 4) != 0 || getU32(fixed + 4) != kVersion) {
+        throw std::runtime_error("Not a citygen raster: " + filename);
+    }
+    width_ = static_cast<int>(getU32(fixed + 8));
+    height_ = static_cast<int>(getU32(fixed + 12));
+    tileSize_ = static_cast<int>(getU32(fixed + 16));
+    std::uint32_t bandCount = getU32(fixed + 20);
+    if (tileSize_ <= 0 || bandCount > 255) throw std::runtime_error("Corrupt raster header: " + filename);
+    tilesX_ = (width_ + tileSize_ - 1) / tileSize_;
+    tilesY_ = (height_ + tileSize_ - 1) / tileSize_;
+    for (std::uint32_t b = 0; b < bandCount; ++b) {
+        std::uint8_t meta[2];
+        if (!ifs.read(reinterpret_cast<char *>(meta), 2)) throw std::runtime_error("Truncated raster: " + filename);
+        BandInfo info;
+        info.type = static_cast<RasterType>(meta[0]);
+        if (info.type != RasterType::UInt8 && info.type != RasterType::Float32) {
+            throw std::runtime_error("Unknown raster band type in " + filename);
+        }
+        info.name.resize(meta[1]);
+        if (!ifs.read(&info.name[0], meta[1])) throw std::runtime_error("Truncated raster: " + filename);
+        bands_.push_back(std::move(info));
+    }
+    std::size_t entries = bands_.size() * static_cast<std::size_t>(tilesX_) * tilesY_;
+    std::vector<std::uint8_t> dir(entries * 12);
+    if (!ifs.read(reinterpret_cast<char *>(dir.data()), static_cast<std::streamsize>(dir.size()))) {
+        throw std::runtime_error("Truncated raster directory: " + filename);
+    }
+    directory_.resize(entries);
+    for (std::size_t i = 0; i < entries; ++i) {
+        directory_[i].offset = getU64(dir.data() + i * 12);
+        directory_[i].size = getU32(dir.data() + i * 12 + 8);
+    }
+}
+
+int RasterReader::findBand(const std::string &name) const {
+    for (std::size_t i = 0; i < bands_.size(); ++i) {
+        if (bands_[i].name == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+std::vector<std::uint8_t> RasterReader::readWindow(std::size_t band, int x0, int y0, int w, int h) const {
+    if (band >= bands_.size()) throw std::out_of_range("Raster band index out of range");
+    int x1 = std::min(width_, x0 + w);
+    int y1 = std::min(height_, y0 + h);
+    x0 = std::max(0, x0);
+    y0 = std::max(0, y0);
+    if (x1 <= x0 || y1 <= y0) return {};
+    const std::size_t cell = rasterTypeSize(bands_[band].type);
+    const int outW = x1 - x0;
+    std::vector<std::uint8_t> out(static_cast<std::size_t>(outW) * (y1 - y0) * cell);
+    std::ifstream ifs(filename_, std::ios::binary);
+    if (!ifs) throw std::runtime_error("Cannot open raster: " + filename_);
+    std::vector<std::uint8_t> packed;
+    std::vector<std::uint8_t> raw;
+    std::vector<std::uint8_t> tile;
+    for (int ty = y0 / tileSize_; ty <= (y1 - 1) / tileSize_; ++ty) {
+        for (int tx = x0 / tileSize_; tx <= (x1 - 1) / tileSize_; ++tx) {
+            const TileEntry &e = directory_[band * tilesX_ * tilesY_ + static_cast<std::size_t>(ty) * tilesX_ + tx];
+            int tileX0 = tx * tileSize_;
+            int tileY0 = ty * tileSize_;
+            int tw = std::min(tileSize_, width_ - tileX0);
+            int th = std::min(tileSize_, height_ - tileY0);
+            packed.resize(e.size);
+            ifs.seekg(static_cast<std::streamoff>(e.offset));
+            if (!ifs.read(reinterpret_cast<char *>(packed.data()), e.size)) {
+                throw std::runtime_error("Truncated raster tile in " + filename_);
+            }
+            std::size_t rawSize = static_cast<std::size_t>(tw) * th * cell;
+            raw.resize(rawSize);
+            if (!unpackBits(packed.data(), packed.size(), raw.data(), rawSize)) {
+                throw std::runtime_error("Corrupt raster tile in " + filename_);
+            }
+            const std::uint8_t *cells = raw.data();
+            if (cell > 1) {
+                tile.resize(rawSize);
+                unshuffleBytes(raw.data(), rawSize / cell, cell, tile.data());
+                deltaDecodeRows(tile.data(), tw, th);
+                cells = tile.data();
+            }
+            int ix0 = std::max(x0, tileX0);
+            int ix1 = std::min(x1, tileX0 + tw);
+            int iy0 = std::max(y0, tileY0);
+            int iy1 = std::min(y1, tileY0 + th);
+            for (int y = iy0; y < iy1; ++y) {
+                const std::uint8_t *src = cells + (static_cast<std::size_t>(y - tileY0) * tw + (ix0 - tileX0)) * cell;
+                std::uint8_t *dst = out.data() + (static_cast<std::size_t>(y - y0) * outW + (ix0 - x0)) * cell;
+                std::memcpy(dst, src, static_cast<std::size_t>(ix1 - ix0) * cell);
+            }
+        }
+    }
+    return out;
+}
+
+std::vector<std::uint8_t> RasterReader::readWindowU8(std::size_t band, int x0, int y0, int w, int h) const {
+    if (band < bands_.size() && bands_[band].type != RasterType::UInt8) {
+        throw std::invalid_argument("Raster band is not UInt8: " + bands_[band].name);
+    }
+    return readWindow(band, x0, y0, w, h);
+}
+
+std::vector<float> RasterReader::readWindowF32(std::size_t band, int x0, int y0, int w, int h) const {
+    if (band < bands_.size() && bands_[band].type != RasterType::Float32) {
+        throw std::invalid_argument("Raster band is not Float32: " + bands_[band].name);
+    }
+    std::vector<std::uint8_t> bytes = readWindow(band, x0, y0, w, h);
+    std::vector<float> out(bytes.size() / 4);
+    std::memcpy(out.data(), bytes.data(), bytes.size());
+    return out;
+}
@@ -0,0 +1,498 @@
+#include "Region.h"
+#include "CityGenerator.h"
+#include "Layout.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+using Quad = std::array<Vec2, 4>;
+
+// Margin (grid cells) between a city's disc and the edge of its own grid.
+constexpr int kLocalMargin = 2;
+
+// Rows of the region grid per zone-merge work item.
+constexpr std::size_t kRowChunk = 64;
+
+// Grid a city is generated on: the disc plus a margin, centred, with an
+// even size so the centre falls on a cell corner.
+int localGridSize(const RegionCity &c) {
+    return 2 * (static_cast<int>(std::ceil(c.radius)) + kLocalMargin);
+}
+
+// Facilities are sited after the merge, so none are lost at a boundary.
+Config localConfig(const RegionCity &c) {
+    Config cfg = c.config;
+    cfg.grid_size = localGridSize(c);
+    cfg.city_radius = 2.0 * c.radius / cfg.grid_size;
+    cfg.hospitals = 0;
+    cfg.schools = 0;
+    return cfg;
+}
+
+int parseInt(const std::string &value, const std::string &key, int line) {
+    char *end = nullptr;
+    long v = std::strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || v < std::numeric_limits<int>::min() ||
+        v > std::numeric_limits<int>::max()) {
+        throw std::invalid_argument("Region line " + std::to_string(line) + ": invalid " + key + "=" + value);
+    }
+    return static_cast<int>(v);
+}
+
+double pointSegmentDistance(const Vec2 &p, const Vec2 &a, const Vec2 &b) {
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double len2 = dx * dx + dy * dy;
+    double t = len2 > 0.0 ? std::clamp(((p.x - a.x) * dx + (p.y - a.y) * dy) / len2, 0.0, 1.0) : 0.0;
+    double ex = a.x + t * dx - p.x;
+    double ey = a.y + t * dy - p.y;
+    return std::sqrt(ex * ex + ey * ey);
+}
+
+// Power-diagram cell of one city: p is inside with margin m when every
+// constraint a.p + b >= m |a| holds.  Each constraint comes from another
+// city j and compares the powers |p - c|^2 - r^2 of the two discs.
+struct PowerCell {
+    struct Plane {
+        double ax, ay, b, norm;
+    };
+    std::vector<Plane> planes;
+    bool empty = false; ///< Shares its centre with a larger (or earlier) city
+
+    bool contains(const Vec2 &p, double margin = 0.0) const {
+        if (empty) return false;
+        for (const Plane &h : planes) {
+            if (h.ax * p.x + h.ay * p.y + h.b < margin * h.norm) return false;
+        }
+        return true;
+    }
+
+    bool contains(const Quad &q, double margin = 0.0) const {
+        for (const Vec2 &p : q) {
+            if (!contains(p, margin)) return false;
+        }
+        return true;
+    }
+
+    // Clip the segment a-b to the cell less margin; false if nothing is left.
+    bool clip(Vec2 &a, Vec2 &b, double margin) const {
+        if (empty) return false;
+        double t0 = 0.0;
+        double t1 = 1.0;
+        double dx = b.x - a.x;
+        double dy = b.y - a.y;
+        for (const Plane &h : planes) {
+            double f = h.ax * a.x + h.ay * a.y + h.b - margin * h.norm;
+            double slope = h.ax * dx + h.ay * dy;
+            if (slope == 0.0) {
+                if (f < 0.0) return false;
+            } else if (slope > 0.0) {
+                t0 = std::max(t0, -f / slope);
+            } else {
+                t1 = std::min(t1, -f / slope);
+            }
+        }
+        if (t1 - t0 <= 1e-9) return false;
+        Vec2 start{a.x + t0 * dx, a.y + t0 * dy};
+        b = {a.x + t1 * dx, a.y + t1 * dy};
+        a = start;
+        return true;
+    }
+
+    // Whether the cell reaches into the open disc: clip the disc's
+    // bounding square to the cell, then look for a point of the polygon
+    // closer than r to the centre.
+    bool meetsDisc(const Vec2 &c, double r) const {
+        if (empty) return false;
+        std::vector<Vec2> poly{{c.x - r, c.y - r}, {c.x + r, c.y - r}, {c.x + r, c.y + r}, {c.x - r, c.y + r}};
+        for (const Plane &h : planes) {
+            std::vector<Vec2> next;
+            for (std::size_t k = 0; k < poly.size(); ++k) {
+                const Vec2 &p = poly[k];
+                const Vec2 &q = poly[(k + 1) % poly.size()];
+                double fp = h.ax * p.x + h.ay * p.y + h.b;
+                double fq = h.ax * q.x + h.ay * q.y + h.b;
+                if (fp >= 0.0) next.push_back(p);
+                if ((fp >= 0.0) != (fq >= 0.0)) {
+                    double t = fp / (fp - fq);
+                    next.push_back({p.x + t * (q.x - p.x), p.y + t * (q.y - p.y)});
+                }
+            }
+            poly = std::move(next);
+            if (poly.empty()) return false;
+        }
+        if (contains(c)) return true;
+        for (std::size_t k = 0; k < poly.size(); ++k) {
+            if (pointSegmentDistance(c, poly[k], poly[(k + 1) % poly.size()]) < r) return true;
+        }
+        return false;
+    }
+};
+
+std::vector<PowerCell> powerCells(const Region &region) {
+    const auto &cities = region.cities;
+    std::vector<PowerCell> cells(cities.size());
+    for (std::size_t i = 0; i < cities.size(); ++i) {
+        const RegionCity &ci = cities[i];
+        for (std::size_t j = 0; j < cities.size(); ++j) {
+            if (j == i) continue;
+            const RegionCity &cj = cities[j];
+            // power_j(p) - power_i(p) = a.p + b
+            double ax = 2.0 * (ci.x - cj.x);
+            double ay = 2.0 * (ci.y - cj.y);
+            double b = (static_cast<double>(cj.x) * cj.x + static_cast<double>(cj.y) * cj.y) -
+                       (static_cast<double>(ci.x) * ci.x + static_cast<double>(ci.y) * ci.y) -
+                       cj.radius * cj.radius + ci.radius * ci.radius;
+            if (ax == 0.0 && ay == 0.0) {
+                if (b < 0.0 || (b == 0.0 && j < i)) cells[i].empty = true;
+                continue;
+            }
+            cells[i].planes.push_back({ax, ay, b, std::sqrt(ax * ax + ay * ay)});
+        }
+    }
+    return cells;
+}
+
+// City owning a point: smallest power |p - c|^2 - r^2, lowest index on ties.
+std::size_t ownerOf(const Region &region, double px, double py) {
+    std::size_t best = 0;
+    double bestPower = std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0; i < region.cities.size(); ++i) {
+        const RegionCity &c = region.cities[i];
+        double dx = px - c.x;
+        double dy = py - c.y;
+        double power = dx * dx + dy * dy - c.radius * c.radius;
+        if (power < bestPower) {
+            bestPower = power;
+            best = i;
+        }
+    }
+    return best;
+}
+
+double cross(const Vec2 &o, const Vec2 &a, const Vec2 &b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// Convex quad of either orientation; points on the boundary are inside.
+bool quadContains(const Quad &q, const Vec2 &p) {
+    bool neg = false;
+    bool pos = false;
+    for (std::size_t k = 0; k < 4; ++k) {
+        double c = cross(q[k], q[(k + 1) % 4], p);
+        neg = neg || c < 0.0;
+        pos = pos || c > 0.0;
+    }
+    return !(neg && pos);
+}
+
+bool segmentsCross(const Vec2 &a, const Vec2 &b, const Vec2 &c, const Vec2 &d) {
+    double d1 = cross(c, d, a);
+    double d2 = cross(c, d, b);
+    double d3 = cross(a, b, c);
+    double d4 = cross(a, b, d);
+    return ((d1 > 0.0 && d2 < 0.0) || (d1 < 0.0 && d2 > 0.0)) &&
+           ((d3 > 0.0 && d4 < 0.0) || (d3 < 0.0 && d4 > 0.0));
+}
+
+// Distance between the segment a-b and a convex quad (0 if they meet).
+double segmentQuadDistance(const Vec2 &a, const Vec2 &b, const Quad &q) {
+    if (quadContains(q, a) || quadContains(q, b)) return 0.0;
+    double best = std::numeric_limits<double>::infinity();
+    for (std::size_t k = 0; k < 4; ++k) {
+        const Vec2 &p = q[k];
+        const Vec2 &n = q[(k + 1) % 4];
+        if (segmentsCross(a, b, p, n)) return 0.0;
+        best = std::min({best, pointSegmentDistance(a, p, n), pointSegmentDistance(b, p, n),
+                         pointSegmentDistance(p, a, b)});
+    }
+    return best;
+}
+
+Quad footprintQuad(const Building &b) { return b.hasCorners ? b.corners : rectToQuad(b.footprint); }
+
+Quad translated(Quad q, double dx, double dy) {
+    for (Vec2 &p : q) {
+        p.x += dx;
+        p.y += dy;
+    }
+    return q;
+}
+
+Rect translated(Rect r, double dx, double dy) {
+    r.x0 += dx;
+    r.x1 += dx;
+    r.y0 += dy;
+    r.y1 += dy;
+    return r;
+}
+
+// Arterials joining the discs along a minimum spanning tree (Prim) of
+// the gaps between them.  Discs that touch need no connector.
+std::vector<RoadSegment> connectors(const Region &region) {
+    const auto &cities = region.cities;
+    const std::size_t n = cities.size();
+    auto gap = [&](std::size_t i, std::size_t j) {
+        double d = std::hypot(cities[i].x - cities[j].x, cities[i].y - cities[j].y);
+        return std::max(d - cities[i].radius - cities[j].radius, 0.0);
+    };
+    std::vector<bool> joined(n, false);
+    std::vector<double> cost(n, std::numeric_limits<double>::infinity());
+    std::vector<std::size_t> via(n, 0);
+    std::vector<RoadSegment> roads;
+    if (n == 0) return roads;
+    joined[0] = true;
+    for (std::size_t j = 1; j < n; ++j) cost[j] = gap(0, j);
+    for (std::size_t step = 1; step < n; ++step) {
+        std::size_t next = n;
+        for (std::size_t j = 0; j < n; ++j) {
+            if (!joined[j] && (next == n || cost[j] < cost[next])) next = j;
+        }
+        joined[next] = true;
+        const RegionCity &a = cities[via[next]];
+        const RegionCity &b = cities[next];
+        double dx = b.x - a.x;
+        double dy = b.y - a.y;
+        double d = std::sqrt(dx * dx + dy * dy);
+        if (d - a.radius - b.radius > 0.0) {
+            double ux = dx / d;
+            double uy = dy / d;
+            RoadSegment road;
+            road.x1 = a.x + ux * a.radius;
+            road.y1 = a.y + uy * a.radius;
+            road.x2 = b.x - ux * b.radius;
+            road.y2 = b.y - uy * b.radius;
+            road.type = RoadType::Arterial;
+            roads.push_back(road);
+        }
+        for (std::size_t j = 0; j < n; ++j) {
+            if (joined[j]) continue;
+            double g = gap(next, j);
+            if (g < cost[j]) {
+                cost[j] = g;
+                via[j] = next;
+            }
+        }
+    }
+    return roads;
+}
+
+// The parts of one generated city that survive the merge, moved to region
+// coordinates.
+City keepInside(const City &local, const RegionCity &spec, const PowerCell &cell,
+                const std::vector<RoadSegment> &links) {
+    const double ox = spec.x - localGridSize(spec) / 2;
+    const double oy = spec.y - localGridSize(spec) / 2;
+    const double linkHalfWidth = 0.5 * roadWidth(RoadType::Arterial);
+    auto nearLink = [&](const Quad &q) {
+        for (const RoadSegment &r : links) {
+            if (segmentQuadDistance({r.x1, r.y1}, {r.x2, r.y2}, q) < linkHalfWidth) return true;
+        }
+        return false;
+    };
+    City kept;
+    std::vector<Quad> droppedBlocks;
+    for (const Block &block : local.blocks) {
+        Block moved = block;
+        moved.bounds = translated(block.bounds, ox, oy);
+        moved.corners = translated(block.hasCorners ? block.corners : rectToQuad(block.bounds), ox, oy);
+        moved.hasCorners = true;
+        if (cell.contains(moved.corners) && !nearLink(moved.corners)) kept.blocks.push_back(moved);
+        else droppedBlocks.push_back(moved.corners);
+    }
+    for (std::size_t i = 0; i < local.buildings.size(); ++i) {
+        const Building &b = local.buildings[i];
+        Quad q = translated(footprintQuad(b), ox, oy);
+        if (!cell.contains(q) || nearLink(q)) continue;
+        Vec2 c = centroidOfQuad(q);
+        bool inDropped = std::any_of(droppedBlocks.begin(), droppedBlocks.end(),
+                                     [&](const Quad &blk) { return quadContains(blk, c); });
+        if (inDropped) continue;
+        Building moved = b;
+        moved.footprint = translated(b.footprint, ox, oy);
+        moved.corners = q;
+        moved.hasCorners = true;
+        kept.buildings.push_back(moved);
+    }
+    for (const RoadSegment &r : local.roads) {
+        Vec2 a{r.x1 + ox, r.y1 + oy};
+        Vec2 b{r.x2 + ox, r.y2 + oy};
+        if (!cell.clip(a, b, 0.5 * roadWidth(r.type))) continue;
+        kept.roads.push_back({a.x, a.y, b.x, b.y, r.type});
+    }
+    return kept;
+}
+
+} // namespace
+
+int Region::population() const {
+    long long total = 0;
+    for (const RegionCity &c : cities) total += c.config.population;
+    return static_cast<int>(std::min<long long>(total, std::numeric_limits<int>::max()));
+}
+
+Region regionFromString(const std::string &text, const Config &base) {
+    Region region;
+    Config shared = base;
+    std::vector<bool> ownSeed;
+    std::istringstream in(text);
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+        ++lineNo;
+        std::string where = "Region line " + std::to_string(lineNo) + ": ";
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::vector<std::string> tokens;
+        for (std::string w; words >> w;) tokens.push_back(w);
+        if (tokens.empty()) continue;
+        bool isCity = tokens[0] == "city";
+        if (!isCity && !region.cities.empty()) {
+            throw std::invalid_argument(where + "shared options must come before the first city");
+        }
+        RegionCity city;
+        city.config = shared;
+        bool hasX = false, hasY = false, hasRadius = false, seeded = false;
+        for (std::size_t t = isCity ? 1 : 0; t < tokens.size(); ++t) {
+            std::size_t eq = tokens[t].find('=');
+            if (eq == std::string::npos || eq == 0 || eq + 1 == tokens[t].size()) {
+                throw std::invalid_argument(where + "expected key=value, got " + tokens[t]);
+            }
+            std::string key = tokens[t].substr(0, eq);
+            std::string value = tokens[t].substr(eq + 1);
+            if (isCity && key == "x") {
+                city.x = parseInt(value, key, lineNo);
+                hasX = true;
+            } else if (isCity && key == "y") {
+                city.y = parseInt(value, key, lineNo);
+                hasY = true;
+            } else if (isCity && key == "radius") {
+                char *end = nullptr;
+                city.radius = std::strtod(value.c_str(), &end);
+                if (*end != '\0' || !(city.radius >= 1.0)) {
+                    throw std::invalid_argument(where + "radius must be at least 1, got " + value);
+                }
+                hasRadius = true;
+            } else if (isCity && (key == "grid-size" || key == "radius-fraction")) {
+                throw std::invalid_argument(where + key + " is set per region, not per city");
+            } else {
+                try {
+                    if (!applyConfigOption(isCity ? city.config : shared, key, value)) {
+                        throw std::invalid_argument("unknown option " + key);
+                    }
+                } catch (const std::invalid_argument &e) {
+                    throw std::invalid_argument(where + e.what());
+                }
+                seeded = seeded || key == "seed";
+            }
+        }
+        if (!isCity) continue;
+        if (!hasX || !hasY || !hasRadius) throw std::invalid_argument(where + "city needs x, y and radius");
+        region.cities.push_back(city);
+        ownSeed.push_back(seeded);
+    }
+    shared.normalize();
+    region.gridSize = shared.grid_size;
+    if (region.cities.empty()) throw std::invalid_argument("Region has no cities");
+    for (std::size_t i = 0; i < region.cities.size(); ++i) {
+        RegionCity &c = region.cities[i];
+        if (!ownSeed[i]) c.config.seed = shared.seed + static_cast<std::uint32_t>(i);
+        if (c.x - c.radius < 0.0 || c.y - c.radius < 0.0 || c.x + c.radius > region.gridSize ||
+            c.y + c.radius > region.gridSize) {
+            throw std::invalid_argument("Region city " + std::to_string(i) + " does not fit on the " +
+                                        std::to_string(region.gridSize) + " grid");
+        }
+    }
+    // A city swallowed by its neighbours would vanish with its facilities.
+    std::vector<PowerCell> cells = powerCells(region);
+    for (std::size_t i = 0; i < region.cities.size(); ++i) {
+        const RegionCity &c = region.cities[i];
+        if (!cells[i].meetsDisc({static_cast<double>(c.x), static_cast<double>(c.y)}, c.radius)) {
+            throw std::invalid_argument("Region city " + std::to_string(i) +
+                                        " lies wholly inside the territory of other cities");
+        }
+    }
+    return region;
+}
+
+Region loadRegion(const std::string &path, const Config &base) {
+    std::ifstream in(path);
+    if (!in) throw std::invalid_argument("Cannot read region file: " + path);
+    std::ostringstream text;
+    text << in.rdbuf();
+    return regionFromString(text.str(), base);
+}
+
+City generateRegion(const Region &region, ExecutionContext *ctx) {
+    const std::size_t n = region.cities.size();
+    std::vector<City> locals(n);
+    {
+        // Nested parallel passes of each generation run inline on its worker.
+        StageScope stage(ctx, "region", n);
+        parallelFor(0, n, [&](std::size_t i) {
+            // Each city runs its own stages; the region context only
+            // reports cities done but still cancels them.
+            ExecutionContext local(ctx);
+            locals[i] = CityGenerator::generate(localConfig(region.cities[i]), ctx ? &local : nullptr);
+            stage.advance();
+        });
+    }
+    std::vector<PowerCell> cells = powerCells(region);
+    std::vector<RoadSegment> links = connectors(region);
+    std::vector<City> kept(n);
+    parallelFor(0, n, [&](std::size_t i) {
+        const RegionCity &spec = region.cities[i];
+        kept[i] = keepInside(locals[i], spec, cells[i], links);
+        // Distances to the connectors count when siting facilities.
+        std::size_t ownRoads = kept[i].roads.size();
+        kept[i].roads.insert(kept[i].roads.end(), links.begin(), links.end());
+        std::mt19937 rng(spec.config.seed);
+        CityGenerator::placeFacilities(kept[i], spec.config, rng);
+        kept[i].roads.resize(ownRoads);
+    });
+    for (std::size_t i = 0; i < n; ++i) {
+        const Config &cfg = region.cities[i].config;
+        std::size_t wanted = static_cast<std::size_t>(cfg.hospitals) + static_cast<std::size_t>(cfg.schools);
+        if (kept[i].facilities.size() < wanted) {
+            throw std::invalid_argument("Region city " + std::to_string(i) + " keeps " +
+                                        std::to_string(kept[i].buildings.size()) +
+                                        " buildings, too few for its " + std::to_string(wanted) +
+                                        " facilities");
+        }
+    }
+
+    City city(region.gridSize);
+    const std::size_t size = static_cast<std::size_t>(region.gridSize);
+    parallelFor(0, (size + kRowChunk - 1) / kRowChunk, [&](std::size_t chunk) {
+        if (ctx) ctx->check();
+        std::size_t end = std::min(size, (chunk + 1) * kRowChunk);
+        for (std::size_t y = chunk * kRowChunk; y < end; ++y) {
+            for (std::size_t x = 0; x < size; ++x) {
+                std::size_t owner = ownerOf(region, x + 0.5, y + 0.5);
+                const RegionCity &spec = region.cities[owner];
+                const City &local = locals[owner];
+                int lx = static_cast<int>(x) - (spec.x - local.size / 2);
+                int ly = static_cast<int>(y) - (spec.y - local.size / 2);
+                if (lx < 0 || ly < 0 || lx >= local.size || ly >= local.size) continue;
+                city.zoneAt(x, y) = local.zoneAt(lx, ly);
+            }
+        }
+    });
+    for (std::size_t i = 0; i < n; ++i) {
+        for (const Building &b : kept[i].buildings) city.buildings.push_back(b);
+        city.facilities.insert(city.facilities.end(), kept[i].facilities.begin(), kept[i].facilities.end());
+        city.roads.insert(city.roads.end(), kept[i].roads.begin(), kept[i].roads.end());
+        city.blocks.insert(city.blocks.end(), kept[i].blocks.begin(), kept[i].blocks.end());
+    }
+    city.roads.insert(city.roads.end(), links.begin(), links.end());
+    return city;
+}
@@ -0,0 +1,768 @@
+#include "Server.h"
+#include "CityGenerator.h"
+#include "Estimate.h"
+#include "Execution.h"
+#include "JsonWriter.h"
+#include "Memory.h"
+#include "Numa.h"
+#include "Parallel.h"
+#include "Summary.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t kMaxRequestBytes = 64 * 1024;
+constexpr int kReadTimeoutSeconds = 5;
+constexpr int kAcceptPollMillis = 200;
+// How often a request waiting on another's generation checks its own deadline.
+constexpr auto kWaitSlice = std::chrono::milliseconds(50);
+
+std::atomic<bool> gStopping{false};
+
+void stopOnSignal(int) { gStopping.store(true); }
+
+using Clock = std::chrono::steady_clock;
+
+// ---------------------------------------------------------------------------
+// HTTP plumbing: one request per connection, Connection: close.
+
+struct Request {
+    std::string method;
+    std::string path;
+    std::vector<std::pair<std::string, std::string>> params;
+};
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+std::string percentDecode(const std::string &in) {
+    std::string out;
+    out.reserve(in.size());
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        if (in[i] == '+') {
+            out.push_back(' ');
+        } else if (in[i] == '%' && i + 2 < in.size() && hexValue(in[i + 1]) >= 0 && hexValue(in[i + 2]) >= 0) {
+            out.push_back(static_cast<char>(hexValue(in[i + 1]) * 16 + hexValue(in[i + 2])));
+            i += 2;
+        } else {
+            out.push_back(in[i]);
+        }
+    }
+    return out;
+}
+
+void parseQuery(const std::string &query, Request &req) {
+    std::size_t pos = 0;
+    while (pos < query.size()) {
+        std::size_t amp = query.find('&', pos);
+        if (amp == std::string::npos) amp = query.size();
+        std::string pair = query.substr(pos, amp - pos);
+        if (!pair.empty()) {
+            std::size_t eq = pair.find('=');
+            std::string key = percentDecode(pair.substr(0, eq));
+            std::string value = eq == std::string::npos ? std::string() : percentDecode(pair.substr(eq + 1));
+            req.params.emplace_back(key, value);
+        }
+        pos = amp + 1;
+    }
+}
+
+std::string lowerCase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+enum class ParseResult { Incomplete, Complete, Malformed };
+
+// Parse one request from the bytes received so far.  A POST body is
+// treated as a form-encoded query string, so `curl -d seed=3` works as
+// well as a GET.
+ParseResult parseRequest(const std::string &data, Request &req) {
+    std::size_t headerEnd = data.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+        return data.size() > kMaxRequestBytes ? ParseResult::Malformed : ParseResult::Incomplete;
+    }
+    std::size_t lineEnd = data.find("\r\n");
+    std::string line = data.substr(0, lineEnd);
+    std::size_t sp1 = line.find(' ');
+    std::size_t sp2 = line.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos) return ParseResult::Malformed;
+    req.method = line.substr(0, sp1);
+    std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    std::size_t q = target.find('?');
+    req.path = target.substr(0, q);
+    if (q != std::string::npos) parseQuery(target.substr(q + 1), req);
+
+    std::size_t contentLength = 0;
+    std::size_t pos = lineEnd + 2;
+    while (pos < headerEnd) {
+        std::size_t end = data.find("\r\n", pos);
+        std::string header = data.substr(pos, end - pos);
+        std::size_t colon = header.find(':');
+        if (colon != std::string::npos && lowerCase(header.substr(0, colon)) == "content-length") {
+            contentLength = std::strtoul(header.c_str() + colon + 1, nullptr, 10);
+        }
+        pos = end + 2;
+    }
+    if (contentLength > kMaxRequestBytes) return ParseResult::Malformed;
+    if (data.size() - (headerEnd + 4) < contentLength) return ParseResult::Incomplete;
+    if (contentLength > 0) parseQuery(data.substr(headerEnd + 4, contentLength), req);
+    return ParseResult::Complete;
+}
+
+void setBlocking(int fd) {
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags >= 0) ::fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+}
+
+bool sendAll(int fd, const char *data, std::size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+const char *reasonPhrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 413: return "Payload Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default: return "Error";
+    }
+}
+
+void sendHead(int fd, int status, const char *contentType, long long contentLength,
+              const std::string &extra = std::string()) {
+    std::string head = "HTTP/1.1 " + std::to_string(status) + " " + reasonPhrase(status) + "\r\n";
+    head += "Content-Type: ";
+    head += contentType;
+    head += "\r\n";
+    if (contentLength >= 0) head += "Content-Length: " + std::to_string(contentLength) + "\r\n";
+    head += extra;
+    head += "Connection: close\r\n\r\n";
+    sendAll(fd, head.data(), head.size());
+}
+
+void sendBody(int fd, int status, const char *contentType, const std::string &body,
+              const std::string &extra = std::string()) {
+    sendHead(fd, status, contentType, static_cast<long long>(body.size()), extra);
+    sendAll(fd, body.data(), body.size());
+}
+
+void sendError(int fd, int status, const std::string &message, const std::string &extra = std::string()) {
+    std::string body;
+    JsonWriter json(body);
+    json.beginObject();
+    json.field("error", message);
+    json.endObject();
+    body.push_back('\n');
+    sendBody(fd, status, "application/json", body, extra);
+}
+
+// Bind the listening socket.  TCP endpoints are loopback-only: the server
+// has no authentication and is meant for tools on the same machine.
+int listenOn(const std::string &endpoint, std::string &bound) {
+    if (endpoint.rfind("unix:", 0) == 0) {
+        std::string path = endpoint.substr(5);
+        sockaddr_un addr{};
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            throw std::invalid_argument("Invalid Unix socket path: " + path);
+        }
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw std::runtime_error("socket: " + std::string(std::strerror(errno)));
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        ::unlink(path.c_str());
+        if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(fd, 128) != 0) {
+            std::string reason = std::strerror(errno);
+            ::close(fd);
+            throw std::runtime_error("Cannot listen on " + endpoint + ": " + reason);
+        }
+        bound = endpoint;
+        return fd;
+    }
+    std::string host = "127.0.0.1";
+    std::string port = endpoint;
+    std::size_t colon = endpoint.rfind(':');
+    if (colon != std::string::npos) {
+        host = endpoint.substr(0, colon);
+        port = endpoint.substr(colon + 1);
+    }
+    if (host == "localhost") host = "127.0.0.1";
+    char *end = nullptr;
+    long portNumber = std::strtol(port.c_str(), &end, 10);
+    if (host != "127.0.0.1" || port.empty() || *end != '\0' || portNumber < 0 || portNumber > 65535) {
+        throw std::invalid_argument("Invalid endpoint (expected unix:<path> or a loopback port): " + endpoint);
+    }
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw std::runtime_error("socket: " + std::string(std::strerror(errno)));
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<std::uint16_t>(portNumber));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(fd, 128) != 0) {
+        std::string reason = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("Cannot listen on " + endpoint + ": " + reason);
+    }
+    socklen_t len = sizeof(addr);
+    ::getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len);
+    bound = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    return fd;
+}
+
+// ---------------------------------------------------------------------------
+// Generated-city cache.
+
+struct CachedCity {
+    City city;
+    std::string summary;
+    std::uint64_t bytes = 0;
+    int node = -1; ///< NUMA node holding the city's pages (-1 without placement)
+};
+using CityPtr = std::shared_ptr<const CachedCity>;
+
+std::uint64_t footprintOf(const City &city, const std::string &summary) {
+    return city.zones.storageBytes() + city.buildings.size() * sizeof(Building) +
+           city.roads.size() * sizeof(RoadSegment) + city.blocks.size() * sizeof(Block) +
+           city.facilities.size() * sizeof(Facility) + summary.size();
+}
+
+class CityCache {
+public:
+    explicit CityCache(std::uint64_t budget) : budget_(budget) {}
+
+    CityPtr get(const std::string &key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) return nullptr;
+        order_.splice(order_.begin(), order_, it->second);
+        return it->second->second;
+    }
+
+    void put(const std::string &key, CityPtr city) {
+        if (city->bytes > budget_ || index_.count(key)) return;
+        order_.emplace_front(key, city);
+        index_[key] = order_.begin();
+        bytes_ += city->bytes;
+        while (bytes_ > budget_) {
+            bytes_ -= order_.back().second->bytes;
+            index_.erase(order_.back().first);
+            order_.pop_back();
+        }
+    }
+
+    std::size_t entries() const { return index_.size(); }
+    std::uint64_t bytes() const { return bytes_; }
+
+private:
+    using Entry = std::pair<std::string, CityPtr>;
+    std::uint64_t budget_;
+    std::uint64_t bytes_ = 0;
+    std::list<Entry> order_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+// Runs the calling thread on another NUMA node for a scope, e.g. to export
+// a cached city next to its pages, then returns it to its own node.
+class NodeVisit {
+public:
+    explicit NodeVisit(int node) {
+        int home = boundNode();
+        if (home >= 0 && node >= 0 && node != home && bindThreadToNode(static_cast<std::size_t>(node))) {
+            home_ = home;
+        }
+    }
+    ~NodeVisit() {
+        if (home_ >= 0) bindThreadToNode(static_cast<std::size_t>(home_));
+    }
+    NodeVisit(const NodeVisit &) = delete;
+    NodeVisit &operator=(const NodeVisit &) = delete;
+
+private:
+    int home_ = -1;
+};
+
+// Export into an anonymous in-memory file (Output.h fd:N target), then
+// send it with a Content-Length.  Clients can tell a complete model from a
+// truncated one, and an export that fails still gets an error status.
+void sendModel(int fd, const CachedCity &entry, Config::ExportFormat format, ExecutionContext &ctx) {
+    int body = ::memfd_create("citygen-model", MFD_CLOEXEC);
+    if (body < 0) throw std::runtime_error("memfd_create: " + std::string(std::strerror(errno)));
+    struct Closer {
+        int fd;
+        ~Closer() { ::close(fd); }
+    } closer{body};
+    std::string target = "fd:" + std::to_string(body);
+    const char *contentType = "model/obj";
+    bool written = false;
+    {
+        NodeVisit visit(entry.node);
+        switch (format) {
+            case Config::ExportFormat::GLB:
+                contentType = "model/gltf-binary";
+                written = entry.city.saveGLTF(target, true, &ctx);
+                break;
+            case Config::ExportFormat::GLTF:
+                contentType = "model/gltf+json";
+                written = entry.city.saveGLTF(target, false, &ctx);
+                break;
+            case Config::ExportFormat::OBJ:
+            default:
+                written = entry.city.saveOBJ(target, &ctx);
+                break;
+        }
+    }
+    if (!written) throw std::runtime_error("cannot encode the model");
+    struct stat st {};
+    if (::fstat(body, &st) != 0) throw std::runtime_error("fstat: " + std::string(std::strerror(errno)));
+    sendHead(fd, 200, contentType, static_cast<long long>(st.st_size));
+    off_t offset = 0;
+    while (offset < st.st_size) {
+        ssize_t n = ::sendfile(fd, body, &offset, static_cast<std::size_t>(st.st_size - offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break; // The client went away; nothing left to tell it.
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Scheduler.
+
+enum class Endpoint { Summary, Model };
+
+struct Job {
+    int fd = -1;
+    Endpoint endpoint = Endpoint::Summary;
+    Config cfg;
+    int priority = 1;
+    bool hasDeadline = false;
+    Clock::time_point deadline{};
+};
+
+// Integer priorities are bounded so the queue key (-priority) cannot overflow.
+constexpr int kMaxPriority = 1000;
+
+int priorityFromString(const std::string &s) {
+    std::string p = lowerCase(s);
+    if (p == "low") return 0;
+    if (p == "normal") return 1;
+    if (p == "high") return 2;
+    return static_cast<int>(integerOptionFromString("priority", p, -kMaxPriority, kMaxPriority));
+}
+
+class Server {
+public:
+    Server(const ServerOptions &options, const Config &defaults)
+        : options_(options), defaults_(defaults), cache_(options.cacheBytes) {}
+
+    int run();
+
+private:
+    void acceptLoop(int listenFd);
+    void handleRequest(int fd, const Request &req);
+    void admit(Job job);
+    void workerLoop(unsigned index, unsigned workers);
+    void execute(Job &job);
+    CityPtr obtainCity(const Config &cfg, ExecutionContext &ctx);
+    std::string statsJson();
+
+    ServerOptions options_;
+    Config defaults_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    bool stopping_ = false;
+    // Ordered by (-priority, arrival): begin() runs next, prev(end()) is
+    // the first to be turned away.
+    std::map<std::pair<int, std::uint64_t>, Job> queue_;
+    std::uint64_t arrivals_ = 0;
+    std::set<ExecutionContext *> running_;
+    CityCache cache_;
+    std::map<std::string, std::shared_future<CityPtr>> inflight_;
+
+    std::uint64_t completed_ = 0;
+    std::uint64_t rejected_ = 0;
+    std::uint64_t cacheHits_ = 0;
+    std::uint64_t cacheMisses_ = 0;
+    Clock::time_point started_ = Clock::now();
+};
+
+int Server::run() {
+    std::string bound;
+    int listenFd = -1;
+    try {
+        listenFd = listenOn(options_.endpoint, bound);
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    unsigned workers = options_.workers ? options_.workers : std::max(1u, workerCount() / 2);
+    std::cout << "Listening on " << bound << " with " << workers << " workers" << std::endl;
+
+    gStopping.store(false);
+    std::signal(SIGINT, stopOnSignal);
+    std::signal(SIGTERM, stopOnSignal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < workers; ++i) pool.emplace_back([this, i, workers] { workerLoop(i, workers); });
+    acceptLoop(listenFd);
+
+    // Shutdown: turn away whatever is queued, cancel what is running.
+    std::map<std::pair<int, std::uint64_t>, Job> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        abandoned.swap(queue_);
+        for (ExecutionContext *ctx : running_) ctx->cancel();
+    }
+    ready_.notify_all();
+    for (auto &entry : abandoned) {
+        sendError(entry.second.fd, 503, "server shutting down");
+        ::close(entry.second.fd);
+    }
+    for (auto &t : pool) t.join();
+    ::close(listenFd);
+    if (bound.rfind("unix:", 0) == 0) ::unlink(bound.c_str() + 5);
+    std::cout << "Server stopped after " << completed_ << " jobs" << std::endl;
+    return 0;
+}
+
+// Connections are read without blocking, multiplexed with accept(2), so a
+// slow or idle client cannot hold up anyone else.  A request that has not
+// fully arrived within kReadTimeoutSeconds gets 408.
+void Server::acceptLoop(int listenFd) {
+    struct Incoming {
+        int fd;
+        std::string data;
+        Clock::time_point deadline;
+    };
+    std::vector<Incoming> incoming;
+    while (!gStopping.load()) {
+        std::vector<pollfd> fds{{listenFd, POLLIN, 0}};
+        for (const Incoming &c : incoming) fds.push_back({c.fd, POLLIN, 0});
+        int ready = ::poll(fds.data(), fds.size(), kAcceptPollMillis);
+        Clock::time_point now = Clock::now();
+        // Backwards, so erasing entry i leaves the pollfd of every entry
+        // still to be visited in place.
+        for (std::size_t i = incoming.size(); i-- > 0;) {
+            Incoming &c = incoming[i];
+            int fd = c.fd;
+            if (ready > 0 && fds[i + 1].revents != 0) {
+                char chunk[4096];
+                ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+                if (n > 0) c.data.append(chunk, static_cast<std::size_t>(n));
+                Request req;
+                ParseResult parsed = n > 0 ? parseRequest(c.data, req) : ParseResult::Malformed;
+                if (parsed == ParseResult::Incomplete) continue;
+                incoming.erase(incoming.begin() + static_cast<std::ptrdiff_t>(i));
+                setBlocking(fd);
+                if (parsed == ParseResult::Complete) {
+                    handleRequest(fd, req);
+                } else {
+                    sendError(fd, 400, "malformed request");
+                    ::close(fd);
+                }
+            } else if (now >= c.deadline) {
+                incoming.erase(incoming.begin() + static_cast<std::ptrdiff_t>(i));
+                setBlocking(fd);
+                sendError(fd, 408, "request not received in time");
+                ::close(fd);
+            }
+        }
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd >= 0) incoming.push_back({fd, std::string(), now + std::chrono::seconds(kReadTimeoutSeconds)});
+        }
+    }
+    for (const Incoming &c : incoming) ::close(c.fd);
+}
+
+// Validate on the accepting thread; cheap endpoints are answered here,
+// generation requests go to the queue.
+void Server::handleRequest(int fd, const Request &req) {
+    if (req.method != "GET" && req.method != "POST") {
+        sendError(fd, 405, "use GET or POST");
+        ::close(fd);
+        return;
+    }
+    if (req.path == "/health") {
+        sendBody(fd, 200, "text/plain", "ok\n");
+        ::close(fd);
+        return;
+    }
+    if (req.path == "/stats") {
+        sendBody(fd, 200, "application/json", statsJson());
+        ::close(fd);
+        return;
+    }
+    Job job;
+    job.fd = fd;
+    if (req.path == "/summary") {
+        job.endpoint = Endpoint::Summary;
+    } else if (req.path == "/model") {
+        job.endpoint = Endpoint::Model;
+    } else {
+        sendError(fd, 404, "unknown path " + req.path);
+        ::close(fd);
+        return;
+    }
+    job.cfg = defaults_;
+    try {
+        for (const auto &[key, value] : req.params) {
+            if (key == "priority") {
+                job.priority = priorityFromString(value);
+            } else if (key == "timeout") {
+                double seconds = timeoutFromString(key, value);
+                if (seconds > 0.0) {
+                    job.hasDeadline = true;
+                    job.deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                                      std::chrono::duration<double>(seconds));
+                }
+            } else if (!applyConfigOption(job.cfg, key, value)) {
+                throw std::invalid_argument("Unknown parameter: " + key);
+            }
+        }
+    } catch (const std::invalid_argument &e) {
+        sendError(fd, 400, e.what());
+        ::close(fd);
+        return;
+    }
+    job.cfg.normalize();
+    if (options_.jobMemoryBytes > 0) {
+        std::uint64_t peak = estimateResources(job.cfg).peakRssBytes;
+        if (peak > options_.jobMemoryBytes) {
+            sendError(fd, 413, "estimated peak memory of " + std::to_string(peak) +
+                                   " bytes exceeds the per-job limit");
+            ::close(fd);
+            return;
+        }
+    }
+    admit(std::move(job));
+}
+
+void Server::admit(Job job) {
+    Job turnedAway;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::pair<int, std::uint64_t> slot{-job.priority, arrivals_++};
+        bool accepted = true;
+        if (queue_.size() >= options_.queueLimit) {
+            if (queue_.empty() || std::prev(queue_.end())->first.first <= slot.first) {
+                accepted = false;
+            } else {
+                auto lowest = std::prev(queue_.end());
+                turnedAway = std::move(lowest->second);
+                queue_.erase(lowest);
+            }
+            rejected_++;
+        }
+        if (accepted) queue_.emplace(slot, std::move(job));
+        else turnedAway = std::move(job);
+    }
+    if (turnedAway.fd >= 0) {
+        sendError(turnedAway.fd, 503, "queue full", "Retry-After: 1\r\n");
+        ::close(turnedAway.fd);
+    }
+    ready_.notify_one();
+}
+
+// With NUMA placement the workers are split into one contiguous group per
+// node; each worker stays bound to its node for its lifetime.
+void Server::workerLoop(unsigned index, unsigned workers) {
+    std::size_t node = 0;
+    bool placed = false;
+    if (numaPlacement()) {
+        node = static_cast<std::size_t>(index) * numaNodes().size() / workers;
+        placed = bindThreadToNode(node);
+    }
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            job = std::move(queue_.begin()->second);
+            queue_.erase(queue_.begin());
+        }
+        Clock::time_point start = Clock::now();
+        execute(job);
+        ::close(job.fd);
+        if (placed) recordNumaJob(node, Clock::now() - start);
+        std::lock_guard<std::mutex> lock(mutex_);
+        completed_++;
+    }
+}
+
+void Server::execute(Job &job) {
+    ExecutionContext ctx;
+    if (job.hasDeadline) ctx.setDeadline(job.deadline);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) ctx.cancel();
+        running_.insert(&ctx);
+    }
+    try {
+        ctx.check();
+        CityPtr entry = obtainCity(job.cfg, ctx);
+        if (job.endpoint == Endpoint::Summary) {
+            sendBody(job.fd, 200, "application/json", entry->summary);
+        } else {
+            sendModel(job.fd, *entry, job.cfg.export_format, ctx);
+        }
+    } catch (const GenerationCancelled &e) {
+        bool expired = e.reason() == GenerationCancelled::Reason::DeadlineExceeded;
+        sendError(job.fd, expired ? 504 : 503, e.what());
+    } catch (const MemoryLimitExceeded &e) {
+        sendError(job.fd, 503, e.what());
+    } catch (const std::exception &e) {
+        sendError(job.fd, 500, e.what());
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_.erase(&ctx);
+}
+
+// Cache lookup with single flight: the first request for a key generates,
+// identical requests arriving meanwhile wait for its result.  Waiters keep
+// to their own deadline and cancellation.  If the run they waited on was
+// cancelled (the leader's deadline, not theirs), they look again and may
+// generate the city themselves.
+CityPtr Server::obtainCity(const Config &cfg, ExecutionContext &ctx) {
+    // The output format is not part of the key, so one entry serves every format.
+    std::string key = generationKey(cfg);
+    std::shared_ptr<std::promise<CityPtr>> promise;
+    for (;;) {
+        std::shared_future<CityPtr> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (CityPtr hit = cache_.get(key)) {
+                cacheHits_++;
+                return hit;
+            }
+            auto it = inflight_.find(key);
+            if (it != inflight_.end()) {
+                cacheHits_++;
+                pending = it->second;
+            } else {
+                cacheMisses_++;
+                promise = std::make_shared<std::promise<CityPtr>>();
+                inflight_[key] = promise->get_future().share();
+            }
+        }
+        if (promise) break;
+        while (pending.wait_for(kWaitSlice) != std::future_status::ready) ctx.check();
+        try {
+            return pending.get();
+        } catch (const GenerationCancelled &) {
+            ctx.check();
+        }
+    }
+    try {
+        auto entry = std::make_shared<CachedCity>();
+        entry->city = CityGenerator::generate(cfg, &ctx);
+        entry->summary = summaryToJson(computeSummary(entry->city, &ctx));
+        entry->bytes = footprintOf(entry->city, entry->summary);
+        entry->node = boundNode();
+        CityPtr result = entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cache_.put(key, result);
+            inflight_.erase(key);
+        }
+        promise->set_value(result);
+        return result;
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            inflight_.erase(key);
+        }
+        promise->set_exception(std::current_exception());
+        throw;
+    }
+}
+
+std::string Server::statsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string out;
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("queued", static_cast<std::uint64_t>(queue_.size()));
+    json.field("running", static_cast<std::uint64_t>(running_.size()));
+    json.field("completed", completed_);
+    json.field("rejected", rejected_);
+    json.field("cacheHits", cacheHits_);
+    json.field("cacheMisses", cacheMisses_);
+    json.field("cacheEntries", static_cast<std::uint64_t>(cache_.entries()));
+    json.field("cacheBytes", cache_.bytes());
+    if (numaPlacement()) {
+        double uptime = std::chrono::duration<double>(Clock::now() - started_).count();
+        json.key("numa");
+        json.beginArray();
+        for (const NumaNodeStats &s : numaStats()) {
+            json.beginObject();
+            json.field("node", s.node);
+            json.field("cpus", static_cast<std::uint64_t>(s.cpus));
+            json.field("jobs", s.jobs);
+            json.field("busySeconds", s.busySeconds);
+            json.field("jobsPerSecond", uptime > 0.0 ? s.jobs / uptime : 0.0);
+            json.endObject();
+        }
+        json.endArray();
+    }
+    json.endObject();
+    out.push_back('\n');
+    return out;
+}
+
+} // namespace
+
+int runServer(const ServerOptions &options, const Config &defaults) {
+    Server server(options, defaults);
+    return server.run();
+}
@@ -0,0 +1,242 @@
+#include "Shards.h"
+#include "CityFile.h"
+#include "Config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @file ShardWorkers.cpp
+ *
+ * Coordinator and worker sides of multi-process shard export (see
+ * Shards.h for the protocol).
+ */
+
+namespace {
+
+constexpr int kPollMillis = 200;
+
+std::string selfExecutable() {
+    char path[4096];
+    ssize_t n = ::readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (n <= 0) throw std::runtime_error("cannot locate the citygen executable for shard workers");
+    return std::string(path, static_cast<std::size_t>(n));
+}
+
+struct Worker {
+    pid_t pid = -1;
+    int fd = -1;          ///< Our end of the socket pair (the worker's stdin and stdout)
+    bool open = true;     ///< False once we have shut down our sending side
+    int shard = -1;       ///< Shard in flight, or -1 when idle
+    std::string received; ///< Incomplete record line
+};
+
+// Workers still running when the coordinator unwinds are stopped, and the
+// scratch city file is removed.
+class WorkerPool {
+public:
+    WorkerPool(std::vector<std::string> args, std::string scratch)
+        : args_(std::move(args)), scratch_(std::move(scratch)) {}
+    ~WorkerPool() {
+        for (Worker &w : workers) {
+            ::kill(w.pid, SIGTERM);
+            reap(w);
+        }
+        ::unlink(scratch_.c_str());
+    }
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void spawn() {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+            throw std::runtime_error("socketpair: " + std::string(std::strerror(errno)));
+        }
+        std::vector<char *> argv;
+        for (std::string &a : args_) argv.push_back(a.data());
+        argv.push_back(nullptr);
+        pid_t pid = ::fork();
+        if (pid < 0) {
+            std::string reason = std::strerror(errno);
+            ::close(fds[0]);
+            ::close(fds[1]);
+            throw std::runtime_error("cannot start shard worker: " + reason);
+        }
+        if (pid == 0) {
+            // dup2 clears close-on-exec on the copies.
+            if (::dup2(fds[1], 0) < 0 || ::dup2(fds[1], 1) < 0) ::_exit(127);
+            ::execv(argv[0], argv.data());
+            ::_exit(127);
+        }
+        ::close(fds[1]);
+        Worker w;
+        w.pid = pid;
+        w.fd = fds[0];
+        workers.push_back(w);
+    }
+
+    /// Close our end and wait for the worker; returns its wait status.
+    static int reap(Worker &w) {
+        if (w.fd >= 0) ::close(w.fd);
+        w.fd = -1;
+        int status = 0;
+        while (::waitpid(w.pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        return status;
+    }
+
+    std::vector<Worker> workers;
+
+private:
+    std::vector<std::string> args_;
+    std::string scratch_;
+};
+
+bool sendLine(int fd, const std::string &line) {
+    const char *data = line.data();
+    std::size_t len = line.size();
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+std::size_t saveShardsWithWorkers(const City &city, const std::string &directory,
+                                  const std::string &extension, int count, City::ShardMode mode,
+                                  int workers, ExecutionContext *ctx) {
+    ShardPlan plan = planShards(city, count, mode);
+    count = plan.count;
+    const std::string scratch = directory + "/.city_shards.city";
+    if (!city.saveCity(scratch, ctx)) {
+        std::remove(scratch.c_str());
+        throw std::runtime_error("cannot write " + scratch);
+    }
+    WorkerPool pool({selfExecutable(), "shard-worker", scratch, directory, extension, std::to_string(count),
+                     mode == City::ShardMode::Spatial ? "spatial" : "round-robin"},
+                    scratch);
+    const std::size_t target = static_cast<std::size_t>(std::clamp(workers, 1, count));
+
+    std::deque<int> queue;
+    for (int s = 0; s < count; ++s) queue.push_back(s);
+    std::vector<int> attempts(static_cast<std::size_t>(count), 0);
+    std::vector<ShardRecord> records(static_cast<std::size_t>(count));
+    int done = 0;
+    StageScope stage(ctx, "shards", static_cast<std::uint64_t>(count));
+    auto failed = [&](int shard) {
+        if (++attempts[shard] > kShardRetries) {
+            throw std::runtime_error("shard " + std::to_string(shard) + " failed after " +
+                                     std::to_string(kShardRetries + 1) + " attempts");
+        }
+        queue.push_front(shard);
+    };
+
+    while (done < count) {
+        if (ctx) ctx->check();
+        while (pool.workers.size() < target && !queue.empty()) pool.spawn();
+        for (Worker &w : pool.workers) {
+            if (w.shard >= 0 || !w.open) continue;
+            if (queue.empty()) {
+                ::shutdown(w.fd, SHUT_WR);
+                w.open = false;
+                continue;
+            }
+            w.shard = queue.front();
+            queue.pop_front();
+            // A worker that has already died shows up as end of file below.
+            sendLine(w.fd, std::to_string(w.shard) + "\n");
+        }
+        std::vector<pollfd> fds;
+        for (const Worker &w : pool.workers) fds.push_back({w.fd, POLLIN, 0});
+        if (::poll(fds.data(), fds.size(), kPollMillis) <= 0) continue;
+        for (std::size_t i = fds.size(); i-- > 0;) {
+            if (fds[i].revents == 0) continue;
+            Worker &w = pool.workers[i];
+            char chunk[4096];
+            ssize_t n = ::read(w.fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            bool broken = n <= 0;
+            if (!broken) w.received.append(chunk, static_cast<std::size_t>(n));
+            std::size_t eol;
+            while (!broken && (eol = w.received.find('\n')) != std::string::npos) {
+                ShardRecord r;
+                bool ok = shardRecordFromLine(w.received.substr(0, eol), r) && r.index == w.shard;
+                w.received.erase(0, eol + 1);
+                if (!ok) {
+                    broken = true;
+                    break;
+                }
+                records[r.index] = r;
+                w.shard = -1;
+                ++done;
+                stage.advance();
+            }
+            if (!broken) continue;
+            // End of file, a read error or a garbled record: the worker is
+            // finished either way, and any shard it held goes back in line.
+            ::kill(w.pid, SIGTERM);
+            WorkerPool::reap(w);
+            int shard = w.shard;
+            pool.workers.erase(pool.workers.begin() + static_cast<std::ptrdiff_t>(i));
+            if (shard >= 0) failed(shard);
+        }
+    }
+    stage.finish();
+    for (Worker &w : pool.workers) {
+        if (w.open) ::shutdown(w.fd, SHUT_WR);
+        WorkerPool::reap(w);
+    }
+    pool.workers.clear();
+    if (!writeShardManifest(city, plan, directory, extension, records)) return 0;
+    return records.size();
+}
+
+int runShardWorker(int argc, char **argv) {
+    if (argc != 5) {
+        std::cerr << "Usage: citygen shard-worker <city-file> <directory> <format> <count> <mode>"
+                  << std::endl;
+        return 2;
+    }
+    try {
+        std::string directory = argv[1];
+        std::string extension = argv[2];
+        int count = static_cast<int>(integerOptionFromString("shard count", argv[3], 1, kMaxShards));
+        City::ShardMode mode = shardModeFromString(argv[4]) == Config::ShardMode::RoundRobin
+                                   ? City::ShardMode::RoundRobin
+                                   : City::ShardMode::Spatial;
+        City city = loadCity(argv[0]);
+        ShardPlan plan = planShards(city, count, mode);
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            long long index = integerOptionFromString("shard index", line, 0, plan.count - 1);
+            ShardRecord record;
+            if (!writeShard(city, plan, static_cast<int>(index), directory, extension, record)) {
+                throw std::runtime_error("cannot write " + directory + "/" + record.file);
+            }
+            std::cout << shardRecordToLine(record) << std::endl;
+        }
+        return 0;
+    } catch (const std::exception &e) {
+        std::cerr << "shard-worker: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,288 @@
+#include "Shards.h"
+#include "Execution.h"
+#include "Output.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @file Shards.cpp
+ *
+ * Split a city into N standalone model files plus a JSON manifest so that
+ * downstream jobs can ingest the pieces in parallel.
+ */
+
+namespace {
+
+// Buildings are dealt out in runs of at most this many consecutive entries.
+// Runs keep neighbouring parcels of a block together in round-robin mode.
+constexpr std::size_t kRoundRobinRun = 256;
+
+Vec2 buildingCentre(const Building &b) {
+    if (!b.hasCorners) return {b.footprint.centreX(), b.footprint.centreY()};
+    Vec2 c;
+    for (const auto &p : b.corners) {
+        c.x += p.x;
+        c.y += p.y;
+    }
+    c.x *= 0.25;
+    c.y *= 0.25;
+    return c;
+}
+
+// Node of the k-d tree produced by recursive bisection.  Leaves carry a
+// shard index; inner nodes split on x or y at `split`.
+struct KdNode {
+    int shard = -1;
+    bool splitX = true;
+    double split = 0.0;
+    std::unique_ptr<KdNode> lo;
+    std::unique_ptr<KdNode> hi;
+};
+
+// Recursively bisect the given building indices into `count` shards of
+// near-equal size along the longer axis of their centroid bounds.  Uneven
+// shard counts are split proportionally (e.g. 5 → 2 + 3).
+std::unique_ptr<KdNode> bisect(std::vector<std::size_t>::iterator begin,
+                               std::vector<std::size_t>::iterator end,
+                               const std::vector<Vec2> &centres, int count, int &nextShard) {
+    auto node = std::make_unique<KdNode>();
+    if (count <= 1 || end - begin < 2) {
+        node->shard = nextShard;
+        nextShard += std::max(count, 1);
+        return node;
+    }
+    double minX = std::numeric_limits<double>::max(), maxX = -minX;
+    double minY = minX, maxY = -minX;
+    for (auto it = begin; it != end; ++it) {
+        const Vec2 &c = centres[*it];
+        minX = std::min(minX, c.x);
+        maxX = std::max(maxX, c.x);
+        minY = std::min(minY, c.y);
+        maxY = std::max(maxY, c.y);
+    }
+    node->splitX = (maxX - minX) >= (maxY - minY);
+    int loCount = count / 2;
+    auto mid = begin + (end - begin) * loCount / count;
+    auto key = [&](std::size_t i) { return node->splitX ? centres[i].x : centres[i].y; };
+    std::nth_element(begin, mid, end, [&](std::size_t a, std::size_t b) {
+        return key(a) < key(b) || (key(a) == key(b) && a < b);
+    });
+    node->split = key(*mid);
+    node->lo = bisect(begin, mid, centres, loCount, nextShard);
+    node->hi = bisect(mid, end, centres, count - loCount, nextShard);
+    return node;
+}
+
+int classify(const KdNode *node, const Vec2 &p) {
+    while (node->shard < 0) {
+        double v = node->splitX ? p.x : p.y;
+        node = v < node->split ? node->lo.get() : node->hi.get();
+    }
+    return node->shard;
+}
+
+// Indices 0..shard.size()-1 grouped by their shard, each group ascending.
+std::vector<std::vector<std::size_t>> bucketByShard(const std::vector<int> &shard, int count) {
+    std::vector<std::vector<std::size_t>> buckets(static_cast<std::size_t>(count));
+    for (std::size_t i = 0; i < shard.size(); ++i) buckets[static_cast<std::size_t>(shard[i])].push_back(i);
+    return buckets;
+}
+
+struct Bounds {
+    double x0 = std::numeric_limits<double>::max();
+    double y0 = std::numeric_limits<double>::max();
+    double x1 = -std::numeric_limits<double>::max();
+    double y1 = -std::numeric_limits<double>::max();
+
+    void add(double x, double y) {
+        x0 = std::min(x0, x);
+        y0 = std::min(y0, y);
+        x1 = std::max(x1, x);
+        y1 = std::max(y1, y);
+    }
+    bool empty() const { return x1 < x0; }
+};
+
+} // namespace
+
+ShardPlan planShards(const City &city, int count, City::ShardMode mode) {
+    const auto &buildings = city.buildings;
+    const auto &roads = city.roads;
+    const auto &facilities = city.facilities;
+    ShardPlan plan;
+    plan.count = std::max(count, 1);
+    plan.mode = mode;
+    count = plan.count;
+    std::vector<int> buildingShard(buildings.size(), 0);
+    std::vector<int> roadShard(roads.size(), 0);
+    std::vector<int> facilityShard(facilities.size(), 0);
+    if (mode == City::ShardMode::Spatial) {
+        std::vector<Vec2> centres(buildings.size());
+        for (std::size_t i = 0; i < buildings.size(); ++i) centres[i] = buildingCentre(buildings[i]);
+        std::vector<std::size_t> order(buildings.size());
+        std::iota(order.begin(), order.end(), 0);
+        int nextShard = 0;
+        std::unique_ptr<KdNode> tree;
+        if (!order.empty()) {
+            tree = bisect(order.begin(), order.end(), centres, count, nextShard);
+        }
+        if (tree) {
+            for (std::size_t i = 0; i < buildings.size(); ++i) buildingShard[i] = classify(tree.get(), centres[i]);
+            for (std::size_t i = 0; i < roads.size(); ++i) {
+                Vec2 mid{(roads[i].x1 + roads[i].x2) * 0.5, (roads[i].y1 + roads[i].y2) * 0.5};
+                roadShard[i] = classify(tree.get(), mid);
+            }
+            for (std::size_t i = 0; i < facilities.size(); ++i) {
+                facilityShard[i] = classify(tree.get(), {facilities[i].x, facilities[i].y});
+            }
+        }
+    } else {
+        // Small cities still get several runs per shard.
+        std::size_t run = std::clamp<std::size_t>(buildings.size() / (std::size_t(count) * 4), 1, kRoundRobinRun);
+        for (std::size_t i = 0; i < buildings.size(); ++i) {
+            buildingShard[i] = static_cast<int>((i / run) % count);
+        }
+        for (std::size_t i = 0; i < roads.size(); ++i) roadShard[i] = static_cast<int>(i % count);
+        for (std::size_t i = 0; i < facilities.size(); ++i) facilityShard[i] = static_cast<int>(i % count);
+    }
+    // Bucket once here so each writeShard() visits only its own features.
+    plan.buildings = bucketByShard(buildingShard, count);
+    plan.roads = bucketByShard(roadShard, count);
+    plan.facilities = bucketByShard(facilityShard, count);
+    return plan;
+}
+
+bool writeShard(const City &city, const ShardPlan &plan, int index, const std::string &directory,
+                const std::string &extension, ShardRecord &record) {
+    // Each shard is a self-contained City holding only its features, so
+    // the regular exporters produce a standalone model for it.
+    City shard;
+    shard.size = city.size;
+    Bounds bounds;
+    const auto &buildings = plan.buildings[static_cast<std::size_t>(index)];
+    const auto &roads = plan.roads[static_cast<std::size_t>(index)];
+    const auto &facilities = plan.facilities[static_cast<std::size_t>(index)];
+    shard.buildings.reserve(buildings.size());
+    for (std::size_t i : buildings) {
+        const Building &b = city.buildings[i];
+        shard.buildings.push_back(b);
+        if (b.hasCorners) {
+            for (const auto &c : b.corners) bounds.add(c.x, c.y);
+        } else {
+            bounds.add(b.footprint.x0, b.footprint.y0);
+            bounds.add(b.footprint.x1, b.footprint.y1);
+        }
+    }
+    shard.roads.reserve(roads.size());
+    for (std::size_t i : roads) {
+        shard.roads.push_back(city.roads[i]);
+        bounds.add(city.roads[i].x1, city.roads[i].y1);
+        bounds.add(city.roads[i].x2, city.roads[i].y2);
+    }
+    for (std::size_t i : facilities) shard.facilities.push_back(city.facilities[i]);
+    record = ShardRecord();
+    record.index = index;
+    record.buildings = shard.buildings.size();
+    record.roads = shard.roads.size();
+    record.facilities = shard.facilities.size();
+    record.hasBounds = !bounds.empty();
+    if (record.hasBounds) {
+        record.x0 = bounds.x0;
+        record.y0 = bounds.y0;
+        record.x1 = bounds.x1;
+        record.y1 = bounds.y1;
+    }
+    char name[64];
+    std::snprintf(name, sizeof(name), "city_shard_%03d.%s", index, extension.c_str());
+    record.file = name;
+    std::string path = directory + "/" + record.file;
+    if (extension == "glb") return shard.saveGLTF(path, true);
+    if (extension == "gltf") return shard.saveGLTF(path, false);
+    return shard.saveOBJ(path);
+}
+
+bool writeShardManifest(const City &city, const ShardPlan &plan, const std::string &directory,
+                        const std::string &extension, const std::vector<ShardRecord> &records) {
+    OutputSink manifest(directory + "/city_shards.json");
+    if (!manifest) return false;
+    manifest << "{\n";
+    manifest << "  \"mode\": \"" << (plan.mode == City::ShardMode::Spatial ? "spatial" : "round-robin") << "\",\n";
+    manifest << "  \"format\": \"" << extension << "\",\n";
+    manifest << "  \"totalBuildings\": " << city.buildings.size() << ",\n";
+    manifest << "  \"totalRoads\": " << city.roads.size() << ",\n";
+    manifest << "  \"shards\": [\n";
+    // Bounds round-trip exactly, as in the worker records.
+    manifest.precision(std::numeric_limits<double>::max_digits10);
+    for (std::size_t s = 0; s < records.size(); ++s) {
+        const ShardRecord &r = records[s];
+        manifest << "    {\"index\": " << s
+                 << ", \"file\": \"" << r.file << "\""
+                 << ", \"buildings\": " << r.buildings
+                 << ", \"roads\": " << r.roads
+                 << ", \"facilities\": " << r.facilities
+                 << ", \"bounds\": ";
+        if (!r.hasBounds) {
+            manifest << "null";
+        } else {
+            manifest << "[" << r.x0 << ", " << r.y0 << ", " << r.x1 << ", " << r.y1 << "]";
+        }
+        manifest << "}" << (s + 1 < records.size() ? "," : "") << "\n";
+    }
+    manifest << "  ]\n}";
+    return manifest.close();
+}
+
+std::string shardRecordToLine(const ShardRecord &r) {
+    char line[512];
+    if (r.hasBounds) {
+        std::snprintf(line, sizeof(line), "%d %s %zu %zu %zu %.17g %.17g %.17g %.17g", r.index, r.file.c_str(),
+                      r.buildings, r.roads, r.facilities, r.x0, r.y0, r.x1, r.y1);
+    } else {
+        std::snprintf(line, sizeof(line), "%d %s %zu %zu %zu - - - -", r.index, r.file.c_str(), r.buildings,
+                      r.roads, r.facilities);
+    }
+    return line;
+}
+
+bool shardRecordFromLine(const std::string &line, ShardRecord &r) {
+    std::istringstream in(line);
+    std::string bounds[4];
+    if (!(in >> r.index >> r.file >> r.buildings >> r.roads >> r.facilities >> bounds[0] >> bounds[1] >>
+          bounds[2] >> bounds[3])) {
+        return false;
+    }
+    r.hasBounds = bounds[0] != "-";
+    if (!r.hasBounds) return true;
+    double *values[4] = {&r.x0, &r.y0, &r.x1, &r.y1};
+    for (int k = 0; k < 4; ++k) {
+        char *end = nullptr;
+        *values[k] = std::strtod(bounds[k].c_str(), &end);
+        if (end == bounds[k].c_str() || *end != '\0') return false;
+    }
+    return true;
+}
+
+std::size_t City::saveShards(const std::string &directory, const std::string &extension,
+                             int count, ShardMode mode, ExecutionContext *ctx) const {
+    ShardPlan plan = planShards(*this, count, mode);
+    std::vector<ShardRecord> records(static_cast<std::size_t>(plan.count));
+    std::vector<char> written(records.size(), 0);
+    StageScope stage(ctx, "shards", static_cast<std::uint64_t>(plan.count));
+    parallelFor(0, records.size(), [&](std::size_t s) {
+        written[s] = writeShard(*this, plan, static_cast<int>(s), directory, extension, records[s]);
+        stage.advance();
+    });
+    stage.finish();
+    if (std::find(written.begin(), written.end(), 0) != written.end()) return 0;
+    if (!writeShardManifest(*this, plan, directory, extension, records)) return 0;
+    return records.size();
+}
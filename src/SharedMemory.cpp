@@ -0,0 +1,193 @@
+#include "SharedMemory.h"
+#include "Execution.h"
+
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[4] = {'C', 'G', 'S', 'M'};
+constexpr std::uint32_t kVersion = 1;
+constexpr std::uint64_t kAlignment = 64;
+
+struct SegmentHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t sectionCount;
+    std::uint32_t complete;
+    std::uint64_t totalBytes;
+    std::int32_t gridSize;
+    std::uint8_t reserved[36];
+};
+static_assert(sizeof(SegmentHeader) == 64, "segment header layout");
+
+struct SectionEntry {
+    char name[32];
+    std::uint32_t type;
+    std::uint32_t components;
+    std::uint64_t offset;
+    std::uint64_t count;
+    std::uint64_t reserved;
+};
+static_assert(sizeof(SectionEntry) == 64, "section entry layout");
+
+std::uint64_t alignUp(std::uint64_t v) { return (v + kAlignment - 1) / kAlignment * kAlignment; }
+
+bool validType(std::uint32_t type) { return type >= 1 && type <= 6; }
+
+} // namespace
+
+std::size_t sharedTypeSize(SharedType type) {
+    switch (type) {
+        case SharedType::Int32:
+        case SharedType::UInt32:
+        case SharedType::Float32: return 4;
+        case SharedType::Float64: return 8;
+        case SharedType::UInt8:
+        case SharedType::Text:
+        default: return 1;
+    }
+}
+
+std::string sharedSegmentName(const std::string &name) {
+    std::string canonical = (!name.empty() && name[0] == '/') ? name : "/" + name;
+    if (canonical.size() < 2 || canonical.find('/', 1) != std::string::npos) {
+        throw std::invalid_argument("invalid shared-memory segment name: " + name);
+    }
+    return canonical;
+}
+
+std::uint64_t writeSharedSegment(const std::string &name, int gridSize,
+                                 const std::vector<SharedSection> &sections,
+                                 ExecutionContext *ctx) {
+    std::string segment = sharedSegmentName(name);
+    StageScope stage(ctx, "shared memory", sections.size());
+
+    std::vector<SectionEntry> table(sections.size());
+    std::uint64_t offset = alignUp(sizeof(SegmentHeader) + table.size() * sizeof(SectionEntry));
+    for (std::size_t i = 0; i < sections.size(); ++i) {
+        const SharedSection &s = sections[i];
+        SectionEntry &e = table[i];
+        std::memset(&e, 0, sizeof(e));
+        std::strncpy(e.name, s.name.c_str(), sizeof(e.name) - 1);
+        e.type = static_cast<std::uint32_t>(s.type);
+        e.components = s.components;
+        e.count = s.count;
+        e.offset = offset;
+        offset = alignUp(offset + s.count * s.components * sharedTypeSize(s.type));
+    }
+    std::uint64_t total = offset;
+
+    ::shm_unlink(segment.c_str());
+    int fd = ::shm_open(segment.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return 0;
+    // Reserve the pages up front: a full tmpfs must fail here rather than
+    // raise SIGBUS halfway through the copy.
+    if (::ftruncate(fd, static_cast<off_t>(total)) != 0 ||
+        ::posix_fallocate(fd, 0, static_cast<off_t>(total)) != 0) {
+        ::close(fd);
+        ::shm_unlink(segment.c_str());
+        return 0;
+    }
+    void *p = ::mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        ::shm_unlink(segment.c_str());
+        return 0;
+    }
+    auto *base = static_cast<std::uint8_t *>(p);
+
+    auto *header = reinterpret_cast<SegmentHeader *>(base);
+    std::memcpy(header->magic, kMagic, sizeof(kMagic));
+    header->version = kVersion;
+    header->sectionCount = static_cast<std::uint32_t>(table.size());
+    header->totalBytes = total;
+    header->gridSize = gridSize;
+    if (!table.empty()) {
+        std::memcpy(base + sizeof(SegmentHeader), table.data(), table.size() * sizeof(SectionEntry));
+    }
+    try {
+        for (std::size_t i = 0; i < sections.size(); ++i) {
+            if (sections[i].count > 0 && sections[i].fill) sections[i].fill(base + table[i].offset);
+            stage.advance();
+        }
+    } catch (...) {
+        ::munmap(p, total);
+        ::shm_unlink(segment.c_str());
+        throw;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    header->complete = 1;
+    ::munmap(p, total);
+    return total;
+}
+
+SharedCityView::SharedCityView(const std::string &name) {
+    std::string segment = sharedSegmentName(name);
+    int fd = ::shm_open(segment.c_str(), O_RDONLY, 0);
+    if (fd < 0) throw std::runtime_error("cannot open shared-memory segment " + segment);
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::uint64_t>(st.st_size) < sizeof(SegmentHeader)) {
+        ::close(fd);
+        throw std::runtime_error("truncated shared-memory segment " + segment);
+    }
+    size_ = static_cast<std::uint64_t>(st.st_size);
+    void *p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) throw std::runtime_error("cannot map shared-memory segment " + segment);
+    base_ = p;
+
+    auto fail = [&](const char *what) {
+        ::munmap(base_, size_);
+        base_ = nullptr;
+        throw std::runtime_error(std::string(what) + " shared-memory segment " + segment);
+    };
+    const auto *bytes = static_cast<const std::uint8_t *>(base_);
+    const auto *header = reinterpret_cast<const SegmentHeader *>(bytes);
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion) {
+        fail("unrecognised");
+    }
+    if (!header->complete) fail("incomplete");
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->totalBytes > size_ ||
+        sizeof(SegmentHeader) + std::uint64_t(header->sectionCount) * sizeof(SectionEntry) > size_) {
+        fail("truncated");
+    }
+    gridSize_ = header->gridSize;
+    const auto *table = reinterpret_cast<const SectionEntry *>(bytes + sizeof(SegmentHeader));
+    sections_.reserve(header->sectionCount);
+    for (std::uint32_t i = 0; i < header->sectionCount; ++i) {
+        const SectionEntry &e = table[i];
+        if (!validType(e.type)) fail("corrupt");
+        Section s;
+        s.name.assign(e.name, strnlen(e.name, sizeof(e.name)));
+        s.type = static_cast<SharedType>(e.type);
+        s.components = e.components;
+        s.count = e.count;
+        std::uint64_t length = e.count * e.components * sharedTypeSize(s.type);
+        if (e.offset > size_ || length > size_ - e.offset) fail("truncated");
+        s.data = bytes + e.offset;
+        sections_.push_back(std::move(s));
+    }
+}
+
+SharedCityView::~SharedCityView() {
+    if (base_) ::munmap(base_, size_);
+}
+
+const SharedCityView::Section *SharedCityView::find(const std::string &name) const {
+    for (const auto &s : sections_) {
+        if (s.name == name) return &s;
+    }
+    return nullptr;
+}
+
+bool SharedCityView::unlink(const std::string &name) {
+    return ::shm_unlink(sharedSegmentName(name).c_str()) == 0;
+}
@@ -0,0 +1,115 @@
+#include "Sketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+// Capacities shrink geometrically by this factor towards lower levels.
+constexpr double kDecay = 2.0 / 3.0;
+
+} // namespace
+
+KllSketch::KllSketch(unsigned k) : k_(std::max(k, 8u)), levels_(1), parity_(1, 0) {}
+
+std::size_t KllSketch::capacity(std::size_t level) const {
+    std::size_t depth = levels_.size() - 1 - level;
+    double cap = std::ceil(k_ * std::pow(kDecay, static_cast<double>(depth)));
+    return std::max<std::size_t>(2, static_cast<std::size_t>(cap));
+}
+
+std::size_t KllSketch::retained() const {
+    std::size_t total = 0;
+    for (const auto &level : levels_) total += level.size();
+    return total;
+}
+
+void KllSketch::update(double v) {
+    if (n_ == 0) {
+        min_ = max_ = v;
+    } else {
+        min_ = std::min(min_, v);
+        max_ = std::max(max_, v);
+    }
+    n_++;
+    sum_ += v;
+    levels_[0].push_back(v);
+    if (levels_[0].size() >= capacity(0)) compress();
+}
+
+void KllSketch::merge(const KllSketch &other) {
+    if (other.n_ == 0) return;
+    if (n_ == 0) {
+        min_ = other.min_;
+        max_ = other.max_;
+    } else {
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+    n_ += other.n_;
+    sum_ += other.sum_;
+    if (other.levels_.size() > levels_.size()) {
+        levels_.resize(other.levels_.size());
+        parity_.resize(other.levels_.size(), 0);
+    }
+    for (std::size_t h = 0; h < other.levels_.size(); ++h) {
+        levels_[h].insert(levels_[h].end(), other.levels_[h].begin(), other.levels_[h].end());
+    }
+    compress();
+}
+
+// Halve the lowest over-full level into the one above until the sketch
+// fits its total capacity again.
+void KllSketch::compress() {
+    for (;;) {
+        std::size_t total = 0, budget = 0;
+        for (std::size_t h = 0; h < levels_.size(); ++h) {
+            total += levels_[h].size();
+            budget += capacity(h);
+        }
+        if (total < budget) return;
+        std::size_t h = 0;
+        while (h < levels_.size() && levels_[h].size() < capacity(h)) ++h;
+        if (h == levels_.size()) return;
+        if (h + 1 == levels_.size()) {
+            levels_.emplace_back();
+            parity_.push_back(0);
+        }
+        std::vector<double> &level = levels_[h];
+        std::sort(level.begin(), level.end());
+        // An odd item stays behind so the promoted pairs are exact.
+        std::size_t pairs = level.size() / 2;
+        std::size_t offset = parity_[h];
+        parity_[h] ^= 1;
+        std::vector<double> &up = levels_[h + 1];
+        for (std::size_t i = 0; i < pairs; ++i) up.push_back(level[2 * i + offset]);
+        if (level.size() % 2) {
+            double last = level.back();
+            level.assign(1, last);
+        } else {
+            level.clear();
+        }
+    }
+}
+
+double KllSketch::quantile(double q) const {
+    if (n_ == 0) return -1.0;
+    std::vector<std::pair<double, std::uint64_t>> items;
+    items.reserve(retained());
+    for (std::size_t h = 0; h < levels_.size(); ++h) {
+        for (double v : levels_[h]) items.push_back({v, std::uint64_t(1) << h});
+    }
+    std::sort(items.begin(), items.end());
+    std::uint64_t weight = 0;
+    for (const auto &it : items) weight += it.second;
+    q = std::clamp(q, 0.0, 1.0);
+    auto rank = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(weight)));
+    rank = std::max<std::uint64_t>(rank, 1);
+    std::uint64_t cumulative = 0;
+    for (const auto &it : items) {
+        cumulative += it.second;
+        if (cumulative >= rank) return it.first;
+    }
+    return items.back().first;
+}
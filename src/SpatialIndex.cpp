@@ -0,0 +1,164 @@
+#include "SpatialIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Upper bound on cells per axis; keeps the index small for huge inputs.
+constexpr int kMaxCellsPerAxis = 1024;
+
+// Visit rings of cells around the cell containing (x, y), calling
+// scan(gx, gy, best) for each, until no unvisited cell can hold anything closer
+// than the best squared distance found so far.
+template <typename Scan>
+double ringSearch(double x, double y, double x0, double y0, double cell, int nx, int ny, Scan &&scan) {
+    int cx = std::clamp(static_cast<int>(std::floor((x - x0) / cell)), 0, nx - 1);
+    int cy = std::clamp(static_cast<int>(std::floor((y - y0) / cell)), 0, ny - 1);
+    double best = std::numeric_limits<double>::max();
+    for (int r = 0;; ++r) {
+        int gx0 = cx - r, gx1 = cx + r, gy0 = cy - r, gy1 = cy + r;
+        for (int gx = std::max(gx0, 0); gx <= std::min(gx1, nx - 1); ++gx) {
+            if (gy0 >= 0) scan(gx, gy0, best);
+            if (gy1 < ny && gy1 != gy0) scan(gx, gy1, best);
+        }
+        for (int gy = std::max(gy0 + 1, 0); gy <= std::min(gy1 - 1, ny - 1); ++gy) {
+            if (gx0 >= 0) scan(gx0, gy, best);
+            if (gx1 < nx && gx1 != gx0) scan(gx1, gy, best);
+        }
+        if (gx0 <= 0 && gy0 <= 0 && gx1 >= nx - 1 && gy1 >= ny - 1) break;
+        // Any unvisited cell lies beyond one of the square's edges; edges
+        // already at the grid border have nothing beyond them.
+        const double inf = std::numeric_limits<double>::max();
+        double left = gx0 <= 0 ? inf : x - (x0 + gx0 * cell);
+        double right = gx1 >= nx - 1 ? inf : (x0 + (gx1 + 1) * cell) - x;
+        double bottom = gy0 <= 0 ? inf : y - (y0 + gy0 * cell);
+        double top = gy1 >= ny - 1 ? inf : (y0 + (gy1 + 1) * cell) - y;
+        double reach = std::max(0.0, std::min({left, right, bottom, top}));
+        if (best <= reach * reach) break;
+    }
+    return best;
+}
+
+double segmentDistSq(const RoadSegment &s, double x, double y) {
+    double dx = s.x2 - s.x1;
+    double dy = s.y2 - s.y1;
+    double len2 = dx * dx + dy * dy;
+    double t = len2 > 0.0 ? ((x - s.x1) * dx + (y - s.y1) * dy) / len2 : 0.0;
+    t = std::clamp(t, 0.0, 1.0);
+    double px = s.x1 + t * dx - x;
+    double py = s.y1 + t * dy - y;
+    return px * px + py * py;
+}
+
+} // namespace
+
+PointGrid::PointGrid(const std::vector<Vec2> &points) {
+    if (points.empty()) return;
+    double minX = std::numeric_limits<double>::max(), maxX = -minX;
+    double minY = minX, maxY = -minX;
+    for (const auto &p : points) {
+        minX = std::min(minX, p.x);
+        maxX = std::max(maxX, p.x);
+        minY = std::min(minY, p.y);
+        maxY = std::max(maxY, p.y);
+    }
+    double extent = std::max({maxX - minX, maxY - minY, 1e-9});
+    int perAxis = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(points.size()))));
+    perAxis = std::clamp(perAxis, 1, kMaxCellsPerAxis);
+    x0_ = minX;
+    y0_ = minY;
+    cell_ = extent / perAxis;
+    nx_ = std::clamp(static_cast<int>((maxX - minX) / cell_) + 1, 1, perAxis);
+    ny_ = std::clamp(static_cast<int>((maxY - minY) / cell_) + 1, 1, perAxis);
+
+    auto cellOf = [&](const Vec2 &p) {
+        int cx = std::min(static_cast<int>((p.x - x0_) / cell_), nx_ - 1);
+        int cy = std::min(static_cast<int>((p.y - y0_) / cell_), ny_ - 1);
+        return static_cast<std::size_t>(cy) * nx_ + cx;
+    };
+    start_.assign(static_cast<std::size_t>(nx_) * ny_ + 1, 0);
+    for (const auto &p : points) start_[cellOf(p) + 1]++;
+    for (std::size_t i = 1; i < start_.size(); ++i) start_[i] += start_[i - 1];
+    points_.resize(points.size());
+    std::vector<std::uint32_t> fill(start_.begin(), start_.end() - 1);
+    for (const auto &p : points) points_[fill[cellOf(p)]++] = p;
+}
+
+double PointGrid::nearestSq(double x, double y) const {
+    if (points_.empty()) return -1.0;
+    return ringSearch(x, y, x0_, y0_, cell_, nx_, ny_, [&](int gx, int gy, double &best) {
+        std::size_t c = static_cast<std::size_t>(gy) * nx_ + gx;
+        for (std::uint32_t i = start_[c]; i < start_[c + 1]; ++i) {
+            double dx = x - points_[i].x;
+            double dy = y - points_[i].y;
+            best = std::min(best, dx * dx + dy * dy);
+        }
+    });
+}
+
+SegmentGrid::SegmentGrid(const std::vector<RoadSegment> &roads) : segments_(roads) {
+    if (segments_.empty()) return;
+    double minX = std::numeric_limits<double>::max(), maxX = -minX;
+    double minY = minX, maxY = -minX;
+    for (const auto &s : segments_) {
+        minX = std::min({minX, s.x1, s.x2});
+        maxX = std::max({maxX, s.x1, s.x2});
+        minY = std::min({minY, s.y1, s.y2});
+        maxY = std::max({maxY, s.y1, s.y2});
+    }
+    double extent = std::max({maxX - minX, maxY - minY, 1e-9});
+    int perAxis = static_cast<int>(std::ceil(2.0 * std::sqrt(static_cast<double>(segments_.size()))));
+    perAxis = std::clamp(perAxis, 1, kMaxCellsPerAxis);
+    x0_ = minX;
+    y0_ = minY;
+    cell_ = extent / perAxis;
+    nx_ = std::clamp(static_cast<int>((maxX - minX) / cell_) + 1, 1, perAxis);
+    ny_ = std::clamp(static_cast<int>((maxY - minY) / cell_) + 1, 1, perAxis);
+
+    // Walk each segment row by row: within a row's y-slab the segment
+    // covers one contiguous x-interval, hence a run of columns.  The
+    // interval is widened slightly so rounding never drops a cell.
+    const double eps = cell_ * 1e-6;
+    auto col = [&](double x) { return std::clamp(static_cast<int>(std::floor((x - x0_) / cell_)), 0, nx_ - 1); };
+    auto row = [&](double y) { return std::clamp(static_cast<int>(std::floor((y - y0_) / cell_)), 0, ny_ - 1); };
+    auto forEachCell = [&](const RoadSegment &s, auto &&emit) {
+        double ya = std::min(s.y1, s.y2), yb = std::max(s.y1, s.y2);
+        for (int r = row(ya - eps); r <= row(yb + eps); ++r) {
+            double lo = std::max(ya, y0_ + r * cell_);
+            double hi = std::min(yb, y0_ + (r + 1) * cell_);
+            double xa, xb;
+            if (s.y1 == s.y2) {
+                xa = s.x1;
+                xb = s.x2;
+            } else {
+                double slope = (s.x2 - s.x1) / (s.y2 - s.y1);
+                xa = s.x1 + (lo - s.y1) * slope;
+                xb = s.x1 + (hi - s.y1) * slope;
+            }
+            if (xa > xb) std::swap(xa, xb);
+            for (int c = col(xa - eps); c <= col(xb + eps); ++c) {
+                emit(static_cast<std::size_t>(r) * nx_ + c);
+            }
+        }
+    };
+    start_.assign(static_cast<std::size_t>(nx_) * ny_ + 1, 0);
+    for (const auto &s : segments_) forEachCell(s, [&](std::size_t c) { start_[c + 1]++; });
+    for (std::size_t i = 1; i < start_.size(); ++i) start_[i] += start_[i - 1];
+    ids_.resize(start_.back());
+    std::vector<std::uint32_t> fill(start_.begin(), start_.end() - 1);
+    for (std::size_t i = 0; i < segments_.size(); ++i) {
+        forEachCell(segments_[i], [&](std::size_t c) { ids_[fill[c]++] = static_cast<std::uint32_t>(i); });
+    }
+}
+
+double SegmentGrid::nearestSq(double x, double y) const {
+    if (segments_.empty()) return -1.0;
+    return ringSearch(x, y, x0_, y0_, cell_, nx_, ny_, [&](int gx, int gy, double &best) {
+        std::size_t c = static_cast<std::size_t>(gy) * nx_ + gx;
+        for (std::uint32_t i = start_[c]; i < start_[c + 1]; ++i) {
+            best = std::min(best, segmentDistSq(segments_[ids_[i]], x, y));
+        }
+    });
+}
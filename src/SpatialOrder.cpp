@@ -0,0 +1,153 @@
+#include "SpatialOrder.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// Keys per radix-sort work item.
+constexpr std::size_t kSortChunk = std::size_t(1) << 16;
+
+// Radix digits: three passes of 11 bits cover a 32-bit key.
+constexpr int kDigitBits = 11;
+constexpr std::size_t kBuckets = std::size_t(1) << kDigitBits;
+constexpr int kPasses = (32 + kDigitBits - 1) / kDigitBits;
+
+// Curve coordinates span [0, 2^16) over the city grid.
+constexpr double kCurveCells = 65536.0;
+
+std::uint32_t spread(std::uint32_t v) {
+    v &= 0xffffu;
+    v = (v | (v << 8)) & 0x00ff00ffu;
+    v = (v | (v << 4)) & 0x0f0f0f0fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+
+std::uint32_t curveCoordinate(double v, int size) {
+    double scaled = v / std::max(size, 1) * kCurveCells;
+    return static_cast<std::uint32_t>(std::clamp(scaled, 0.0, kCurveCells - 1.0));
+}
+
+Vec2 centroid(const std::array<Vec2, 4> &corners, bool hasCorners, const Rect &box) {
+    if (!hasCorners) return {box.centreX(), box.centreY()};
+    Vec2 c;
+    for (const Vec2 &p : corners) {
+        c.x += p.x;
+        c.y += p.y;
+    }
+    return {c.x * 0.25, c.y * 0.25};
+}
+
+std::uint32_t curveKey(const Vec2 &p, int size, Config::SpatialOrder order) {
+    std::uint32_t x = curveCoordinate(p.x, size);
+    std::uint32_t y = curveCoordinate(p.y, size);
+    return order == Config::SpatialOrder::Morton ? mortonIndex(x, y) : hilbertIndex(x, y);
+}
+
+} // namespace
+
+std::uint32_t hilbertIndex(std::uint32_t x, std::uint32_t y) {
+    // Walk the quadrants from the top bit down, rotating the frame so each
+    // sub-square is entered where the previous one left off.
+    std::uint32_t d = 0;
+    for (std::uint32_t s = 1u << 15; s > 0; s >>= 1) {
+        std::uint32_t rx = (x & s) ? 1u : 0u;
+        std::uint32_t ry = (y & s) ? 1u : 0u;
+        d += s * s * ((3u * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+std::uint32_t mortonIndex(std::uint32_t x, std::uint32_t y) { return spread(x) | (spread(y) << 1); }
+
+std::vector<std::uint32_t> radixSortPermutation(const std::vector<std::uint32_t> &keys) {
+    const std::size_t n = keys.size();
+    std::vector<std::uint32_t> order(n);
+    for (std::size_t i = 0; i < n; ++i) order[i] = static_cast<std::uint32_t>(i);
+    if (n < 2) return order;
+    std::vector<std::uint32_t> sortedKeys = keys;
+    std::vector<std::uint32_t> nextOrder(n);
+    std::vector<std::uint32_t> nextKeys(n);
+    const std::size_t chunks = (n + kSortChunk - 1) / kSortChunk;
+    // counts[c * kBuckets + b]: keys of chunk c with digit b, turned into
+    // that chunk's first output slot for the digit.  Chunks scatter into
+    // disjoint ranges in chunk order, which keeps the sort stable.
+    std::vector<std::size_t> counts(chunks * kBuckets);
+    for (int pass = 0; pass < kPasses; ++pass) {
+        const int shift = pass * kDigitBits;
+        std::fill(counts.begin(), counts.end(), 0);
+        parallelFor(0, chunks, [&](std::size_t c) {
+            std::size_t *hist = counts.data() + c * kBuckets;
+            std::size_t end = std::min(n, (c + 1) * kSortChunk);
+            for (std::size_t i = c * kSortChunk; i < end; ++i) hist[(sortedKeys[i] >> shift) & (kBuckets - 1)]++;
+        });
+        std::size_t offset = 0;
+        for (std::size_t b = 0; b < kBuckets; ++b) {
+            for (std::size_t c = 0; c < chunks; ++c) {
+                std::size_t count = counts[c * kBuckets + b];
+                counts[c * kBuckets + b] = offset;
+                offset += count;
+            }
+        }
+        parallelFor(0, chunks, [&](std::size_t c) {
+            std::size_t *slot = counts.data() + c * kBuckets;
+            std::size_t end = std::min(n, (c + 1) * kSortChunk);
+            for (std::size_t i = c * kSortChunk; i < end; ++i) {
+                std::size_t dst = slot[(sortedKeys[i] >> shift) & (kBuckets - 1)]++;
+                nextKeys[dst] = sortedKeys[i];
+                nextOrder[dst] = order[i];
+            }
+        });
+        sortedKeys.swap(nextKeys);
+        order.swap(nextOrder);
+    }
+    return order;
+}
+
+void applySpatialOrder(City &city, Config::SpatialOrder order, ExecutionContext *ctx) {
+    if (order == Config::SpatialOrder::None) return;
+    StageScope stage(ctx, "spatial order", 2);
+
+    const std::size_t nb = city.buildings.size();
+    std::vector<std::uint32_t> keys(nb);
+    parallelFor(0, (nb + kSortChunk - 1) / kSortChunk, [&](std::size_t c) {
+        std::size_t end = std::min(nb, (c + 1) * kSortChunk);
+        for (std::size_t i = c * kSortChunk; i < end; ++i) {
+            const Building &b = city.buildings[i];
+            keys[i] = curveKey(centroid(b.corners, b.hasCorners, b.footprint), city.size, order);
+        }
+    });
+    std::vector<std::uint32_t> perm = radixSortPermutation(keys);
+    SpillVector<Building> buildings;
+    buildings.reserve(nb);
+    std::vector<std::uint32_t> ids(nb);
+    for (std::size_t k = 0; k < nb; ++k) {
+        buildings.push_back(city.buildings[perm[k]]);
+        ids[k] = city.buildingIds.empty() ? perm[k] : city.buildingIds[perm[k]];
+    }
+    city.buildings.swap(buildings);
+    city.buildingIds = std::move(ids);
+    stage.advance();
+
+    const std::size_t nk = city.blocks.size();
+    keys.resize(nk);
+    for (std::size_t i = 0; i < nk; ++i) {
+        const Block &b = city.blocks[i];
+        keys[i] = curveKey(centroid(b.corners, b.hasCorners, b.bounds), city.size, order);
+    }
+    perm = radixSortPermutation(keys);
+    std::vector<Block> blocks(nk);
+    for (std::size_t k = 0; k < nk; ++k) blocks[k] = city.blocks[perm[k]];
+    city.blocks = std::move(blocks);
+    stage.advance();
+}
@@ -0,0 +1,379 @@
+#include "Summary.h"
+#include "JsonWriter.h"
+#include "Parallel.h"
+#include "Sketch.h"
+#include "SpatialIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// Fixed chunk sizes; results must not depend on the worker count.
+constexpr std::size_t kBuildingChunk = 8192;
+constexpr std::size_t kCellChunk = 1 << 16;
+// KLL accuracy parameter: ~1% rank error in about 600 retained values.
+constexpr unsigned kSketchK = 200;
+
+// Index into the per-zone height accumulators, or -1 for zones without
+// height statistics.
+int heightSlot(ZoneType z) {
+    switch (z) {
+        case ZoneType::Residential: return 0;
+        case ZoneType::Commercial: return 1;
+        case ZoneType::Industrial: return 2;
+        default: return -1;
+    }
+}
+
+double footprintArea(const Building &b) {
+    if (!b.hasCorners) return b.footprint.width() * b.footprint.height();
+    double twice = 0.0;
+    for (std::size_t i = 0; i < 4; ++i) {
+        const Vec2 &p = b.corners[i];
+        const Vec2 &q = b.corners[(i + 1) % 4];
+        twice += p.x * q.y - q.x * p.y;
+    }
+    return std::abs(twice) * 0.5;
+}
+
+int areaBin(double area) {
+    if (area <= 0.0) return 0;
+    int bin = static_cast<int>(std::floor(std::log2(area))) - CitySummary::kAreaLog2Min;
+    return std::clamp(bin, 0, CitySummary::kAreaBins - 1);
+}
+
+// Reduction state of one chunk.
+struct Partial {
+    std::array<std::uint64_t, 5> zoneCells{};
+    std::uint64_t totalBuildings = 0;
+    std::uint64_t parcels = 0;
+    std::array<std::uint64_t, 3> heightCount{};
+    std::array<std::int64_t, 3> heightSum{};
+    std::array<int, 3> heightMax{};
+    std::array<std::uint64_t, CitySummary::kHeightBins> heightHistogram{};
+    std::array<std::uint64_t, CitySummary::kAreaBins> areaHistogram{};
+    double areaSum = 0.0;
+    double footprintArea = 0.0;
+    KllSketch school{kSketchK};
+    KllSketch hospital{kSketchK};
+    KllSketch road{kSketchK};
+    KllSketch height{kSketchK};
+};
+
+// Chunk-local structure-of-arrays staging of the building fields the
+// reduction reads, so the hot loops stream over dense arrays.
+struct BuildingColumns {
+    std::vector<std::uint8_t> zone;
+    std::vector<int> height;
+    std::vector<double> area;
+    std::vector<double> centreX;
+    std::vector<double> centreY;
+    std::vector<double> resX;
+    std::vector<double> resY;
+
+    void load(const SpillVector<Building> &buildings, std::size_t begin, std::size_t end) {
+        std::size_t n = end - begin;
+        zone.resize(n);
+        height.resize(n);
+        area.resize(n);
+        centreX.clear();
+        centreY.clear();
+        resX.clear();
+        resY.clear();
+        for (std::size_t i = 0; i < n; ++i) {
+            const Building &b = buildings[begin + i];
+            zone[i] = static_cast<std::uint8_t>(b.zone);
+            height[i] = b.height;
+            area[i] = footprintArea(b);
+            if (b.zone == ZoneType::None || b.zone == ZoneType::Green) continue;
+            centreX.push_back(b.footprint.centreX());
+            centreY.push_back(b.footprint.centreY());
+            if (b.zone == ZoneType::Residential) {
+                resX.push_back(b.footprint.centreX());
+                resY.push_back(b.footprint.centreY());
+            }
+        }
+    }
+};
+
+void reduceBuildings(const BuildingColumns &cols, const PointGrid &schools,
+                     const PointGrid &hospitals, const SegmentGrid &roads, Partial &out) {
+    const auto none = static_cast<std::uint8_t>(ZoneType::None);
+    const auto green = static_cast<std::uint8_t>(ZoneType::Green);
+    for (std::size_t i = 0; i < cols.zone.size(); ++i) {
+        std::uint8_t z = cols.zone[i];
+        if (z == none) continue;
+        out.parcels++;
+        out.areaSum += cols.area[i];
+        out.areaHistogram[areaBin(cols.area[i])]++;
+        if (z == green) continue;
+        out.totalBuildings++;
+        out.footprintArea += cols.area[i];
+        int h = std::max(cols.height[i], 0);
+        out.heightHistogram[std::min(h, CitySummary::kHeightBins - 1)]++;
+        out.height.update(cols.height[i]);
+        int slot = heightSlot(static_cast<ZoneType>(z));
+        if (slot >= 0) {
+            out.heightCount[slot]++;
+            out.heightSum[slot] += cols.height[i];
+            out.heightMax[slot] = std::max(out.heightMax[slot], cols.height[i]);
+        }
+    }
+    auto measure = [](const auto &index, const std::vector<double> &xs,
+                      const std::vector<double> &ys, KllSketch &sketch) {
+        if (index.empty()) return;
+        for (std::size_t i = 0; i < xs.size(); ++i) sketch.update(std::sqrt(index.nearestSq(xs[i], ys[i])));
+    };
+    measure(schools, cols.resX, cols.resY, out.school);
+    measure(hospitals, cols.resX, cols.resY, out.hospital);
+    measure(roads, cols.centreX, cols.centreY, out.road);
+}
+
+DistributionStats distributionStats(const KllSketch &sketch) {
+    DistributionStats s;
+    s.count = sketch.count();
+    if (s.count == 0) return s;
+    s.mean = sketch.sum() / static_cast<double>(s.count);
+    s.p50 = sketch.quantile(0.5);
+    s.p90 = sketch.quantile(0.9);
+    s.p95 = sketch.quantile(0.95);
+    s.p99 = sketch.quantile(0.99);
+    s.max = sketch.max();
+    return s;
+}
+
+void writeDistribution(JsonWriter &json, const char *name, const DistributionStats &d) {
+    json.key(name);
+    json.beginObject();
+    json.field("count", d.count);
+    json.field("mean", d.mean);
+    json.field("p50", d.p50);
+    json.field("p90", d.p90);
+    json.field("p95", d.p95);
+    json.field("p99", d.p99);
+    json.field("max", d.max);
+    json.endObject();
+}
+
+template <std::size_t N>
+void writeTrimmed(JsonWriter &json, const std::array<std::uint64_t, N> &bins) {
+    std::size_t used = N;
+    while (used > 1 && bins[used - 1] == 0) --used;
+    json.beginArray();
+    for (std::size_t i = 0; i < used; ++i) json.value(bins[i]);
+    json.endArray();
+}
+
+// Scalar metrics of summaryMetric(), named after their keys in
+// city_summary.json.  Metrics a city does not define (e.g. school distances
+// without residential buildings) are NaN rather than zero.
+constexpr double kUndefined = std::numeric_limits<double>::quiet_NaN();
+
+struct MetricDef {
+    const char *name;
+    double (*extract)(const CitySummary &);
+};
+
+double heightMean(const HeightStats &h) { return h.count ? h.mean : kUndefined; }
+double heightMax(const HeightStats &h) { return h.count ? h.max : kUndefined; }
+double distMean(const DistributionStats &d) { return d.count ? d.mean : kUndefined; }
+double distP90(const DistributionStats &d) { return d.count ? d.p90 : kUndefined; }
+double distMax(const DistributionStats &d) { return d.count ? d.max : kUndefined; }
+double cells(const CitySummary &s, ZoneType z) {
+    return static_cast<double>(s.zoneCells[static_cast<std::size_t>(z)]);
+}
+
+const MetricDef kMetrics[] = {
+    {"totalBuildings", [](const CitySummary &s) { return static_cast<double>(s.totalBuildings); }},
+    {"parcels", [](const CitySummary &s) { return static_cast<double>(s.parcels); }},
+    {"residentialCells", [](const CitySummary &s) { return cells(s, ZoneType::Residential); }},
+    {"commercialCells", [](const CitySummary &s) { return cells(s, ZoneType::Commercial); }},
+    {"industrialCells", [](const CitySummary &s) { return cells(s, ZoneType::Industrial); }},
+    {"greenCells", [](const CitySummary &s) { return cells(s, ZoneType::Green); }},
+    {"undevelopedCells", [](const CitySummary &s) { return cells(s, ZoneType::None); }},
+    {"numHospitals", [](const CitySummary &s) { return static_cast<double>(s.hospitals); }},
+    {"numSchools", [](const CitySummary &s) { return static_cast<double>(s.schools); }},
+    {"heights.residential.mean", [](const CitySummary &s) { return heightMean(s.residential); }},
+    {"heights.commercial.mean", [](const CitySummary &s) { return heightMean(s.commercial); }},
+    {"heights.industrial.mean", [](const CitySummary &s) { return heightMean(s.industrial); }},
+    {"maxResidentialHeight", [](const CitySummary &s) { return heightMax(s.residential); }},
+    {"maxCommercialHeight", [](const CitySummary &s) { return heightMax(s.commercial); }},
+    {"maxIndustrialHeight", [](const CitySummary &s) { return heightMax(s.industrial); }},
+    {"meanParcelArea", [](const CitySummary &s) { return s.parcels ? s.meanParcelArea : kUndefined; }},
+    {"footprintArea", [](const CitySummary &s) { return s.footprintArea; }},
+    {"footprintCoverage", [](const CitySummary &s) { return s.footprintCoverage; }},
+    {"distanceToSchool.mean", [](const CitySummary &s) { return distMean(s.schoolDistance); }},
+    {"distanceToSchool.p90", [](const CitySummary &s) { return distP90(s.schoolDistance); }},
+    {"distanceToSchool.max", [](const CitySummary &s) { return distMax(s.schoolDistance); }},
+    {"distanceToHospital.mean", [](const CitySummary &s) { return distMean(s.hospitalDistance); }},
+    {"distanceToHospital.p90", [](const CitySummary &s) { return distP90(s.hospitalDistance); }},
+    {"distanceToHospital.max", [](const CitySummary &s) { return distMax(s.hospitalDistance); }},
+    {"distanceToRoad.mean", [](const CitySummary &s) { return distMean(s.roadDistance); }},
+    {"distanceToRoad.p90", [](const CitySummary &s) { return distP90(s.roadDistance); }},
+    {"distanceToRoad.max", [](const CitySummary &s) { return distMax(s.roadDistance); }},
+    {"height.mean", [](const CitySummary &s) { return distMean(s.heightDistribution); }},
+    {"height.p90", [](const CitySummary &s) { return distP90(s.heightDistribution); }},
+    {"height.max", [](const CitySummary &s) { return distMax(s.heightDistribution); }},
+};
+constexpr std::size_t kMetricCount = sizeof(kMetrics) / sizeof(kMetrics[0]);
+
+} // namespace
+
+CitySummary computeSummary(const City &city, ExecutionContext *ctx) {
+    CitySummary s;
+    s.gridSize = city.size;
+    std::vector<Vec2> schoolPos;
+    std::vector<Vec2> hospitalPos;
+    for (const auto &f : city.facilities) {
+        if (f.type == Facility::Type::School) {
+            schoolPos.push_back({f.x, f.y});
+            s.schools++;
+        } else if (f.type == Facility::Type::Hospital) {
+            hospitalPos.push_back({f.x, f.y});
+            s.hospitals++;
+        }
+    }
+    PointGrid schools(schoolPos);
+    PointGrid hospitals(hospitalPos);
+    SegmentGrid roads(city.roads);
+
+    const std::size_t buildingChunks = (city.buildings.size() + kBuildingChunk - 1) / kBuildingChunk;
+    // Zone chunks are whole rows, which the grid hands out as spans.
+    const std::size_t side = static_cast<std::size_t>(std::max(city.size, 0));
+    const std::size_t rowsPerChunk = std::max<std::size_t>(1, kCellChunk / std::max<std::size_t>(side, 1));
+    const std::size_t cellChunks = (side + rowsPerChunk - 1) / rowsPerChunk;
+    const std::size_t chunks = std::max(buildingChunks, cellChunks);
+    std::vector<Partial> partials(chunks);
+    StageScope stage(ctx, "summary", chunks);
+    // Chunk c covers one slice of the zone grid and one slice of the
+    // building list, so both sweeps share a single parallel pass.
+    parallelFor(0, chunks, [&](std::size_t c) {
+        stage.advance();
+        Partial &p = partials[c];
+        std::size_t y0 = std::min(c * rowsPerChunk, side);
+        std::size_t y1 = std::min(y0 + rowsPerChunk, side);
+        for (std::size_t y = y0; y < y1; ++y) {
+            city.zones.forEachRowSpan(static_cast<int>(y), [&](int, const ZoneType *span, int n) {
+                for (int k = 0; k < n; ++k) p.zoneCells[static_cast<std::size_t>(span[k])]++;
+            });
+        }
+        std::size_t b0 = std::min(c * kBuildingChunk, city.buildings.size());
+        std::size_t b1 = std::min(b0 + kBuildingChunk, city.buildings.size());
+        if (b0 == b1) return;
+        BuildingColumns cols;
+        cols.load(city.buildings, b0, b1);
+        reduceBuildings(cols, schools, hospitals, roads, p);
+    });
+    stage.finish();
+
+    std::array<std::uint64_t, 3> heightCount{};
+    std::array<std::int64_t, 3> heightSum{};
+    std::array<int, 3> heightMax{};
+    double areaSum = 0.0;
+    KllSketch school(kSketchK), hospital(kSketchK), road(kSketchK), height(kSketchK);
+    for (auto &p : partials) {
+        for (std::size_t i = 0; i < 5; ++i) s.zoneCells[i] += p.zoneCells[i];
+        s.totalBuildings += p.totalBuildings;
+        s.parcels += p.parcels;
+        for (std::size_t i = 0; i < 3; ++i) {
+            heightCount[i] += p.heightCount[i];
+            heightSum[i] += p.heightSum[i];
+            heightMax[i] = std::max(heightMax[i], p.heightMax[i]);
+        }
+        for (std::size_t i = 0; i < s.heightHistogram.size(); ++i) s.heightHistogram[i] += p.heightHistogram[i];
+        for (std::size_t i = 0; i < s.parcelAreaHistogram.size(); ++i) s.parcelAreaHistogram[i] += p.areaHistogram[i];
+        areaSum += p.areaSum;
+        s.footprintArea += p.footprintArea;
+        school.merge(p.school);
+        hospital.merge(p.hospital);
+        road.merge(p.road);
+        height.merge(p.height);
+    }
+    HeightStats *zones[] = {&s.residential, &s.commercial, &s.industrial};
+    for (std::size_t i = 0; i < 3; ++i) {
+        zones[i]->count = heightCount[i];
+        zones[i]->max = heightMax[i];
+        if (heightCount[i] > 0) zones[i]->mean = static_cast<double>(heightSum[i]) / heightCount[i];
+    }
+    if (s.parcels > 0) s.meanParcelArea = areaSum / static_cast<double>(s.parcels);
+    std::uint64_t developed = city.zones.size() - s.zoneCells[static_cast<std::size_t>(ZoneType::None)];
+    if (developed > 0) s.footprintCoverage = s.footprintArea / static_cast<double>(developed);
+    s.schoolDistance = distributionStats(school);
+    s.hospitalDistance = distributionStats(hospital);
+    s.roadDistance = distributionStats(road);
+    s.heightDistribution = distributionStats(height);
+    s.sketchK = kSketchK;
+    return s;
+}
+
+std::string summaryToJson(const CitySummary &s) {
+    auto cells = [&](ZoneType z) { return s.zoneCells[static_cast<std::size_t>(z)]; };
+    std::string out;
+    out.reserve(2048);
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("gridSize", s.gridSize);
+    json.field("totalBuildings", s.totalBuildings);
+    json.field("residentialCells", cells(ZoneType::Residential));
+    json.field("commercialCells", cells(ZoneType::Commercial));
+    json.field("industrialCells", cells(ZoneType::Industrial));
+    json.field("greenCells", cells(ZoneType::Green));
+    json.field("undevelopedCells", cells(ZoneType::None));
+    json.field("numHospitals", s.hospitals);
+    json.field("numSchools", s.schools);
+    json.field("maxDistanceToSchool", s.schoolDistance.max);
+    json.field("maxDistanceToHospital", s.hospitalDistance.max);
+    json.field("maxResidentialHeight", s.residential.max);
+    json.field("maxCommercialHeight", s.commercial.max);
+    json.field("maxIndustrialHeight", s.industrial.max);
+    json.field("parcels", s.parcels);
+    json.key("heights");
+    json.beginObject();
+    const std::pair<const char *, const HeightStats *> zones[] = {
+        {"residential", &s.residential}, {"commercial", &s.commercial}, {"industrial", &s.industrial}};
+    for (const auto &[name, h] : zones) {
+        json.key(name);
+        json.beginObject();
+        json.field("count", h->count);
+        json.field("mean", h->mean);
+        json.field("max", h->max);
+        json.endObject();
+    }
+    json.endObject();
+    json.key("heightHistogram");
+    writeTrimmed(json, s.heightHistogram);
+    json.field("meanParcelArea", s.meanParcelArea);
+    json.key("parcelAreaHistogram");
+    json.beginObject();
+    json.field("log2Min", CitySummary::kAreaLog2Min);
+    json.key("counts");
+    writeTrimmed(json, s.parcelAreaHistogram);
+    json.endObject();
+    json.field("footprintArea", s.footprintArea);
+    json.field("footprintCoverage", s.footprintCoverage);
+    writeDistribution(json, "distanceToSchool", s.schoolDistance);
+    writeDistribution(json, "distanceToHospital", s.hospitalDistance);
+    writeDistribution(json, "distanceToRoad", s.roadDistance);
+    writeDistribution(json, "height", s.heightDistribution);
+    json.field("sketchK", s.sketchK);
+    json.endObject();
+    return out;
+}
+
+std::size_t summaryMetricCount() { return kMetricCount; }
+
+const char *summaryMetricName(std::size_t index) { return kMetrics[index].name; }
+
+std::size_t findSummaryMetric(const std::string &name) {
+    for (std::size_t i = 0; i < kMetricCount; ++i) {
+        if (name == kMetrics[i].name) return i;
+    }
+    return kMetricCount;
+}
+
+double summaryMetric(const CitySummary &summary, std::size_t index) {
+    return kMetrics[index].extract(summary);
+}
@@ -0,0 +1,314 @@
+#include "Validation.h"
+#include "JsonWriter.h"
+#include "Layout.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+
+namespace {
+
+using Quad = std::array<Vec2, 4>;
+
+// Fixed chunk size; results must not depend on the worker count.
+constexpr std::size_t kChunk = 4096;
+constexpr std::size_t kNoBlock = std::numeric_limits<std::size_t>::max();
+
+// Axis-aligned bounds of a footprint or an inflated road in the sweep.
+struct Box {
+    double x0, y0, x1, y1;
+    std::size_t id;
+    bool road;
+};
+
+Quad footprintQuad(const Building &b) { return b.hasCorners ? b.corners : rectToQuad(b.footprint); }
+
+// The road's centreline inflated by half its width, without end caps.
+bool roadQuad(const RoadSegment &r, Quad &q) {
+    double dx = r.x2 - r.x1;
+    double dy = r.y2 - r.y1;
+    double len = std::sqrt(dx * dx + dy * dy);
+    if (len < 1e-12) return false;
+    double hw = 0.5 * roadWidth(r.type);
+    double nx = -dy / len * hw;
+    double ny = dx / len * hw;
+    q = {{{r.x1 + nx, r.y1 + ny}, {r.x2 + nx, r.y2 + ny}, {r.x2 - nx, r.y2 - ny}, {r.x1 - nx, r.y1 - ny}}};
+    return true;
+}
+
+Box boxOf(const Quad &q, std::size_t id, bool road) {
+    Rect r = boundsFromQuad(q);
+    return {r.x0, r.y0, r.x1, r.y1, id, road};
+}
+
+// Separating-axis test of two convex quads: the smallest overlap of their
+// projections over the edge normals of both, or 0 if an axis separates
+// them.  Degenerate edges (collapsed wedge tips) are skipped.
+double overlapDepth(const Quad &a, const Quad &b) {
+    double depth = std::numeric_limits<double>::infinity();
+    for (const Quad *q : {&a, &b}) {
+        for (std::size_t i = 0; i < 4; ++i) {
+            const Vec2 &p = (*q)[i];
+            const Vec2 &n = (*q)[(i + 1) % 4];
+            double ax = p.y - n.y;
+            double ay = n.x - p.x;
+            double len = std::sqrt(ax * ax + ay * ay);
+            if (len < 1e-12) continue;
+            ax /= len;
+            ay /= len;
+            double minA = std::numeric_limits<double>::infinity(), maxA = -minA;
+            double minB = minA, maxB = -minA;
+            for (const Vec2 &v : a) {
+                double d = v.x * ax + v.y * ay;
+                minA = std::min(minA, d);
+                maxA = std::max(maxA, d);
+            }
+            for (const Vec2 &v : b) {
+                double d = v.x * ax + v.y * ay;
+                minB = std::min(minB, d);
+                maxB = std::max(maxB, d);
+            }
+            double overlap = std::min(maxA, maxB) - std::max(minA, minB);
+            if (overlap <= 0.0) return 0.0;
+            depth = std::min(depth, overlap);
+        }
+    }
+    return std::isinf(depth) ? 0.0 : depth;
+}
+
+// Distance of p outside a convex quad (<= 0 inside), whichever way the
+// quad winds.
+double outsideDistance(const Quad &q, double orientation, const Vec2 &p) {
+    double outside = -std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0; i < 4; ++i) {
+        const Vec2 &a = q[i];
+        const Vec2 &b = q[(i + 1) % 4];
+        double ex = b.x - a.x;
+        double ey = b.y - a.y;
+        double len = std::sqrt(ex * ex + ey * ey);
+        if (len < 1e-12) continue;
+        double cross = ex * (p.y - a.y) - ey * (p.x - a.x);
+        outside = std::max(outside, -orientation * cross / len);
+    }
+    return outside;
+}
+
+double winding(const Quad &q) {
+    double area = 0.0;
+    for (std::size_t i = 0; i < 4; ++i) {
+        area += q[i].x * q[(i + 1) % 4].y - q[(i + 1) % 4].x * q[i].y;
+    }
+    return area < 0.0 ? -1.0 : 1.0;
+}
+
+// Bucket grid over block bounds for "which block is this point in".
+class BlockGrid {
+public:
+    explicit BlockGrid(const std::vector<Quad> &blocks) {
+        if (blocks.empty()) return;
+        Rect all = boundsFromQuad(blocks.front());
+        for (const Quad &q : blocks) {
+            Rect r = boundsFromQuad(q);
+            all = {std::min(all.x0, r.x0), std::min(all.y0, r.y0), std::max(all.x1, r.x1),
+                   std::max(all.y1, r.y1)};
+        }
+        x0_ = all.x0;
+        y0_ = all.y0;
+        n_ = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(blocks.size())))));
+        cell_ = std::max({all.width(), all.height(), 1e-9}) / n_;
+        cells_.resize(static_cast<std::size_t>(n_) * n_);
+        for (std::size_t i = 0; i < blocks.size(); ++i) {
+            Rect r = boundsFromQuad(blocks[i]);
+            for (int y = clampCell(r.y0 - y0_); y <= clampCell(r.y1 - y0_); ++y) {
+                for (int x = clampCell(r.x0 - x0_); x <= clampCell(r.x1 - x0_); ++x) {
+                    cells_[static_cast<std::size_t>(y) * n_ + x].push_back(i);
+                }
+            }
+        }
+    }
+
+    /// Blocks whose bounds may contain (x, y); empty outside the grid.
+    const std::vector<std::size_t> &candidates(double x, double y) const {
+        static const std::vector<std::size_t> none;
+        if (cells_.empty() || x < x0_ || y < y0_ || x > x0_ + cell_ * n_ || y > y0_ + cell_ * n_) {
+            return none;
+        }
+        return cells_[static_cast<std::size_t>(clampCell(y - y0_)) * n_ + clampCell(x - x0_)];
+    }
+
+private:
+    int clampCell(double offset) const {
+        return std::clamp(static_cast<int>(std::floor(offset / cell_)), 0, n_ - 1);
+    }
+
+    double x0_ = 0.0;
+    double y0_ = 0.0;
+    double cell_ = 1.0;
+    int n_ = 0;
+    std::vector<std::vector<std::size_t>> cells_;
+};
+
+const char *kindName(ValidationIssue::Kind kind) {
+    switch (kind) {
+        case ValidationIssue::Kind::BuildingOverlap: return "buildingOverlap";
+        case ValidationIssue::Kind::RoadIntrusion: return "roadIntrusion";
+        default: return "outsideBlock";
+    }
+}
+
+} // namespace
+
+ValidationReport validateCity(const City &city, ExecutionContext *ctx, double tolerance) {
+    ValidationReport report;
+    report.roads = city.roads.size();
+    report.blocks = city.blocks.size();
+
+    std::vector<std::size_t> ids;
+    std::vector<Quad> quads;
+    std::vector<Box> boxes;
+    for (std::size_t i = 0; i < city.buildings.size(); ++i) {
+        const Building &b = city.buildings[i];
+        if (b.zone == ZoneType::None) continue;
+        ids.push_back(i);
+        quads.push_back(footprintQuad(b));
+        boxes.push_back(boxOf(quads.back(), quads.size() - 1, false));
+    }
+    report.buildings = ids.size();
+    std::vector<Quad> roadQuads(city.roads.size());
+    for (std::size_t r = 0; r < city.roads.size(); ++r) {
+        if (roadQuad(city.roads[r], roadQuads[r])) boxes.push_back(boxOf(roadQuads[r], r, true));
+    }
+    std::sort(boxes.begin(), boxes.end(), [](const Box &a, const Box &b) {
+        return std::tie(a.x0, a.road, a.id) < std::tie(b.x0, b.road, b.id);
+    });
+
+    std::vector<Quad> blockQuads;
+    std::vector<double> blockWinding;
+    for (const Block &blk : city.blocks) {
+        blockQuads.push_back(blk.hasCorners ? blk.corners : rectToQuad(blk.bounds));
+        blockWinding.push_back(winding(blockQuads.back()));
+    }
+    BlockGrid blockGrid(blockQuads);
+
+    std::size_t sweepChunks = (boxes.size() + kChunk - 1) / kChunk;
+    std::size_t blockChunks = (quads.size() + kChunk - 1) / kChunk;
+    std::vector<std::vector<ValidationIssue>> found(sweepChunks + blockChunks);
+    std::vector<std::uint64_t> pairs(sweepChunks, 0);
+    StageScope stage(ctx, "validate", sweepChunks + blockChunks);
+    parallelFor(0, sweepChunks + blockChunks, [&](std::size_t c) {
+        std::vector<ValidationIssue> &out = found[c];
+        if (c < sweepChunks) {
+            // Sweep: each box against the boxes starting before its right edge.
+            std::size_t end = std::min(boxes.size(), (c + 1) * kChunk);
+            for (std::size_t i = c * kChunk; i < end; ++i) {
+                const Box &a = boxes[i];
+                for (std::size_t j = i + 1; j < boxes.size() && boxes[j].x0 <= a.x1; ++j) {
+                    const Box &b = boxes[j];
+                    if ((a.road && b.road) || b.y0 > a.y1 || a.y0 > b.y1) continue;
+                    ++pairs[c];
+                    if (!a.road && !b.road) {
+                        double depth = overlapDepth(quads[a.id], quads[b.id]);
+                        if (depth > tolerance) {
+                            std::size_t first = std::min(ids[a.id], ids[b.id]);
+                            std::size_t second = std::max(ids[a.id], ids[b.id]);
+                            out.push_back({ValidationIssue::Kind::BuildingOverlap, first, second, depth});
+                        }
+                    } else {
+                        const Box &bld = a.road ? b : a;
+                        const Box &road = a.road ? a : b;
+                        double depth = overlapDepth(quads[bld.id], roadQuads[road.id]);
+                        if (depth > tolerance) {
+                            out.push_back({ValidationIssue::Kind::RoadIntrusion, ids[bld.id], road.id, depth});
+                        }
+                    }
+                }
+            }
+        } else {
+            // Blocks: the footprint must lie inside the block its centroid
+            // is in (or nearest to, among the blocks bucketed there).
+            std::size_t begin = (c - sweepChunks) * kChunk;
+            std::size_t end = std::min(quads.size(), begin + kChunk);
+            for (std::size_t i = begin; i < end; ++i) {
+                Vec2 centre = centroidOfQuad(quads[i]);
+                std::size_t block = kNoBlock;
+                double best = std::numeric_limits<double>::infinity();
+                for (std::size_t k : blockGrid.candidates(centre.x, centre.y)) {
+                    double d = outsideDistance(blockQuads[k], blockWinding[k], centre);
+                    if (d < best) {
+                        best = d;
+                        block = k;
+                    }
+                }
+                if (block == kNoBlock) {
+                    out.push_back({ValidationIssue::Kind::OutsideBlock, ids[i], kNoBlock, 0.0});
+                    continue;
+                }
+                double outside = 0.0;
+                for (const Vec2 &p : quads[i]) {
+                    outside = std::max(outside, outsideDistance(blockQuads[block], blockWinding[block], p));
+                }
+                if (outside > tolerance) {
+                    out.push_back({ValidationIssue::Kind::OutsideBlock, ids[i], block, outside});
+                }
+            }
+        }
+        stage.advance();
+    });
+    stage.finish();
+
+    for (std::uint64_t p : pairs) report.candidatePairs += p;
+    for (auto &chunk : found) {
+        report.issues.insert(report.issues.end(), chunk.begin(), chunk.end());
+    }
+    std::sort(report.issues.begin(), report.issues.end(), [](const ValidationIssue &a, const ValidationIssue &b) {
+        return std::tie(a.kind, a.building, a.other) < std::tie(b.kind, b.building, b.other);
+    });
+    for (const ValidationIssue &issue : report.issues) {
+        switch (issue.kind) {
+            case ValidationIssue::Kind::BuildingOverlap: ++report.buildingOverlaps; break;
+            case ValidationIssue::Kind::RoadIntrusion: ++report.roadIntrusions; break;
+            case ValidationIssue::Kind::OutsideBlock: ++report.outsideBlock; break;
+        }
+    }
+    return report;
+}
+
+std::string validationToJson(const City &city, const ValidationReport &report) {
+    std::string out;
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("ok", report.ok());
+    json.field("buildings", report.buildings);
+    json.field("roads", report.roads);
+    json.field("blocks", report.blocks);
+    json.field("candidatePairs", report.candidatePairs);
+    json.field("buildingOverlaps", report.buildingOverlaps);
+    json.field("roadIntrusions", report.roadIntrusions);
+    json.field("outsideBlock", report.outsideBlock);
+    json.key("issues");
+    json.beginArray();
+    for (const ValidationIssue &issue : report.issues) {
+        json.beginObject();
+        json.field("kind", kindName(issue.kind));
+        json.field("building", static_cast<std::uint64_t>(city.buildingId(issue.building)));
+        const bool overlap = issue.kind == ValidationIssue::Kind::BuildingOverlap;
+        const char *other = overlap ? "other"
+                            : issue.kind == ValidationIssue::Kind::RoadIntrusion ? "road"
+                                                                                 : "block";
+        json.key(other);
+        if (issue.other == kNoBlock) {
+            json.null();
+        } else {
+            json.value(static_cast<std::uint64_t>(overlap ? city.buildingId(issue.other) : issue.other));
+        }
+        json.field("depth", issue.depth);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return out;
+}
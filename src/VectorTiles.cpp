@@ -0,0 +1,733 @@
+#include "City.h"
+#include "Config.h"
+#include "Execution.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @file VectorTiles.cpp
+ *
+ * Mapbox Vector Tile (MVT 2.1) pyramid export.  Tiles use a local square
+ * scheme over the city grid rather than Web Mercator: zoom z splits the
+ * [0, size] × [0, size] grid extent into 2^z × 2^z tiles, with tile row y
+ * increasing along grid +Y.  The protobuf wire format is written by hand
+ * so no external dependency is needed.
+ */
+
+namespace {
+
+constexpr std::uint32_t kExtent = 4096;
+// Overlap kept around each tile (in tile units) so renderers can stroke
+// roads and polygon outlines across tile seams without gaps.
+constexpr double kBuffer = 64.0;
+// Below the maximum zoom, footprints smaller than this (in tile units along
+// both axes) are dropped: they would render as sub-pixel specks.
+constexpr double kMinFeatureUnits = 2.0;
+// Zone cells are read from a downsampled grid so that no tile scans more
+// than about this many cells along each axis.
+constexpr double kMaxZoneCellsPerTile = 256.0;
+
+// Minimal protobuf writer covering the wire types used by the MVT schema.
+struct PbfWriter {
+    std::string buf;
+
+    void varint(std::uint64_t v) {
+        while (v >= 0x80) {
+            buf.push_back(static_cast<char>((v & 0x7F) | 0x80));
+            v >>= 7;
+        }
+        buf.push_back(static_cast<char>(v));
+    }
+    void tag(std::uint32_t field, std::uint32_t wireType) {
+        varint((static_cast<std::uint64_t>(field) << 3) | wireType);
+    }
+    void uintField(std::uint32_t field, std::uint64_t v) {
+        tag(field, 0);
+        varint(v);
+    }
+    void bytesField(std::uint32_t field, const std::string &bytes) {
+        tag(field, 2);
+        varint(bytes.size());
+        buf += bytes;
+    }
+    void packedField(std::uint32_t field, const std::vector<std::uint32_t> &vals) {
+        if (vals.empty()) return;
+        PbfWriter inner;
+        for (std::uint32_t v : vals) inner.varint(v);
+        bytesField(field, inner.buf);
+    }
+};
+
+std::uint32_t zigzag(std::int32_t n) {
+    return (static_cast<std::uint32_t>(n) << 1) ^ static_cast<std::uint32_t>(n >> 31);
+}
+
+enum GeomType : std::uint32_t { kPoint = 1, kLineString = 2, kPolygon = 3 };
+
+struct TilePoint {
+    std::int32_t x;
+    std::int32_t y;
+};
+
+// Encodes MVT geometry commands with the cursor carried across parts, as
+// required for multi-part features.
+struct GeometryEncoder {
+    std::vector<std::uint32_t> cmds;
+    std::int32_t cx = 0;
+    std::int32_t cy = 0;
+
+    static std::uint32_t command(std::uint32_t id, std::uint32_t count) {
+        return (id & 0x7u) | (count << 3);
+    }
+    void moveTo(const TilePoint &p) {
+        cmds.push_back(command(1, 1));
+        cmds.push_back(zigzag(p.x - cx));
+        cmds.push_back(zigzag(p.y - cy));
+        cx = p.x;
+        cy = p.y;
+    }
+    void lineTo(const TilePoint *pts, std::size_t count) {
+        if (count == 0) return;
+        cmds.push_back(command(2, static_cast<std::uint32_t>(count)));
+        for (std::size_t i = 0; i < count; ++i) {
+            cmds.push_back(zigzag(pts[i].x - cx));
+            cmds.push_back(zigzag(pts[i].y - cy));
+            cx = pts[i].x;
+            cy = pts[i].y;
+        }
+    }
+    void closePath() { cmds.push_back(command(7, 1)); }
+
+    void ring(const std::vector<TilePoint> &r) {
+        moveTo(r[0]);
+        lineTo(r.data() + 1, r.size() - 1);
+        closePath();
+    }
+};
+
+// Accumulates one layer: features plus its deduplicated key/value tables.
+struct LayerBuilder {
+    std::string name;
+    std::vector<std::string> keys;
+    std::unordered_map<std::string, std::uint32_t> keyIndex;
+    std::vector<std::string> values; // encoded Value messages
+    std::unordered_map<std::string, std::uint32_t> valueIndex;
+    PbfWriter features;
+    std::size_t featureCount = 0;
+
+    explicit LayerBuilder(std::string n) : name(std::move(n)) {}
+
+    std::uint32_t key(const std::string &k) {
+        auto it = keyIndex.find(k);
+        if (it != keyIndex.end()) return it->second;
+        std::uint32_t idx = static_cast<std::uint32_t>(keys.size());
+        keys.push_back(k);
+        keyIndex.emplace(k, idx);
+        return idx;
+    }
+    std::uint32_t value(const std::string &encoded) {
+        auto it = valueIndex.find(encoded);
+        if (it != valueIndex.end()) return it->second;
+        std::uint32_t idx = static_cast<std::uint32_t>(values.size());
+        values.push_back(encoded);
+        valueIndex.emplace(encoded, idx);
+        return idx;
+    }
+    std::uint32_t stringValue(const std::string &s) {
+        PbfWriter v;
+        v.bytesField(1, s);
+        return value(v.buf);
+    }
+    std::uint32_t uintValue(std::uint64_t u) {
+        PbfWriter v;
+        v.uintField(5, u);
+        return value(v.buf);
+    }
+    void tag(std::vector<std::uint32_t> &tags, const std::string &k, std::uint32_t valueIdx) {
+        tags.push_back(key(k));
+        tags.push_back(valueIdx);
+    }
+    void addFeature(std::uint64_t id, GeomType type, const std::vector<std::uint32_t> &tags,
+                    const std::vector<std::uint32_t> &geometry) {
+        if (geometry.empty()) return;
+        PbfWriter f;
+        f.uintField(1, id);
+        f.packedField(2, tags);
+        f.uintField(3, type);
+        f.packedField(4, geometry);
+        features.bytesField(2, f.buf);
+        featureCount++;
+    }
+    std::string finish() const {
+        PbfWriter layer;
+        layer.uintField(15, 2);
+        layer.bytesField(1, name);
+        layer.buf += features.buf;
+        for (const auto &k : keys) layer.bytesField(3, k);
+        for (const auto &v : values) layer.bytesField(4, v);
+        layer.uintField(5, kExtent);
+        return layer.buf;
+    }
+};
+
+// Majority-downsampled copies of the zone grid.  Level 0 is the grid
+// itself; each further level halves the resolution so coarse tiles read a
+// bounded number of cells.
+struct ZonePyramid {
+    std::vector<int> sizes;
+    std::vector<std::vector<std::uint8_t>> levels;
+};
+
+ZonePyramid buildZonePyramid(const City &city) {
+    ZonePyramid pyr;
+    pyr.sizes.push_back(city.size);
+    std::vector<std::uint8_t> base(city.zones.size());
+    for (int y = 0; y < city.size; ++y) {
+        city.zones.forEachRowSpan(y, [&](int x0, const ZoneType *span, int n) {
+            std::uint8_t *out = base.data() + static_cast<std::size_t>(y) * city.size + x0;
+            for (int k = 0; k < n; ++k) out[k] = static_cast<std::uint8_t>(span[k]);
+        });
+    }
+    pyr.levels.push_back(std::move(base));
+    while (pyr.sizes.back() > 1) {
+        int fine = pyr.sizes.back();
+        int coarse = (fine + 1) / 2;
+        const std::vector<std::uint8_t> &src = pyr.levels.back();
+        std::vector<std::uint8_t> dst(static_cast<std::size_t>(coarse) * coarse);
+        parallelFor(0, static_cast<std::size_t>(coarse), [&](std::size_t y) {
+            for (int x = 0; x < coarse; ++x) {
+                std::array<int, 5> votes{};
+                for (int dy = 0; dy < 2; ++dy) {
+                    for (int dx = 0; dx < 2; ++dx) {
+                        int fx = x * 2 + dx;
+                        int fy = static_cast<int>(y) * 2 + dy;
+                        if (fx >= fine || fy >= fine) continue;
+                        votes[src[static_cast<std::size_t>(fy) * fine + fx]]++;
+                    }
+                }
+                // Prefer developed zones on ties so thin features survive.
+                int best = 0;
+                for (int z = 1; z < 5; ++z) {
+                    if (votes[z] > 0 && votes[z] >= votes[best]) best = z;
+                }
+                dst[y * coarse + x] = static_cast<std::uint8_t>(best);
+            }
+        });
+        pyr.sizes.push_back(coarse);
+        pyr.levels.push_back(std::move(dst));
+    }
+    return pyr;
+}
+
+// Summed-area table of developed cells, used to decide in O(1) whether a
+// tile contains any zoning at all.
+struct DevelopedTable {
+    int size = 0;
+    std::vector<std::uint32_t> sums; // (size + 1)^2
+
+    explicit DevelopedTable(const City &city) : size(city.size) {
+        std::size_t stride = static_cast<std::size_t>(size) + 1;
+        sums.assign(stride * stride, 0);
+        for (int y = 0; y < size; ++y) {
+            std::uint32_t row = 0;
+            city.zones.forEachRowSpan(y, [&](int x0, const ZoneType *span, int n) {
+                for (int k = 0; k < n; ++k) {
+                    std::size_t x = static_cast<std::size_t>(x0 + k);
+                    row += span[k] != ZoneType::None ? 1u : 0u;
+                    sums[(y + 1) * stride + x + 1] = sums[y * stride + x + 1] + row;
+                }
+            });
+        }
+    }
+    bool any(int x0, int y0, int x1, int y1) const {
+        x0 = std::clamp(x0, 0, size);
+        y0 = std::clamp(y0, 0, size);
+        x1 = std::clamp(x1, 0, size);
+        y1 = std::clamp(y1, 0, size);
+        if (x1 <= x0 || y1 <= y0) return false;
+        std::size_t stride = static_cast<std::size_t>(size) + 1;
+        std::uint32_t total = sums[y1 * stride + x1] - sums[y0 * stride + x1]
+                            - sums[y1 * stride + x0] + sums[y0 * stride + x0];
+        return total > 0;
+    }
+};
+
+// Affine mapping from grid coordinates into one tile's local units.
+struct TileFrame {
+    double originX;
+    double originY;
+    double scale; // tile units per grid unit
+
+    double u(double x) const { return (x - originX) * scale; }
+    double v(double y) const { return (y - originY) * scale; }
+};
+
+struct LocalPoint {
+    double x;
+    double y;
+};
+
+// Sutherland–Hodgman clip of a polygon against the buffered tile square.
+std::vector<LocalPoint> clipPolygon(std::vector<LocalPoint> poly) {
+    const double lo = -kBuffer;
+    const double hi = static_cast<double>(kExtent) + kBuffer;
+    for (int edge = 0; edge < 4 && !poly.empty(); ++edge) {
+        auto inside = [&](const LocalPoint &p) {
+            switch (edge) {
+                case 0: return p.x >= lo;
+                case 1: return p.x <= hi;
+                case 2: return p.y >= lo;
+                default: return p.y <= hi;
+            }
+        };
+        auto intersect = [&](const LocalPoint &a, const LocalPoint &b) {
+            double t;
+            switch (edge) {
+                case 0: t = (lo - a.x) / (b.x - a.x); break;
+                case 1: t = (hi - a.x) / (b.x - a.x); break;
+                case 2: t = (lo - a.y) / (b.y - a.y); break;
+                default: t = (hi - a.y) / (b.y - a.y); break;
+            }
+            return LocalPoint{a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+        };
+        std::vector<LocalPoint> out;
+        out.reserve(poly.size() + 4);
+        for (std::size_t i = 0; i < poly.size(); ++i) {
+            const LocalPoint &cur = poly[i];
+            const LocalPoint &prev = poly[(i + poly.size() - 1) % poly.size()];
+            bool curIn = inside(cur);
+            bool prevIn = inside(prev);
+            if (curIn) {
+                if (!prevIn) out.push_back(intersect(prev, cur));
+                out.push_back(cur);
+            } else if (prevIn) {
+                out.push_back(intersect(prev, cur));
+            }
+        }
+        poly.swap(out);
+    }
+    return poly;
+}
+
+// Liang–Barsky clip of a segment against the buffered tile square.
+bool clipSegment(LocalPoint &a, LocalPoint &b) {
+    const double lo = -kBuffer;
+    const double hi = static_cast<double>(kExtent) + kBuffer;
+    double t0 = 0.0;
+    double t1 = 1.0;
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    const double p[4] = {-dx, dx, -dy, dy};
+    const double q[4] = {a.x - lo, hi - a.x, a.y - lo, hi - a.y};
+    for (int i = 0; i < 4; ++i) {
+        if (p[i] == 0.0) {
+            if (q[i] < 0.0) return false;
+            continue;
+        }
+        double r = q[i] / p[i];
+        if (p[i] < 0.0) {
+            if (r > t1) return false;
+            t0 = std::max(t0, r);
+        } else {
+            if (r < t0) return false;
+            t1 = std::min(t1, r);
+        }
+    }
+    LocalPoint na{a.x + dx * t0, a.y + dy * t0};
+    LocalPoint nb{a.x + dx * t1, a.y + dy * t1};
+    a = na;
+    b = nb;
+    return true;
+}
+
+TilePoint quantize(const LocalPoint &p) {
+    return {static_cast<std::int32_t>(std::lround(p.x)),
+            static_cast<std::int32_t>(std::lround(p.y))};
+}
+
+// Quantise a clipped ring, drop repeated vertices and orient it as an MVT
+// exterior ring (positive surveyor's area in y-down tile coordinates).
+// Returns false if the ring collapses at this resolution.
+bool finishRing(const std::vector<LocalPoint> &in, std::vector<TilePoint> &out) {
+    out.clear();
+    for (const auto &p : in) {
+        TilePoint q = quantize(p);
+        if (!out.empty() && out.back().x == q.x && out.back().y == q.y) continue;
+        out.push_back(q);
+    }
+    while (out.size() > 1 && out.front().x == out.back().x && out.front().y == out.back().y) {
+        out.pop_back();
+    }
+    if (out.size() < 3) return false;
+    std::int64_t area2 = 0;
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        const TilePoint &a = out[i];
+        const TilePoint &b = out[(i + 1) % out.size()];
+        area2 += static_cast<std::int64_t>(a.x) * b.y - static_cast<std::int64_t>(b.x) * a.y;
+    }
+    if (area2 == 0) return false;
+    if (area2 < 0) std::reverse(out.begin(), out.end());
+    return true;
+}
+
+// Reference from a tile to a feature intersecting it.  Features are
+// numbered buildings first, then roads, then facilities.
+struct TileRef {
+    std::uint32_t x;
+    std::uint32_t y;
+    std::uint32_t feature;
+
+    bool operator<(const TileRef &o) const {
+        if (x != o.x) return x < o.x;
+        if (y != o.y) return y < o.y;
+        return feature < o.feature;
+    }
+    bool operator==(const TileRef &o) const {
+        return x == o.x && y == o.y && feature == o.feature;
+    }
+};
+
+struct FeatureBox {
+    double x0, y0, x1, y1;
+};
+
+FeatureBox buildingBox(const Building &b) {
+    if (!b.hasCorners) return {b.footprint.x0, b.footprint.y0, b.footprint.x1, b.footprint.y1};
+    FeatureBox box{b.corners[0].x, b.corners[0].y, b.corners[0].x, b.corners[0].y};
+    for (const auto &c : b.corners) {
+        box.x0 = std::min(box.x0, c.x);
+        box.y0 = std::min(box.y0, c.y);
+        box.x1 = std::max(box.x1, c.x);
+        box.y1 = std::max(box.y1, c.y);
+    }
+    return box;
+}
+
+// Assign every feature to the tiles it touches at the finest zoom.  Roads
+// are walked column by column so long diagonal spokes only touch the tiles
+// along their path rather than their whole bounding box.
+std::vector<TileRef> assignFinestTiles(const City &city, int zoom) {
+    const std::uint32_t n = 1u << zoom;
+    const double span = static_cast<double>(city.size) / n;
+    const double pad = kBuffer / kExtent * span;
+    auto tileRange = [&](double lo, double hi, std::uint32_t &t0, std::uint32_t &t1) {
+        double a = std::floor((lo - pad) / span);
+        double b = std::floor((hi + pad) / span);
+        if (b < 0.0 || a > static_cast<double>(n - 1)) return false;
+        t0 = static_cast<std::uint32_t>(std::max(a, 0.0));
+        t1 = static_cast<std::uint32_t>(std::min(b, static_cast<double>(n - 1)));
+        return true;
+    };
+    const std::size_t nb = city.buildings.size();
+    const std::size_t nr = city.roads.size();
+    const std::size_t nf = city.facilities.size();
+    const std::size_t total = nb + nr + nf;
+    // Per-feature buckets keep the parallel pass free of shared writes.
+    std::vector<std::vector<TileRef>> perFeature(total);
+    parallelFor(0, total, [&](std::size_t i) {
+        std::vector<TileRef> &out = perFeature[i];
+        std::uint32_t id = static_cast<std::uint32_t>(i);
+        std::uint32_t tx0, tx1, ty0, ty1;
+        if (i < nb) {
+            const Building &b = city.buildings[i];
+            if (b.zone == ZoneType::None) return;
+            FeatureBox box = buildingBox(b);
+            if (!tileRange(box.x0, box.x1, tx0, tx1) || !tileRange(box.y0, box.y1, ty0, ty1)) return;
+            for (std::uint32_t tx = tx0; tx <= tx1; ++tx)
+                for (std::uint32_t ty = ty0; ty <= ty1; ++ty) out.push_back({tx, ty, id});
+        } else if (i < nb + nr) {
+            const RoadSegment &r = city.roads[i - nb];
+            double half = 0.5 * roadWidth(r.type);
+            double minX = std::min(r.x1, r.x2) - half;
+            double maxX = std::max(r.x1, r.x2) + half;
+            if (!tileRange(minX, maxX, tx0, tx1)) return;
+            double dx = r.x2 - r.x1;
+            for (std::uint32_t tx = tx0; tx <= tx1; ++tx) {
+                // y extent of the segment within this (padded) tile column
+                double cx0 = tx * span - pad - half;
+                double cx1 = (tx + 1) * span + pad + half;
+                double ta = 0.0, tb = 1.0;
+                if (std::abs(dx) > 1e-12) {
+                    double s0 = (cx0 - r.x1) / dx;
+                    double s1 = (cx1 - r.x1) / dx;
+                    if (s0 > s1) std::swap(s0, s1);
+                    ta = std::max(0.0, s0);
+                    tb = std::min(1.0, s1);
+                    if (ta > tb) continue;
+                }
+                double ya = r.y1 + (r.y2 - r.y1) * ta;
+                double yb = r.y1 + (r.y2 - r.y1) * tb;
+                if (!tileRange(std::min(ya, yb) - half, std::max(ya, yb) + half, ty0, ty1)) continue;
+                for (std::uint32_t ty = ty0; ty <= ty1; ++ty) out.push_back({tx, ty, id});
+            }
+        } else {
+            const Facility &f = city.facilities[i - nb - nr];
+            if (!tileRange(f.x, f.x, tx0, tx1) || !tileRange(f.y, f.y, ty0, ty1)) return;
+            for (std::uint32_t tx = tx0; tx <= tx1; ++tx)
+                for (std::uint32_t ty = ty0; ty <= ty1; ++ty) out.push_back({tx, ty, id});
+        }
+    });
+    std::vector<TileRef> refs;
+    std::size_t count = 0;
+    for (const auto &v : perFeature) count += v.size();
+    refs.reserve(count);
+    for (auto &v : perFeature) refs.insert(refs.end(), v.begin(), v.end());
+    std::sort(refs.begin(), refs.end());
+    return refs;
+}
+
+// Derive the references of the next coarser zoom from the current ones: a
+// parent tile holds the union of its four children's features.
+using TileXY = std::pair<std::uint32_t, std::uint32_t>;
+
+// Tiles over zoning at every zoom up to maxZoom, each level sorted.  A
+// tile can only be developed if its parent is, so each level tests the
+// four children of the level above rather than all 4^z tiles.
+std::vector<std::vector<TileXY>> developedTiles(const DevelopedTable &developed, int size, int maxZoom) {
+    std::vector<std::vector<TileXY>> levels(static_cast<std::size_t>(maxZoom) + 1);
+    if (developed.any(0, 0, size, size)) levels[0].push_back({0, 0});
+    for (int z = 1; z <= maxZoom; ++z) {
+        const double span = static_cast<double>(size) / (1u << z);
+        for (const TileXY &parent : levels[z - 1]) {
+            for (std::uint32_t k = 0; k < 4; ++k) {
+                std::uint32_t tx = 2 * parent.first + (k & 1);
+                std::uint32_t ty = 2 * parent.second + (k >> 1);
+                if (developed.any(static_cast<int>(std::floor(tx * span)), static_cast<int>(std::floor(ty * span)),
+                                  static_cast<int>(std::ceil((tx + 1) * span)),
+                                  static_cast<int>(std::ceil((ty + 1) * span)))) {
+                    levels[z].push_back({tx, ty});
+                }
+            }
+        }
+        std::sort(levels[z].begin(), levels[z].end());
+    }
+    return levels;
+}
+
+std::vector<TileRef> parentRefs(const std::vector<TileRef> &refs) {
+    std::vector<TileRef> out;
+    out.reserve(refs.size());
+    for (const auto &r : refs) out.push_back({r.x >> 1, r.y >> 1, r.feature});
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+// Emit the zone layer: runs of equal zone along each row are merged with
+// identical runs on following rows into rectangles, then grouped into one
+// multipolygon feature per zone type.
+void encodeZoneLayer(const ZonePyramid &pyr, int citySize, const TileFrame &frame,
+                     double span, double tileX0, double tileY0, LayerBuilder &layer) {
+    int level = 0;
+    while (level + 1 < static_cast<int>(pyr.levels.size()) &&
+           span / std::ldexp(1.0, level) > kMaxZoneCellsPerTile) {
+        level++;
+    }
+    const int lsize = pyr.sizes[level];
+    const double cell = std::ldexp(1.0, level);
+    const std::vector<std::uint8_t> &grid = pyr.levels[level];
+    const double pad = kBuffer / kExtent * span;
+    int cx0 = std::max(0, static_cast<int>(std::floor((tileX0 - pad) / cell)));
+    int cy0 = std::max(0, static_cast<int>(std::floor((tileY0 - pad) / cell)));
+    int cx1 = std::min(lsize, static_cast<int>(std::ceil((tileX0 + span + pad) / cell)));
+    int cy1 = std::min(lsize, static_cast<int>(std::ceil((tileY0 + span + pad) / cell)));
+    if (cx1 <= cx0 || cy1 <= cy0) return;
+
+    struct Run { int x0, x1, y0; std::uint8_t zone; };
+    std::array<GeometryEncoder, 5> geoms;
+    std::vector<TilePoint> ring;
+    const double worldMax = static_cast<double>(citySize);
+    auto emit = [&](const Run &r, int yEnd) {
+        double x0 = r.x0 * cell, x1 = std::min(r.x1 * cell, worldMax);
+        double y0 = r.y0 * cell, y1 = std::min(yEnd * cell, worldMax);
+        std::vector<LocalPoint> poly = {
+            {frame.u(x0), frame.v(y0)}, {frame.u(x1), frame.v(y0)},
+            {frame.u(x1), frame.v(y1)}, {frame.u(x0), frame.v(y1)}};
+        poly = clipPolygon(std::move(poly));
+        if (poly.size() >= 3 && finishRing(poly, ring)) geoms[r.zone].ring(ring);
+    };
+    std::vector<Run> open;
+    std::vector<Run> next;
+    std::vector<Run> rowRuns;
+    for (int y = cy0; y < cy1; ++y) {
+        rowRuns.clear();
+        const std::uint8_t *row = grid.data() + static_cast<std::size_t>(y) * lsize;
+        for (int x = cx0; x < cx1;) {
+            std::uint8_t z = row[x];
+            int start = x;
+            while (x < cx1 && row[x] == z) ++x;
+            if (z != 0) rowRuns.push_back({start, x, y, z});
+        }
+        // Runs are sorted by x0 in both rows; match identical spans.
+        next.clear();
+        std::size_t i = 0;
+        for (const Run &r : rowRuns) {
+            while (i < open.size() && open[i].x0 < r.x0) emit(open[i++], y);
+            if (i < open.size() && open[i].x0 == r.x0 && open[i].x1 == r.x1 && open[i].zone == r.zone) {
+                next.push_back(open[i++]);
+            } else {
+                next.push_back(r);
+            }
+        }
+        while (i < open.size()) emit(open[i++], y);
+        open.swap(next);
+    }
+    for (const Run &r : open) emit(r, cy1);
+    for (std::uint8_t z = 1; z < 5; ++z) {
+        if (geoms[z].cmds.empty()) continue;
+        std::vector<std::uint32_t> tags;
+        layer.tag(tags, "zone", layer.stringValue(zoneName(static_cast<ZoneType>(z))));
+        layer.addFeature(z, kPolygon, tags, geoms[z].cmds);
+    }
+}
+
+std::string encodeTile(const City &city, const ZonePyramid &pyr, int zoom, int maxZoom,
+                       std::uint32_t tx, std::uint32_t ty,
+                       const TileRef *begin, const TileRef *end) {
+    const double span = static_cast<double>(city.size) / static_cast<double>(1u << zoom);
+    const double tileX0 = tx * span;
+    const double tileY0 = ty * span;
+    TileFrame frame{tileX0, tileY0, kExtent / span};
+    const bool finest = zoom == maxZoom;
+    const std::size_t nb = city.buildings.size();
+    const std::size_t nr = city.roads.size();
+
+    LayerBuilder zones("zones");
+    encodeZoneLayer(pyr, city.size, frame, span, tileX0, tileY0, zones);
+
+    LayerBuilder footprints("buildings");
+    LayerBuilder roads("roads");
+    LayerBuilder facilities("facilities");
+    std::vector<TilePoint> ring;
+    std::vector<std::uint32_t> tags;
+    for (const TileRef *it = begin; it != end; ++it) {
+        std::size_t id = it->feature;
+        tags.clear();
+        GeometryEncoder geom;
+        if (id < nb) {
+            const Building &b = city.buildings[id];
+            if (!finest) {
+                FeatureBox box = buildingBox(b);
+                if ((box.x1 - box.x0) * frame.scale < kMinFeatureUnits &&
+                    (box.y1 - box.y0) * frame.scale < kMinFeatureUnits) continue;
+            }
+            std::vector<LocalPoint> poly;
+            if (b.hasCorners) {
+                for (const auto &c : b.corners) poly.push_back({frame.u(c.x), frame.v(c.y)});
+            } else {
+                const Rect &r = b.footprint;
+                poly = {{frame.u(r.x0), frame.v(r.y0)}, {frame.u(r.x1), frame.v(r.y0)},
+                        {frame.u(r.x1), frame.v(r.y1)}, {frame.u(r.x0), frame.v(r.y1)}};
+            }
+            poly = clipPolygon(std::move(poly));
+            if (poly.size() < 3 || !finishRing(poly, ring)) continue;
+            geom.ring(ring);
+            footprints.tag(tags, "zone", footprints.stringValue(zoneName(b.zone)));
+            footprints.tag(tags, "height", footprints.uintValue(static_cast<std::uint64_t>(std::max(b.height, 0))));
+            if (b.facility) {
+                footprints.tag(tags, "facility", footprints.stringValue(
+                    b.facilityType == Facility::Type::Hospital ? "hospital" : "school"));
+            }
+            footprints.addFeature(city.buildingId(id) + std::uint64_t(1), kPolygon, tags, geom.cmds);
+        } else if (id < nb + nr) {
+            const RoadSegment &r = city.roads[id - nb];
+            LocalPoint a{frame.u(r.x1), frame.v(r.y1)};
+            LocalPoint b{frame.u(r.x2), frame.v(r.y2)};
+            if (!clipSegment(a, b)) continue;
+            TilePoint qa = quantize(a);
+            TilePoint qb = quantize(b);
+            if (qa.x == qb.x && qa.y == qb.y) continue;
+            geom.moveTo(qa);
+            geom.lineTo(&qb, 1);
+            roads.tag(tags, "class", roads.stringValue(roadClassName(r.type)));
+            roads.addFeature(id - nb + 1, kLineString, tags, geom.cmds);
+        } else {
+            const Facility &f = city.facilities[id - nb - nr];
+            TilePoint p = quantize({frame.u(f.x), frame.v(f.y)});
+            if (p.x < 0 || p.y < 0 || p.x > static_cast<std::int32_t>(kExtent) ||
+                p.y > static_cast<std::int32_t>(kExtent)) continue;
+            geom.moveTo(p);
+            facilities.tag(tags, "type", facilities.stringValue(
+                f.type == Facility::Type::Hospital ? "hospital" : "school"));
+            facilities.addFeature(id - nb - nr + 1, kPoint, tags, geom.cmds);
+        }
+    }
+
+    PbfWriter tile;
+    for (const LayerBuilder *layer : {&zones, &footprints, &roads, &facilities}) {
+        if (layer->featureCount == 0) continue;
+        tile.bytesField(3, layer->finish());
+    }
+    return tile.buf;
+}
+
+} // namespace
+
+std::size_t City::saveVectorTiles(const std::string &directory, int minZoom, int maxZoom,
+                                  ExecutionContext *ctx) const {
+    namespace fs = std::filesystem;
+    if (size <= 0) return 0;
+    maxZoom = std::clamp(maxZoom, 0, maxTileZoom(size));
+    minZoom = std::clamp(minZoom, 0, maxZoom);
+    const ZonePyramid pyr = buildZonePyramid(*this);
+    const std::vector<std::vector<TileXY>> developed = developedTiles(DevelopedTable(*this), size, maxZoom);
+    std::vector<TileRef> refs = assignFinestTiles(*this, maxZoom);
+    std::size_t written = 0;
+    for (int z = maxZoom; z >= minZoom; --z) {
+        const std::uint32_t n = 1u << z;
+        // Tiles to emit: anything with features, plus anything over zoning.
+        std::vector<TileXY> tiles;
+        for (const auto &r : refs) {
+            if (tiles.empty() || tiles.back().first != r.x || tiles.back().second != r.y) {
+                tiles.push_back({r.x, r.y});
+            }
+        }
+        std::size_t featureTiles = tiles.size();
+        tiles.insert(tiles.end(), developed[z].begin(), developed[z].end());
+        std::inplace_merge(tiles.begin(), tiles.begin() + static_cast<std::ptrdiff_t>(featureTiles), tiles.end());
+        tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+
+        fs::path levelDir = fs::path(directory) / std::to_string(z);
+        std::uint32_t lastX = n;
+        for (const auto &t : tiles) {
+            if (t.first != lastX) {
+                fs::create_directories(levelDir / std::to_string(t.first));
+                lastX = t.first;
+            }
+        }
+        std::vector<char> ok(tiles.size(), 0);
+        StageScope stage(ctx, "tiles", tiles.size());
+        parallelFor(0, tiles.size(), [&](std::size_t i) {
+            stage.advance();
+            const auto &t = tiles[i];
+            TileRef lo{t.first, t.second, 0};
+            auto begin = std::lower_bound(refs.begin(), refs.end(), lo);
+            auto end = begin;
+            while (end != refs.end() && end->x == t.first && end->y == t.second) ++end;
+            std::string bytes = encodeTile(*this, pyr, z, maxZoom, t.first, t.second,
+                                           refs.data() + (begin - refs.begin()),
+                                           refs.data() + (end - refs.begin()));
+            fs::path path = levelDir / std::to_string(t.first) / (std::to_string(t.second) + ".mvt");
+            std::ofstream ofs(path, std::ios::binary);
+            if (!ofs) return;
+            ofs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            ofs.close();
+            ok[i] = ofs.good() ? 1 : 0;
+        });
+        if (std::find(ok.begin(), ok.end(), 0) != ok.end()) return 0;
+        written += tiles.size();
+        if (z > minZoom) refs = parentRefs(refs);
+    }
+    return written;
+}
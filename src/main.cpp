@@ -1,10 +1,32 @@
+#include "Checkpoint.h"
+#include "CityDiff.h"
+#include "CityFile.h"
 #include "CityGenerator.h"
 #include "Config.h"
+#include "Ensemble.h"
+#include "Estimate.h"
+#include "Execution.h"
+#include "Memory.h"
+#include "Numa.h"
+#include "Optimizer.h"
+#include "Output.h"
+#include "Region.h"
+#include "Server.h"
+#include "Shards.h"
+#include "SharedMemory.h"
+#include "Validation.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <vector>
 #include <cstdlib>
 #include <filesystem>
+#include <memory>
 #include <stdexcept>
 
 /**
@@ -20,6 +42,364 @@ static std::string parseArg(const std::string &arg, const std::string &prefix) {
     return std::string();
 }
 
+// Context of the running job, cancelled by SIGINT/SIGTERM.
+static std::atomic<ExecutionContext *> gActiveContext{nullptr};
+
+static void cancelOnSignal(int sig) {
+    if (ExecutionContext *ctx = gActiveContext.load()) ctx->cancel();
+    // A second signal falls through to the default action.
+    std::signal(sig, SIG_DFL);
+}
+
+/// Generate the city and write every requested output; returns the exit code.
+/// An empty outDir writes only the shared-memory segment (and --summary).
+/// With checkpoints, outputs recorded by a resumed checkpoint are skipped.
+/// Validation defects (--validate) exit with 3 once every output is written.
+/// With a region, its cities are generated and merged instead of cfg's city.
+static int generateAndExport(const Config &cfg, const std::string &outDir,
+                             const std::string &summaryTarget, bool streamed,
+                             const std::string &shmName, std::ostream &log,
+                             ExecutionContext &ctx, Checkpointer *checkpoints,
+                             const Region *region) {
+    City city = region ? generateRegion(*region, &ctx) : CityGenerator::generate(cfg, &ctx, checkpoints);
+    if (region) {
+        log << "Merged " << region->cities.size() << " cities into one region" << std::endl;
+    }
+    if (checkpoints && checkpoints->resumedStage() != CheckpointStage::None) {
+        log << "Resumed after stage: " << checkpointStageName(checkpoints->resumedStage())
+            << std::endl;
+    }
+    auto pending = [&](ExportStep step) { return !checkpoints || !checkpoints->exported(step); };
+    auto exported = [&](ExportStep step) {
+        if (checkpoints) checkpoints->markExported(step);
+    };
+    auto cannotWrite = [](const std::string &path) {
+        std::cerr << "Error: cannot write " << path << std::endl;
+        return 1;
+    };
+    // Save outputs
+    std::string modelPath;
+    std::string summaryPath = summaryTarget;
+    if (streamed) {
+        modelPath = outDir;
+    } else if (!outDir.empty()) {
+        switch (cfg.export_format) {
+            case Config::ExportFormat::OBJ: modelPath = outDir + "/city.obj"; break;
+            case Config::ExportFormat::GLB: modelPath = outDir + "/city.glb"; break;
+            case Config::ExportFormat::GLTF:
+            default: modelPath = outDir + "/city.gltf"; break;
+        }
+        if (summaryPath.empty()) summaryPath = outDir + "/city_summary.json";
+    }
+    if (!pending(ExportModel)) {
+        if (cfg.shards > 0) modelPath = outDir + "/shards/city_shards.json";
+        if (!modelPath.empty()) log << "Model already written: " << modelPath << std::endl;
+    } else if (cfg.shards > 0) {
+        // Shards replace the single model file; the manifest indexes them.
+        std::string shardDir = outDir + "/shards";
+        std::filesystem::create_directories(shardDir);
+        std::string ext = modelPath.substr(modelPath.rfind('.') + 1);
+        City::ShardMode mode = cfg.shard_mode == Config::ShardMode::RoundRobin
+                                   ? City::ShardMode::RoundRobin
+                                   : City::ShardMode::Spatial;
+        std::size_t written = cfg.shard_workers > 0
+                                  ? saveShardsWithWorkers(city, shardDir, ext, cfg.shards, mode,
+                                                          cfg.shard_workers, &ctx)
+                                  : city.saveShards(shardDir, ext, cfg.shards, mode, &ctx);
+        if (written == 0) return cannotWrite(shardDir + "/city_shards.json");
+        log << "Wrote " << written << " model shards to: " << shardDir << std::endl;
+        modelPath = shardDir + "/city_shards.json";
+    } else if (!modelPath.empty()) {
+        bool written = false;
+        switch (cfg.export_format) {
+            case Config::ExportFormat::OBJ:
+                written = city.saveOBJ(modelPath, &ctx);
+                break;
+            case Config::ExportFormat::GLB:
+                written = city.saveGLTF(modelPath, true, &ctx);
+                break;
+            case Config::ExportFormat::GLTF:
+            default:
+                written = city.saveGLTF(modelPath, false, &ctx);
+                break;
+        }
+        if (!written) return cannotWrite(modelPath);
+    }
+    exported(ExportModel);
+    if (!summaryPath.empty() && pending(ExportSummary)) {
+        if (!city.saveSummary(summaryPath, &ctx)) return cannotWrite(summaryPath);
+        exported(ExportSummary);
+    }
+    if (!cfg.city_file.empty()) {
+        if (!city.saveCity(cfg.city_file, &ctx)) return cannotWrite(cfg.city_file);
+        log << "Wrote city file: " << cfg.city_file << std::endl;
+    }
+    if (cfg.tiles_max_zoom >= 0 && pending(ExportTiles)) {
+        std::size_t tiles = city.saveVectorTiles(outDir + "/tiles", cfg.tiles_min_zoom, cfg.tiles_max_zoom, &ctx);
+        if (tiles == 0) return cannotWrite(outDir + "/tiles");
+        log << "Wrote " << tiles << " vector tiles to: " << outDir << "/tiles" << std::endl;
+        exported(ExportTiles);
+    }
+    if (cfg.export_raster && pending(ExportRaster)) {
+        std::string rasterPath = outDir + "/city_raster.cgr";
+        if (!city.saveRaster(rasterPath, cfg.population, &ctx)) return cannotWrite(rasterPath);
+        log << "Wrote raster layers to: " << rasterPath << std::endl;
+        exported(ExportRaster);
+    }
+    if (!shmName.empty()) {
+        std::uint64_t bytes = city.saveSharedMemory(shmName, &ctx);
+        if (bytes == 0) {
+            std::cerr << "Error: cannot create shared-memory segment " << sharedSegmentName(shmName)
+                      << std::endl;
+            return 1;
+        }
+        log << "Shared-memory segment: " << sharedSegmentName(shmName) << " (" << bytes
+            << " bytes)" << std::endl;
+    }
+    bool valid = true;
+    if (cfg.validate) {
+        ValidationReport report = validateCity(city, &ctx);
+        valid = report.ok();
+        log << "Validation: " << report.buildingOverlaps << " building overlaps, " << report.roadIntrusions
+            << " road intrusions, " << report.outsideBlock << " footprints outside their block"
+            << std::endl;
+        if (!streamed && !outDir.empty()) {
+            std::string reportPath = outDir + "/city_validation.json";
+            OutputSink out(reportPath);
+            out << validationToJson(city, report);
+            if (!out.close()) return cannotWrite(reportPath);
+            log << "Wrote validation report to: " << reportPath << std::endl;
+        }
+    }
+    if (memorySpilled() > 0) {
+        log << "Spilled " << (memorySpilled() >> 20) << " MiB to scratch files under the "
+            << (cfg.memory_limit >> 20) << " MiB memory limit" << std::endl;
+    }
+    if (checkpoints) {
+        if (!checkpoints->wait()) std::cerr << "Warning: some checkpoints could not be written" << std::endl;
+        checkpoints->discard();
+    }
+    if (!modelPath.empty()) {
+        log << "Generated city at: " << modelPath;
+        if (!summaryPath.empty()) log << " and summary: " << summaryPath;
+        log << std::endl;
+    }
+    return valid ? 0 : 3;
+}
+
+/// Per-node throughput of a batch run with NUMA placement (--numa).
+static void logNumaStats(std::ostream &log, std::chrono::steady_clock::duration elapsed) {
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    for (const NumaNodeStats &s : numaStats()) {
+        log << "NUMA node " << s.node << ": " << s.cpus << " CPUs, " << s.jobs << " cities, "
+            << (seconds > 0.0 ? s.jobs / seconds : 0.0) << " cities/s, "
+            << (s.jobs ? s.busySeconds / s.jobs : 0.0) << " s per city" << std::endl;
+    }
+}
+
+/// Run an ensemble and write its report to target (path, '-' or fd:N).
+static int runEnsembleReport(const Config &cfg, EnsembleSeeds seeds, const std::string &target,
+                             ExecutionContext &ctx) {
+    auto start = std::chrono::steady_clock::now();
+    EnsembleReport report = runEnsemble(cfg, seeds, &ctx);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    OutputSink out(target);
+    if (!out) {
+        std::cerr << "Error: cannot write ensemble report to " << target << std::endl;
+        return 1;
+    }
+    out << ensembleToJson(report);
+    bool stream = out.isStream();
+    if (!out.close()) {
+        std::cerr << "Error: cannot write ensemble report to " << target << std::endl;
+        return 1;
+    }
+    (stream ? std::cerr : std::cout) << "Wrote ensemble report for " << seeds.count()
+                                     << " seeds to: " << target << std::endl;
+    if (numaPlacement()) logNumaStats(stream ? std::cerr : std::cout, elapsed);
+    return 0;
+}
+
+/// `citygen optimize --vary=<option>:<lo>-<hi> ... [--target=..] [--objective=..]`.
+/// Exit status: 0 with a non-empty Pareto set, 1 if no candidate met the
+/// targets, 2 on bad arguments or errors.
+static int runOptimize(int argc, char **argv) {
+    Config cfg;
+    OptimizerOptions options;
+    std::string target = "-";
+    bool showProgress = false;
+    double timeoutSeconds = 0.0;
+    try {
+        for (int i = 0; i < argc; ++i) {
+            std::string arg = argv[i];
+            std::size_t eq = arg.find('=');
+            if (arg.rfind("--", 0) == 0 && eq != std::string::npos && eq + 1 < arg.size() &&
+                applyConfigOption(cfg, arg.substr(2, eq - 2), arg.substr(eq + 1))) {
+                continue;
+            }
+            if (auto s = parseArg(arg, "--vary="); !s.empty()) {
+                options.dimensions.push_back(searchDimensionFromString(s));
+            } else if (auto s = parseArg(arg, "--target="); !s.empty()) {
+                options.targets.push_back(metricTargetFromString(s));
+            } else if (auto s = parseArg(arg, "--objective="); !s.empty()) {
+                options.objectives.push_back(objectiveFromString(s));
+            } else if (auto s = parseArg(arg, "--candidates="); !s.empty()) {
+                options.candidates =
+                    static_cast<unsigned>(integerOptionFromString("candidates", s, 1, kMaxCandidates));
+            } else if (auto s = parseArg(arg, "--replicates="); !s.empty()) {
+                options.replicates =
+                    static_cast<unsigned>(integerOptionFromString("replicates", s, 1, kMaxReplicates));
+            } else if (auto s = parseArg(arg, "--eta="); !s.empty()) {
+                options.eta = static_cast<unsigned>(integerOptionFromString("eta", s, 2, kMaxReplicates));
+            } else if (auto s = parseArg(arg, "--drop-margin="); !s.empty()) {
+                options.dropMargin = numberOptionFromString("drop-margin", s);
+                if (options.dropMargin < 0.0) throw std::invalid_argument("Invalid drop-margin: " + s);
+            } else if (auto s = parseArg(arg, "--search-seed="); !s.empty()) {
+                options.searchSeed = static_cast<std::uint32_t>(
+                    integerOptionFromString("search-seed", s, 0, std::numeric_limits<std::uint32_t>::max()));
+            } else if (auto s = parseArg(arg, "--output="); !s.empty()) {
+                target = s;
+            } else if (arg == "--progress") {
+                showProgress = true;
+            } else if (arg == "--numa") {
+                setNumaPlacement(true);
+            } else if (auto s = parseArg(arg, "--timeout="); !s.empty()) {
+                timeoutSeconds = timeoutFromString("timeout", s);
+            } else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                return 2;
+            }
+        }
+    } catch (const std::invalid_argument &e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+    if (options.dimensions.empty()) {
+        std::cerr << "Usage: citygen optimize --vary=<option>:<lo>-<hi> [--vary=...]\n"
+                  << "           [--target=<metric><=<x>|<metric>>=<x>] [--objective=max:<metric>|min:<metric>]\n"
+                  << "           [--candidates=<n>] [--replicates=<n>] [--eta=<n>] [--drop-margin=<f>]\n"
+                  << "           [--search-seed=<n>] [--output=<path|-|fd:N>] [--numa] [generation options]"
+                  << std::endl;
+        return 2;
+    }
+    ExecutionContext ctx;
+    if (showProgress) {
+        ctx.onProgress([](const ExecutionContext::Progress &p) {
+            std::cerr << "progress: " << p.stage << " " << p.done << "/" << p.total << std::endl;
+        });
+    }
+    if (timeoutSeconds > 0.0) {
+        ctx.setTimeout(std::chrono::duration_cast<ExecutionContext::Clock::duration>(
+            std::chrono::duration<double>(timeoutSeconds)));
+    }
+    gActiveContext.store(&ctx);
+    std::signal(SIGINT, cancelOnSignal);
+    std::signal(SIGTERM, cancelOnSignal);
+    int status = 2;
+    try {
+        auto start = std::chrono::steady_clock::now();
+        OptimizerResult result = optimizeConfig(cfg, options, &ctx);
+        if (numaPlacement()) logNumaStats(std::cerr, std::chrono::steady_clock::now() - start);
+        OutputSink out(target);
+        if (out) {
+            out << optimizerToJson(result, options);
+            if (out.close()) {
+                bool found = std::any_of(result.candidates.begin(), result.candidates.end(),
+                                         [](const OptimizerCandidate &c) { return c.pareto; });
+                if (!found) std::cerr << "No candidate met every target" << std::endl;
+                status = found ? 0 : 1;
+            }
+        }
+        if (status == 2) std::cerr << "Error: cannot write " << target << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+    gActiveContext.store(nullptr);
+    return status;
+}
+
+/// `citygen validate a.city [--tolerance=<units>]`: the --validate checks
+/// on a saved city, with the report on stdout.  Exit status as for a run
+/// with --validate: 0 clean, 3 on defects, 2 on trouble.
+static int runValidate(int argc, char **argv) {
+    std::string file;
+    double tolerance = 1e-3;
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (auto s = parseArg(arg, "--tolerance="); !s.empty()) {
+            try {
+                tolerance = numberOptionFromString("tolerance", s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 2;
+            }
+        } else if (arg.rfind("--", 0) == 0 || !file.empty()) {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        } else {
+            file = arg;
+        }
+    }
+    if (file.empty()) {
+        std::cerr << "Usage: citygen validate a.city [--tolerance=<units>]" << std::endl;
+        return 2;
+    }
+    try {
+        City city = loadCity(file);
+        ValidationReport report = validateCity(city, nullptr, tolerance);
+        std::cout << validationToJson(city, report);
+        return report.ok() ? 0 : 3;
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+}
+
+/// `citygen diff a.city b.city [--tolerance=<units>] [--layer=<path>]`.
+/// Exit status follows diff(1): 0 identical, 1 different, 2 trouble.
+static int runDiff(int argc, char **argv) {
+    std::vector<std::string> files;
+    std::string layerPath;
+    double tolerance = 0.5;
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (auto s = parseArg(arg, "--layer="); !s.empty()) {
+            layerPath = s;
+        } else if (auto s = parseArg(arg, "--tolerance="); !s.empty()) {
+            try {
+                tolerance = numberOptionFromString("tolerance", s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 2;
+            }
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.size() != 2) {
+        std::cerr << "Usage: citygen diff a.city b.city [--tolerance=<units>] [--layer=<path>]"
+                  << std::endl;
+        return 2;
+    }
+    try {
+        City a = loadCity(files[0]);
+        City b = loadCity(files[1]);
+        CityDiff diff = diffCities(a, b, tolerance);
+        std::cout << cityDiffToJson(diff);
+        if (!layerPath.empty() && !saveDiffLayer(diff, a, b, layerPath)) {
+            std::cerr << "Error: cannot write " << layerPath << std::endl;
+            return 2;
+        }
+        return diff.identical() ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+}
+
 /**
  * @brief Entry point for the command-line city generator.
  *
@@ -29,45 +409,161 @@ static std::string parseArg(const std::string &arg, const std::string &prefix) {
  *           --radius-fraction=0.8 --output=out_dir
  *
  * The program will produce a OBJ file (city.obj) and a summary JSON
- * (city_summary.json) in the specified output directory.
+ * (city_summary.json) in the specified output directory.  With
+ * --output=- (or fd:N) the model is streamed instead and the summary is
+ * only written if --summary= names a target.
  */
 int main(int argc, char **argv) {
+    if (argc >= 2 && std::string(argv[1]) == "diff") return runDiff(argc - 2, argv + 2);
+    if (argc >= 2 && std::string(argv[1]) == "validate") return runValidate(argc - 2, argv + 2);
+    if (argc >= 2 && std::string(argv[1]) == "optimize") return runOptimize(argc - 2, argv + 2);
+    if (argc >= 2 && std::string(argv[1]) == "shard-worker") return runShardWorker(argc - 2, argv + 2);
     Config cfg;
     std::string outDir;
+    std::string summaryTarget;
+    bool estimateOnly = false;
+    bool showProgress = false;
+    double timeoutSeconds = 0.0;
+    std::string shmName;
+    bool checkpoint = false;
+    bool resume = false;
+    std::string checkpointPath;
+    ServerOptions server;
+    std::string ensembleSpec;
+    std::string regionPath;
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
-        if (auto s = parseArg(arg, "--population="); !s.empty()) {
-            cfg.population = static_cast<std::uint32_t>(std::strtoul(s.c_str(), nullptr, 10));
-        } else if (auto s = parseArg(arg, "--hospitals="); !s.empty()) {
-            cfg.hospitals = static_cast<std::uint32_t>(std::strtoul(s.c_str(), nullptr, 10));
-        } else if (auto s = parseArg(arg, "--schools="); !s.empty()) {
-            cfg.schools = static_cast<std::uint32_t>(std::strtoul(s.c_str(), nullptr, 10));
-        } else if (auto s = parseArg(arg, "--transport="); !s.empty()) {
-            cfg.transport_mode = transportModeFromString(s);
-        } else if (auto s = parseArg(arg, "--seed="); !s.empty()) {
-            cfg.seed = static_cast<std::uint32_t>(std::strtoul(s.c_str(), nullptr, 10));
-        } else if (auto s = parseArg(arg, "--grid-size="); !s.empty()) {
-            cfg.grid_size = static_cast<int>(std::strtol(s.c_str(), nullptr, 10));
-        } else if (auto s = parseArg(arg, "--radius-fraction="); !s.empty()) {
-            cfg.city_radius = std::strtod(s.c_str(), nullptr);
-        } else if (auto s = parseArg(arg, "--format="); !s.empty()) {
+        std::size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) == 0 && eq != std::string::npos && eq + 1 < arg.size()) {
+            try {
+                if (applyConfigOption(cfg, arg.substr(2, eq - 2), arg.substr(eq + 1))) continue;
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        }
+        if (auto s = parseArg(arg, "--tiles="); !s.empty()) {
             try {
-                cfg.export_format = exportFormatFromString(s);
+                tileZoomsFromString(s, cfg.tiles_min_zoom, cfg.tiles_max_zoom);
             } catch (const std::invalid_argument &e) {
                 std::cerr << e.what() << std::endl;
                 return 1;
             }
-        } else if (auto s = parseArg(arg, "--layout="); !s.empty()) {
+        } else if (arg == "--raster") {
+            cfg.export_raster = true;
+        } else if (arg == "--validate") {
+            cfg.validate = true;
+        } else if (auto s = parseArg(arg, "--shards="); !s.empty()) {
             try {
-                cfg.layout = layoutTypeFromString(s);
+                cfg.shards = static_cast<int>(integerOptionFromString("shards", s, 0, kMaxShards));
             } catch (const std::invalid_argument &e) {
                 std::cerr << e.what() << std::endl;
                 return 1;
             }
+        } else if (auto s = parseArg(arg, "--shard-workers="); !s.empty()) {
+            try {
+                cfg.shard_workers = static_cast<int>(integerOptionFromString("shard-workers", s, 0, kMaxShards));
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--shard-mode="); !s.empty()) {
+            try {
+                cfg.shard_mode = shardModeFromString(s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--memory-limit="); !s.empty()) {
+            try {
+                cfg.memory_limit = byteSizeFromString(s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--zone-layout="); !s.empty()) {
+            try {
+                cfg.zone_layout = zoneLayoutFromString(s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--scratch-dir="); !s.empty()) {
+            cfg.scratch_dir = s;
+        } else if (arg == "--progress") {
+            showProgress = true;
+        } else if (arg == "--numa") {
+            setNumaPlacement(true);
+        } else if (auto s = parseArg(arg, "--timeout="); !s.empty()) {
+            try {
+                timeoutSeconds = timeoutFromString("timeout", s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--serve="); !s.empty()) {
+            server.endpoint = s;
+        } else if (auto s = parseArg(arg, "--serve-workers="); !s.empty()) {
+            try {
+                server.workers =
+                    static_cast<unsigned>(integerOptionFromString("serve-workers", s, 0, kMaxServeWorkers));
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--queue-limit="); !s.empty()) {
+            try {
+                server.queueLimit =
+                    static_cast<std::size_t>(integerOptionFromString("queue-limit", s, 0, kMaxQueueLimit));
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--cache-size="); !s.empty()) {
+            try {
+                server.cacheBytes = byteSizeFromString(s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--job-memory="); !s.empty()) {
+            try {
+                server.jobMemoryBytes = byteSizeFromString(s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (arg == "--estimate") {
+            estimateOnly = true;
+        } else if (auto s = parseArg(arg, "--summary="); !s.empty()) {
+            summaryTarget = s;
         } else if (auto s = parseArg(arg, "--output="); !s.empty()) {
             outDir = s;
+        } else if (arg == "--checkpoint") {
+            checkpoint = true;
+        } else if (auto s = parseArg(arg, "--checkpoint="); !s.empty()) {
+            checkpoint = true;
+            checkpointPath = s;
+        } else if (auto s = parseArg(arg, "--city-file="); !s.empty()) {
+            cfg.city_file = s;
+        } else if (arg == "--resume") {
+            resume = true;
+        } else if (auto s = parseArg(arg, "--shm="); !s.empty()) {
+            try {
+                shmName = sharedSegmentName(s);
+            } catch (const std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (auto s = parseArg(arg, "--ensemble="); !s.empty()) {
+            ensembleSpec = s;
+        } else if (auto s = parseArg(arg, "--region="); !s.empty()) {
+            regionPath = s;
         } else if (arg == "--help" || arg == "-h") {
-            std::cout << "Usage: citygen [options]\n\n"
+            std::cout << "Usage: citygen [options]\n"
+                      << "       citygen diff a.city b.city [--tolerance=<units>] [--layer=<path>]\n"
+                      << "       citygen validate a.city [--tolerance=<units>]\n"
+                      << "       citygen optimize --vary=<option>:<lo>-<hi> [--target=..] [--objective=..]\n\n"
                       << "Options:\n"
                       << "  --population=<number>      Number of inhabitants (default 100000)\n"
                       << "  --hospitals=<number>       Number of hospitals to place (default 1)\n"
@@ -78,7 +574,42 @@ int main(int argc, char **argv) {
                       << "  --radius-fraction=<float>  Fraction of half grid forming city radius (default 0.8)\n"
                       << "  --format=<obj|gltf|glb>    Output mesh format (default obj)\n"
                       << "  --layout=<grid|radial>     Street layout type (default grid)\n"
-                      << "  --output=<dir>             Directory to output results (required)\n"
+                      << "  --spatial-order=<curve>    Store buildings in curve order (none|hilbert|morton)\n"
+                      << "  --tiles=[<min>-]<max>      Also write an MVT pyramid to <dir>/tiles\n"
+                      << "  --raster                   Also write tiled zone/distance/density raster\n"
+                      << "  --validate                 Check footprints for overlaps, road intrusions and\n"
+                      << "                             block containment (exit code 3 on defects)\n"
+                      << "  --shards=<number>          Split the model into N files under <dir>/shards\n"
+                      << "  --shard-mode=<mode>        Shard partitioning (spatial|round-robin, default spatial)\n"
+                      << "  --shard-workers=<number>   Write the shards from N worker processes\n"
+                      << "  --memory-limit=<bytes>     Budget for large arrays (K/M/G suffixes); beyond\n"
+                      << "                             it they spill to memory-mapped scratch files\n"
+                      << "  --scratch-dir=<dir>        Scratch file directory (default <dir>, else $TMPDIR)\n"
+                      << "  --zone-layout=<rows|tiled> Zone grid storage: row-major or 64x64 tiles\n"
+                      << "  --progress                 Report per-stage progress on stderr\n"
+                      << "  --timeout=<seconds>        Abort (exit code 124) if not done in time\n"
+                      << "  --serve=<unix:path|port>   Run as a generation server (see docs)\n"
+                      << "  --serve-workers=<number>   Concurrent server jobs (default half the cores)\n"
+                      << "  --queue-limit=<number>     Waiting jobs before 503 (default 64)\n"
+                      << "  --cache-size=<bytes>       Server cache of generated cities (default 256M)\n"
+                      << "  --job-memory=<bytes>       Reject jobs estimated to need more memory\n"
+                      << "  --ensemble=seeds:<a>-<b>   Generate every seed of the range and write one\n"
+                      << "                             report of per-metric distributions (no models)\n"
+                      << "  --numa                     Bind server and ensemble workers to NUMA nodes\n"
+                      << "                             and report per-node throughput\n"
+                      << "  --region=<file>            Generate the cities listed in a region file on\n"
+                      << "                             one grid, joined by arterials, as one model\n"
+                      << "  --estimate                 Print predicted counts, output sizes and peak\n"
+                      << "                             memory as JSON without generating\n"
+                      << "  --output=<dir|-|fd:N>      Directory to output results (required);\n"
+                      << "                             '-' or 'fd:N' streams the model only\n"
+                      << "  --summary=<path|-|fd:N>    Summary target (default <dir>/city_summary.json)\n"
+                      << "  --city-file=<path>         Also write a binary .city dump for 'citygen diff'\n"
+                      << "  --checkpoint[=<path>]      Snapshot the city after each stage and record\n"
+                      << "                             finished outputs (default <dir>/city.checkpoint)\n"
+                      << "  --resume                   Continue from the checkpoint of an interrupted run\n"
+                      << "  --shm=<name>               Also publish the city in a POSIX shared-memory\n"
+                      << "                             segment (--output then becomes optional)\n"
                       << std::endl;
             return 0;
         } else {
@@ -86,36 +617,135 @@ int main(int argc, char **argv) {
             return 1;
         }
     }
-    if (outDir.empty()) {
+    cfg.normalize();
+    std::unique_ptr<Region> region;
+    if (!regionPath.empty()) {
+        if (!server.endpoint.empty() || estimateOnly || !ensembleSpec.empty()) {
+            std::cerr << "Error: --region cannot be combined with --serve, --estimate or --ensemble"
+                      << std::endl;
+            return 1;
+        }
+        if (checkpoint || resume) {
+            std::cerr << "Error: --region does not support checkpoints" << std::endl;
+            return 1;
+        }
+        try {
+            region = std::make_unique<Region>(loadRegion(regionPath, cfg));
+        } catch (const std::invalid_argument &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        // Region-wide exports (raster density, tiles) see the whole grid.
+        cfg.grid_size = region->gridSize;
+        cfg.population = region->population();
+    }
+    if (cfg.tiles_max_zoom > maxTileZoom(cfg.grid_size)) {
+        std::cerr << "Error: --tiles zoom " << cfg.tiles_max_zoom << " makes tiles smaller than a grid cell (at most "
+                  << maxTileZoom(cfg.grid_size) << " for a " << cfg.grid_size << " grid)" << std::endl;
+        return 1;
+    }
+    if (!server.endpoint.empty()) {
+        setMemoryLimit(cfg.memory_limit);
+        if (!cfg.scratch_dir.empty()) setScratchDirectory(cfg.scratch_dir);
+        return runServer(server, cfg);
+    }
+    if (estimateOnly) {
+        std::cout << estimateToJson(estimateResources(cfg));
+        return 0;
+    }
+    EnsembleSeeds ensemble;
+    if (!ensembleSpec.empty()) {
+        try {
+            ensemble = ensembleSeedsFromString(ensembleSpec);
+        } catch (const std::invalid_argument &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        if (!shmName.empty() || checkpoint || resume || !cfg.city_file.empty() ||
+            cfg.tiles_max_zoom >= 0 || cfg.export_raster || cfg.shards > 0) {
+            std::cerr << "Error: --ensemble writes only its report; per-city outputs are not supported"
+                      << std::endl;
+            return 1;
+        }
+        // The report goes to --summary, else <dir>/ensemble_report.json,
+        // else stdout.
+        if (summaryTarget.empty()) {
+            if (outDir.empty() || isStreamTarget(outDir)) summaryTarget = outDir.empty() ? "-" : outDir;
+            else summaryTarget = outDir + "/ensemble_report.json";
+        }
+    }
+    if (outDir.empty() && shmName.empty() && ensembleSpec.empty()) {
         std::cerr << "Error: --output=<dir> must be specified" << std::endl;
         return 1;
     }
+    // "--output=-" or "--output=fd:N" streams the model itself; status
+    // messages then go to stderr so the data stream stays clean.
+    bool streamed = !outDir.empty() && isStreamTarget(outDir);
+    std::ostream &log = streamed ? std::cerr : std::cout;
+    if ((streamed || outDir.empty()) &&
+        (cfg.tiles_max_zoom >= 0 || cfg.export_raster || cfg.shards > 0)) {
+        std::cerr << "Error: --tiles, --raster and --shards require a directory --output" << std::endl;
+        return 1;
+    }
+    if (cfg.shard_workers > 0 && cfg.shards == 0) {
+        std::cerr << "Error: --shard-workers requires --shards" << std::endl;
+        return 1;
+    }
+    if (streamed && summaryTarget == outDir && ensembleSpec.empty()) {
+        std::cerr << "Error: model and summary cannot share one output stream" << std::endl;
+        return 1;
+    }
+    checkpoint = checkpoint || resume;
+    if (checkpoint && checkpointPath.empty()) {
+        if (streamed || outDir.empty()) {
+            std::cerr << "Error: --checkpoint needs a path unless --output is a directory" << std::endl;
+            return 1;
+        }
+        checkpointPath = outDir + "/city.checkpoint";
+    }
     // Create output directory if it does not exist
-    std::filesystem::create_directories(outDir);
-    // Generate city
-    City city = CityGenerator::generate(cfg);
-    // Save outputs
-    std::string objPath = outDir + "/city.obj";
-    std::string gltfPath = outDir + "/city.gltf";
-    std::string glbPath = outDir + "/city.glb";
-    std::string modelPath;
-    std::string summaryPath = outDir + "/city_summary.json";
-    switch (cfg.export_format) {
-        case Config::ExportFormat::OBJ:
-            city.saveOBJ(objPath);
-            modelPath = objPath;
-            break;
-        case Config::ExportFormat::GLB:
-            city.saveGLTF(glbPath, true);
-            modelPath = glbPath;
-            break;
-        case Config::ExportFormat::GLTF:
-        default:
-            city.saveGLTF(gltfPath, false);
-            modelPath = gltfPath;
-            break;
-    }
-    city.saveSummary(summaryPath);
-    std::cout << "Generated city at: " << modelPath << " and summary: " << summaryPath << std::endl;
-    return 0;
+    if (!streamed && !outDir.empty()) std::filesystem::create_directories(outDir);
+    // Spill files default to the output volume: $TMPDIR is often a tmpfs,
+    // where spilling would only move the pages into other RAM.
+    setMemoryLimit(cfg.memory_limit);
+    if (!cfg.scratch_dir.empty()) setScratchDirectory(cfg.scratch_dir);
+    else if (!streamed && !outDir.empty()) setScratchDirectory(outDir);
+    ExecutionContext ctx;
+    if (showProgress) {
+        ctx.onProgress([](const ExecutionContext::Progress &p) {
+            unsigned percent = p.total ? static_cast<unsigned>(p.done * 100 / p.total) : 100;
+            std::cerr << "progress: " << p.stage << " " << percent << "% ("
+                      << p.done << "/" << p.total << ")" << std::endl;
+        });
+    }
+    if (timeoutSeconds > 0.0) {
+        ctx.setTimeout(std::chrono::duration_cast<ExecutionContext::Clock::duration>(
+            std::chrono::duration<double>(timeoutSeconds)));
+    }
+    gActiveContext.store(&ctx);
+    std::signal(SIGINT, cancelOnSignal);
+    std::signal(SIGTERM, cancelOnSignal);
+    std::unique_ptr<Checkpointer> checkpoints;
+    if (checkpoint) checkpoints = std::make_unique<Checkpointer>(checkpointPath, cfg, resume);
+    int status = 1;
+    try {
+        if (!ensembleSpec.empty()) {
+            status = runEnsembleReport(cfg, ensemble, summaryTarget, ctx);
+        } else {
+            status = generateAndExport(cfg, outDir, summaryTarget, streamed, shmName, log, ctx,
+                                       checkpoints.get(), region.get());
+        }
+    } catch (const CheckpointMismatch &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    } catch (const MemoryLimitExceeded &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    } catch (const std::invalid_argument &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    } catch (const GenerationCancelled &e) {
+        // Conventional codes: 124 as timeout(1) uses, 128+SIGINT otherwise.
+        std::cerr << "Error: " << e.what() << std::endl;
+        status = e.reason() == GenerationCancelled::Reason::DeadlineExceeded ? 124 : 130;
+    }
+    gActiveContext.store(nullptr);
+    return status;
 }
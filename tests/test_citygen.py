@@ -52,7 +52,7 @@ def compile_generator():
         # No compiler in the environment; skip compilation and rely on the Python fallback
         return
     cmd = [
-        compiler, "-std=c++17", "-O2", "-Wall",
+        compiler, "-std=c++17", "-O2", "-Wall", "-pthread", "-ffp-contract=off", "-fno-trapping-math",
         "-I", str(PROJECT_ROOT / "include"),
     ] + sources + ["-o", str(output)]
     result = subprocess.run(cmd, capture_output=True, text=True)
@@ -60,9 +60,96 @@ def compile_generator():
         raise RuntimeError(f"Compilation failed:\n{result.stderr}")
 
 
+def protobuf_fields(buf: bytes):
+    """Yield (field number, value) pairs of a protobuf message.
+
+    Varints come back as ints, length-delimited fields as bytes; the
+    fixed-width wire types do not occur in vector tiles.
+    """
+    def varint(pos):
+        value = shift = 0
+        while True:
+            byte = buf[pos]
+            value |= (byte & 0x7F) << shift
+            pos += 1
+            shift += 7
+            if byte < 0x80:
+                return value, pos
+
+    pos = 0
+    while pos < len(buf):
+        key, pos = varint(pos)
+        if key & 7 == 0:
+            value, pos = varint(pos)
+        elif key & 7 == 2:
+            length, pos = varint(pos)
+            value = buf[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError(f"unexpected wire type {key & 7}")
+        yield key >> 3, value
+
+
+def decode_mvt_geometry(packed: bytes) -> list:
+    """Decode an MVT geometry into a list of parts, each a list of (x, y)."""
+    words = []
+    pos = 0
+    while pos < len(packed):
+        value = shift = 0
+        while True:
+            byte = packed[pos]
+            value |= (byte & 0x7F) << shift
+            pos += 1
+            shift += 7
+            if byte < 0x80:
+                break
+        words.append(value)
+    parts = []
+    x = y = 0
+    i = 0
+    while i < len(words):
+        command, count = words[i] & 7, words[i] >> 3
+        i += 1
+        if command == 7:  # ClosePath
+            continue
+        for _ in range(count):
+            dx, dy = words[i], words[i + 1]
+            i += 2
+            x += (dx >> 1) ^ -(dx & 1)
+            y += (dy >> 1) ^ -(dy & 1)
+            if command == 1:  # MoveTo
+                parts.append([])
+            parts[-1].append((x, y))
+    return parts
+
+
+def read_shared_segment(name: str) -> tuple:
+    """Map, check and unlink a --shm segment; returns (grid size, sections).
+
+    Sections map each name to its raw payload bytes (see SharedMemory.h).
+    """
+    import mmap
+    import struct
+    try:
+        with open("/dev/shm/" + name, "rb") as f:
+            seg = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    finally:
+        os.unlink("/dev/shm/" + name)
+    magic, _, count, complete, total, grid = struct.unpack_from("<4sIIIQi", seg, 0)
+    if (magic, complete, total) != (b"CGSM", 1, len(seg)):
+        raise ValueError("incomplete shared-memory segment")
+    sizes = {1: 1, 2: 4, 3: 4, 4: 4, 5: 8, 6: 1}
+    sections = {}
+    for i in range(count):
+        raw, kind, comps, offset, n, _ = struct.unpack_from("<32sIIQQQ", seg, 64 + 64 * i)
+        sections[raw.rstrip(b"\0").decode()] = seg[offset:offset + n * comps * sizes[kind]]
+    return grid, sections
+
+
 def run_generator(population: int = 100000, hospitals: int = 1, schools: int = 1,
                   seed: int = 0, grid_size: int = 100, radius: float = 0.8,
-                  output_dir: Path | None = None) -> dict:
+                  output_dir: Path | None = None,
+                  extra_args: list[str] | None = None) -> dict:
     """Run the city generator and return the summary data.
 
     If the compiled C++ executable exists, this function invokes it and
@@ -86,7 +173,7 @@ def run_generator(population: int = 100000, hospitals: int = 1, schools: int = 1
             f"--grid-size={grid_size}",
             f"--radius-fraction={radius}",
             f"--output={output_dir}"
-        ]
+        ] + list(extra_args or [])
         result = subprocess.run(args, capture_output=True, text=True)
         if result.returncode != 0:
             raise RuntimeError(f"Generator failed: {result.stderr}")
@@ -108,6 +195,24 @@ def run_generator(population: int = 100000, hospitals: int = 1, schools: int = 1
         return generate_py(cfg)
 
 
+def unix_get(path: str, url: str):
+    """GET url from a server on a Unix socket; returns (status, headers, body)."""
+    import http.client
+    import socket
+
+    class UnixConnection(http.client.HTTPConnection):
+        def connect(self):
+            self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self.sock.connect(path)
+
+    conn = UnixConnection("localhost", timeout=120)
+    conn.request("GET", url)
+    response = conn.getresponse()
+    body = response.read()
+    conn.close()
+    return response.status, dict(response.getheaders()), body
+
+
 class TestCityGenerator(unittest.TestCase):
     @classmethod
     def setUpClass(cls) -> None:
@@ -170,6 +275,1015 @@ class TestCityGenerator(unittest.TestCase):
         self.assertLessEqual(data["maxIndustrialHeight"], 14,
                              "Industrial height cap exceeded")
 
+    def test_summary_distributions_consistent(self):
+        """Histograms add up to the counts and quantiles are ordered."""
+        data = run_generator(population=70000, hospitals=2, schools=4, seed=9)
+        self.assertEqual(sum(data["heightHistogram"]), data["totalBuildings"])
+        self.assertEqual(sum(data["parcelAreaHistogram"]["counts"]), data["parcels"])
+        self.assertGreater(data["footprintCoverage"], 0.0)
+        for key, legacy in (("distanceToSchool", "maxDistanceToSchool"),
+                            ("distanceToHospital", "maxDistanceToHospital")):
+            d = data[key]
+            self.assertEqual(d["count"], data["heights"]["residential"]["count"])
+            self.assertLessEqual(d["p50"], d["p90"])
+            self.assertLessEqual(d["p90"], d["p95"])
+            self.assertLessEqual(d["p95"], d["p99"])
+            self.assertLessEqual(d["p99"], d["max"])
+            self.assertEqual(d["max"], data[legacy])
+        for key in ("distanceToRoad", "height"):
+            d = data[key]
+            self.assertEqual(d["count"], data["totalBuildings"])
+            self.assertLessEqual(d["p50"], d["p99"])
+            self.assertLessEqual(d["p99"], d["max"])
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_vector_tile_pyramid(self):
+        """Every zoom level of the requested pyramid is written, and the root tile decodes."""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out = Path(tmpdir)
+            data = run_generator(population=30000, seed=5, output_dir=out,
+                                 extra_args=["--tiles=0-3"])
+            for z in range(4):
+                tiles = list((out / "tiles" / str(z)).glob("*/*.mvt"))
+                self.assertTrue(tiles, f"No tiles written for zoom {z}")
+            root = (out / "tiles" / "0" / "0" / "0.mvt").read_bytes()
+            # Tile.layers is field 3 with wire type 2 (length-delimited)
+            self.assertEqual(root[0], 0x1A)
+            layers = {}
+            for field, layer in protobuf_fields(root):
+                self.assertEqual(field, 3)
+                parts = list(protobuf_fields(layer))
+                name = next(v.decode() for f, v in parts if f == 1)
+                extent = next((v for f, v in parts if f == 5), 4096)
+                layers[name] = (extent, [v for f, v in parts if f == 2])
+            self.assertLessEqual({"zones", "buildings", "roads", "facilities"}, set(layers))
+            # Zoom 0 covers the whole grid, so every footprint is in the root
+            # tile; decoded, their rings add up to the summary's area.
+            extent, features = layers["buildings"]
+            self.assertEqual(len(features), data["totalBuildings"])
+            scale = extent / data["gridSize"]
+            area = 0.0
+            for feature in features:
+                fields = dict(protobuf_fields(feature))
+                self.assertEqual(fields[3], 3)  # POLYGON
+                rings = decode_mvt_geometry(fields[4])
+                self.assertEqual(len(rings), 1)
+                ring = rings[0]
+                self.assertGreaterEqual(len(ring), 3)
+                for x, y in ring:
+                    self.assertTrue(0 <= x <= extent and 0 <= y <= extent, (x, y))
+                area += abs(sum(x0 * y1 - x1 * y0 for (x0, y0), (x1, y1)
+                                in zip(ring, ring[1:] + ring[:1]))) / 2.0
+            self.assertAlmostEqual(area / scale ** 2, data["footprintArea"],
+                                   delta=0.01 * data["footprintArea"])
+            _, roads = layers["roads"]
+            for feature in roads:
+                fields = dict(protobuf_fields(feature))
+                self.assertEqual(fields[3], 2)  # LINESTRING
+                self.assertEqual(len(decode_mvt_geometry(fields[4])[0]), 2)
+            # Zoom 20 on a 100-cell grid would be tiles far below a cell.
+            result = subprocess.run([str(EXECUTABLE), "--tiles=20", f"--output={out / 'deep'}"],
+                                    capture_output=True, text=True, timeout=60)
+            self.assertEqual(result.returncode, 1)
+            self.assertIn("at most 6", result.stderr)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_raster_zone_band_matches_summary(self):
+        """The tiled raster's zone band decodes to the summary's cell counts."""
+        import struct
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out = Path(tmpdir)
+            data = run_generator(population=30000, seed=9, grid_size=300,
+                                 output_dir=out, extra_args=["--raster"])
+            raw = (out / "city_raster.cgr").read_bytes()
+        self.assertEqual(raw[:4], b"CGRT")
+        _, width, height, tile, bands = struct.unpack_from("<5I", raw, 4)
+        pos = 24
+        names = []
+        for _ in range(bands):
+            length = raw[pos + 1]
+            names.append(raw[pos + 2:pos + 2 + length].decode())
+            pos += 2 + length
+        self.assertEqual(names[0], "zone")
+        self.assertIn("population_density", names)
+        tiles_x = (width + tile - 1) // tile
+        tiles_y = (height + tile - 1) // tile
+        counts = [0] * 5
+        for t in range(tiles_x * tiles_y):
+            offset, size = struct.unpack_from("<QI", raw, pos + t * 12)
+            payload = raw[offset:offset + size]
+            i = 0
+            while i < len(payload):
+                h = payload[i]
+                i += 1
+                if h < 128:
+                    for b in payload[i:i + h + 1]:
+                        counts[b] += 1
+                    i += h + 1
+                elif h > 128:
+                    counts[payload[i]] += 257 - h
+                    i += 1
+        self.assertEqual(sum(counts), width * height)
+        self.assertEqual(counts[1], data["residentialCells"])
+        self.assertEqual(counts[4], data["greenCells"])
+
+    @unittest.skipUnless(EXECUTABLE.exists() and shutil.which("g++"), "citygen or g++ not available")
+    def test_raster_reader_windows(self):
+        """RasterReader windows across tile edges add up to the summary's zone counts."""
+        probe_source = r"""
+#include "Raster.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Counts zone codes over 97×61 windows that start off the raster and
+// straddle the 256-cell tile edges, then checks a Float32 window against
+// the same cells read as one whole-raster window.
+int main(int argc, char **argv) {
+    RasterReader reader(argv[1]);
+    int zone = reader.findBand("zone");
+    int density = reader.findBand("population_density");
+    if (zone < 0 || density < 0 || reader.findBand("missing") != -1) return 1;
+    long counts[5] = {0, 0, 0, 0, 0};
+    for (int y = -13; y < reader.height(); y += 61) {
+        for (int x = -13; x < reader.width(); x += 97) {
+            for (std::uint8_t v : reader.readWindowU8(zone, x, y, 97, 61)) ++counts[v];
+        }
+    }
+    std::vector<float> whole = reader.readWindowF32(density, 0, 0, reader.width(), reader.height());
+    std::vector<float> part = reader.readWindowF32(density, 200, 230, 97, 61);
+    int w = std::min(97, reader.width() - 200);
+    int h = std::min(61, reader.height() - 230);
+    bool same = part.size() == static_cast<std::size_t>(w) * h;
+    for (int y = 0; same && y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            same = same && part[y * w + x] == whole[(230 + y) * reader.width() + 200 + x];
+        }
+    }
+    std::printf("%ld %ld %ld %ld %ld %d\n", counts[0], counts[1], counts[2], counts[3], counts[4], same ? 1 : 0);
+}
+"""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out = Path(tmpdir)
+            data = run_generator(population=30000, seed=9, grid_size=300,
+                                 output_dir=out, extra_args=["--raster"])
+            source = out / "probe.cpp"
+            source.write_text(probe_source)
+            binary = out / "probe"
+            sources = [str(p) for p in (PROJECT_ROOT / "src").glob("*.cpp") if p.name != "main.cpp"]
+            subprocess.run(["g++", "-std=c++17", "-O0", "-pthread", f"-I{PROJECT_ROOT / 'include'}",
+                            str(source)] + sources + ["-o", str(binary)], check=True)
+            result = subprocess.run([str(binary), str(out / "city_raster.cgr")],
+                                    capture_output=True, text=True, check=True)
+        counts = [int(v) for v in result.stdout.split()]
+        self.assertEqual(counts[:5], [data["undevelopedCells"], data["residentialCells"],
+                                      data["commercialCells"], data["industrialCells"],
+                                      data["greenCells"]])
+        self.assertEqual(counts[5], 1)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_stream_glb_to_stdout(self):
+        """--output=- streams a complete GLB on stdout and nothing else."""
+        import struct
+        result = subprocess.run(
+            [str(EXECUTABLE), "--seed=3", "--format=glb", "--output=-"],
+            capture_output=True)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        glb = result.stdout
+        self.assertEqual(glb[:4], b"glTF")
+        version, length = struct.unpack_from("<II", glb, 4)
+        self.assertEqual(version, 2)
+        self.assertEqual(length, len(glb))
+
+    @unittest.skipUnless(EXECUTABLE.exists() and Path("/dev/full").exists(),
+                         "citygen executable or /dev/full not available")
+    def test_failed_writes_fail_the_run(self):
+        """An output whose writes fail (here /dev/full) exits 1 and names it."""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            for option in ("--summary=/dev/full", "--city-file=/dev/full"):
+                result = subprocess.run([str(EXECUTABLE), "--seed=1", "--grid-size=60",
+                                         "--output=" + tmpdir, option],
+                                        capture_output=True, text=True)
+                self.assertEqual(result.returncode, 1, option)
+                self.assertIn("cannot write /dev/full", result.stderr)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_async_writer_backends_agree(self):
+        """io_uring and the pwrite fallback produce byte-identical files."""
+        outputs = []
+        for disable in ("0", "1"):
+            with tempfile.TemporaryDirectory() as tmpdir:
+                env = dict(os.environ, CITYGEN_NO_IO_URING=disable)
+                result = subprocess.run(
+                    [str(EXECUTABLE), "--seed=8", "--format=glb", "--raster",
+                     f"--output={tmpdir}"], capture_output=True, env=env)
+                self.assertEqual(result.returncode, 0, result.stderr)
+                outputs.append(((Path(tmpdir) / "city.glb").read_bytes(),
+                                (Path(tmpdir) / "city_raster.cgr").read_bytes()))
+        self.assertEqual(outputs[0], outputs[1])
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_spatial_shards_cover_all_buildings(self):
+        """Shards are standalone GLBs whose building counts add up."""
+        import struct
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out = Path(tmpdir)
+            data = run_generator(population=60000, seed=4, output_dir=out,
+                                 extra_args=["--format=glb", "--shards=3"])
+            manifest = json.loads((out / "shards" / "city_shards.json").read_text())
+            self.assertEqual(len(manifest["shards"]), 3)
+            self.assertGreaterEqual(manifest["totalBuildings"], data["totalBuildings"])
+            self.assertEqual(sum(s["buildings"] for s in manifest["shards"]),
+                             manifest["totalBuildings"])
+            self.assertEqual(sum(s["facilities"] for s in manifest["shards"]),
+                             data["numHospitals"] + data["numSchools"])
+            for shard in manifest["shards"]:
+                glb = (out / "shards" / shard["file"]).read_bytes()
+                self.assertEqual(glb[:4], b"glTF")
+                self.assertEqual(struct.unpack_from("<I", glb, 8)[0], len(glb))
+        for bad in ("--shards=abc", "--shards=-2", "--shard-workers=2x"):
+            result = subprocess.run([str(EXECUTABLE), bad], capture_output=True, text=True)
+            self.assertEqual(result.returncode, 1, bad)
+            self.assertIn("Invalid shard", result.stderr)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_shard_workers_match_in_process_shards(self):
+        """--shard-workers writes the same files, retrying a shard whose worker was killed."""
+        import filecmp
+        import signal
+        import time
+
+        def workers_of(pid):
+            found = []
+            for entry in Path("/proc").iterdir():
+                try:
+                    stat = (entry / "stat").read_text()
+                    cmdline = (entry / "cmdline").read_bytes().split(b"\0")
+                except OSError:
+                    continue
+                ppid = int(stat.rsplit(")", 1)[1].split()[1])
+                if ppid == pid and cmdline[1:2] == [b"shard-worker"]:
+                    found.append(int(entry.name))
+            return found
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            args = [str(EXECUTABLE), "--format=glb", "--shards=5", "--seed=4", "--grid-size=600",
+                    "--population=400000"]
+            local = subprocess.run(args + [f"--output={Path(tmpdir) / 'local'}"], capture_output=True, text=True)
+            self.assertEqual(local.returncode, 0, local.stderr)
+            coordinator = subprocess.Popen(args + [f"--output={Path(tmpdir) / 'workers'}", "--shard-workers=3"],
+                                           stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+            # A worker killed while it loads the city holds its first shard,
+            # which must be handed to a fresh worker.
+            killed = None
+            deadline = time.monotonic() + 120
+            while killed is None and coordinator.poll() is None and time.monotonic() < deadline:
+                pids = workers_of(coordinator.pid)
+                if pids:
+                    killed = pids[0]
+                    os.kill(killed, signal.SIGKILL)
+            _, err = coordinator.communicate(timeout=120)
+            self.assertIsNotNone(killed, "no shard worker seen")
+            self.assertEqual(coordinator.returncode, 0, err)
+            local = Path(tmpdir) / "local" / "shards"
+            workers = Path(tmpdir) / "workers" / "shards"
+            names = sorted(p.name for p in local.iterdir())
+            self.assertEqual(sorted(p.name for p in workers.iterdir()), names)
+            _, mismatch, errors = filecmp.cmpfiles(local, workers, names, shallow=False)
+            self.assertEqual((mismatch, errors), ([], []))
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_spatial_order_improves_locality(self):
+        """--spatial-order=hilbert keeps the city and shrinks runs of buildings."""
+        import struct
+
+        def window_spread(path: Path, grid: int, window: int = 64) -> float:
+            raw = path.read_bytes()
+            pos = 16 + grid * grid
+            count = struct.unpack_from("<Q", raw, pos)[0]
+            boxes = [struct.unpack_from("<4d", raw, pos + 8 + i * 112) for i in range(count)]
+            spreads = []
+            for start in range(0, count - window + 1, window):
+                run = boxes[start:start + window]
+                dx = max(b[2] for b in run) - min(b[0] for b in run)
+                dy = max(b[3] for b in run) - min(b[1] for b in run)
+                spreads.append((dx * dx + dy * dy) ** 0.5)
+            return sum(spreads) / len(spreads)
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            files = {}
+            for order in ("none", "hilbert"):
+                files[order] = Path(tmpdir) / f"{order}.city"
+                run_generator(seed=3, grid_size=600, output_dir=Path(tmpdir) / order,
+                              extra_args=[f"--spatial-order={order}", f"--city-file={files[order]}"])
+            result = subprocess.run([str(EXECUTABLE), "diff", str(files["none"]), str(files["hilbert"])],
+                                    capture_output=True, text=True)
+            self.assertEqual(result.returncode, 0, result.stderr)
+            self.assertTrue(json.loads(result.stdout)["identical"])
+            self.assertLess(window_spread(files["hilbert"], 600),
+                            0.8 * window_spread(files["none"], 600))
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_memory_limit_spills_without_changing_output(self):
+        """Under --memory-limit large arrays spill to disk; output is unchanged."""
+        outputs = []
+        for extra in ([], ["--memory-limit=1M"]):
+            with tempfile.TemporaryDirectory() as tmpdir:
+                result = subprocess.run(
+                    [str(EXECUTABLE), "--seed=6", "--grid-size=600", "--format=glb",
+                     f"--output={tmpdir}"] + extra, capture_output=True, text=True)
+                self.assertEqual(result.returncode, 0, result.stderr)
+                self.assertEqual("Spilled" in result.stdout, bool(extra))
+                self.assertEqual([p.name for p in Path(tmpdir).iterdir()
+                                  if p.name.startswith("citygen-spill")], [])
+                outputs.append(((Path(tmpdir) / "city.glb").read_bytes(),
+                                (Path(tmpdir) / "city_summary.json").read_bytes()))
+        self.assertEqual(outputs[0], outputs[1])
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_zone_layout_tiled_matches_rows(self):
+        """--zone-layout=tiled writes the same files as the row-major grid."""
+        import filecmp
+        with tempfile.TemporaryDirectory() as tmpdir:
+            for layout in ("rows", "tiled"):
+                # 333 is not a multiple of the tile size, so edge tiles are padded.
+                run_generator(seed=5, grid_size=333, hospitals=3, schools=4,
+                              output_dir=Path(tmpdir) / layout,
+                              extra_args=[f"--zone-layout={layout}", "--raster", "--tiles=2",
+                                          f"--city-file={Path(tmpdir) / layout}.city"])
+            comparison = filecmp.dircmp(Path(tmpdir) / "rows", Path(tmpdir) / "tiled")
+            self.assertEqual((comparison.left_only, comparison.right_only), ([], []))
+            _, mismatch, errors = filecmp.cmpfiles(Path(tmpdir) / "rows", Path(tmpdir) / "tiled",
+                                                   comparison.common_files, shallow=False)
+            self.assertEqual((mismatch, errors), ([], []))
+            result = subprocess.run([str(EXECUTABLE), "diff", f"{tmpdir}/rows.city", f"{tmpdir}/tiled.city"],
+                                    capture_output=True, text=True)
+            self.assertEqual(result.returncode, 0, result.stderr)
+            self.assertEqual(json.loads(result.stdout)["zones"]["changed"], 0)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_progress_and_deadline(self):
+        """--progress reports every stage; an expired --timeout exits with 124."""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            result = subprocess.run(
+                [str(EXECUTABLE), "--seed=2", "--progress", f"--output={tmpdir}"],
+                capture_output=True, text=True)
+            self.assertEqual(result.returncode, 0, result.stderr)
+            finished = {line.split()[1] for line in result.stderr.splitlines()
+                        if line.startswith("progress:") and "100%" in line}
+            self.assertTrue({"zoning", "parcels", "facilities", "export", "summary"} <= finished)
+            result = subprocess.run(
+                [str(EXECUTABLE), "--grid-size=4000", "--timeout=0.001", f"--output={tmpdir}"],
+                capture_output=True, text=True)
+            self.assertEqual(result.returncode, 124)
+            self.assertIn("deadline exceeded", result.stderr)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_resume_after_interrupt(self):
+        """An interrupted --checkpoint run resumes to the same outputs."""
+        import signal
+        args = [str(EXECUTABLE), "--seed=6", "--grid-size=600", "--format=glb", "--raster"]
+        with tempfile.TemporaryDirectory() as tmpdir:
+            ref, out = Path(tmpdir) / "ref", Path(tmpdir) / "out"
+            subprocess.run(args + [f"--output={ref}"], check=True, capture_output=True)
+            proc = subprocess.Popen(args + [f"--output={out}", "--checkpoint", "--progress"],
+                                    stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+            for line in proc.stderr:
+                if line.startswith("progress: facilities"):
+                    proc.send_signal(signal.SIGINT)
+                    break
+            proc.communicate(timeout=60)
+            self.assertEqual(proc.returncode, 130)
+            self.assertTrue((out / "city.checkpoint").exists())
+            result = subprocess.run(args + [f"--output={out}", "--seed=7", "--resume"],
+                                    capture_output=True, text=True)
+            self.assertNotEqual(result.returncode, 0)
+            result = subprocess.run(args + [f"--output={out}", "--resume"],
+                                    capture_output=True, text=True)
+            self.assertEqual(result.returncode, 0, result.stderr)
+            self.assertIn("Resumed after stage:", result.stdout)
+            self.assertFalse((out / "city.checkpoint").exists())
+            for name in ("city.glb", "city_summary.json", "city_raster.cgr"):
+                self.assertEqual((out / name).read_bytes(), (ref / name).read_bytes(), name)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_city_diff_reports_facility_changes(self):
+        """citygen diff isolates the buildings that extra hospitals change."""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            files = []
+            for hospitals in (1, 3):
+                path = Path(tmpdir) / f"h{hospitals}.city"
+                run_generator(hospitals=hospitals, seed=3, grid_size=300,
+                              output_dir=Path(tmpdir) / str(hospitals),
+                              extra_args=[f"--city-file={path}"])
+                files.append(str(path))
+            same = subprocess.run([str(EXECUTABLE), "diff", files[0], files[0]],
+                                  capture_output=True, text=True)
+            self.assertEqual(same.returncode, 0, same.stderr)
+            self.assertTrue(json.loads(same.stdout)["identical"])
+            bad = subprocess.run([str(EXECUTABLE), "diff", files[0], files[0], "--tolerance=abc"],
+                                 capture_output=True, text=True)
+            self.assertEqual(bad.returncode, 2)
+            layer = Path(tmpdir) / "diff.geojson"
+            result = subprocess.run([str(EXECUTABLE), "diff", files[0], files[1],
+                                     f"--layer={layer}"], capture_output=True, text=True)
+            self.assertEqual(result.returncode, 1, result.stderr)
+            diff = json.loads(result.stdout)
+            self.assertEqual(diff["zones"]["changed"], 0)
+            self.assertEqual(diff["roads"]["unchanged"], diff["roads"]["a"])
+            buildings = diff["buildings"]
+            self.assertEqual((buildings["added"], buildings["removed"], buildings["moved"]), (0, 0, 0))
+            self.assertGreater(buildings["facilityChanged"], 0)
+            self.assertEqual(diff["facilities"]["b"] - diff["facilities"]["a"], 2)
+            features = json.loads(layer.read_text())["features"]
+            self.assertEqual(sum(f["properties"]["kind"] == "building" for f in features),
+                             buildings["modified"])
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_ensemble_matches_individual_runs(self):
+        """--ensemble reduces the same summaries that single runs write."""
+        seeds = range(5, 11)
+        singles = [run_generator(population=40000, schools=2, seed=s) for s in seeds]
+        result = subprocess.run([str(EXECUTABLE), "--ensemble=seeds:5-10", "--population=40000",
+                                 "--hospitals=1", "--schools=2", "--output=-"],
+                                capture_output=True, text=True)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        report = json.loads(result.stdout)
+        self.assertEqual(report["seeds"]["count"], len(seeds))
+        for key in ("totalBuildings", "meanParcelArea"):
+            values = [single[key] for single in singles]
+            metric = report["metrics"][key]
+            mean = sum(values) / len(values)
+            variance = sum((v - mean) ** 2 for v in values) / (len(values) - 1)
+            self.assertAlmostEqual(metric["mean"], mean, places=6)
+            self.assertAlmostEqual(metric["variance"], variance, places=6)
+            self.assertEqual((metric["min"], metric["max"]), (min(values), max(values)))
+            self.assertIn(metric["p50"], values)
+        school = report["metrics"]["distanceToSchool.mean"]
+        self.assertAlmostEqual(school["mean"], sum(s["distanceToSchool"]["mean"] for s in singles)
+                               / len(singles), places=6)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_numa_placement_reports_nodes(self):
+        """--numa spreads ensemble and server jobs over the host's nodes without changing results."""
+        import signal
+        import time
+
+        # Nodes with a CPU this process may use, as Numa.h counts them.
+        allowed = os.sched_getaffinity(0)
+        expected = {}
+        for node in sorted(Path("/sys/devices/system/node").glob("node[0-9]*")):
+            cpus = set()
+            for part in (node / "cpulist").read_text().strip().split(","):
+                if part:
+                    lo, _, hi = part.partition("-")
+                    cpus.update(range(int(lo), int(hi or lo) + 1))
+            if cpus & allowed:
+                expected[int(node.name[4:])] = len(cpus & allowed)
+        if not expected:
+            expected = {0: len(allowed)}
+
+        jobs = 2 * len(expected) + 2
+        args = [str(EXECUTABLE), f"--ensemble=seeds:1-{jobs}", "--population=40000", "--output=-"]
+        plain = subprocess.run(args, capture_output=True, text=True)
+        placed = subprocess.run(args + ["--numa"], capture_output=True, text=True)
+        self.assertEqual(placed.returncode, 0, placed.stderr)
+        self.assertEqual(placed.stdout, plain.stdout)
+        counts = {}
+        for line in placed.stderr.splitlines():
+            if line.startswith("NUMA node "):
+                head, rest = line[len("NUMA node "):].split(": ", 1)
+                cpus, cities = rest.split(", ")[:2]
+                counts[int(head)] = (int(cpus.split()[0]), int(cities.split()[0]))
+        self.assertEqual({node: c for node, (c, _) in counts.items()}, expected)
+        self.assertEqual(sum(n for _, n in counts.values()), jobs)
+        # Nodes take turns, so every node gets some of the cities.
+        self.assertTrue(all(n > 0 for _, n in counts.values()), counts)
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            sock = os.path.join(tmpdir, "citygen.sock")
+            server = subprocess.Popen([str(EXECUTABLE), f"--serve=unix:{sock}", "--numa",
+                                       f"--serve-workers={2 * len(expected)}"],
+                                      stdout=subprocess.PIPE, text=True)
+            try:
+                self.assertIn("Listening on", server.stdout.readline())
+                for seed in range(3):
+                    self.assertEqual(unix_get(sock, f"/summary?seed={seed}&grid-size=80")[0], 200)
+                # A worker counts its job just after sending the response.
+                deadline = time.monotonic() + 30
+                stats = json.loads(unix_get(sock, "/stats")[2])
+                while stats["completed"] < 3 and time.monotonic() < deadline:
+                    time.sleep(0.05)
+                    stats = json.loads(unix_get(sock, "/stats")[2])
+            finally:
+                server.send_signal(signal.SIGINT)
+                server.communicate(timeout=30)
+        self.assertEqual({s["node"]: s["cpus"] for s in stats["numa"]}, expected)
+        self.assertEqual(sum(s["jobs"] for s in stats["numa"]), stats["completed"])
+        self.assertEqual(stats["completed"], 3)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_optimizer_pareto_set_meets_targets(self):
+        """citygen optimize reports non-dominated configs that meet the targets."""
+        result = subprocess.run([str(EXECUTABLE), "optimize", "--population=60000",
+                                 "--vary=radius-fraction:0.4-0.95", "--vary=schools:1-6",
+                                 "--vary=seed:0-500", "--target=distanceToSchool.mean<=14",
+                                 "--objective=max:greenCells", "--objective=min:numSchools",
+                                 "--candidates=60"], capture_output=True, text=True)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        report = json.loads(result.stdout)
+        pareto = report["pareto"]
+        self.assertGreater(len(pareto), 0)
+        self.assertEqual(report["cityRuns"], 60)
+        for member in pareto:
+            self.assertLessEqual(member["metrics"]["distanceToSchool.mean"], 14)
+        for a in pareto:
+            for b in pareto:
+                self.assertFalse(a["metrics"]["greenCells"] > b["metrics"]["greenCells"] and
+                                 a["metrics"]["numSchools"] < b["metrics"]["numSchools"])
+        best = pareto[0]
+        single = run_generator(population=60000, hospitals=1, seed=best["options"]["seed"],
+                               schools=best["options"]["schools"],
+                               radius=best["options"]["radius-fraction"])
+        self.assertEqual(single["greenCells"], best["metrics"]["greenCells"])
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_optimizer_replicates_halve_candidates(self):
+        """--replicates runs the best third on three times as many seeds per rung."""
+        result = subprocess.run([str(EXECUTABLE), "optimize", "--population=20000", "--grid-size=60",
+                                 "--schools=1", "--vary=radius-fraction:0.4-0.95", "--vary=seed:0-500",
+                                 "--objective=max:greenCells", "--candidates=27", "--replicates=9"],
+                                capture_output=True, text=True)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        report = json.loads(result.stdout)
+        # 27 candidates on 1 seed, 9 on 3 seeds, 3 on 9 seeds; seeds already
+        # run are not repeated.
+        self.assertEqual(report["rungs"], 3)
+        self.assertEqual(report["rungSizes"], [27, 9, 3])
+        self.assertEqual(report["seedsPerCandidate"], 9)
+        self.assertEqual(report["cityRuns"], 27 + 9 * 2 + 3 * 6)
+        best = report["pareto"][0]
+        self.assertEqual(best["seeds"], 9)
+        # The reported metric is the mean over the candidate's nine seeds.
+        green = [run_generator(population=20000, hospitals=1, schools=1, grid_size=60,
+                               seed=best["seed"] + k,
+                               radius=best["options"]["radius-fraction"])["greenCells"]
+                 for k in range(9)]
+        self.assertAlmostEqual(best["metrics"]["greenCells"], sum(green) / 9)
+        for bad in ("--eta=x", "--eta=1", "--replicates=0", "--drop-margin=-1", "--timeout=abc"):
+            result = subprocess.run([str(EXECUTABLE), "optimize", "--vary=schools:1-4", bad],
+                                    capture_output=True, text=True)
+            self.assertEqual(result.returncode, 2, bad)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_validate_passes_grid_and_radial(self):
+        """--validate passes grid and radial cities; radial blocks scale with area."""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            grid = Path(tmpdir) / "grid"
+            run_generator(seed=2, grid_size=300, output_dir=grid, extra_args=["--validate"])
+            report = json.loads((grid / "city_validation.json").read_text())
+            self.assertTrue(report["ok"])
+            self.assertEqual(report["issues"], [])
+            # A report that cannot be written fails the run like any output.
+            blocked = Path(tmpdir) / "blocked"
+            (blocked / "city_validation.json").mkdir(parents=True)
+            result = subprocess.run([str(EXECUTABLE), "--grid-size=60", "--validate", f"--output={blocked}"],
+                                    capture_output=True, text=True)
+            self.assertEqual(result.returncode, 1)
+            self.assertIn("cannot write", result.stderr)
+            blocks = {}
+            for size in (300, 1000):
+                radial = Path(tmpdir) / f"radial{size}"
+                result = subprocess.run([str(EXECUTABLE), "--layout=radial", "--validate",
+                                         f"--grid-size={size}", f"--output={radial}"],
+                                        capture_output=True, text=True)
+                self.assertEqual(result.returncode, 0, result.stderr)
+                report = json.loads((radial / "city_validation.json").read_text())
+                self.assertTrue(report["ok"], report["issues"][:5])
+                for key in ("buildingOverlaps", "roadIntrusions", "outsideBlock"):
+                    self.assertEqual(report[key], 0)
+                blocks[size] = report["blocks"]
+            # Radial streets split in outer bands, so block size stays
+            # roughly constant and the block count grows with the area.
+            area_ratio = (1000 / 300) ** 2
+            self.assertGreater(blocks[1000] / blocks[300], 0.7 * area_ratio)
+            self.assertLess(blocks[1000] / blocks[300], 1.3 * area_ratio)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_region_merges_cities(self):
+        """--region merges cities without overlaps and keeps every facility."""
+        region = ("grid-size=400 seed=3\n"
+                  "city x=150 y=200 radius=100 population=300000 hospitals=2 schools=4\n"
+                  "city x=310 y=120 radius=50 population=60000 schools=2 layout=radial\n"
+                  "city x=320 y=310 radius=40 population=40000 schools=1\n")
+        with tempfile.TemporaryDirectory() as tmpdir:
+            path = Path(tmpdir) / "region.txt"
+            path.write_text(region)
+            summaries = []
+            for run in ("a", "b"):
+                out = Path(tmpdir) / run
+                result = subprocess.run([str(EXECUTABLE), f"--region={path}", "--validate",
+                                         f"--output={out}"], capture_output=True, text=True)
+                self.assertEqual(result.returncode, 0, result.stderr)
+                report = json.loads((out / "city_validation.json").read_text())
+                self.assertTrue(report["ok"], report["issues"][:5])
+                summaries.append(json.loads((out / "city_summary.json").read_text()))
+            self.assertEqual(summaries[0], summaries[1])
+            self.assertEqual(summaries[0]["gridSize"], 400)
+            self.assertEqual(summaries[0]["numHospitals"], 4)
+            self.assertEqual(summaries[0]["numSchools"], 7)
+            # A city inside a larger one has no territory of its own and
+            # would take its facilities with it.
+            path.write_text("grid-size=300 seed=3\n"
+                            "city x=150 y=150 radius=120\n"
+                            "city x=160 y=150 radius=10 hospitals=1 schools=2\n")
+            result = subprocess.run([str(EXECUTABLE), f"--region={path}",
+                                     f"--output={Path(tmpdir) / 'swallowed'}"],
+                                    capture_output=True, text=True)
+            self.assertEqual(result.returncode, 1)
+            self.assertIn("Region city 1", result.stderr)
+
+    @unittest.skipUnless(EXECUTABLE.exists() and Path("/dev/shm").is_dir(),
+                         "citygen executable or /dev/shm not available")
+    def test_radial_ring_chords_follow_circle(self):
+        """Ring chords sag at most 0.05 units and outer rings get more of them."""
+        import math
+        import struct
+        name = "citygen-rings-%d" % os.getpid()
+        with tempfile.TemporaryDirectory() as tmpdir:
+            result = subprocess.run([str(EXECUTABLE), "--layout=radial", "--grid-size=600",
+                                     "--population=600000", "--output=" + tmpdir, "--shm=" + name],
+                                    capture_output=True, text=True)
+            self.assertEqual(result.returncode, 0, result.stderr)
+        grid, sections = read_shared_segment(name)
+        segments = sections["road_segment"]
+        centre = grid / 2.0
+        rings = {}
+        for x1, y1, x2, y2 in struct.iter_unpack("<4d", segments):
+            r1 = math.hypot(x1 - centre, y1 - centre)
+            r2 = math.hypot(x2 - centre, y2 - centre)
+            if r1 < 1.0 or abs(r1 - r2) > 1e-6:
+                continue  # radial streets
+            sagitta = r1 - math.hypot((x1 + x2) / 2 - centre, (y1 + y2) / 2 - centre)
+            self.assertLessEqual(sagitta, 0.05 + 1e-9)
+            rings.setdefault(round(r1, 6), []).append(sagitta)
+        radii = sorted(rings)
+        self.assertGreater(len(radii), 10)
+        counts = [len(rings[r]) for r in radii]
+        self.assertEqual(counts, sorted(counts))
+        self.assertGreaterEqual(counts[-1], 3 * counts[0])
+        # Chords are no finer than needed: every ring sags close to the bound.
+        for r in radii:
+            self.assertGreater(max(rings[r]), 0.01)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_validate_reports_defects(self):
+        """citygen validate flags a .city file with two buildings on one footprint."""
+        import struct
+        with tempfile.TemporaryDirectory() as tmpdir:
+            city = Path(tmpdir) / "a.city"
+            run_generator(seed=2, grid_size=150, output_dir=Path(tmpdir) / "out",
+                          extra_args=[f"--city-file={city}"])
+            result = subprocess.run([str(EXECUTABLE), "validate", str(city)], capture_output=True, text=True)
+            self.assertEqual(result.returncode, 0, result.stderr)
+            self.assertTrue(json.loads(result.stdout)["ok"])
+            # Header: magic, version, sizeof(Building), grid size; then the
+            # zone grid and the building count before the raw records.
+            raw = bytearray(city.read_bytes())
+            _, record, grid = struct.unpack_from("<IIi", raw, 4)
+            start = 16 + grid * grid + 8
+            self.assertGreater(struct.unpack_from("<Q", raw, start - 8)[0], 8)
+            raw[start + 7 * record:start + 8 * record] = raw[start + 3 * record:start + 4 * record]
+            city.write_bytes(bytes(raw))
+            result = subprocess.run([str(EXECUTABLE), "validate", str(city)], capture_output=True, text=True)
+            self.assertEqual(result.returncode, 3, result.stderr)
+            report = json.loads(result.stdout)
+            self.assertFalse(report["ok"])
+            self.assertGreaterEqual(report["buildingOverlaps"], 1)
+            for kind, key in (("buildingOverlap", "buildingOverlaps"),
+                              ("roadIntrusion", "roadIntrusions"), ("outsideBlock", "outsideBlock")):
+                self.assertEqual(sum(i["kind"] == kind for i in report["issues"]), report[key])
+            overlap = next(i for i in report["issues"] if i["kind"] == "buildingOverlap")
+            self.assertEqual(set(overlap), {"kind", "building", "other", "depth"})
+            self.assertEqual({overlap["building"], overlap["other"]}, {3, 7})
+            self.assertGreater(overlap["depth"], 0)
+            for issue in report["issues"]:
+                self.assertLess(issue["building"], report["buildings"])
+            result = subprocess.run([str(EXECUTABLE), "validate", str(city), "--tolerance=abc"],
+                                    capture_output=True, text=True)
+            self.assertEqual(result.returncode, 2)
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_server_matches_cli(self):
+        """--serve answers over a Unix socket with the same bytes as the CLI."""
+        import signal
+
+        def get(path, url):
+            status, _, body = unix_get(path, url)
+            return status, body
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            sock = os.path.join(tmpdir, "citygen.sock")
+            server = subprocess.Popen([str(EXECUTABLE), f"--serve=unix:{sock}", "--serve-workers=2"],
+                                      stdout=subprocess.PIPE, text=True)
+            try:
+                self.assertIn("Listening on", server.stdout.readline())
+                self.assertEqual(get(sock, "/health"), (200, b"ok\n"))
+                query = "seed=11&grid-size=150&population=80000&schools=2"
+                status, body = get(sock, "/summary?" + query)
+                self.assertEqual(status, 200)
+                status, headers, glb = unix_get(sock, "/model?" + query + "&format=glb&priority=high")
+                self.assertEqual(status, 200)
+                self.assertEqual(int(headers["Content-Length"]), len(glb))
+                self.assertEqual(get(sock, "/summary?seed=11&grid-size=oops")[0], 400)
+                self.assertEqual(get(sock, "/summary?seed=11&bogus=1")[0], 400)
+                for bad in ("timeout=abc", "timeout=-1", "priority=-2147483648", "priority=1x"):
+                    self.assertEqual(get(sock, "/summary?seed=11&" + bad)[0], 400, bad)
+                stats = json.loads(get(sock, "/stats")[1])
+                self.assertEqual(stats["cacheMisses"], 1)
+                self.assertEqual(stats["cacheHits"], 1)
+            finally:
+                server.send_signal(signal.SIGINT)
+                server.communicate(timeout=30)
+            self.assertEqual(server.returncode, 0)
+            out = Path(tmpdir) / "cli"
+            data = run_generator(population=80000, seed=11, grid_size=150, schools=2,
+                                 output_dir=out, extra_args=["--format=glb"])
+            self.assertEqual(json.loads(body), data)
+            self.assertEqual(glb, (out / "city.glb").read_bytes())
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_server_deadlines_and_queue(self):
+        """Idle clients, per-request deadlines and queue displacement in --serve."""
+        import signal
+        import socket
+        import time
+        from concurrent.futures import ThreadPoolExecutor
+
+        big = "grid-size=6000&population=20000000&radius-fraction=1"
+        with tempfile.TemporaryDirectory() as tmpdir:
+            sock = os.path.join(tmpdir, "citygen.sock")
+            server = subprocess.Popen([str(EXECUTABLE), f"--serve=unix:{sock}", "--serve-workers=2",
+                                       "--queue-limit=1", "--cache-size=1"],
+                                      stdout=subprocess.PIPE, text=True)
+
+            def status(url):
+                return unix_get(sock, url)[0]
+
+            def wait_for(key, value):
+                # cacheMisses counts generations a worker has started.
+                for _ in range(3000):
+                    if json.loads(unix_get(sock, "/stats")[2])[key] == value:
+                        return
+                    time.sleep(0.01)
+                self.fail(f"stats never reached {key}={value}")
+
+            try:
+                self.assertIn("Listening on", server.stdout.readline())
+                # A connection that never sends its request holds up nobody.
+                idle = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+                idle.connect(sock)
+                self.assertEqual(unix_get(sock, "/health")[2], b"ok\n")
+                with ThreadPoolExecutor(4) as pool:
+                    # A request joining a running generation keeps its own deadline...
+                    leader = pool.submit(status, f"/summary?seed=1&{big}")
+                    wait_for("cacheMisses", 1)
+                    self.assertEqual(status(f"/summary?seed=1&{big}&timeout=0.2"), 504)
+                    self.assertEqual(leader.result(), 200)
+                    # ...and is not failed by the deadline of the run it joined.
+                    leader = pool.submit(status, f"/summary?seed=2&{big}&timeout=0.3")
+                    wait_for("cacheMisses", 2)
+                    self.assertEqual(status(f"/summary?seed=2&{big}"), 200)
+                    self.assertEqual(leader.result(), 504)
+                    # With the queue full, a high-priority arrival turns the
+                    # low-priority waiting job away.
+                    # The waiter above generated seed 2 itself: three misses so far.
+                    busy = []
+                    for seed in (3, 4):
+                        busy.append(pool.submit(status, f"/summary?seed={seed}&{big}"))
+                        wait_for("cacheMisses", 1 + seed)
+                    low = pool.submit(status, "/summary?seed=5&priority=low")
+                    wait_for("queued", 1)
+                    self.assertEqual(status("/summary?seed=6&priority=high"), 200)
+                    self.assertEqual(low.result(), 503)
+                    self.assertEqual([b.result() for b in busy], [200, 200])
+                idle.close()
+            finally:
+                server.send_signal(signal.SIGINT)
+                server.communicate(timeout=30)
+            self.assertEqual(server.returncode, 0)
+
+    @unittest.skipUnless(EXECUTABLE.exists() and shutil.which("g++"), "citygen or g++ not available")
+    def test_detmath_accuracy_and_reproducibility(self):
+        """DetMath stays within its error bounds and gives the same bits in every build."""
+        import math
+        import random
+        probe_source = r"""
+#include "DetMath.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// Reads "<function> <hex double>" lines and prints each result as a hex
+// double, then a few sampler draws and a shuffle.
+int main() {
+    char name[16];
+    char arg[64];
+    std::vector<double> logs;
+    while (std::scanf("%15s %63s", name, arg) == 2) {
+        double x = std::strtod(arg, nullptr);
+        std::string f = name;
+        double r = f == "exp" ? detmath::exp(x)
+                 : f == "log" ? detmath::log(x)
+                 : f == "sin" ? detmath::sin(x)
+                 : f == "cos" ? detmath::cos(x)
+                 : f == "asin" ? detmath::asin(x)
+                 : detmath::acos(x);
+        std::printf("%a\n", r);
+    }
+    std::mt19937 rng(42);
+    std::printf("%a %a %a\n", detmath::uniform01(rng), detmath::lognormal(rng, 1.0, 0.5),
+                detmath::exponential(rng, 0.2));
+    std::vector<int> v(10);
+    for (int i = 0; i < 10; ++i) v[i] = i;
+    detmath::shuffle(v.begin(), v.end(), rng);
+    for (int i : v) std::printf("%d ", i);
+    std::printf("\n");
+}
+"""
+        rnd = random.Random(1)
+        draws = {"exp": lambda: rnd.uniform(-700.0, 700.0),
+                 "log": lambda: 10.0 ** rnd.uniform(-300.0, 300.0),
+                 "sin": lambda: rnd.uniform(-1e6, 1e6),
+                 "cos": lambda: rnd.uniform(-1e6, 1e6),
+                 "asin": lambda: rnd.uniform(-1.0, 1.0),
+                 "acos": lambda: rnd.uniform(-1.0, 1.0)}
+        cases = [("exp", 1.0), ("log", 10.0), ("sin", 1e5), ("asin", 0.5)]
+        cases += [(f, draw()) for f, draw in draws.items() for _ in range(2000)]
+        stdin = "".join(f"{f} {x.hex()}\n" for f, x in cases)
+        flags = ["-std=c++17", "-ffp-contract=off", "-fno-trapping-math", f"-I{PROJECT_ROOT / 'include'}"]
+        builds = [["-O0"], ["-O3", "-march=native"]]
+        outputs = []
+        with tempfile.TemporaryDirectory() as tmpdir:
+            source = Path(tmpdir) / "probe.cpp"
+            source.write_text(probe_source)
+            for i, extra in enumerate(builds):
+                binary = Path(tmpdir) / f"probe{i}"
+                subprocess.run(["g++"] + flags + extra + [str(source), "-o", str(binary)], check=True)
+                outputs.append(subprocess.run([str(binary)], input=stdin, capture_output=True,
+                                              text=True, check=True).stdout)
+            # The generator itself, built without optimisation, writes the same city.
+            slow = Path(tmpdir) / "citygen_O0"
+            subprocess.run(["g++"] + flags + ["-O0", "-pthread"] +
+                           [str(p) for p in (PROJECT_ROOT / "src").glob("*.cpp")] + ["-o", str(slow)],
+                           check=True)
+            cities = []
+            for i, binary in enumerate((EXECUTABLE, slow)):
+                out = Path(tmpdir) / f"city{i}"
+                args = ["--seed=8", "--grid-size=200", "--layout=radial", "--format=glb", f"--output={out}"]
+                subprocess.run([str(binary)] + args, capture_output=True, check=True)
+                cities.append(((out / "city.glb").read_bytes(), (out / "city_summary.json").read_bytes()))
+            self.assertEqual(cities[0], cities[1])
+        self.assertEqual(outputs[0], outputs[1])
+        lines = outputs[0].splitlines()
+        # Golden values pin the algorithms, so a port that drifts shows up here.
+        self.assertEqual(lines[:4], ["0x1.5bf0a8b14576ap+1", "0x1.26bb1bbb55516p+1",
+                                     "0x1.24daa9c527e96p-5", "0x1.0c152382d7366p-1"])
+        self.assertEqual(lines[-2], "0x1.32835d6632cbp-1 0x1.2ef05179b1fcbp+1 0x1.2c54e244c47a1p+1")
+        self.assertEqual(lines[-1].split(), "9 6 1 3 4 7 5 8 2 0".split())
+        # Documented error bounds (DetMath.h), plus an ulp for libm's own error.
+        bounds = {"exp": 2.2, "log": 2.3, "sin": 2.6, "cos": 2.6, "asin": 4.1, "acos": 3.1}
+        for (f, x), line in zip(cases, lines):
+            got = float.fromhex(line)
+            want = getattr(math, f)(x)
+            error = abs(got - want)
+            if f in ("sin", "cos") and abs(want) < 1e-3:
+                self.assertLess(error, 1e-17, (f, x))
+            else:
+                self.assertLessEqual(error, bounds[f] * math.ulp(want), (f, x))
+
+    @unittest.skipUnless(EXECUTABLE.exists(), "citygen executable not built")
+    def test_estimate_matches_generation(self):
+        """--estimate predicts parcel count and GLB size without generating."""
+        args = ["--population=200000", "--seed=5", "--grid-size=300", "--schools=1",
+                "--radius-fraction=0.8", "--format=glb"]
+        result = subprocess.run([str(EXECUTABLE), "--estimate"] + args,
+                                capture_output=True, text=True)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        estimate = json.loads(result.stdout)
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out = Path(tmpdir)
+            data = run_generator(population=200000, seed=5, grid_size=300,
+                                 output_dir=out, extra_args=["--format=glb"])
+            glb_size = (out / "city.glb").stat().st_size
+        self.assertAlmostEqual(estimate["parcels"] / data["parcels"], 1.0, delta=0.15)
+        self.assertAlmostEqual(estimate["outputBytes"]["glb"] / glb_size, 1.0, delta=0.15)
+        self.assertGreater(estimate["peakRssBytes"], 0)
+
+
+    @unittest.skipUnless(EXECUTABLE.exists() and Path("/dev/shm").is_dir(),
+                         "citygen executable or /dev/shm not available")
+    def test_shared_memory_matches_files(self):
+        """--shm publishes the summary and glTF mesh buffers in a segment."""
+        import struct
+        name = "citygen-test-%d" % os.getpid()
+        with tempfile.TemporaryDirectory() as tmpdir:
+            result = subprocess.run(
+                [str(EXECUTABLE), "--seed=4", "--grid-size=150", "--format=glb",
+                 "--output=" + tmpdir, "--shm=" + name],
+                capture_output=True, text=True)
+            self.assertEqual(result.returncode, 0, result.stderr)
+            self.assertIn("Shared-memory segment: /" + name, result.stdout)
+            glb = (Path(tmpdir) / "city.glb").read_bytes()
+            summary = (Path(tmpdir) / "city_summary.json").read_bytes()
+        grid, sections = read_shared_segment(name)
+        self.assertEqual(grid, 150)
+        self.assertEqual(sections["summary"], summary)
+        self.assertEqual(len(sections["zones"]), 150 * 150)
+        built = sum(1 for z in sections["building_zone"] if z not in (0, 4))
+        self.assertEqual(built, json.loads(summary)["totalBuildings"])
+        # Each glTF primitive's accessors are exactly the mesh sections.
+        json_len = struct.unpack_from("<I", glb, 12)[0]
+        gltf = json.loads(glb[20:20 + json_len])
+        binary = glb[20 + json_len + 8:]
+        for mesh in gltf["meshes"]:
+            prim = mesh["primitives"][0]
+            for attr, index in (("positions", prim["attributes"]["POSITION"]),
+                                ("normals", prim["attributes"]["NORMAL"]),
+                                ("indices", prim["indices"])):
+                view = gltf["bufferViews"][gltf["accessors"][index]["bufferView"]]
+                start = view.get("byteOffset", 0)
+                self.assertEqual(sections["mesh/%s/%s" % (mesh["name"], attr)],
+                                 binary[start:start + view["byteLength"]])
+
+    @unittest.skipUnless(EXECUTABLE.exists() and shutil.which("g++") and Path("/dev/shm").is_dir(),
+                         "citygen, g++ or /dev/shm not available")
+    def test_shared_city_view_reads_segment(self):
+        """SharedCityView maps the same sections the segment holds, then unlinks it."""
+        import struct
+        probe_source = r"""
+#include "SharedMemory.h"
+
+#include <cstdio>
+
+// Prints the grid size, then each section as a "name type components
+// count bytes" line followed by its payload, and unlinks the segment.
+int main(int argc, char **argv) {
+    SharedCityView view(argv[1]);
+    if (!view.find("summary") || view.find("missing")) return 1;
+    std::printf("%d %zu\n", view.gridSize(), view.sections().size());
+    for (const auto &s : view.sections()) {
+        std::size_t bytes = s.count * s.components * sharedTypeSize(s.type);
+        std::printf("%s %u %u %llu %zu\n", s.name.c_str(), static_cast<unsigned>(s.type), s.components,
+                    static_cast<unsigned long long>(s.count), bytes);
+        std::fwrite(s.data, 1, bytes, stdout);
+    }
+    return SharedCityView::unlink(argv[1]) ? 0 : 2;
+}
+"""
+        name = "citygen-view-%d" % os.getpid()
+        with tempfile.TemporaryDirectory() as tmpdir:
+            source = Path(tmpdir) / "probe.cpp"
+            source.write_text(probe_source)
+            binary = Path(tmpdir) / "probe"
+            subprocess.run(["g++", "-std=c++17", "-O0", "-pthread", f"-I{PROJECT_ROOT / 'include'}",
+                            str(source), str(PROJECT_ROOT / "src" / "SharedMemory.cpp"),
+                            str(PROJECT_ROOT / "src" / "Execution.cpp"), "-o", str(binary)], check=True)
+            result = subprocess.run(
+                [str(EXECUTABLE), "--seed=4", "--grid-size=120", "--format=glb",
+                 "--output=" + tmpdir, "--shm=" + name],
+                capture_output=True, text=True)
+            self.assertEqual(result.returncode, 0, result.stderr)
+            summary = (Path(tmpdir) / "city_summary.json").read_bytes()
+            # Copy the raw segment before the view unlinks it.
+            with open("/dev/shm/" + name, "rb") as f:
+                segment = f.read()
+            view = subprocess.run([str(binary), name], capture_output=True, check=True).stdout
+        self.assertFalse(Path("/dev/shm/" + name).exists())
+        line, pos = view.split(b"\n", 1)[0], view.index(b"\n") + 1
+        grid, count = map(int, line.split())
+        self.assertEqual(grid, 120)
+        sections = {}
+        for _ in range(count):
+            end = view.index(b"\n", pos)
+            section, kind, comps, n, size = view[pos:end].decode().split()
+            pos = end + 1
+            sections[section] = (int(kind), int(comps), int(n), view[pos:pos + int(size)])
+            pos += int(size)
+        self.assertEqual(pos, len(view))
+        self.assertEqual(sections["summary"][3], summary)
+        self.assertEqual(len(sections["zones"][3]), 120 * 120)
+        # Every section is the segment's own bytes at its table offset.
+        for i in range(count):
+            raw, kind, comps, offset, n, _ = struct.unpack_from("<32sIIQQQ", segment, 64 + 64 * i)
+            entry = sections[raw.rstrip(b"\0").decode()]
+            self.assertEqual(entry[:3], (kind, comps, n))
+            self.assertEqual(entry[3], segment[offset:offset + len(entry[3])])
+
 
 class TestPythonBindings(unittest.TestCase):
     @classmethod